@@ -0,0 +1,145 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  main.cpp
+/// @brief I/Oグループによる集約出力の往復確認
+///
+/// ランク番号が連続しないI/Oグループ (偶数ランクと奇数ランク) で物理量を集約出力し，
+/// 出力時と異なるプロセス数で読み込んで，各ブロックの値がグローバルなリーフ番号と一致することを確認する．
+///
+/// - write : aggregate write <入力ディレクトリ (cellid.bcm)> <出力ディレクトリ>
+/// - read  : aggregate read  <出力ディレクトリ>
+///
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "mpi.h"
+#include "../SampleLoader/BoundaryConditionSetter.h"
+#include "Partition.h"
+#include "Block.h"
+#include "BlockManager.h"
+#include "Scalar3D.h"
+#include "BCMFileLoader.h"
+#include "BCMFileSaver.h"
+#include "Vec3.h"
+
+using namespace Vec3class;
+
+static const int vc = 1;
+
+/// セルの値 (グローバルなリーフ番号とブロック内のセル番号から決まる)
+static double CellValue(const int gid, const int x, const int y, const int z, const Vec3i& sz)
+{
+	return static_cast<double>(gid) * (sz.x * sz.y * sz.z) + x + sz.x * (y + sz.y * z);
+}
+
+/// 自プロセスの全ブロックにセルの値を設定または照合 (照合した場合は不一致のセル数を返す)
+static int Traverse(const int dcid, const int numLeaf, const bool check)
+{
+	BlockManager& blockManager = BlockManager::getInstance();
+	const MPI::Intracomm& comm = blockManager.getCommunicator();
+	Vec3i sz = blockManager.getSize();
+
+	Partition part(comm.Get_size(), numLeaf);
+
+	int errCount = 0;
+	for(int id = 0; id < blockManager.getNumBlock(); ++id){
+		const int gid = part.getStart(comm.Get_rank()) + id;
+		BlockBase* block = blockManager.getBlock(id);
+		Scalar3D<double> *mesh = dynamic_cast< Scalar3D<double>* >(block->getDataClass(dcid));
+		double* data = mesh->getData();
+		Index3DS idx = mesh->getIndex();
+		for(int z = 0; z < sz.z; z++){
+			for(int y = 0; y < sz.y; y++){
+				for(int x = 0; x < sz.x; x++){
+					if( !check ){
+						data[idx(x, y, z)] = CellValue(gid, x, y, z, sz);
+					}else if( data[idx(x, y, z)] != CellValue(gid, x, y, z, sz) ){
+						errCount++;
+					}
+				}
+			}
+		}
+	}
+	return errCount;
+}
+
+int main(int argc, char** argv)
+{
+	using namespace std;
+
+	MPI::Init(argc, argv);
+
+	const int rank = MPI::COMM_WORLD.Get_rank();
+
+	const string mode = argc >= 3 ? string(argv[1]) : string("");
+	if( !((mode == "write" && argc == 4) || (mode == "read" && argc == 3)) ){
+		if( rank == 0 ){
+			printf("err : useage %s write <input dir> <output dir>\n", argv[0]);
+			printf("      useage %s read  <output dir>\n", argv[0]);
+		}
+		MPI::Finalize();
+		return -1;
+	}
+
+	BoundaryConditionSetter* bcsetter = new BoundaryConditionSetter;
+
+	int ret = EXIT_SUCCESS;
+
+	if( mode == "write" ){
+		BCMFileIO::BCMFileLoader loader(string(argv[2]) + "/cellid.bcm", bcsetter);
+		BlockManager& blockManager = BlockManager::getInstance();
+
+		int id_cid = 0;
+		loader.LoadLeafBlock(&id_cid, "CellID", vc);
+
+		int id_agg = blockManager.setDataClass< Scalar3D<double> >(vc);
+		Traverse(id_agg, loader.GetOctree()->getNumLeafNode(), false);
+
+		BCMFileIO::IdxStep step(0, 0);
+		BCMFileIO::BCMFileSaver saver(loader.GetGlobalOrigin(), loader.GetGlobalRegion(), loader.GetOctree(), argv[3]);
+		saver.RegisterCellIDInformation(id_cid, 5, vc, "CellID", "cid", "lb", "cid");
+		saver.RegisterDataInformation(&id_agg, BCMFileIO::LB_SCALAR, BCMFileIO::LB_FLOAT64, vc, "Agg", "agg", "lb", step, "AGG");
+
+		// 偶数ランクと奇数ランクのグループ (ノードにラウンドロビンで配置した場合と同じ並び)
+		if( !saver.SetAggregationGroup(rank % 2) || !saver.Save() ||
+		    !saver.SaveLeafBlock("CellID") || !saver.SaveLeafBlock("Agg", 0) ){
+			ret = EXIT_FAILURE;
+		}
+	}else{
+		BCMFileIO::BCMFileLoader loader(string(argv[2]) + "/cellid.bcm", bcsetter);
+
+		int id_agg = 0;
+		if( !loader.LoadAdditionalIndex(string(argv[2]) + "/data.bcm") ||
+		    !loader.LoadLeafBlock(&id_agg, "Agg", vc, 0) ){
+			ret = EXIT_FAILURE;
+		}else{
+			int errCount = Traverse(id_agg, loader.GetOctree()->getNumLeafNode(), true);
+			int errTotal = 0;
+			MPI::COMM_WORLD.Allreduce(&errCount, &errTotal, 1, MPI::INT, MPI::SUM);
+			if( rank == 0 ){
+				printf("mismatched cells : %d\n", errTotal);
+			}
+			if( errTotal != 0 ){ ret = EXIT_FAILURE; }
+		}
+	}
+
+	delete bcsetter;
+
+	MPI::Finalize();
+
+	return ret;
+}
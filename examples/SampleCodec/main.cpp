@@ -0,0 +1,264 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  main.cpp
+/// @brief 圧縮LeafBlockファイル (LBZ1) の往復確認
+///
+/// 物理量を圧縮形式を指定して出力し，出力時と異なるプロセス数で読み込んで，
+/// 各セルの値と元の値の差が誤差上限以下であること (可逆圧縮はビット単位で一致すること) を確認する．
+/// 増分出力 (時間差分形式を含む) は，増分ファイルのまま読み込む系と，出力途中および最後のステップを
+/// CompactLeafBlock()で変換した系の両方を確認する．
+///
+/// - write : codec write <入力ディレクトリ (cellid.bcm)> <出力ディレクトリ>
+/// - read  : codec read  <出力ディレクトリ>
+///
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "mpi.h"
+#include "../SampleLoader/BoundaryConditionSetter.h"
+#include "Partition.h"
+#include "Block.h"
+#include "BlockManager.h"
+#include "Scalar3D.h"
+#include "BCMFileLoader.h"
+#include "BCMFileSaver.h"
+#include "Vec3.h"
+
+using namespace Vec3class;
+
+static const int vc = 1;
+
+/// 確認する系
+struct CodecField
+{
+	const char*           name;     ///< 系の名称
+	BCMFileIO::LB_CODEC   codec;    ///< 圧縮形式
+	double                bound;    ///< 誤差上限 (LB_CODEC_RELERRはブロック内の値の範囲に対する比．可逆圧縮は0)
+	int                   interval; ///< 増分出力で全ブロックを出力する間隔 (0の場合は増分出力しない)
+	BCMFileIO::LB_DELTA   delta;    ///< 増分出力の時間差分形式
+	bool                  compact;  ///< 増分ファイルを変換するフラグ
+};
+
+static const CodecField fields[] = {
+	{ "Abs",  BCMFileIO::LB_CODEC_ABSERR,  1.0e-3, 0, BCMFileIO::LB_DELTA_NONE, false },
+	{ "Rel",  BCMFileIO::LB_CODEC_RELERR,  1.0e-4, 0, BCMFileIO::LB_DELTA_NONE, false },
+	{ "Lor",  BCMFileIO::LB_CODEC_LORENZO, 0.0,    0, BCMFileIO::LB_DELTA_NONE, false },
+	{ "Inc",  BCMFileIO::LB_CODEC_NONE,    0.0,    3, BCMFileIO::LB_DELTA_NONE, false },
+	{ "IncC", BCMFileIO::LB_CODEC_NONE,    0.0,    3, BCMFileIO::LB_DELTA_NONE, true  },
+	{ "Xor",  BCMFileIO::LB_CODEC_NONE,    0.0,    3, BCMFileIO::LB_DELTA_XOR,  false },
+	{ "XorC", BCMFileIO::LB_CODEC_NONE,    0.0,    3, BCMFileIO::LB_DELTA_XOR,  true  },
+	{ "Sub",  BCMFileIO::LB_CODEC_NONE,    0.0,    3, BCMFileIO::LB_DELTA_SUB,  false },
+};
+
+static const int numField = sizeof(fields) / sizeof(fields[0]);
+
+static const int numStep = 5;
+
+/// セルの値 (グローバルなリーフ番号，タイムステップとセル位置から決まる滑らかな分布)
+///
+/// 増分出力で変化しないブロックが生じるよう，ブロックごとに1, 2, 3ステップに1回だけ変化させる．
+///
+static double CellValue(const int gid, const int step, const int x, const int y, const int z)
+{
+	const int s = step - step % (1 + gid % 3);
+	return sin(0.3 * x + 0.2 * gid) * cos(0.4 * y - 0.1 * s) + 0.05 * z + gid;
+}
+
+/// 自プロセスの全ブロックに仮想セルを含めてセルの値を設定
+static void Fill(const int dcid, const int numLeaf, const int step)
+{
+	BlockManager& blockManager = BlockManager::getInstance();
+	const MPI::Intracomm& comm = blockManager.getCommunicator();
+	Vec3i sz = blockManager.getSize();
+
+	Partition part(comm.Get_size(), numLeaf);
+
+	for(int id = 0; id < blockManager.getNumBlock(); ++id){
+		const int gid = part.getStart(comm.Get_rank()) + id;
+		BlockBase* block = blockManager.getBlock(id);
+		Scalar3D<double> *mesh = dynamic_cast< Scalar3D<double>* >(block->getDataClass(dcid));
+		double* data = mesh->getData();
+		Index3DS idx = mesh->getIndex();
+		for(int z = -vc; z < sz.z + vc; z++){
+			for(int y = -vc; y < sz.y + vc; y++){
+				for(int x = -vc; x < sz.x + vc; x++){
+					data[idx(x, y, z)] = CellValue(gid, step, x, y, z);
+				}
+			}
+		}
+	}
+}
+
+/// 自プロセスの全ブロックの内部セルを照合し，誤差上限を超えるセル数を返す (maxRatioは誤差と誤差上限の比の最大値)
+///
+/// LB_CODEC_RELERRの誤差上限は，出力したブロック (仮想セルを含む) の値の範囲から求める．
+/// 誤差上限が0の場合はビット単位の一致を確認する．
+///
+static int Compare(const int dcid, const int numLeaf, const int step, const CodecField& field, double* maxRatio)
+{
+	BlockManager& blockManager = BlockManager::getInstance();
+	const MPI::Intracomm& comm = blockManager.getCommunicator();
+	Vec3i sz = blockManager.getSize();
+
+	Partition part(comm.Get_size(), numLeaf);
+
+	int errCount = 0;
+	for(int id = 0; id < blockManager.getNumBlock(); ++id){
+		const int gid = part.getStart(comm.Get_rank()) + id;
+
+		double bound = field.bound;
+		if( field.codec == BCMFileIO::LB_CODEC_RELERR ){
+			double vmin = CellValue(gid, step, -vc, -vc, -vc);
+			double vmax = vmin;
+			for(int z = -vc; z < sz.z + vc; z++){
+				for(int y = -vc; y < sz.y + vc; y++){
+					for(int x = -vc; x < sz.x + vc; x++){
+						const double v = CellValue(gid, step, x, y, z);
+						if( v < vmin ){ vmin = v; }
+						if( v > vmax ){ vmax = v; }
+					}
+				}
+			}
+			bound = field.bound * (vmax - vmin);
+		}
+
+		BlockBase* block = blockManager.getBlock(id);
+		Scalar3D<double> *mesh = dynamic_cast< Scalar3D<double>* >(block->getDataClass(dcid));
+		double* data = mesh->getData();
+		Index3DS idx = mesh->getIndex();
+		for(int z = 0; z < sz.z; z++){
+			for(int y = 0; y < sz.y; y++){
+				for(int x = 0; x < sz.x; x++){
+					const double value = CellValue(gid, step, x, y, z);
+					const double err = fabs(data[idx(x, y, z)] - value);
+					if( field.bound == 0.0 ){
+						if( memcmp(&data[idx(x, y, z)], &value, sizeof(double)) != 0 ){ errCount++; }
+					}else if( !(err <= bound) ){
+						errCount++;
+					}
+					if( bound > 0.0 && err / bound > *maxRatio ){
+						*maxRatio = err / bound;
+					}
+				}
+			}
+		}
+	}
+	return errCount;
+}
+
+int main(int argc, char** argv)
+{
+	using namespace std;
+
+	MPI::Init(argc, argv);
+
+	const int rank = MPI::COMM_WORLD.Get_rank();
+
+	const string mode = argc >= 3 ? string(argv[1]) : string("");
+	if( !((mode == "write" && argc == 4) || (mode == "read" && argc == 3)) ){
+		if( rank == 0 ){
+			printf("err : useage %s write <input dir> <output dir>\n", argv[0]);
+			printf("      useage %s read  <output dir>\n", argv[0]);
+		}
+		MPI::Finalize();
+		return -1;
+	}
+
+	BoundaryConditionSetter* bcsetter = new BoundaryConditionSetter;
+
+	int ret = EXIT_SUCCESS;
+
+	if( mode == "write" ){
+		BCMFileIO::BCMFileLoader loader(string(argv[2]) + "/cellid.bcm", bcsetter);
+		BlockManager& blockManager = BlockManager::getInstance();
+		const int numLeaf = loader.GetOctree()->getNumLeafNode();
+
+		int id_cid = 0;
+		loader.LoadLeafBlock(&id_cid, "CellID", vc);
+
+		BCMFileIO::IdxStep step(0, numStep - 1);
+		BCMFileIO::BCMFileSaver saver(loader.GetGlobalOrigin(), loader.GetGlobalRegion(), loader.GetOctree(), argv[3]);
+		saver.RegisterCellIDInformation(id_cid, 5, vc, "CellID", "cid", "lb", "cid");
+
+		int id_fields[numField];
+		for(int n = 0; n < numField; n++){
+			id_fields[n] = blockManager.setDataClass< Scalar3D<double> >(vc);
+			if( !saver.RegisterDataInformation(&id_fields[n], BCMFileIO::LB_SCALAR, BCMFileIO::LB_FLOAT64, vc,
+			                                   fields[n].name, fields[n].name, "lb", step, fields[n].name,
+			                                   false, false, fields[n].codec, fields[n].bound) ){
+				ret = EXIT_FAILURE;
+			}
+			if( fields[n].interval > 0 && !saver.SetIncrementalOutput(fields[n].name, fields[n].interval, fields[n].delta) ){
+				ret = EXIT_FAILURE;
+			}
+		}
+
+		if( ret == EXIT_SUCCESS && (!saver.Save() || !saver.SaveLeafBlock("CellID")) ){
+			ret = EXIT_FAILURE;
+		}
+		for(int s = 0; ret == EXIT_SUCCESS && s < numStep; s++){
+			for(int n = 0; ret == EXIT_SUCCESS && n < numField; n++){
+				Fill(id_fields[n], numLeaf, s);
+				if( !saver.SaveLeafBlock(fields[n].name, s) ){ ret = EXIT_FAILURE; }
+
+				// 出力途中 (以降の増分ファイルが参照する) と最後のステップを変換
+				if( ret == EXIT_SUCCESS && fields[n].compact && (s == 1 || s == numStep - 1) &&
+				    !saver.CompactLeafBlock(fields[n].name, s) ){
+					ret = EXIT_FAILURE;
+				}
+			}
+		}
+	}else{
+		BCMFileIO::BCMFileLoader loader(string(argv[2]) + "/cellid.bcm", bcsetter);
+		const int numLeaf = loader.GetOctree()->getNumLeafNode();
+
+		if( !loader.LoadAdditionalIndex(string(argv[2]) + "/data.bcm") ){
+			ret = EXIT_FAILURE;
+		}
+
+		for(int n = 0; ret == EXIT_SUCCESS && n < numField; n++){
+			int errCount = 0;
+			double maxRatio = 0.0;
+			for(int s = 0; s < numStep; s++){
+				int id_field = 0;
+				if( !loader.LoadLeafBlock(&id_field, fields[n].name, vc, s) ){
+					ret = EXIT_FAILURE;
+					break;
+				}
+				errCount += Compare(id_field, numLeaf, s, fields[n], &maxRatio);
+			}
+			if( ret != EXIT_SUCCESS ){ break; }
+
+			int errTotal = 0;
+			double maxRatioTotal = 0.0;
+			MPI::COMM_WORLD.Allreduce(&errCount, &errTotal, 1, MPI::INT, MPI::SUM);
+			MPI::COMM_WORLD.Allreduce(&maxRatio, &maxRatioTotal, 1, MPI::DOUBLE, MPI::MAX);
+			if( rank == 0 ){
+				printf("%s : cells over the bound : %d, max error / bound : %f\n", fields[n].name, errTotal, maxRatioTotal);
+			}
+			if( errTotal != 0 ){ ret = EXIT_FAILURE; }
+		}
+	}
+
+	delete bcsetter;
+
+	MPI::Finalize();
+
+	return ret;
+}
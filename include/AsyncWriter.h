@@ -0,0 +1,181 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  AsyncWriter.h
+/// @brief バックグラウンドスレッドでファイルを出力するクラス
+///
+
+#ifndef __BCMTOOLS_ASYNC_WRITER_H__
+#define __BCMTOOLS_ASYNC_WRITER_H__
+
+#include <pthread.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+namespace BCMFileIO {
+
+	class GatherWriter;
+
+	/// バックグラウンドスレッドでファイルを出力するクラス
+	///
+	/// @note 出力要求はチケット番号で識別し，Test()/Wait()で完了を確認する．
+	///       Wait()/WaitAll()で結果を返した要求の状態は破棄し，失敗した要求のチケット番号のみ保持する．
+	///       出力スレッドはMPI関数を呼び出さない．
+	///
+	class AsyncWriter {
+	public:
+
+		/// コンストラクタ
+		///
+		/// @param[in] maxInFlight 同時に保持する出力要求の最大数
+		///
+		explicit AsyncWriter(const int maxInFlight = 2);
+
+		/// デストラクタ
+		///
+		/// @note 未完了の出力要求がある場合，完了を待ってから出力スレッドを終了する．
+		///
+		~AsyncWriter();
+
+		/// 同時に保持する出力要求の最大数を設定
+		///
+		/// @param[in] maxInFlight 出力要求の最大数 (1以上)
+		///
+		void SetMaxInFlight(const int maxInFlight);
+
+		/// 未完了の出力要求数が最大数未満になるまで待機
+		///
+		/// @note 出力データを準備する前に呼び出すことで，一時バッファの数を最大数以下に抑える．
+		///
+		void WaitForSlot();
+
+		/// 出力要求を登録
+		///
+		/// @param[in] filepath 出力ファイルパス
+		/// @param[in] image    出力データ (所有権を移譲．出力後に解放される)
+		/// @return チケット番号
+		///
+		/// @note 未完了の出力要求が最大数に達している場合，空きができるまで待機する．
+		///
+		int Submit(const std::string& filepath, GatherWriter* image);
+
+		/// ファイルのコピー要求を登録
+		///
+		/// @param[in] source   コピー元ファイルパス
+		/// @param[in] filepath コピー先ファイルパス (ディレクトリは作成済みであること)
+		/// @return チケット番号
+		///
+		/// @note 未完了の要求が最大数に達している場合，空きができるまで待機する．
+		///
+		int SubmitCopy(const std::string& source, const std::string& filepath);
+
+		/// 出力要求の完了を確認 (待機しない)
+		///
+		/// @param[in]  ticket チケット番号
+		/// @param[out] done   完了している場合true (結果を返し済みの場合もtrue)
+		/// @return 発行済みのチケット番号の場合true, 不明なチケット番号の場合false
+		///
+		bool Test(const int ticket, bool* done);
+
+		/// 出力要求の完了を待機
+		///
+		/// @param[in] ticket チケット番号
+		/// @return 出力に成功した場合true, 失敗した場合または不明なチケット番号の場合false
+		///
+		/// @note 結果を返し済みのチケット番号に対しては同じ結果を返す．
+		///
+		bool Wait(const int ticket);
+
+		/// 全ての出力要求の完了を待機
+		///
+		/// @return 結果を返していない全ての出力に成功した場合true, 失敗した場合false
+		///
+		bool WaitAll();
+
+		/// 未完了の出力要求数を取得
+		///
+		/// @return 未完了の出力要求数
+		///
+		int GetNumInFlight();
+
+	private:
+		AsyncWriter(const AsyncWriter&);
+		AsyncWriter& operator=(const AsyncWriter&);
+
+		/// 出力スレッドのエントリポイント
+		static void* ThreadMain(void* arg);
+
+		/// 出力スレッドの処理
+		void Run();
+
+	private:
+		/// 出力要求
+		struct Job
+		{
+			int           ticket;   ///< チケット番号
+			std::string   filepath; ///< 出力ファイルパス
+			std::string   source;   ///< コピー元ファイルパス (コピー要求の場合)
+			GatherWriter* image;    ///< 出力データ (コピー要求の場合NULL)
+		};
+
+		/// 要求をキューに登録
+		///
+		/// @param[in,out] job 要求 (チケット番号はここで設定)
+		/// @return チケット番号
+		///
+		int Enqueue(Job& job);
+
+		/// 要求を実行 (出力データは解放される)
+		///
+		/// @param[in] job 要求
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		static bool Execute(const Job& job);
+
+		/// 完了した要求の結果を返し済みとして状態を破棄 (ロックを取得して呼び出すこと)
+		///
+		/// @param[in] it 完了した要求の状態
+		/// @return 出力に成功した場合true, 失敗した場合false
+		///
+		bool Report(std::map<int, int>::iterator it);
+
+		/// 出力要求の状態
+		enum JobState
+		{
+			JOB_PENDING = 0, ///< 未完了
+			JOB_SUCCESS,     ///< 出力成功
+			JOB_FAILED       ///< 出力失敗
+		};
+
+		pthread_t           m_thread;      ///< 出力スレッド
+		pthread_mutex_t     m_mutex;       ///< 排他制御用mutex
+		pthread_cond_t      m_cond;        ///< 状態変化通知用条件変数
+		bool                m_running;     ///< 出力スレッド起動フラグ
+		bool                m_stop;        ///< 出力スレッド終了要求フラグ
+
+		std::deque<Job>     m_queue;       ///< 出力待ちの要求
+		std::map<int, int>  m_states;      ///< 結果を返していないチケット番号ごとの状態
+		std::set<int>       m_failed;      ///< 結果を返し済みの出力に失敗したチケット番号
+		int                 m_nextTicket;  ///< 次に発行するチケット番号
+		int                 m_numInFlight; ///< 未完了の出力要求数
+		int                 m_maxInFlight; ///< 未完了の出力要求の最大数
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_ASYNC_WRITER_H__
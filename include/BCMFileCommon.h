@@ -42,6 +42,15 @@ typedef unsigned __int64 uint64_t;
 /// LeafBlockファイルのエンディアン識別子 (LB01)
 #define LEAFBLOCK_FILE_IDENTIFIER (('L' | ('B' << 8) | ('0' << 16) | ('1' << 24)))
 
+/// LeafBlockファイルのエンディアン識別子 (LB02．LBHeaderの直後にLBHeaderExtを持つ)
+#define LEAFBLOCK_FILE_IDENTIFIER_V2 (('L' | ('B' << 8) | ('0' << 16) | ('2' << 24)))
+
+/// 増分LeafBlockファイルのエンディアン識別子 (LBD1)
+#define LEAFBLOCK_DELTA_FILE_IDENTIFIER (('L' | ('B' << 8) | ('D' << 16) | ('1' << 24)))
+
+/// 圧縮LeafBlockファイルのエンディアン識別子 (LBZ1)
+#define LEAFBLOCK_CODEC_FILE_IDENTIFIER (('L' | ('B' << 8) | ('Z' << 16) | ('1' << 24)))
+
 namespace BCMFileIO {
 
 #ifdef __GNUC__
@@ -80,6 +89,60 @@ namespace BCMFileIO {
 
 	} ALIGNMENT;
 
+	/// LeafBlockファイルヘッダの拡張 (LB02)
+	///
+	/// @note LB02のファイルはLBHeaderの直後にLBHeaderExtを持ち，以降の構成はLB01と同じ．
+	///       CellIDのLBCellIDHeader::compSizeはcodecで符号化したBitVoxelのサイズを表す．
+	///       LB01で表現できる圧縮形式 (LB_STREAM_RAW, LB_STREAM_RLE) はLB01で出力する．
+	struct LBHeaderExt
+	{
+		unsigned int codec;    ///< 圧縮形式 (LB_STREAM_CODEC．StreamCodec::Register()で登録した圧縮形式も可)
+		int          param;    ///< 符号化時のパラメータ (圧縮レベルなど．展開には使用しない)
+		uint64_t     reserved; ///< 予約 (0)
+
+		LBHeaderExt() : codec(0), param(0), reserved(0) {}
+
+	} ALIGNMENT;
+
+	/// 増分LeafBlockファイルのブロック参照
+	///
+	/// @note 増分ファイルはLBHeaderの直後にブロックごとの参照をnumBlock個持ち，その後に変化したブロックのみを格納する．
+	///       stepがファイル自身のステップと異なるブロックは，そのステップのファイルに格納されている．
+	struct LBDeltaEntry
+	{
+		unsigned int step;  ///< ブロックを格納しているファイルのタイムステップ
+		unsigned int index; ///< ファイル内の格納位置 (ブロック単位．stepがファイル自身のステップの場合のみ有効)
+
+	} ALIGNMENT;
+
+	/// 圧縮LeafBlockファイルの符号化情報
+	///
+	/// @note 圧縮ファイルはLBHeaderの直後に符号化情報，ブロックごとの格納情報 (LBCodecEntry) をnumBlock個持ち，
+	///       その後にブロックごとの符号を格納する．
+	struct LBCodecHeader
+	{
+		unsigned int codec;    ///< 圧縮形式 (LB_CODEC．時間差分のみのファイルはLB_CODEC_NONE)
+		unsigned int baseStep; ///< 時間差分の基準とするタイムステップ (時間差分のブロックを含まない場合は0)
+
+	} ALIGNMENT;
+
+	/// 圧縮LeafBlockファイルのブロック格納情報
+	///
+	/// @note stepがファイル自身のステップと異なるブロックは，そのステップのファイルに格納されている (増分出力)．
+	///       LB_CODEC_ENTRY_DELTA_XOR, LB_CODEC_ENTRY_DELTA_SUBのブロックは，LBCodecHeader::baseStepの
+	///       同じブロックとの差分を格納している (時間差分出力)．
+	///       LB_CODEC_ENTRY_CONSTANTのブロックは，値が一定のコンポーネントを1値に縮約している (読み込み時は値で埋める)．
+	///       LB_CODEC_ENTRY_MASKEDのブロックは，マスク外のセルを除いている (読み込み時は指定した値で埋める)．
+	///       LB_CODEC_ENTRY_ABSENTのブロックはファイルに含まれない (格納情報がブロックの有無を表す．読み込み時は全セルを指定した値で埋める)．
+	struct LBCodecEntry
+	{
+		uint64_t     offset; ///< ファイル先頭からの符号の位置 (Byte単位)
+		uint64_t     size;   ///< 符号のサイズ (Byte単位)
+		unsigned int step;   ///< ブロックを格納しているファイルのタイムステップ
+		unsigned int flags;  ///< 格納フラグ (LB_CODEC_ENTRY_FLAG)
+
+	} ALIGNMENT;
+
 	/// LeafBlockのCellIDヘッダ構造体
 	struct LBCellIDHeader
 	{
@@ -88,6 +151,21 @@ namespace BCMFileIO {
 
 	} ALIGNMENT;
 
+	/// CellIDのブロック単位符号の格納情報 (LB_STREAM_BLOCK)
+	///
+	/// @note 符号はブロックごとの格納情報をnumBlock個持ち，その後にブロックごとの符号を格納する．
+	///       offsetは格納情報の直後からの位置．符号はバイト順を保存しない (LB02の他の圧縮形式と同じ)．
+	struct LBCellIDBlockEntry
+	{
+		uint64_t      offset;   ///< 符号の位置 (Byte単位)
+		unsigned int  size;     ///< 符号のサイズ (Byte単位．LB_CELLID_BLOCK_UNIFORMの場合0)
+		unsigned char mode;     ///< 符号化方法 (LB_CELLID_BLOCK_MODE)
+		unsigned char bitWidth; ///< BitVoxelのビット幅 (ブロック内の最大値から決定)
+		unsigned char value;    ///< ブロック内で一様な値 (LB_CELLID_BLOCK_UNIFORMのみ)
+		unsigned char reserved; ///< 予約 (0)
+
+	} ALIGNMENT;
+
 	typedef BitVoxel::bitVoxelCell bitVoxelCell;
 
 	/// RLE圧縮符号の走査用構造体
@@ -128,7 +206,59 @@ namespace BCMFileIO {
 		LB_INT64   =  6, ///< 符号付き64bit整数型
 		LB_UINT64  =  7, ///< 符号なし64bit整数型
 		LB_FLOAT32 =  8, ///< 32bit浮動小数点 (単精度浮動小数点)
-		LB_FLOAT64 =  9  ///< 64bit浮動小数点 (倍精度浮動小数点)
+		LB_FLOAT64 =  9, ///< 64bit浮動小数点 (倍精度浮動小数点)
+		LB_FLOAT16 = 10, ///< 16bit浮動小数点 (IEEE754 半精度．ファイル上の型としてのみ使用)
+		LB_BFLOAT16 = 11 ///< 16bit浮動小数点 (bfloat16．ファイル上の型としてのみ使用)
+	};
+
+	/// 物理量リーフブロックの圧縮形式
+	enum LB_CODEC
+	{
+		LB_CODEC_NONE    = 0, ///< 圧縮なし
+		LB_CODEC_LORENZO = 1, ///< Lorenzo予測 + XOR残差 + バイトプレーン分割 + ゼロラン符号 (LB_FLOAT32, LB_FLOAT64のみ．可逆)
+		LB_CODEC_ABSERR  = 2, ///< 量子化 + Lorenzo予測 + ビットプレーン分割 + ゼロラン符号 (LB_FLOAT32, LB_FLOAT64のみ．誤差上限を絶対値で指定)
+		LB_CODEC_RELERR  = 3  ///< 量子化 + Lorenzo予測 + ビットプレーン分割 + ゼロラン符号 (LB_FLOAT32, LB_FLOAT64のみ．誤差上限をブロック内の値の範囲に対する比で指定)
+	};
+
+	/// 圧縮LeafBlockファイルのブロック格納フラグ
+	enum LB_CODEC_ENTRY_FLAG
+	{
+		LB_CODEC_ENTRY_RAW       = 1, ///< 符号化せずファイルのバイト順で格納 (符号の方が大きい場合)
+		LB_CODEC_ENTRY_DELTA_XOR = 2, ///< 基準ステップとのXOR差分を符号化して格納
+		LB_CODEC_ENTRY_DELTA_SUB = 4, ///< 基準ステップとの算術差分を符号化して格納
+		LB_CODEC_ENTRY_CONSTANT  = 8, ///< 値が一定のコンポーネントを1値に縮約して格納 (ファイルのバイト順．BlockCodec::EncodeConstant())
+		LB_CODEC_ENTRY_MASKED    = 16, ///< CellIDによるマスク外のセルを除いて格納 (ファイルのバイト順．BlockCodec::EncodeMasked())
+		LB_CODEC_ENTRY_ABSENT    = 32  ///< 全セルがマスク外のため格納しない (符号なし．offset, sizeは0)
+	};
+
+	/// CellIDファイルの圧縮形式 (StreamCodecの識別番号)
+	enum LB_STREAM_CODEC
+	{
+		LB_STREAM_RAW        = 0,  ///< 圧縮なし (LB01のcompSize = 0と同じ)
+		LB_STREAM_RLE        = 1,  ///< 要素単位のランレングス符号 (LB01のRLEと同じ．BCMRLE)
+		LB_STREAM_SHUFFLE_LZ = 2,  ///< バイトシャッフル + LZ77符号
+		LB_STREAM_ZSTD       = 3,  ///< zstd (HAVE_ZSTDを定義してビルドした場合のみ．paramは圧縮レベル)
+		LB_STREAM_LZ4        = 4,  ///< LZ4 (HAVE_LZ4を定義してビルドした場合のみ．paramは加速度)
+		LB_STREAM_BLOCK      = 5,  ///< ブロック単位の適応符号 (LBCellIDBlockEntry．ブロックごとに展開できる)
+		LB_STREAM_VRLE       = 6,  ///< 要素単位の可変長ラン長符号 (ラン長に上限のないRLE．大きな一様領域向け)
+		LB_STREAM_USER       = 128 ///< 利用者が登録する圧縮形式の識別番号の下限
+	};
+
+	/// CellIDのブロック単位符号の符号化方法
+	enum LB_CELLID_BLOCK_MODE
+	{
+		LB_CELLID_BLOCK_UNIFORM  = 0, ///< ブロック内の値が一様 (LBCellIDBlockEntry::valueのみ)
+		LB_CELLID_BLOCK_BITVOXEL = 1, ///< BitVoxel
+		LB_CELLID_BLOCK_RLE      = 2, ///< BitVoxelの要素単位のランレングス符号 (LB_STREAM_RLE)
+		LB_CELLID_BLOCK_VRLE     = 3  ///< BitVoxelの要素単位の可変長ラン長符号 (LB_STREAM_VRLE)
+	};
+
+	/// 物理量リーフブロックの時間差分形式
+	enum LB_DELTA
+	{
+		LB_DELTA_NONE = 0, ///< 時間差分なし
+		LB_DELTA_XOR  = 1, ///< 前回出力したステップとのXOR (指数部と上位の仮数部が一致する場合に有効)
+		LB_DELTA_SUB  = 2  ///< 前回出力したステップとの算術差分をさらに空間方向に予測 (浮動小数点は大小関係を保つ整数に変換して差分)
 	};
 
 	/// インデックスファイル用単位系情報
@@ -147,6 +277,7 @@ namespace BCMFileIO {
 		unsigned int rank;     ///< ランク番号
 		unsigned int rangeMin; ///< ブロックIDのレンジ最小値
 		unsigned int rangeMax; ///< ブロックIDのレンジ最大値
+		int          groupID;  ///< I/Oグループ番号 (集約出力しない場合-1)
 	};
 
 	/// 2byte用エンディアンスワップ
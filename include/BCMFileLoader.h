@@ -22,6 +22,7 @@
 
 #include <mpi.h>
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -35,6 +36,7 @@
 using namespace Vec3class;
 
 class BlockManager;
+class BlockBase;
 class BCMOctree;
 class BoundaryConditionSetterBase;
 
@@ -43,6 +45,8 @@ class TextParser;
 namespace BCMFileIO {
 
 	class PartitionMapper;
+	struct DataStreamState;
+	class MemoryCheckpoint;
 
 	/// BCMファイルを読み込むクラス
 	class BCMFileLoader
@@ -106,6 +110,66 @@ namespace BCMFileIO {
 		bool LoadLeafBlock(int *dataClassID, const std::string& name, const unsigned int vc,
 		                   const unsigned int step = 0, const bool separateVCUpdate = false);
 
+		/// 連続するタイムステップを順に読み込む場合のリーフブロックの読み込み．
+		///
+		/// @param[out] dataClassID       生成したブロックのデータクラスID (配列の先頭アドレス)
+		/// @param[in]  name              系の名称
+		/// @param[in]  vc                仮想セルサイズ
+		/// @param[in]  step              読み込むタイムステップ
+		/// @param[in]  separateVCUpdate  仮想セルの同期方法フラグ．trueの場合、3軸方向別々に同期を行う
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note LoadLeafBlock()と同じ結果となるが，読み込んだブロックを系ごとに保持し，
+		///       次に読み込むステップの時間差分 (BCMFileSaver::SetIncrementalOutput()) の基準として使用する．
+		///       前回読み込んだステップを基準とするファイルはキーフレームまでたどらずに復元できる．
+		///       保持するブロックの分だけメモリを使用するため，読み込み終了後はClearSequentialState()で解放すること．
+		///       Dataのみ対応．(集団操作)
+		///
+		bool LoadLeafBlockSequential(int *dataClassID, const std::string& name, const unsigned int vc,
+		                             const unsigned int step, const bool separateVCUpdate = false);
+
+		/// 逐次読み込みの状態を破棄
+		///
+		/// @param[in] name 系の名称 (空文字列の場合は全ての系)
+		///
+		void ClearSequentialState(const std::string& name = std::string(""));
+
+		/// メモリ上のチェックポイントからリーフブロックを読み込む．
+		///
+		/// @param[out] dataClassID       生成したブロックのデータクラスID (配列の先頭アドレス)
+		/// @param[in]  name              系の名称
+		/// @param[in]  vc                仮想セルサイズ
+		/// @param[in]  checkpoint        BCMFileSaver::SaveLeafBlockMemory()で保存したチェックポイント
+		/// @param[in]  separateVCUpdate  仮想セルの同期方法フラグ．trueの場合、3軸方向別々に同期を行う
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ファイルを読み込まずに，自プロセスまたはパートナープロセスのメモリに保持したイメージから
+		///       ブロックを再構築する．チェックポイント保存時と同じプロセス数・ブロック分割である必要がある．
+		///       Dataのみ対応．nameに対応するブロックが生成されていない場合、ブロックを生成．(集団操作)
+		///
+		bool LoadLeafBlockMemory(int *dataClassID, const std::string& name, const unsigned int vc,
+		                         MemoryCheckpoint& checkpoint, const bool separateVCUpdate = false);
+
+		/// 段階出力の一時ディレクトリを設定
+		///
+		/// @param[in] dir 出力時にBCMFileSaver::SetStaging()で指定した一時ディレクトリ (空文字列の場合は使用しない)
+		///
+		/// @note 設定した場合，LoadLeafBlock()は分散ファイルのDataについて，一時ディレクトリに確定済みのコピーが
+		///       残っていればそちらを読み込む．確定記録 ("<ファイル名>.commit") がない，またはいずれかのファイルが
+		///       確定後に変更されている場合は出力ディレクトリのファイルを読み込む．
+		///
+		void SetStagingDirectory(const std::string& dir);
+
+		/// 物理量のリーフブロックファイルをメモリマップして読み込むかを設定
+		///
+		/// @param[in] enable メモリマップする場合true (既定値false．stdioで読み込む)
+		///
+		/// @note 有効な場合，LoadLeafBlock()はファイルごとに1度だけマップし，非圧縮のブロックは複写せずマップ内から展開する．
+		///       同じファイルを繰り返し開く後処理ツールなどで，プロセスやステップ間でページキャッシュを共有できる．
+		///       マップできないファイルはstdioで読み込む．読み込み中にファイルを切り詰めないこと．
+		///
+		void SetMappedRead(const bool enable);
+
 		/// 読み込んだOctreeを返す．
 		/// @return Octreeのポインタ
 		///
@@ -130,6 +194,55 @@ namespace BCMFileIO {
 		///
 		const IdxStep* GetStep(const std::string& name) const;
 
+		/// 圧縮形式を取得
+		///
+		/// @param[in]  name       系の名称
+		/// @param[out] codec      圧縮形式 (NULLの場合は取得しない)
+		/// @param[out] errorBound 非可逆圧縮の誤差上限 (可逆または非圧縮の場合0．NULLの場合は取得しない)
+		/// @return 系が存在する場合true
+		///
+		/// @note 展開はリーフブロックファイルの圧縮情報に従って行われるため，読込みには不要．
+		///       可視化などで展開値の精度を確認する際に用いる．
+		///
+		bool GetCodec(const std::string& name, LB_CODEC* codec, double* errorBound) const;
+
+		/// マスク外のセルを埋める値を設定
+		///
+		/// @param[in] name  系の名称
+		/// @param[in] value マスク外のセルの値 (データ型に変換して埋める．既定値は0)
+		/// @return 系が存在する場合true
+		///
+		/// @note BCMFileSaver::SetCellMask()で出力したブロックのうち，値を格納していないセルに使用する．
+		///
+		bool SetMaskFillValue(const std::string& name, const double value);
+
+		/// メモリ上 (Scalar3D) のデータ型を設定
+		///
+		/// @param[in] name     系の名称
+		/// @param[in] dataType メモリ上のデータ型 (LB_FLOAT32, LB_FLOAT64)
+		/// @return 成功した場合true
+		///
+		/// @note CreateLeafBlock()の前に呼び出すこと．読み込み時にファイル上のデータ型から変換する．
+		///       未設定の場合はファイル上のデータ型 (LB_FLOAT16, LB_BFLOAT16の場合はLB_FLOAT32)．
+		///
+		bool SetMemoryDataType(const std::string& name, const LB_DATA_TYPE dataType);
+
+		/// 外部境界の仮想セルの設定関数 (ブロック，データクラスID，内部構造の仮想セルサイズを受け取る)
+		typedef void (*OuterBoundaryFunc)(BlockBase* block, const int dataClassID, const unsigned int vc);
+
+		/// 外部境界の仮想セルの設定関数を登録
+		///
+		/// @param[in] name 系の名称
+		/// @param[in] func 設定関数 (NULLの場合は登録を解除)
+		/// @return 系が存在する場合true
+		///
+		/// @note 読み込み時に仮想セルを同期した場合 (ファイルの仮想セルサイズが内部構造より小さい場合．
+		///       BCMFileSaver::SetInteriorOutput()で出力した系など)，同期後に自プロセスの全ブロック/全コンポーネントについて呼び出す．
+		///       同期では外部境界の仮想セルが設定されないため，コンストラクタに渡したBoundaryConditionSetterBaseで
+		///       ブロックに設定された境界情報を参照して値を設定する．
+		///
+		bool SetOuterBoundaryFunc(const std::string& name, OuterBoundaryFunc func);
+
 		/// 単位系を取得
 		///
 		/// @return 単位系
@@ -194,6 +307,13 @@ namespace BCMFileIO {
 		///
 		bool LoadIndexProc(const std::string& filename, std::vector<IdxProc>& procList);
 
+		/// ファイルの仮想セルサイズより大きい仮想セルを同期 (外部境界の設定関数が登録されている場合は同期後に呼び出す)
+		///
+		/// @param[in] ib ブロック情報
+		/// @param[in] vc 内部構造の仮想セルサイズ
+		///
+		void UpdateVirtualCells(const IdxBlock* ib, const unsigned int vc);
+
 		/// 読み込んだインデックスファイルの内容をstdoutに出力
 		void PrintIdxInformation();
 
@@ -260,6 +380,15 @@ namespace BCMFileIO {
 		BCMOctree *m_octree;                   ///< Octree
 
 		PartitionMapper* m_pmapper;            ///< MxNデータマッパ
+		PartitionMapper* m_gmapper;            ///< MxNデータマッパ (I/Oグループ単位の集約ファイル用)
+
+		std::string m_stageDir;                ///< 段階出力の一時ディレクトリ (使用しない場合は空)
+
+		bool m_mappedRead;                     ///< 物理量のファイルをメモリマップして読み込むフラグ
+
+		std::map<std::string, DataStreamState*> m_streamStates; ///< 系ごとの逐次読み込みの状態
+
+		std::map<std::string, OuterBoundaryFunc> m_outerBoundaryFuncs; ///< 系ごとの外部境界の仮想セルの設定関数
 	};
 
 } // namespace BCMFileIO
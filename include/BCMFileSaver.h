@@ -24,12 +24,16 @@
 #include <mpi.h>
 #include <string>
 #include <vector>
+#include <deque>
+#include <map>
 
 #include "Vec3.h"
 
 #include "BCMFileCommon.h"
 #include "IdxBlock.h"
 #include "IdxStep.h"
+#include "LeafBlockSaver.h"
+#include "AsyncWriter.h"
 
 using namespace Vec3class;
 
@@ -39,6 +43,9 @@ class BlockManager;
 
 namespace BCMFileIO {
 
+	class IOServerClient;
+	class MemoryCheckpoint;
+
 	/// BCMファイルを出力するクラス
 	class BCMFileSaver
 	{
@@ -53,6 +60,20 @@ namespace BCMFileIO {
 		///
 		BCMFileSaver( const Vec3r& globalOrigin, const Vec3r& globalRegion, const BCMOctree* octree, const std::string dir = std::string("") );
 
+		/// コンストラクタ (コミュニケータ指定)
+		///
+		/// @param[in] globalOrigin 計算空間全体の起点座標
+		/// @param[in] globalRegion 計算空間全体の領域サイズ
+		/// @param[in] octree 出力Octree
+		/// @param[in] comm 出力を行うプロセスのコミュニケータ (BlockManagerのブロック分割と一致させること)
+		/// @param[in] dir ファイル出力先ディレクトリ(省略した場合、カレントディレクトリ)
+		///
+		/// @note I/Oサーバを使用する場合，IOServer::SplitComm()で得た計算プロセス側のコミュニケータを指定する．
+		///       commは本クラスの破棄まで保持すること．
+		///
+		BCMFileSaver( const Vec3r& globalOrigin, const Vec3r& globalRegion, const BCMOctree* octree,
+		              const MPI::Intracomm& comm, const std::string dir = std::string("") );
+
 		/// デストラクタ
 		~BCMFileSaver();
 
@@ -89,8 +110,18 @@ namespace BCMFileIO {
 		/// @param[in] step         タイムステップ情報
 		/// @param[in] dataDir      リーフブロックファイルの出力ディレクトリを指定 (コンストラクタで指定した出力ディレクトリからの相対パス)
 		/// @param[in] stepSubDir   タイムステップごとの出力ディレクトリフラグ (trueの場合、タイムステップごとのディレクトリを作成)
+		/// @param[in] gatherMode   集約モード (trueの場合、MPI-IOによりタイムステップごとに1ファイルへ出力)
+		/// @param[in] codec        圧縮形式 (LB_FLOAT32, LB_FLOAT64のみ対応)
+		/// @param[in] errorBound   誤差上限 (LB_CODEC_ABSERRは絶対値，LB_CODEC_RELERRはブロック内の値の範囲に対する比．正の値)
 		/// @return 成功した場合true, 失敗した場合false
 		///
+		/// @note gatherModeがtrueの場合、各ブロックはグローバルなリーフ番号から求まる位置に出力されるため、
+		///       ファイルの内容は出力時のプロセス数に依存しない
+		///       圧縮は分散ファイルのみ対応し、ブロックごとに符号化して圧縮LeafBlockファイル (識別子LBZ1) に出力する。
+		///       gatherModeがtrueの場合は指定できない。SetAggregation()後に登録する場合 (集約出力) も指定できない。
+		///       LB_CODEC_ABSERR, LB_CODEC_RELERRは可視化出力向けの非可逆圧縮で、展開値と元の値の差はerrorBound以下となる。
+		///       誤差上限はインデックスファイル (data.bcm) に記録される。
+		///
 		bool RegisterDataInformation( const int          *dataClassID,
 		                              const LB_KIND       kind,
 									  const LB_DATA_TYPE  dataType,
@@ -100,7 +131,10 @@ namespace BCMFileIO {
 									  const std::string&  extension,
 									  const IdxStep&      step,
 									  const std::string&  dataDir = std::string("./"),
-									  const bool          stepSubDir = false );
+									  const bool          stepSubDir = false,
+									  const bool          gatherMode = false,
+									  const LB_CODEC      codec = LB_CODEC_NONE,
+									  const double        errorBound = 0.0 );
 
 		/// 出力対象データの単位系設定
 		///
@@ -110,6 +144,223 @@ namespace BCMFileIO {
 		///
 		bool SetUnit( const IdxUnit& unit );
 
+		/// MPI-IOのヒントを設定 (共有ファイル出力用)
+		///
+		/// @param[in] key   ヒントのキー (例 "striping_factor", "striping_unit", "cb_nodes")
+		/// @param[in] value ヒントの値
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note RegisterDataInformation()でgatherModeをtrueとしたデータの出力時に使用される
+		///
+		bool SetIOHint( const std::string& key, const std::string& value );
+
+		/// I/Oグループによる集約出力を設定
+		///
+		/// @param[in] groupSize 1グループあたりのプロセス数 (0の場合，ノードごとに1グループ)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note RegisterDataInformation()でgatherModeをfalseとしたデータに適用される．
+		///       各グループの先頭プロセスが集約プロセスとなり，タイムステップごとにグループあたり1ファイルを出力する．
+		///       グループの割り当てはproc.bcmに記載されるため，Save()の前に呼び出すこと．(集団操作)
+		///       圧縮形式，SetConstantElision()，SetCellMask()またはSetIncrementalOutput()を設定済みの
+		///       Dataがある場合は失敗する．
+		///
+		bool SetAggregation( const int groupSize );
+
+		/// I/Oグループを直接指定して集約出力を設定
+		///
+		/// @param[in] groupID 自プロセスのI/Oグループ番号 (0以上．グループ内のランク番号は連続しなくてよい)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ノード以外の単位 (ネットワークの配置など) でグループを構成する場合に使用する．
+		///       グループ内の最小ランクが集約プロセスとなる．その他はSetAggregation()と同じ．(集団操作)
+		///
+		bool SetAggregationGroup( const int groupID );
+
+		/// 分散ファイル出力時に同時に出力するプロセス数の上限を設定
+		///
+		/// @param[in] maxWriters 同時に出力するプロセス数の上限 (0の場合制限なし)
+		/// @param[in] adaptive   trueの場合，出力ごとに観測したスループットに応じて上限を調整
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 各プロセスはランク番号順にトークンを受け渡し，トークンを持つプロセスのみがファイルを開いて書き込む．
+		///       adaptiveがtrueの場合，上限を2倍/半分に変化させ，スループットが低下したら変化の向きを反転する．
+		///       スループットは系ごとに前回の出力と比較し，系ごとの最初の出力は基準の記録のみとする．
+		///       RegisterDataInformation()でgatherModeをfalseとしたデータの同期出力に適用される．
+		///
+		bool SetWriteThrottle( const int maxWriters, const bool adaptive = false );
+
+		/// I/Oサーバによる出力を設定
+		///
+		/// @param[in] comm       計算プロセスとI/Oサーバを含むコミュニケータ (先頭から計算プロセス，末尾numServers個がI/Oサーバ)
+		/// @param[in] numServers I/Oサーバのプロセス数
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 設定後，Save()およびSaveLeafBlock()は出力データを一時バッファにコピーしてI/Oサーバへノンブロッキング送信し，
+		///       送信の完了を待たずに戻る．CellIDの圧縮，ファイル出力およびディレクトリ作成はI/Oサーバで行う．
+		///       I/Oサーバ側ではcommの同じプロセス位置でIOServerを生成し，IOServer::Run()を呼び出すこと．(集団操作)
+		///       共有ファイル/集約出力するCellIDおよびDataは従来どおり計算プロセスで出力する．
+		///       同時に処理中の要求数はSetAsyncDepth()で設定した数に制限される．
+		///       I/Oサーバでの出力の失敗は，結果を受信した後のSave()/SaveLeafBlock()およびCloseIOServer()で
+		///       全プロセスのエラーとして返す．
+		///
+		bool SetIOServer( const MPI::Intracomm& comm, const int numServers );
+
+		/// I/Oサーバへの出力要求を終了
+		///
+		/// @return 全プロセスの未確認の出力がI/Oサーバで成功した場合true, 失敗した場合false
+		///
+		/// @note 処理中の要求の完了を待ってから終了要求を送る．I/OサーバのIOServer::Run()は
+		///       担当する全ての計算プロセスから終了要求を受け取ると戻る．
+		///       呼び出さない場合はデストラクタで終了要求を送る (出力結果は確認しない)．(集団操作)
+		///
+		bool CloseIOServer();
+
+		/// ノードローカルな一時ディレクトリを経由した段階出力を設定
+		///
+		/// @param[in] localDir  一時出力先ディレクトリ (例 "/tmp/stage/", "/dev/shm/stage/")．空文字列の場合は段階出力を無効化
+		/// @param[in] keepLocal trueの場合，確定後も一時出力先のファイルを残す (リスタート時にBCMFileLoader::SetStagingDirectory()で優先して読み込む)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 有効な場合，Save()のインデックスファイル/Octreeと，SaveLeafBlock()の分散ファイルを一時出力先へ出力して戻り，
+		///       バックグラウンドスレッドが出力ディレクトリの同じ位置へ "<ファイル名>.drain" としてコピーする．
+		///       全プロセスのコピーが完了した出力単位 (Save()/SaveLeafBlock()の呼び出しごと) から本来のファイル名に変更して確定する．
+		///       keepLocalがtrueの場合，確定時に一時出力先へ確定記録 ("<ファイル名>.commit") を出力する．
+		///       確定は以降のSave()/SaveLeafBlock()呼び出し時およびWaitStaging()で行い，確定待ちの出力単位数は
+		///       SetAsyncDepth()で設定した数に制限される．
+		///       共有ファイル/集約出力するデータ，およびI/Oサーバを使用する場合は出力ディレクトリへ直接出力する．
+		///       無効にする場合は全ての確定を待つ．(集団操作)
+		///
+		bool SetStaging( const std::string& localDir, const bool keepLocal = true );
+
+		/// 段階出力のコピー完了を待機し，全ての出力を確定
+		///
+		/// @return 全プロセスのコピーに成功した場合true, 失敗した場合false
+		///
+		/// @note 全プロセスで呼び出すこと．(集団操作)
+		///       確定していない出力はデストラクタでは確定されないため，終了前に呼び出すこと．
+		///
+		bool WaitStaging();
+
+		/// 物理量の増分出力を設定
+		///
+		/// @param[in] name         系の名称 (Registerした際に設定した名前)
+		/// @param[in] fullInterval 全ブロックを出力する間隔 (出力回数)．0の場合は増分出力を無効化
+		/// @param[in] delta        変化したブロックの時間差分形式 (LB_DELTA_NONEの場合はブロック全体を格納)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 有効な場合，SaveLeafBlock()はブロックごとのハッシュ値を前回の出力と比較し，
+		///       変化したブロックのみを格納して残りは過去のステップのファイルを参照する増分ファイルを出力する．
+		///       fullInterval回に1回は全ブロックを出力し，読み込み時にたどるファイル数を制限する．
+		///       deltaを指定した場合，変化したブロックは前回出力したステップとの差分 (XORまたは算術差分) を圧縮して
+		///       圧縮ファイル (識別子LBZ1) に格納し，全ブロックを出力するステップをキーフレームとする．
+		///       前回出力したブロックを保持するため，対象の系と同じ量のメモリを使用する．非可逆圧縮とは併用できない．
+		///       増分ファイルはBCMFileLoaderで通常のファイルと同様に読み込める．時間差分はキーフレームまでたどって復元されるため，
+		///       連続するステップを読み込む場合はBCMFileLoader::LoadLeafBlockSequential()を使用すると効率が良い．
+		///       分散ファイル形式のDataのみ対応 (共有ファイルおよび集約出力は不可)．増分出力は同期出力となり，I/Oサーバおよび子プロセスによる出力より優先される．
+		///       設定するたびに状態は初期化され，次回の出力は全ブロックとなる．(集団操作)
+		///
+		bool SetIncrementalOutput(const char* name, const int fullInterval, const LB_DELTA delta = LB_DELTA_NONE);
+
+		/// CellIDの圧縮形式を設定
+		///
+		/// @param[in] name  系の名称 (Registerした際に設定した名前)
+		/// @param[in] codec 圧縮形式 (LB_STREAM_CODEC．StreamCodec::Register()で登録した識別番号も可)
+		/// @param[in] param 圧縮形式のパラメータ (LB_STREAM_ZSTDは圧縮レベル，LB_STREAM_LZ4は加速度．0の場合は既定値)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 既定値はLB_STREAM_RLE．BitVoxel化したCellIDを圧縮する．
+		///       LB_STREAM_VRLEはラン長に上限のないRLEで，大きな一様領域を含む形状で符号と展開時間を削減する．
+		///       LB_STREAM_BLOCKはブロックごとに一様な値，BitVoxel，BitVoxelのRLE (LB_STREAM_RLE, LB_STREAM_VRLE) のうち最小のものを選択し，
+		///       BitVoxelのビット幅はブロック内の最大値から決定する．読み込み時は必要なブロックのみ展開する．
+		///       LB_STREAM_RAW, LB_STREAM_RLEはLB01，それ以外はヘッダに圧縮形式を記録したLB02で出力し，
+		///       BCMFileLoaderはファイルのヘッダに従って展開する．(集団操作)
+		///
+		bool SetCellIDCodec(const char* name, const unsigned int codec, const int param = 0);
+
+		/// 値が一定のブロックの縮約出力を設定
+		///
+		/// @param[in] name   系の名称 (Registerした際に設定した名前)
+		/// @param[in] enable 有効にする場合true
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 有効な場合，ブロック内で全セルの値が同じコンポーネント (一様流や0の領域) を1値に縮約し，
+		///       圧縮ファイル (識別子LBZ1) に格納する．圧縮形式を指定していない系も圧縮ファイルとなる．
+		///       読み込み時は値で埋めるためブロック全体を読み込まない．値はビット単位で比較するため可逆．
+		///       分散ファイル形式のDataのみ対応．(集団操作)
+		///
+		bool SetConstantElision(const char* name, const bool enable);
+
+		/// セルのマスクの判定関数 (CellIDを受け取り，値を格納するセルの場合trueを返す)
+		typedef bool (*CellMaskPredicate)(const unsigned char cellID);
+
+		/// CellIDによるセルのマスク出力を設定
+		///
+		/// @param[in] name          系の名称 (Registerした際に設定した名前)
+		/// @param[in] cellIDClassID マスクに使用するCellIDのデータクラスID (-1の場合はマスクしない)
+		/// @param[in] isActive      値を格納するセルの判定関数
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 有効な場合，判定関数がfalseを返すセル (物体内部など) を含むブロックは，
+		///       セルごとのマスク (ビット幅1のBitVoxel) とマスク内のセルの値のみを圧縮ファイル (識別子LBZ1) に格納する．
+		///       全セルがマスク外のブロック (物体内部のブロック) はファイルに格納せず，ブロックごとの格納情報にのみ記録する．
+		///       読み込み時はマスク外のセルをBCMFileLoader::SetMaskFillValue()の値で埋める．マスク内のセルは可逆．
+		///       マスクを含むブロックは圧縮形式や時間差分を使用せず，時間差分の出力は行わない．
+		///       CellIDはScalar3D<unsigned char>で，系の仮想セルサイズ以上の仮想セルを持つこと (小さい場合はエラー)．
+		///       判定関数は設定時に全CellID (0-255) について評価する．分散ファイル形式のDataのみ対応．(集団操作)
+		///
+		bool SetCellMask(const char* name, const int cellIDClassID, CellMaskPredicate isActive);
+
+		/// CellIDによるセルのマスク出力を設定 (指定したCellIDのセルを格納しない)
+		///
+		/// @param[in] name          系の名称 (Registerした際に設定した名前)
+		/// @param[in] cellIDClassID マスクに使用するCellIDのデータクラスID
+		/// @param[in] inactiveID    値を格納しないセルのCellID (物体のIDなど)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		bool SetCellMask(const char* name, const int cellIDClassID, const unsigned char inactiveID);
+
+		/// ファイル上のデータ型を設定 (メモリ上のScalar3Dと異なる型で出力)
+		///
+		/// @param[in] name     系の名称 (Registerした際に設定した名前)
+		/// @param[in] dataType ファイル上のデータ型 (LB_FLOAT16, LB_BFLOAT16を含む)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 出力時にメモリ上の型 (Register時のデータ型) から変換する．倍精度の系を単精度や半精度で出力する場合などに使用する．
+		///       整数型を含む変換はstatic_castと同じ規則に従い，値域外の値は保証しない．
+		///       圧縮形式はファイル上のデータ型に対応していること．メモリチェックポイントもファイル上の型で保持する．
+		///       CellIDには使用できない．(集団操作)
+		///
+		bool SetOutputDataType(const char* name, const LB_DATA_TYPE dataType);
+
+		/// 内部セルのみの出力を設定
+		///
+		/// @param[in] name   系の名称 (Registerした際に設定した名前)
+		/// @param[in] enable 有効にする場合true
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 有効な場合，仮想セルを出力せずにファイルの仮想セルサイズを0とし，
+		///       Register時の仮想セルサイズをインデックスファイルにGhostCellSizeとして記録する．
+		///       読み込み時はBCMFileLoaderが仮想セルの同期 (BlockManager::updateVC) で仮想セルを再構築する．
+		///       外部境界の仮想セルはBCMFileLoader::SetOuterBoundaryFunc()で設定する．
+		///       RestoreLeafBlockMemory()は内部セルのみ復元するため，仮想セルはアプリケーションで同期すること．
+		///       Dataのみ対応．(集団操作)
+		///
+		bool SetInteriorOutput(const char* name, const bool enable);
+
+		/// 増分ファイルを全ブロックを格納したファイルに変換
+		///
+		/// @param[in] name 系の名称 (Registerした際に設定した名前)
+		/// @param[in] step 変換するタイムステップ
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 自プロセスが出力したstepのファイルを，参照先のブロックを集めた通常のLeafBlockファイルに置き換える．
+		///       最後に出力したステップを変換した場合，以降の増分ファイルはそのステップ以降のみを参照するため，
+		///       それより前のステップのファイルを削除できる．
+		///       段階出力を使用している場合は，事前にWaitStaging()で確定すること．(集団操作)
+		///
+		bool CompactLeafBlock(const char* name, const unsigned int step);
+
 		/// ファイル出力を実行
 		///
 		/// @return 成功した場合true, 失敗した場合false
@@ -131,7 +382,135 @@ namespace BCMFileIO {
 		///
 		bool SaveLeafBlock(const char* name, unsigned int step = 0);
 
+		/// リーフブロックのイメージをメモリ上のチェックポイントに保存
+		///
+		/// @param[in] name       系の名称 (Registerした際に設定した名前)
+		/// @param[in] step       タイムステップ
+		/// @param[in] checkpoint 保存先のチェックポイント (本クラスと同じコミュニケータで生成したもの)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note SaveLeafBlock()で分散ファイルに出力するものと同じイメージを，自プロセスと別ノードの
+		///       パートナープロセスのメモリに保持する．ファイルは出力しない．Dataのみ対応．(集団操作)
+		///       頻繁なメモリ上のチェックポイントと，間隔を空けたファイル出力を組み合わせて使用する．
+		///
+		bool SaveLeafBlockMemory(const char* name, const unsigned int step, MemoryCheckpoint& checkpoint);
+
+		/// メモリ上のチェックポイントからリーフブロックを復元
+		///
+		/// @param[in]  name       系の名称 (Registerした際に設定した名前)
+		/// @param[in]  checkpoint SaveLeafBlockMemory()で保存したチェックポイント
+		/// @param[out] step       復元したタイムステップ (NULLの場合は返さない)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ジョブ内でのロールバックに使用する．失われたイメージはパートナーから復元した後，
+		///       登録したデータクラスに出力時の仮想セルサイズの範囲を書き戻す．
+		///       データクラスの仮想セルがそれより大きい場合は，呼び出し後に仮想セルの同期を行うこと．(集団操作)
+		///
+		bool RestoreLeafBlockMemory(const char* name, MemoryCheckpoint& checkpoint, unsigned int* step = NULL);
+
+		/// リーフブロックファイルを非同期に出力
+		///
+		/// @param[in]  name   系の名称 (Registerした際に設定した名前)
+		/// @param[in]  step   タイムステップ
+		/// @param[out] handle 出力ハンドル (NULLの場合は返さない)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 自プロセスのブロックを一時バッファにコピーした時点で戻り，ファイル出力はバックグラウンドスレッドで行う．
+		///       戻った後はブロックの内容を書き換えてよい．出力完了はTestLeafBlock()/WaitLeafBlock()で確認する．
+		///       同時に出力中のステップ数はSetAsyncDepth()で設定した数に制限され，超える場合は空きを待つ．
+		///       CellIDおよび集約/共有ファイル出力するDataは同期出力となり，handleには-1 (完了済み) を返す．
+		///       I/Oサーバまたは段階出力を使用する場合もSaveLeafBlock()で出力し，handleには-1を返す．
+		///
+		bool SaveLeafBlockAsync(const char* name, unsigned int step = 0, int* handle = NULL);
+
+		/// 非同期出力の完了を確認 (待機しない)
+		///
+		/// @param[in]  handle 出力ハンドル
+		/// @param[out] done   自プロセスの出力が完了している場合true
+		/// @return 有効なハンドルの場合true, 不明なハンドルの場合false
+		///
+		bool TestLeafBlock(const int handle, bool* done);
+
+		/// 非同期出力の完了を待機
+		///
+		/// @param[in] handle 出力ハンドル
+		/// @return 全プロセスの出力に成功した場合true, 失敗した場合または不明なハンドルの場合false
+		///
+		/// @note 全プロセスで同じハンドルを指定して呼び出すこと．(集団操作)
+		///       完了済みのハンドルに対して再度呼び出した場合は同じ結果を返す．
+		///
+		bool WaitLeafBlock(const int handle);
+
+		/// 全ての非同期出力の完了を待機
+		///
+		/// @return 全プロセスの出力に成功した場合true, 失敗した場合false
+		///
+		/// @note 全プロセスで呼び出すこと．(集団操作)
+		///
+		bool WaitAllLeafBlock();
+
+		/// 同時に出力中とするステップ数の上限を設定
+		///
+		/// @param[in] depth 上限 (1以上．デフォルトは2)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		bool SetAsyncDepth(const int depth);
+
+		/// 子プロセスによる出力 (fork) の有効/無効を設定
+		///
+		/// @param[in] enable trueの場合，SaveLeafBlock()で分散ファイルのDataを子プロセスで出力
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 有効な場合，SaveLeafBlock()は出力リスト作成後にforkし，子プロセスがコピーオンライトの
+		///       メモリイメージからファイルを出力する間に戻る．一時バッファへのコピーは行わない．
+		///       MPIがNICに登録した (MADV_DONTFORKを設定した) Scalar3Dの領域は子プロセスに存在することが
+		///       保証されないため，RDMAで送受信するバッファを直接出力する場合は使用しないこと．
+		///       子プロセスの出力結果は次回のSaveLeafBlock()呼び出し時に回収され，失敗していた場合はfalseを返す．
+		///       同時に出力中の子プロセス数はSetAsyncDepth()で設定した数に制限される．
+		///       無効にする場合は全ての子プロセスの終了を待つ．(集団操作)
+		///
+		bool SetForkOutput(const bool enable);
+
+		/// 子プロセスによる出力の完了を待機
+		///
+		/// @return 全プロセスの出力に成功した場合true, 失敗した場合false
+		///
+		/// @note 全プロセスで呼び出すこと．(集団操作)
+		///
+		bool WaitForkOutput();
+
 	private:
+		/// 段階出力したファイル
+		struct StagedFile
+		{
+			int         ticket;    ///< コピー要求のチケット番号 (回収済みの場合 STAGE_DRAINED/STAGE_FAILED)
+			std::string localPath; ///< 一時出力先のファイルパス
+			std::string finalPath; ///< 出力ディレクトリのファイルパス
+		};
+
+		/// 同時出力プロセス数の自動調整に使用する系ごとの観測値
+		struct ThrottleSample
+		{
+			int    maxWriters; ///< 観測時の同時出力プロセス数の上限
+			double throughput; ///< 観測したスループット (Byte/秒)
+		};
+
+		/// 回収済みのコピー要求の状態
+		enum StageState
+		{
+			STAGE_DRAINED = -1, ///< コピー成功
+			STAGE_FAILED  = -2  ///< コピー失敗
+		};
+
+		/// セルのマスク出力を設定 (SetCellMask()の共通処理)
+		///
+		/// @param[in] name          系の名称
+		/// @param[in] cellIDClassID マスクに使用するCellIDのデータクラスID (-1の場合はマスクしない)
+		/// @param[in] table         CellIDごとの格納フラグ (256要素)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		bool SetCellMaskTable(const char* name, const int cellIDClassID, const std::vector<unsigned char>& table);
+
 		/// インデックスファイルを出力
 		///
 		/// @param[in] octName  Octreeファイル名
@@ -173,6 +552,40 @@ namespace BCMFileIO {
 		///
 		bool SaveOctree(const std::string& filepath, const BCMOctree* octree);
 
+		/// インデックスファイルの内容を出力 (I/Oサーバ使用時は出力を要求)
+		///
+		/// @param[in] filepath 出力ファイルパス
+		/// @param[in] content  ファイルの内容
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		bool WriteIndexFile(const std::string& filepath, const std::string& content);
+
+		/// 段階出力が有効かを判定
+		///
+		/// @return 段階出力が有効な場合true (I/Oサーバを使用する場合は常にfalse)
+		///
+		bool IsStaging() const { return !m_stageDir.empty() && m_ioClient == NULL; }
+
+		/// インデックスファイルおよびOctreeの出力先ディレクトリを取得
+		///
+		/// @return 段階出力が有効な場合は一時出力先ディレクトリ，そうでない場合は出力ディレクトリ
+		///
+		std::string GetWriteDirectory() const { return IsStaging() ? m_stageDir : m_targetDir; }
+
+		/// 段階出力したファイルの出力ディレクトリへのコピーを登録
+		///
+		/// @param[in]     relPath 出力ディレクトリからの相対パス
+		/// @param[in,out] group   コピーを登録する出力単位
+		///
+		void StageFile(const std::string& relPath, std::vector<StagedFile>& group);
+
+		/// 全プロセスのコピーが完了した出力単位を確定
+		///
+		/// @param[in] maxRemain 確定後に残してよい出力単位数 (超える場合は古いものからコピー完了を待つ)
+		/// @return 全プロセスのコピーおよび確定に成功した場合true (集団操作)
+		///
+		bool CommitStaging(const size_t maxRemain);
+
 		/// CellIDブロックを取得
 		///
 		/// @param[in] ib			インデックスブロック
@@ -181,15 +594,47 @@ namespace BCMFileIO {
 		/// @return CellIDブロックの先頭アドレス
 		///
 		unsigned char* GetCellIDBlock(const IdxBlock* ib, BlockManager& blockManager);
+
+		/// 出力を行った子プロセスの終了状態を回収
+		///
+		/// @param[in] maxRemain 回収後に残してよい子プロセス数 (超える場合は古いものから終了を待つ)
+		/// @return 回収した子プロセスが全て出力に成功していた場合true
+		///
+		bool ReapForkedWriters(const size_t maxRemain);
+
+		/// 観測したスループットに応じて同時に出力するプロセス数の上限を調整
+		///
+		/// @param[in] name    出力した系の名称
+		/// @param[in] bytes   自プロセスがファイルに出力したByte数 (圧縮後)
+		/// @param[in] elapsed 出力時間 (秒)
+		///
+		/// @note スループットは同じ系の前回の観測値と比較する (出力量の異なる系どうしは比較しない)．
+		///       系ごとの最初の観測値は基準として記録するのみで，上限は変更しない．
+		///
+		void AdaptWriteThrottle(const std::string& name, const uint64_t bytes, const double elapsed);
 	private:
-		BlockManager&          m_blockManager;   ///< ブロックマネージャ
-		const MPI::Intracomm&  m_comm;           ///< MPIコミュニケータ
-		const BCMOctree*       m_octree;         ///< BCMOctree
-		const Vec3r            m_globalOrigin;   ///< 計算空間の起点座標
-		const Vec3r            m_globalRegion;   ///< 計算空間全体の領域サイズ
-		IdxUnit                m_unit;           ///< 単位系
-		std::string            m_targetDir;      ///< ファイル出力ターゲットディレクトリ名
-		std::vector<IdxBlock>  m_idxBlockList;   ///< 登録されたブロック情報リスト
+		BlockManager&          m_blockManager;      ///< ブロックマネージャ
+		const MPI::Intracomm&  m_comm;              ///< MPIコミュニケータ
+		const BCMOctree*       m_octree;            ///< BCMOctree
+		const Vec3r            m_globalOrigin;      ///< 計算空間の起点座標
+		const Vec3r            m_globalRegion;      ///< 計算空間全体の領域サイズ
+		IdxUnit                m_unit;              ///< 単位系
+		std::string            m_targetDir;         ///< ファイル出力ターゲットディレクトリ名
+		std::vector<IdxBlock>  m_idxBlockList;      ///< 登録されたブロック情報リスト
+		DataIOConfig           m_ioConfig;          ///< 物理量の出力設定
+		AsyncWriter            m_asyncWriter;       ///< 非同期出力スレッド
+		int                    m_asyncDepth;        ///< 同時に出力中とするステップ数の上限
+		bool                   m_forkOutput;        ///< 子プロセスによる出力フラグ
+		std::vector<pid_t>     m_forkedWriters;     ///< 出力中の子プロセスのプロセスID
+		bool                   m_throttleAdaptive;  ///< 同時出力プロセス数の自動調整フラグ
+		int                    m_throttleDirection; ///< 同時出力プロセス数の調整方向 (1: 増加, -1: 減少)
+		std::map<std::string, ThrottleSample> m_throttleSamples; ///< 系の名称ごとの前回の観測値
+		IOServerClient*        m_ioClient;          ///< I/Oサーバへの要求の送信先 (I/Oサーバを使用しない場合NULL)
+		std::string            m_stageDir;          ///< 段階出力の一時出力先ディレクトリ (使用しない場合は空)
+		bool                   m_stageKeepLocal;    ///< 確定後に一時出力先のファイルを残すフラグ
+		AsyncWriter            m_drainer;           ///< 段階出力のコピースレッド
+		std::deque< std::vector<StagedFile> > m_stageGroups; ///< 確定待ちの出力単位
+		std::map<std::string, DataDeltaState> m_deltaStates; ///< 系の名称ごとの増分出力の状態
 	};
 
 } // namespace BCMFileIO
@@ -26,6 +26,10 @@
 namespace BCMFileIO {
 
 	/// ビットボクセル圧縮/展開ライブラリ
+	///
+	/// @note ビット幅1-8はビット幅ごとの実装でビットボクセル1要素単位に処理する．
+	///       x86-64 (GCC/Clang) ではBMI2 (pext/pdep) の実装をCPUに応じて実行時に選択する．
+	///
 	class BitVoxel {
 	public:
 
@@ -70,6 +74,24 @@ namespace BCMFileIO {
 		/// @note returnされたポインタは適宜解放(delete)してください．
 		///
 		static unsigned char* Decompress( const size_t voxelSize, const bitVoxelCell* bitVoxel, const unsigned char  bitWidth);
+
+		/// ビットボクセル圧縮 (出力先を指定)
+		///
+		/// @param[out] bitVoxel  出力ビットボクセル (GetSize(voxelSize, bitWidth)要素)
+		/// @param[in]  voxelSize 入力ボクセルサイズ
+		/// @param[in]  voxel     入力ボクセルの先頭ポインタ
+		/// @param[in]  bitWidth  ビット幅
+		///
+		static void CompressTo( bitVoxelCell* bitVoxel, const size_t voxelSize, const unsigned char* voxel, const unsigned char bitWidth);
+
+		/// ビットボクセル展開 (出力先を指定)
+		///
+		/// @param[out] voxel     出力ボクセル (voxelSize要素)
+		/// @param[in]  voxelSize ボクセルサイズ (展開後のボクセル数)
+		/// @param[in]  bitVoxel  入力ビットボクセル
+		/// @param[in]  bitWidth  ビット幅
+		///
+		static void DecompressTo( unsigned char* voxel, const size_t voxelSize, const bitVoxelCell* bitVoxel, const unsigned char bitWidth);
 	};
 
 } // namespace BCMFileIO
@@ -0,0 +1,273 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  BlockCodec.h
+/// @brief 物理量リーフブロックの圧縮/展開ライブラリ
+///
+
+#ifndef __BCMTOOLS_BLOCK_CODEC_H__
+#define __BCMTOOLS_BLOCK_CODEC_H__
+
+#include <cstdlib>
+#include <vector>
+
+#include "BCMFileCommon.h"
+#include "Vec3.h"
+
+using namespace Vec3class;
+
+namespace BCMFileIO {
+
+	/// 物理量リーフブロックの圧縮/展開ライブラリ
+	///
+	/// @note LB_CODEC_LORENZOは以下の順に符号化する．
+	///       1. 浮動小数点のビット列を大小関係を保つ符号なし整数に変換
+	///       2. コンポーネントごとに仮想セルを含むブロック内で3次元Lorenzo予測 (ブロック外の隣接セルは0とする)
+	///       3. 実際の値と予測値のXORを残差とする
+	///       4. 残差を上位バイトから順にバイトプレーンに分割 (滑らかなデータでは上位プレーンがほぼ0になる)
+	///       5. ゼロランとリテラルの連長符号化
+	///       予測は整数演算のみで行うため，展開結果は環境に依存せずビット単位で一致する．
+	///       LB_CODEC_ABSERR, LB_CODEC_RELERRは値を誤差上限の2倍の幅で整数に量子化し，
+	///       量子化した整数の3次元Lorenzo予測の差分をジグザグ変換し，ビットプレーン分割とゼロラン符号で符号化する．
+	///       全セルについて復元値の誤差が上限以下であることを符号化時に確認し，
+	///       満たせないブロック (非有限値を含む場合など) はLB_CODEC_LORENZOで可逆に符号化する．
+	///       符号はバイト順に依存しない．
+	///
+	class BlockCodec {
+	public:
+
+		/// 圧縮形式がデータ型に対応しているかを判定
+		///
+		/// @param[in] codec    圧縮形式
+		/// @param[in] dataType データ型
+		/// @return 対応している場合true
+		///
+		static bool IsSupported(const LB_CODEC codec, const LB_DATA_TYPE dataType);
+
+		/// 1ブロック (全コンポーネント) を圧縮
+		///
+		/// @param[in]  codec        圧縮形式
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  errorBound   誤差上限 (LB_CODEC_ABSERR, LB_CODEC_RELERRのみ使用)
+		/// @param[in]  src          ファイルと同じ並びのブロック (実行環境のバイト順)
+		/// @param[out] dst          符号 (上書き)
+		///
+		static void Encode(const LB_CODEC       codec,
+		                   const LB_DATA_TYPE   dataType,
+		                   const Vec3i&         size,
+		                   const int            numComponent,
+		                   const double         errorBound,
+		                   const unsigned char* src,
+		                   std::vector<unsigned char>& dst);
+
+		/// 圧縮形式が非可逆かを判定
+		///
+		/// @param[in] codec 圧縮形式
+		/// @return 非可逆の場合true
+		///
+		static bool IsLossy(const LB_CODEC codec){ return codec == LB_CODEC_ABSERR || codec == LB_CODEC_RELERR; }
+
+		/// 1ブロック (全コンポーネント) を展開
+		///
+		/// @param[in]  codec        圧縮形式
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          符号
+		/// @param[in]  srcSize      符号のサイズ (Byte単位)
+		/// @param[out] dst          展開先 (ファイルと同じ並び，実行環境のバイト順)
+		/// @return 成功した場合true, 符号が壊れている場合false
+		///
+		static bool Decode(const LB_CODEC       codec,
+		                   const LB_DATA_TYPE   dataType,
+		                   const Vec3i&         size,
+		                   const int            numComponent,
+		                   const unsigned char* src,
+		                   const size_t         srcSize,
+		                   unsigned char*       dst);
+
+		/// 1ブロック (全コンポーネント) の時間差分を圧縮
+		///
+		/// @param[in]  delta        時間差分形式 (LB_DELTA_XOR, LB_DELTA_SUB)
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          ブロック (実行環境のバイト順)
+		/// @param[in]  base         基準ステップの同じブロック (実行環境のバイト順)
+		/// @param[out] dst          符号 (上書き)
+		///
+		/// @note LB_DELTA_XORは要素ごとのXOR，LB_DELTA_SUBは要素ごとの差分をさらに3次元Lorenzo予測した残差を
+		///       ジグザグ変換し，バイトプレーンに分割してゼロラン符号化する．全データ型に対応し，可逆．
+		///
+		static void EncodeDelta(const LB_DELTA       delta,
+		                        const LB_DATA_TYPE   dataType,
+		                        const Vec3i&         size,
+		                        const int            numComponent,
+		                        const unsigned char* src,
+		                        const unsigned char* base,
+		                        std::vector<unsigned char>& dst);
+
+		/// 1ブロック (全コンポーネント) の時間差分を展開
+		///
+		/// @param[in]  delta        時間差分形式 (LB_DELTA_XOR, LB_DELTA_SUB)
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          符号
+		/// @param[in]  srcSize      符号のサイズ (Byte単位)
+		/// @param[in]  base         基準ステップの同じブロック (実行環境のバイト順)
+		/// @param[out] dst          展開先 (実行環境のバイト順)
+		/// @return 成功した場合true, 符号が壊れている場合false
+		///
+		static bool DecodeDelta(const LB_DELTA       delta,
+		                        const LB_DATA_TYPE   dataType,
+		                        const Vec3i&         size,
+		                        const int            numComponent,
+		                        const unsigned char* src,
+		                        const size_t         srcSize,
+		                        const unsigned char* base,
+		                        unsigned char*       dst);
+
+		/// 1ブロック中で値が一定のコンポーネントを1値に縮約
+		///
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          ブロック (ファイルと同じ並び)
+		/// @param[out] dst          縮約した符号 (上書き．一定のコンポーネントがない場合は空)
+		/// @return 一定のコンポーネントがある場合true
+		///
+		/// @note 符号はコンポーネントごとのフラグ (1: 一定) をnumComponentバイト並べた後に，
+		///       一定のコンポーネントは1値，それ以外はコンポーネント全体をsrcのバイト順のまま並べる．
+		///       値の比較はビット単位で行う (-0.0と0.0は区別し，同じビット列のNaNは一定とみなす)．
+		///
+		static bool EncodeConstant(const LB_DATA_TYPE   dataType,
+		                           const Vec3i&         size,
+		                           const int            numComponent,
+		                           const unsigned char* src,
+		                           std::vector<unsigned char>& dst);
+
+		/// EncodeConstant()の符号を展開 (一定のコンポーネントは値で埋める)
+		///
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          符号
+		/// @param[in]  srcSize      符号のサイズ (Byte単位)
+		/// @param[out] dst          展開先 (ファイルと同じ並び，符号と同じバイト順)
+		/// @return 成功した場合true, 符号が壊れている場合false
+		///
+		static bool DecodeConstant(const LB_DATA_TYPE   dataType,
+		                           const Vec3i&         size,
+		                           const int            numComponent,
+		                           const unsigned char* src,
+		                           const size_t         srcSize,
+		                           unsigned char*       dst);
+
+		/// 1ブロック中のマスク外のセルを除いて格納
+		///
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          ブロック (ファイルと同じ並び)
+		/// @param[in]  active       セルごとのマスク (1: 格納するセル, 0: 格納しないセル．ファイルと同じ並び)
+		/// @param[out] dst          符号 (上書き．格納しないセルがない場合は空)
+		/// @return 格納しないセルがある場合true
+		///
+		/// @note 符号はマスクをビット幅1のBitVoxel (GetSize(セル数, 1)要素) として並べた後に，
+		///       コンポーネントごとにマスク内のセルの値のみをsrcのバイト順のまま並べる．
+		///       BitVoxelの要素もsrcのバイト順で格納する．
+		///
+		static bool EncodeMasked(const LB_DATA_TYPE   dataType,
+		                         const Vec3i&         size,
+		                         const int            numComponent,
+		                         const unsigned char* src,
+		                         const unsigned char* active,
+		                         std::vector<unsigned char>& dst);
+
+		/// EncodeMasked()の符号を展開 (マスク外のセルは指定した値で埋める)
+		///
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  src          符号
+		/// @param[in]  srcSize      符号のサイズ (Byte単位)
+		/// @param[in]  fill         マスク外のセルの値 (データ型に変換して埋める)
+		/// @param[in]  isNeedSwap   符号のバイトスワップの要否
+		/// @param[out] dst          展開先 (ファイルと同じ並び，符号と同じバイト順)
+		/// @return 成功した場合true, 符号が壊れている場合false
+		///
+		static bool DecodeMasked(const LB_DATA_TYPE   dataType,
+		                         const Vec3i&         size,
+		                         const int            numComponent,
+		                         const unsigned char* src,
+		                         const size_t         srcSize,
+		                         const double         fill,
+		                         const bool           isNeedSwap,
+		                         unsigned char*       dst);
+
+		/// 1ブロック (全コンポーネント) を指定した値で埋める
+		///
+		/// @param[in]  dataType     データ型
+		/// @param[in]  size         仮想セルを含むブロックサイズ
+		/// @param[in]  numComponent コンポーネント数
+		/// @param[in]  fill         値 (データ型に変換して埋める)
+		/// @param[in]  isNeedSwap   バイトスワップした値で埋める場合true
+		/// @param[out] dst          展開先 (ファイルと同じ並び)
+		///
+		static void Fill(const LB_DATA_TYPE dataType,
+		                 const Vec3i&       size,
+		                 const int          numComponent,
+		                 const double       fill,
+		                 const bool         isNeedSwap,
+		                 unsigned char*     dst);
+
+	private:
+		/// 値をデータ型に変換 (isNeedSwapの場合はバイトスワップ)
+		static void ConvertFillValue(const LB_DATA_TYPE dataType, const double fill, const bool isNeedSwap, unsigned char* value);
+
+		template<typename U>
+		static void EncodeDelta(const bool isXor, const bool isFloat, const Vec3i& size, const int numComponent,
+		                        const unsigned char* src, const unsigned char* base, std::vector<unsigned char>& dst);
+
+		template<typename U>
+		static bool DecodeDelta(const bool isXor, const bool isFloat, const Vec3i& size, const int numComponent,
+		                        const unsigned char* src, const size_t srcSize, const unsigned char* base, unsigned char* dst);
+
+		template<typename U>
+		static void EncodeLorenzo(const Vec3i& size, const int numComponent, const unsigned char* src, std::vector<unsigned char>& dst);
+
+		template<typename U>
+		static bool DecodeLorenzo(const Vec3i& size, const int numComponent, const unsigned char* src, const size_t srcSize, unsigned char* dst);
+
+		template<typename T, typename U>
+		static void EncodeQuantize(const Vec3i& size, const int numComponent, const double bound, const bool relative,
+		                           const unsigned char* src, std::vector<unsigned char>& dst);
+
+		template<typename T, typename U>
+		static bool DecodeQuantize(const Vec3i& size, const int numComponent, const unsigned char* src, const size_t srcSize, unsigned char* dst);
+
+		/// ゼロランとリテラルの連長符号化 (dstに追記)
+		static void EncodeRun(const unsigned char* src, const size_t size, std::vector<unsigned char>& dst);
+
+		/// ゼロランとリテラルの連長符号を展開 (dstSizeちょうどに展開できない場合false)
+		static bool DecodeRun(const unsigned char* src, const size_t srcSize, unsigned char* dst, const size_t dstSize);
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_BLOCK_CODEC_H__
@@ -34,7 +34,7 @@ namespace BCMFileIO {
 		/// @param[in] comm MPIコミュニケータ
 		/// @return 1プロセスでもエラーがある場合trueを返す．全プロセスでエラーが無い場合false
 		///
-		static bool reduceError( const bool err, MPI::Intracomm& comm = MPI::COMM_WORLD );
+		static bool reduceError( const bool err, const MPI::Intracomm& comm = MPI::COMM_WORLD );
 	};
 
 } // namespace BCMFileIO
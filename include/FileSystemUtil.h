@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <cstdio>
 
 #include <string>
 #include <vector>
@@ -141,6 +142,141 @@ namespace BCMFileIO {
 			return true;
 		}
 
+		/// ファイルをコピー
+		///
+		/// @param[in]	source		コピー元ファイルパス
+		/// @param[in]	dest		コピー先ファイルパス (ディレクトリは作成済みであること)
+		/// @return true: コピー成功、false: コピー失敗
+		///
+		/// @note コピー先はディスクへの書き出し (fsync) まで行う．
+		///
+		static bool CopyFile(const std::string& source, const std::string& dest)
+		{
+			FILE* ifp = fopen(source.c_str(), "rb");
+			if( ifp == NULL ){
+				Logger::Error("cannot open file : %s\n", source.c_str());
+				return false;
+			}
+			FILE* ofp = fopen(dest.c_str(), "wb");
+			if( ofp == NULL ){
+				Logger::Error("cannot open file : %s\n", dest.c_str());
+				fclose(ifp);
+				return false;
+			}
+
+			const size_t bufSize = 4 * 1024 * 1024;
+			std::vector<char> buf(bufSize);
+
+			bool ret = true;
+			size_t n;
+			while( (n = fread(&buf[0], 1, bufSize, ifp)) > 0 ){
+				if( fwrite(&buf[0], 1, n, ofp) != n ){ ret = false; break; }
+			}
+			if( ferror(ifp) ){ ret = false; }
+
+			if( fflush(ofp) != 0 ){ ret = false; }
+#ifndef _WIN32
+			if( ret && fsync(fileno(ofp)) != 0 ){ ret = false; }
+#endif
+			if( fclose(ofp) != 0 ){ ret = false; }
+			fclose(ifp);
+
+			if( !ret ){
+				Logger::Error("cannot copy file : %s -> %s\n", source.c_str(), dest.c_str());
+			}
+			return ret;
+		}
+
+		/// ファイルサイズを取得
+		///
+		/// @param[in]	path	ファイルパス
+		/// @return ファイルサイズ (Byte単位)．ファイルが存在しない場合-1
+		///
+		static off_t GetFileSize(const std::string& path)
+		{
+			struct stat st;
+			if( stat(path.c_str(), &st) != 0 ){
+				return -1;
+			}
+			return st.st_size;
+		}
+
+		/// ファイルの識別情報 (サイズ，更新時刻，iノード番号) を取得
+		///
+		/// @param[in]	path	ファイルパス
+		/// @return "サイズ 更新時刻 iノード番号" の文字列．ファイルが存在しない場合は空文字列
+		///
+		static std::string GetFileStamp(const std::string& path)
+		{
+			struct stat st;
+			if( stat(path.c_str(), &st) != 0 ){
+				return std::string("");
+			}
+			char stamp[64];
+			sprintf(stamp, "%lld %lld %llu", static_cast<long long>(st.st_size), static_cast<long long>(st.st_mtime),
+			        static_cast<unsigned long long>(st.st_ino));
+			return std::string(stamp);
+		}
+
+		/// 段階出力のコピーの確定記録を出力 ("<一時出力先のファイル>.commit")
+		///
+		/// @param[in]	localPath	一時出力先のファイルパス
+		/// @param[in]	finalPath	確定した出力先のファイルパス
+		/// @return true: 出力成功、false: 出力失敗
+		///
+		/// @note 確定時点の両ファイルの識別情報を記録する．
+		///
+		static bool WriteCommitStamp(const std::string& localPath, const std::string& finalPath)
+		{
+			const std::string localStamp = GetFileStamp(localPath);
+			const std::string finalStamp = GetFileStamp(finalPath);
+			if( localStamp.empty() || finalStamp.empty() ){
+				return false;
+			}
+			FILE* fp = fopen((localPath + std::string(".commit")).c_str(), "w");
+			if( fp == NULL ){
+				return false;
+			}
+			bool ret = fprintf(fp, "%s\n%s\n", localStamp.c_str(), finalStamp.c_str()) > 0;
+			if( fclose(fp) != 0 ){ ret = false; }
+			return ret;
+		}
+
+		/// 段階出力のコピーの確定記録を削除
+		///
+		/// @param[in]	localPath	一時出力先のファイルパス
+		///
+		static void RemoveCommitStamp(const std::string& localPath)
+		{
+			remove((localPath + std::string(".commit")).c_str());
+		}
+
+		/// 一時出力先のファイルが確定した出力先のファイルと同じ内容かを確認
+		///
+		/// @param[in]	localPath	一時出力先のファイルパス
+		/// @param[in]	finalPath	出力先のファイルパス
+		/// @return true: 確定記録があり，両ファイルが記録時から変更されていない場合
+		///
+		/// @note 以前の実行や中断したコピーで残った一時出力先のファイルは，確定記録がないか
+		///       識別情報が一致しないため使用しない．
+		///
+		static bool IsCommittedCopy(const std::string& localPath, const std::string& finalPath)
+		{
+			FILE* fp = fopen((localPath + std::string(".commit")).c_str(), "r");
+			if( fp == NULL ){
+				return false;
+			}
+			char line[2][64] = { {0}, {0} };
+			bool ret = fgets(line[0], sizeof(line[0]), fp) != NULL && fgets(line[1], sizeof(line[1]), fp) != NULL;
+			fclose(fp);
+			if( !ret ){
+				return false;
+			}
+			const std::string localStamp = GetFileStamp(localPath) + std::string("\n");
+			const std::string finalStamp = GetFileStamp(finalPath) + std::string("\n");
+			return localStamp == std::string(line[0]) && finalStamp == std::string(line[1]);
+		}
+
 		/// 文字列を指定の区切り文字で分割
 		///
 		/// @param[in]	input		入力文字列
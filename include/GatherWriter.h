@@ -0,0 +1,187 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  GatherWriter.h
+/// @brief 複数のメモリ領域を1ファイルにまとめて出力するクラス (scatter/gather I/O)
+///
+
+#ifndef __BCMTOOLS_GATHER_WRITER_H__
+#define __BCMTOOLS_GATHER_WRITER_H__
+
+#include <mpi.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace BCMFileIO {
+
+	/// 複数のメモリ領域を1ファイルにまとめて出力するクラス
+	///
+	/// @note 登録した領域はコピーせずにwritevで出力する．
+	///       Allocate()で確保したバッファのみ本クラスが所有し，デストラクタで解放する．
+	///
+	class GatherWriter {
+	public:
+
+		/// コンストラクタ
+		GatherWriter();
+
+		/// デストラクタ
+		~GatherWriter();
+
+		/// 出力領域を登録 (コピーなし)
+		///
+		/// @param[in] ptr  領域の先頭アドレス
+		/// @param[in] size 領域のサイズ (Byte単位)
+		///
+		/// @note 直前に登録した領域と連続する場合，1つの領域に統合される．
+		///       出力が完了するまで領域の内容を保持すること．
+		///
+		void Add(const void* ptr, const size_t size);
+
+		/// 他の出力リストの登録済み領域の一部を登録 (コピーなし)
+		///
+		/// @param[in] src   登録元の出力リスト
+		/// @param[in] begin 連結した登録元データ内の開始位置 (Byte単位)
+		/// @param[in] size  登録するサイズ (Byte単位)
+		///
+		/// @note 出力が完了するまで登録元の領域を保持すること．
+		///
+		void AddRange(const GatherWriter& src, const size_t begin, const size_t size);
+
+		/// 内部バッファを確保
+		///
+		/// @param[in] size バッファサイズ (Byte単位)
+		/// @return 確保したバッファの先頭アドレス
+		///
+		/// @note 確保したバッファは出力領域として登録されない．Add()で登録すること．
+		///
+		unsigned char* Allocate(const size_t size);
+
+		/// 登録済み領域の総サイズを取得
+		///
+		/// @return 総サイズ (Byte単位)
+		///
+		size_t GetSize() const { return m_size; }
+
+		/// 登録済み領域数を取得
+		///
+		/// @return 領域数
+		///
+		size_t GetNumSegment() const { return m_segments.size(); }
+
+		/// 登録済み領域を取得
+		///
+		/// @param[in] i 領域のインデックス
+		/// @return 領域情報
+		///
+		const struct iovec& GetSegment(const size_t i) const { return m_segments[i]; }
+
+		/// 登録済み領域をファイルに出力
+		///
+		/// @param[in] filepath 出力ファイルパス
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		bool Write(const std::string& filepath) const;
+
+		/// 登録済み領域をファイルディスクリプタに出力
+		///
+		/// @param[in] fd ファイルディスクリプタ
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		bool Write(const int fd) const;
+
+		/// 出力用の領域リストを作成
+		///
+		/// @param[out] iov 登録済み領域のリスト (Write(fd, iov)に渡す)
+		///
+		/// @note fork後の子プロセスではメモリを確保せずに出力する必要があるため，fork前に作成する．
+		///
+		void PrepareIov(std::vector<struct iovec>& iov) const { iov = m_segments; }
+
+		/// 事前に作成した領域リストをファイルディスクリプタに出力
+		///
+		/// @param[in]     fd  ファイルディスクリプタ
+		/// @param[in,out] iov PrepareIov()で作成した領域リスト (出力済みの領域を進めるため書き換えられる)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note メモリ確保およびロガーの呼び出しを行わないため，fork後の子プロセスから呼び出せる．
+		///
+		static bool Write(const int fd, std::vector<struct iovec>& iov);
+
+		/// 登録済み領域をMPI-IOの共有ファイルに集団出力
+		///
+		/// @param[in] fh     MPIファイルハンドル
+		/// @param[in] offset 出力先のファイル内オフセット (Byte単位)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 登録済み領域をhindexed型で記述し，コピーせずにMPI_File_write_at_allで出力する．
+		///       集団操作のため，出力する領域がないプロセスも呼び出すこと．
+		///
+		bool WriteAtAll(MPI_File fh, const MPI_Offset offset) const;
+
+		/// 登録済み領域の一部をMPIデータ型として記述
+		///
+		/// @param[in]  begin 連結した出力データ内の開始位置 (Byte単位)
+		/// @param[in]  size  記述するサイズ (Byte単位)
+		/// @param[out] type  MPI_BOTTOMを基点とするコミット済みのデータ型 (MPI_Type_freeで解放すること)
+		///
+		/// @note コピーせずに送信/出力するために使用する
+		///
+		void CreateDatatype(const size_t begin, const size_t size, MPI_Datatype* type) const;
+
+		/// 登録済み領域の一部のハッシュ値を計算
+		///
+		/// @param[in] begin 連結した出力データ内の開始位置 (Byte単位)
+		/// @param[in] size  計算するサイズ (Byte単位)
+		/// @return 64bit FNV-1aハッシュ値
+		///
+		/// @note 増分出力で前回の出力から内容が変化したブロックを判定するために使用する
+		///
+		uint64_t Hash(const size_t begin, const size_t size) const;
+
+		/// 登録済み領域を連続バッファにコピー
+		///
+		/// @param[out] dst コピー先バッファ (GetSize()以上のサイズが必要)
+		///
+		void CopyTo(unsigned char* dst) const;
+
+		/// 登録済み領域の一部を連続バッファにコピー
+		///
+		/// @param[out] dst   コピー先バッファ (size以上のサイズが必要)
+		/// @param[in]  begin 連結した出力データ内の開始位置 (Byte単位)
+		/// @param[in]  size  コピーするサイズ (Byte単位)
+		///
+		void CopyTo(unsigned char* dst, const size_t begin, const size_t size) const;
+
+		/// 登録済み領域と内部バッファを破棄
+		void Clear();
+
+	private:
+		GatherWriter(const GatherWriter&);
+		GatherWriter& operator=(const GatherWriter&);
+
+	private:
+		std::vector<struct iovec>   m_segments; ///< 出力領域リスト
+		std::vector<unsigned char*> m_buffers;  ///< 内部バッファリスト
+		size_t                      m_size;     ///< 登録済み領域の総サイズ
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_GATHER_WRITER_H__
@@ -0,0 +1,246 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  IOServer.h
+/// @brief 計算プロセスから受け取ったデータをファイルに出力するI/Oサーバ
+///
+
+#ifndef __BCMTOOLS_IO_SERVER_H__
+#define __BCMTOOLS_IO_SERVER_H__
+
+#include <mpi.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "BCMFileCommon.h"
+
+namespace BCMFileIO {
+
+	/// I/Oサーバへの要求の種類
+	enum IOSERVER_REQUEST_TYPE
+	{
+		IOSERVER_WRITE_FILE = 0, ///< 受信したデータをそのままファイルに出力
+		IOSERVER_WRITE_CELLID,   ///< 受信したCellIDを圧縮してリーフブロックファイルに出力
+		IOSERVER_CLOSE           ///< 要求の終了
+	};
+
+	/// I/Oサーバへの要求
+	struct IOServerRequest
+	{
+		int          type;       ///< 要求の種類 (IOSERVER_REQUEST_TYPE)
+		int          pathLength; ///< 出力ファイルパスの長さ
+		uint64_t     dataSize;   ///< データサイズ (Byte単位)
+		LBHeader     header;     ///< リーフブロックヘッダ (CellID出力時のみ使用)
+		unsigned int codec;      ///< 圧縮形式 (LB_STREAM_CODEC．CellID出力時のみ使用)
+		int          codecParam; ///< 圧縮形式のパラメータ (CellID出力時のみ使用)
+	};
+
+	/// 計算プロセスから受け取ったデータをファイルに出力するI/Oサーバ
+	///
+	/// @note コミュニケータの先頭から計算プロセス，末尾のnumServers個のプロセスをI/Oサーバとする．
+	///       計算プロセスiの要求はI/Oサーバ (i % numServers) が処理する．
+	///       出力要求ごとに出力結果を要求元の計算プロセスへ返信する．
+	///
+	class IOServer {
+	public:
+
+		/// コンストラクタ
+		///
+		/// @param[in] comm       計算プロセスとI/Oサーバを含むコミュニケータ
+		/// @param[in] numServers I/Oサーバのプロセス数
+		///
+		/// @note commを複製するため，commの全プロセスでIOServerまたはIOServerClientを生成すること．(集団操作)
+		///
+		IOServer(const MPI::Intracomm& comm, const int numServers);
+
+		/// デストラクタ
+		~IOServer();
+
+		/// 担当する全ての計算プロセスから終了要求を受け取るまで出力要求を処理
+		///
+		/// @return 全ての出力に成功した場合true, 失敗した場合false
+		///
+		bool Run();
+
+		/// 自プロセスがI/Oサーバであるかを判定
+		///
+		/// @param[in] comm       計算プロセスとI/Oサーバを含むコミュニケータ
+		/// @param[in] numServers I/Oサーバのプロセス数
+		/// @return I/Oサーバの場合true
+		///
+		static bool IsServer(const MPI::Intracomm& comm, const int numServers);
+
+		/// 計算プロセスとI/Oサーバでコミュニケータを分割
+		///
+		/// @param[in] comm       計算プロセスとI/Oサーバを含むコミュニケータ
+		/// @param[in] numServers I/Oサーバのプロセス数
+		/// @return 自プロセスが属する側 (計算プロセスまたはI/Oサーバ) のコミュニケータ
+		///
+		/// @note 計算プロセス側のコミュニケータでBlockManagerおよびBCMFileSaverを構築する．(集団操作)
+		///
+		static MPI::Intracomm SplitComm(const MPI::Intracomm& comm, const int numServers);
+
+		/// 計算プロセスの要求を処理するI/Oサーバのランク番号を取得
+		///
+		/// @param[in] commSize   コミュニケータのプロセス数
+		/// @param[in] numServers I/Oサーバのプロセス数
+		/// @param[in] clientRank 計算プロセスのランク番号
+		/// @return I/Oサーバのランク番号
+		///
+		static int GetServerRank(const int commSize, const int numServers, const int clientRank);
+
+	private:
+		IOServer(const IOServer&);
+		IOServer& operator=(const IOServer&);
+
+		/// 出力要求を1つ処理
+		///
+		/// @param[in] source  要求元の計算プロセスのランク番号
+		/// @param[in] request 要求
+		/// @return 出力に成功した場合true, 失敗した場合false
+		///
+		bool Process(const int source, const IOServerRequest& request);
+
+	private:
+		MPI::Intracomm m_comm;       ///< 要求の送受信用コミュニケータ (複製)
+		int            m_numServers; ///< I/Oサーバのプロセス数
+	};
+
+	/// I/Oサーバへ出力要求を送る計算プロセス側のクラス
+	///
+	/// @note 要求とデータはノンブロッキング送信し，送信の完了を待たずに戻る．
+	///       送信中のバッファは，送信とI/Oサーバからの出力結果の受信が完了した後に解放される．
+	///       I/Oサーバでの出力の失敗はCollectStatus()，WaitAll()およびClose()の戻り値で確認する．
+	///
+	class IOServerClient {
+	public:
+
+		/// コンストラクタ
+		///
+		/// @param[in] comm        計算プロセスとI/Oサーバを含むコミュニケータ
+		/// @param[in] numServers  I/Oサーバのプロセス数
+		/// @param[in] maxInFlight 同時に処理中 (出力結果を受信していない) とする要求の最大数
+		///
+		/// @note commを複製するため，commの全プロセスでIOServerまたはIOServerClientを生成すること．(集団操作)
+		///
+		IOServerClient(const MPI::Intracomm& comm, const int numServers, const int maxInFlight = 2);
+
+		/// デストラクタ
+		///
+		/// @note 送信中の要求の完了を待つ．終了要求は送らないため，事前にClose()を呼び出すこと．
+		///
+		~IOServerClient();
+
+		/// 同時に処理中とする要求の最大数を設定
+		///
+		/// @param[in] maxInFlight 要求の最大数 (1以上)
+		///
+		void SetMaxInFlight(const int maxInFlight);
+
+		/// ファイル出力を要求
+		///
+		/// @param[in] filepath 出力ファイルパス
+		/// @param[in] data     出力データ (new[]で確保した領域．所有権を移譲)
+		/// @param[in] size     データサイズ (Byte単位)
+		/// @return 要求を送信した場合true, 失敗した場合false
+		///
+		bool WriteFile(const std::string& filepath, unsigned char* data, const uint64_t size);
+
+		/// CellIDのリーフブロックファイル出力を要求
+		///
+		/// @param[in] filepath 出力ファイルパス
+		/// @param[in] header   リーフブロックヘッダ (numBlockに自プロセスのブロック数を設定)
+		/// @param[in] data     CellIDが格納されたデータバッファ (new[]で確保した領域．所有権を移譲)
+		/// @param[in] size     データサイズ (Byte単位)
+		/// @param[in] codec    圧縮形式 (LB_STREAM_CODEC．I/Oサーバで登録されていること)
+		/// @param[in] param    圧縮形式のパラメータ
+		/// @return 要求を送信した場合true, 失敗した場合false
+		///
+		/// @note BitVoxel化および圧縮はI/Oサーバで行う．
+		///
+		bool WriteCellID(const std::string& filepath, const LBHeader& header, unsigned char* data, const uint64_t size,
+		                 const unsigned int codec, const int param);
+
+		/// 完了した要求の出力結果を回収
+		///
+		/// @param[in] wait trueの場合，処理中の全ての要求の完了を待つ
+		/// @return 前回の回収以降に完了した要求の出力が全て成功した場合true, 失敗を含む場合false
+		///
+		bool CollectStatus(const bool wait);
+
+		/// 処理中の全ての要求の完了を待機
+		///
+		/// @return 前回の回収以降に完了した要求の出力が全て成功した場合true, 失敗を含む場合false
+		///
+		bool WaitAll();
+
+		/// I/Oサーバへ終了要求を送信
+		///
+		/// @return 前回の回収以降に完了した要求の出力が全て成功した場合true, 失敗を含む場合false
+		///
+		/// @note 処理中の要求の完了を待ってから戻る．以降の要求は失敗する．
+		///
+		bool Close();
+
+		/// 終了要求を送信済みかを判定
+		///
+		/// @return 送信済みの場合true
+		///
+		bool IsClosed() const { return m_closed; }
+
+	private:
+		IOServerClient(const IOServerClient&);
+		IOServerClient& operator=(const IOServerClient&);
+
+		/// 要求とデータを送信
+		///
+		/// @param[in] request  要求 (pathLength, dataSizeはここで設定)
+		/// @param[in] filepath 出力ファイルパス
+		/// @param[in] data     出力データ (所有権を移譲)
+		/// @param[in] size     データサイズ (Byte単位)
+		/// @return 要求を送信した場合true, 失敗した場合false
+		///
+		bool Send(const IOServerRequest& request, const std::string& filepath, unsigned char* data, const uint64_t size);
+
+		/// 送信と出力結果の受信が完了した要求を回収
+		///
+		/// @param[in] maxRemain 回収後に残してよい要求数 (超える場合は古いものから完了を待つ)
+		///
+		void Reap(const size_t maxRemain);
+
+	private:
+		/// 送信中の要求
+		struct PendingSend
+		{
+			IOServerRequest           request;  ///< 要求
+			std::string               filepath; ///< 出力ファイルパス
+			unsigned char*            data;     ///< 出力データ
+			int                       status;   ///< I/Oサーバからの出力結果 (0: 成功)
+			std::vector<MPI::Request> requests; ///< 送信および出力結果の受信リクエスト
+		};
+
+		MPI::Intracomm            m_comm;        ///< 要求の送受信用コミュニケータ (複製)
+		int                       m_server;      ///< 要求先のI/Oサーバのランク番号
+		int                       m_maxInFlight; ///< 同時に処理中とする要求の最大数
+		bool                      m_closed;      ///< 終了要求の送信済みフラグ
+		int                       m_numFailed;   ///< 前回の回収以降に出力に失敗した要求数
+		std::deque<PendingSend*>  m_pending;     ///< 処理中の要求
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_IO_SERVER_H__
@@ -38,9 +38,21 @@ namespace BCMFileIO {
 		IdxBlock() :
 			rootDir(std::string("")),
 			dataDir(std::string("")),
+			stageDir(std::string("")),
 			vc(0),
+			ghostVC(0),
+			codec(LB_CODEC_NONE),
+			errorBound(0.0),
+			streamCodec(LB_STREAM_RLE),
+			streamCodecParam(0),
 			isGather(false),
+			isAggregate(false),
 			isStepSubDir(false),
+			isElideConstant(false),
+			maskClassID(-1),
+			maskFillValue(0.0),
+			memoryType(-1),
+			isMappedRead(false),
 			separateVCUpdate(false)
 		{}
 
@@ -108,10 +120,21 @@ namespace BCMFileIO {
 			return NULL;
 		}
 
+		/// メモリ上 (Scalar3D) のデータ型を取得
+		///
+		/// @return memoryTypeが未指定の場合，半精度はLB_FLOAT32，それ以外はdataType
+		///
+		inline LB_DATA_TYPE GetMemoryType() const {
+			if( memoryType >= 0 ){ return static_cast<LB_DATA_TYPE>(memoryType); }
+			if( dataType == LB_FLOAT16 || dataType == LB_BFLOAT16 ){ return LB_FLOAT32; }
+			return dataType;
+		}
+
 
 	public:
 		std::string      rootDir;      ///< インデックスファイルのディレクトリ
 		std::string      dataDir;      ///< データディレクトリ
+		std::string      stageDir;     ///< 段階出力の一時ディレクトリ (rootDirに対応．読み込み時に有効なコピーがあれば優先．空の場合は使用しない)
 
 		std::vector<int> dataClassID;  ///< データクラスID(マルチコンポーネント対応のため配列)
 		LB_DATA_TYPE     dataType;     ///< セルのデータ識別子
@@ -119,10 +142,22 @@ namespace BCMFileIO {
 		LB_KIND          kind;         ///< リーフブロックタイプ
 		unsigned int     bitWidth;     ///< セルあたりのビット幅
 		unsigned int     vc;           ///< 仮想セルサイズ
+		unsigned int     ghostVC;      ///< 出力を省略した仮想セルサイズ (内部セルのみ出力する場合．読み込み時に仮想セルの同期で再構築する)
 		std::string      prefix;       ///< ファイル名Prefix
 		std::string      extension;    ///< ファイル拡張子
-		bool             isGather;     ///< Gatherフラグ
+		LB_CODEC         codec;        ///< 物理量ブロックの圧縮形式 (分散ファイル出力時のみ使用)
+		double           errorBound;   ///< 非可逆圧縮の誤差上限 (LB_CODEC_ABSERRは絶対値，LB_CODEC_RELERRはブロック内の値の範囲に対する比)
+		unsigned int     streamCodec;      ///< CellIDの圧縮形式 (LB_STREAM_CODEC．StreamCodecの識別番号)
+		int              streamCodecParam; ///< CellIDの圧縮形式のパラメータ
+		bool             isGather;     ///< Gatherフラグ (物理量の場合，MPI-IOによる共有ファイル出力)
+		bool             isAggregate;  ///< Aggregateフラグ (物理量の場合，I/Oグループごとに1ファイルへ集約出力)
 		bool             isStepSubDir; ///< ステップごとのサブディレクトリフラグ
+		bool             isElideConstant; ///< 値が一定のブロックを1値に縮約するフラグ (分散ファイル出力時のみ使用)
+		int              maskClassID;  ///< セルのマスクに使用するCellIDのデータクラスID (-1の場合はマスクしない．分散ファイル出力時のみ使用)
+		std::vector<unsigned char> maskTable; ///< CellIDごとの格納フラグ (256要素．1: 格納するセル)
+		double           maskFillValue; ///< 読み込み時にマスク外のセルを埋める値
+		int              memoryType;   ///< メモリ上 (Scalar3D) のデータ型 (LB_DATA_TYPE．-1の場合はGetMemoryType()の既定．dataTypeはファイル上の型)
+		bool             isMappedRead; ///< 読み込み時にファイルをメモリマップするフラグ (物理量のみ)
 		IdxStep          step;         ///< タイムステップ情報
 
 		bool         separateVCUpdate;
@@ -21,6 +21,11 @@
 #define __BCMTOOLS_LEAF_BLOCK_LOADER_H__
 
 #include <mpi.h>
+#include <sys/types.h>
+
+#include <cstdio>
+#include <map>
+#include <vector>
 
 #include "BCMFileCommon.h"
 #include "IdxBlock.h"
@@ -33,6 +38,22 @@ using namespace Vec3class;
 
 namespace BCMFileIO {
 
+	class CellIDStreamDecoder;
+
+	/// 物理量の逐次読み込みの状態 (プロセスごと)
+	///
+	/// @note 時間差分ファイルを連続するステップの順に読み込む場合に，前回復元したブロックを差分の基準として再利用する．
+	struct DataStreamState
+	{
+		typedef std::map< std::pair<int, int>, std::vector<unsigned char> > BlockMap;
+
+		bool         isValid; ///< blocksが有効かどうか
+		unsigned int step;    ///< blocksのタイムステップ
+		BlockMap     blocks;  ///< (ファイル番号, ファイル内ブロック番号) ごとの復元済みブロック (全コンポーネント，実行環境のバイト順)
+
+		DataStreamState() : isValid(false), step(0) {}
+	};
+
 	/// LeafBlockファイルを読み込むクラス
 	class LeafBlockLoader {
 	public:
@@ -40,9 +61,11 @@ namespace BCMFileIO {
 		/// グリッドヘッダとデータを一括りにした構造体
 		struct CellIDCapsule
 		{
-			LBCellIDHeader   header; ///< リーフブロックのグリッドヘッダ
-			unsigned char*   data;   ///< リーフブロックデータ
-			CellIDCapsule() : data(NULL){}
+			LBCellIDHeader   header;     ///< リーフブロックのグリッドヘッダ
+			unsigned char*   data;       ///< リーフブロックデータ
+			unsigned int     codec;      ///< 圧縮形式 (LB_STREAM_CODEC．LB01のファイルはcompSizeから決定)
+			bool             isNeedSwap; ///< 展開したBitVoxelのバイトスワップの要否 (LB01のファイルは読み込み時にスワップ済み)
+			CellIDCapsule() : data(NULL), codec(LB_STREAM_RAW), isNeedSwap(false){}
 		};
 
 		/// LeafBlockファイル(CellID)の読み込み (Gatherなし)
@@ -95,9 +118,66 @@ namespace BCMFileIO {
 		/// @return 展開後のデータ (失敗した場合NULLを返す．)
 		///
 		/// @note cidCapsuleのdataはこの関数内で解放される．
+		///       cidCapsule.codecの圧縮形式がStreamCodecに登録されていない場合は失敗する．
 		///
 		static unsigned char* DecompCellIDData( const LBHeader &header,  const CellIDCapsule& cidCapsule);
 
+		/// ブロック単位符号 (LB_STREAM_BLOCK) から1ブロックを展開
+		///
+		/// @param[in]  header     LeafBlockファイルヘッダ
+		/// @param[in]  cidCapsule CellIDカプセル (codecがLB_STREAM_BLOCKであること)
+		/// @param[in]  index      カプセル内のブロック番号
+		/// @param[out] dst        展開先 (仮想セルを含む1ブロック分)
+		/// @return 成功した場合true, 符号が壊れている場合false
+		///
+		/// @note cidCapsuleのdataは解放しない．
+		///
+		static bool DecompCellIDBlock( const LBHeader &header, const CellIDCapsule& cidCapsule, const size_t index, unsigned char* dst);
+
+
+		/// CellIDカプセルからブロック単位で展開するクラス
+		///
+		/// @note LB_STREAM_BLOCKは各ブロックを直接，LB_STREAM_RAW, LB_STREAM_RLE, LB_STREAM_VRLEは
+		///       CellIDStreamDecoderで逐次展開し，ブロック1つ分を超える一時バッファを使用しない．
+		///       それ以外の圧縮形式は初回にDecompCellIDData()で全体を展開する．
+		///       カプセルのdataの所有権を移譲する (デストラクタで解放)．
+		///
+		class CellIDBlockReader {
+		public:
+			/// コンストラクタ
+			///
+			/// @param[in] header     LeafBlockファイルヘッダ
+			/// @param[in] cidCapsule CellIDカプセル
+			///
+			CellIDBlockReader(const LBHeader& header, const CellIDCapsule& cidCapsule);
+
+			/// デストラクタ
+			~CellIDBlockReader();
+
+			/// ブロックを展開
+			///
+			/// @param[in]  index カプセル内のブロック番号
+			/// @param[out] dst   展開先 (仮想セルを含む1ブロック分)
+			/// @return 成功した場合true, 符号が壊れている場合false
+			///
+			bool Read(const size_t index, unsigned char* dst);
+
+			/// 複数スレッドから同時にRead()できるかを判定
+			///
+			/// @return LB_STREAM_BLOCKの場合true (ブロックごとに独立して展開できる)
+			///
+			bool IsRandomAccess() const;
+
+		private:
+			CellIDBlockReader(const CellIDBlockReader&);
+			CellIDBlockReader& operator=(const CellIDBlockReader&);
+
+			LBHeader             m_header;    ///< LeafBlockファイルヘッダ
+			CellIDCapsule        m_capsule;   ///< CellIDカプセル
+			size_t               m_blockSize; ///< 1ブロックのセル数 (仮想セル込み)
+			CellIDStreamDecoder* m_stream;    ///< 逐次展開 (対応する圧縮形式のみ)
+			unsigned char*       m_voxels;    ///< 全体を展開したCellID (逐次展開に対応しない圧縮形式のみ)
+		};
 
 		/// LeafBlockファイル(Scalar)の読み込み
 		///
@@ -107,6 +187,7 @@ namespace BCMFileIO {
 		/// @param[in] pmapper        MxNデータマッパ
 		/// @param[in] vc             内部構造の仮想セルサイズ
 		/// @param[in] step           読み込むデータのタイムステップインデックス番号
+		/// @param[inout] stream      逐次読み込みの状態 (NULLの場合は使用しない)
 		///
 		/// @return 成功した場合true, 失敗した場合false
 		///
@@ -114,13 +195,53 @@ namespace BCMFileIO {
 		///       仮想セルサイズは、ファイルに記載されている仮想セルサイズと関係なく指定できます。
 		///       ブロック間の仮想セルの同期は行っていないため、ファイルの仮想セルサイズよりも大きい値を入れた
 		///       場合、読めない値は0で埋まります。
+		///       圧縮ファイル (識別子LBZ1) はブロックごとの格納情報から必要なブロックのみを読み込んで展開します。
+		///       時間差分のブロックはキーフレームまで基準ステップをたどって復元します。
+		///       streamを指定した場合は読み込んだブロックをstreamに保持し，次に読み込むステップの時間差分の基準に使用します。
 		///
 		static bool LoadData(const MPI::Intracomm& comm,
 					  const IdxBlock*       ib,
 					  BlockManager&         blockManager,
 					  PartitionMapper*      pmapper,
 					  const int             vc,
-					  const unsigned int    step );
+					  const unsigned int    step,
+					  DataStreamState*      stream = NULL );
+
+		/// 増分LeafBlockファイル(物理量)を全ブロックを格納したファイルに変換
+		///
+		/// @param[in] ib   ブロック情報
+		/// @param[in] bsz  リーフブロックサイズ
+		/// @param[in] step 変換するタイムステップのインデックス番号
+		/// @param[in] fid  ファイル番号 (出力したプロセスのランク番号)
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 参照先のステップのファイルからブロックを集め，同じファイル名の通常のLeafBlockファイルに置き換える．
+		///       圧縮ファイルの場合は全ブロックを同じ圧縮形式で格納した圧縮ファイルに置き換える．
+		///       変換後のファイルは実行環境のバイト順で出力する．時間差分のブロックは復元して符号化せずに格納する．
+		///       変換後もブロックの内容は変わらないため，このファイルを参照する他のステップの増分ファイルはそのまま読み込める．
+		///       他のステップを参照しないファイルの場合は何もしない．通信を行わないため，単体のツールからも使用できる．
+		///
+		static bool CompactDataFile(const IdxBlock* ib, const Vec3i& bsz, const unsigned int step, const int fid);
+
+		/// メモリ上のLeafBlockファイル(物理量)のイメージを読み込む
+		///
+		/// @param[in] ib             ブロック情報
+		/// @param[in] blockManager   ブロックマネージャ
+		/// @param[in] vc             内部構造の仮想セルサイズ
+		/// @param[in] image          分散ファイルと同じ形式のイメージ (MemoryCheckpointのローカルコピー)
+		/// @param[in] size           イメージのサイズ (Byte単位)
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note イメージは自プロセスの全ブロックを含み，ブロックの並びはBlockManagerと一致している必要がある．
+		///       ib->dataClassIDのデータクラスに格納する．
+		///
+		static bool LoadDataImage(const IdxBlock*       ib,
+		                          BlockManager&         blockManager,
+		                          const int             vc,
+		                          const unsigned char*  image,
+		                          const uint64_t        size);
 
 		/// データバッファからBlockManager配下のBlockにデータをコピー
 		///
@@ -152,19 +273,153 @@ namespace BCMFileIO {
 			return true;                                                                                                                    }
 
 	private:
+		/// 読み込み中のLeafBlockファイル(物理量)
+		struct DataFile
+		{
+			FILE*                     fp;         ///< ファイルポインタ
+			LBHeader                  hdr;        ///< ヘッダ
+			bool                      isNeedSwap; ///< バイトスワップの要否
+			off_t                     dataStart;  ///< ブロックデータの開始位置
+			off_t                     blockBytes; ///< 1ブロック (全コンポーネント) のサイズ
+			std::vector<LBDeltaEntry> entries;    ///< ブロック参照 (増分ファイルのみ)
+			LB_CODEC                  codec;      ///< 圧縮形式 (圧縮ファイルのみ)
+			unsigned int              baseStep;   ///< 時間差分の基準ステップ (圧縮ファイルのみ)
+			std::vector<LBCodecEntry> blocks;     ///< ブロックごとの格納情報 (圧縮ファイルのみ)
+			double                    fillValue;  ///< マスク外のセルを埋める値 (IdxBlock::maskFillValue)
+			const unsigned char*      mapped;     ///< メモリマップしたファイルの先頭 (マップしていない場合NULL)
+			uint64_t                  mappedSize; ///< メモリマップしたサイズ (Byte単位)
+
+			DataFile() : fp(NULL), isNeedSwap(false), dataStart(0), blockBytes(0), codec(LB_CODEC_NONE), baseStep(0), fillValue(0.0),
+			             mapped(NULL), mappedSize(0) {}
+		};
+
+		/// LeafBlockファイル(物理量)のパスを取得する (段階出力の一時ディレクトリのコピーを優先)
+		static std::string GetDataFilePath(const IdxBlock* ib, const unsigned int step, const int fid);
+
+		/// LeafBlockファイル(物理量)を開き，ヘッダとブロック参照を読み込む
+		///
+		/// @param[in]  filepath   ファイルパス
+		/// @param[in]  ib         ブロック情報 (ib->isMappedReadの場合はファイル全体をメモリマップする)
+		/// @param[in]  bsz        リーフブロックサイズ
+		/// @param[out] file       開いたファイル
+		/// @param[in]  sequential ブロックを先頭から順に読み込む場合true (メモリマップのアクセスパターンのヒント)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note メモリマップに失敗した場合はstdioで読み込む．
+		///
+		static bool OpenDataFile(const std::string& filepath, const IdxBlock* ib, const Vec3i& bsz, DataFile& file, const bool sequential = false);
+
+		/// LeafBlockファイル(物理量)を閉じる
+		static void CloseDataFile(DataFile& file);
+
+		/// ファイルのoffsetからsizeバイトの領域を取得する
+		///
+		/// @param[in] src    ファイル
+		/// @param[in] offset 領域の先頭位置
+		/// @param[in] size   領域のサイズ
+		/// @param[in] buf    メモリマップしていない場合の読み込み先 (sizeバイト以上．マップしている場合は使用しない)
+		/// @return 領域の先頭 (メモリマップしている場合はマップ内，そうでない場合はbuf)．範囲外または読み込みに失敗した場合NULL
+		///
+		static const unsigned char* FetchBlock(DataFile& src, const uint64_t offset, const size_t size, unsigned char* buf);
+
+		/// 増分ファイルが参照するステップのファイルを開く (開いたファイルはrefsに保持し，2回目以降はそれを返す)
+		///
+		/// @return 開いたファイル．失敗した場合NULL
+		///
+		static DataFile* OpenReference(const IdxBlock*                   ib,
+		                               const Vec3i&                      bsz,
+		                               const unsigned int                step,
+		                               const int                         fid,
+		                               const uint64_t                    numBlock,
+		                               std::map<unsigned int, DataFile>& refs);
+
+		/// ブロックを格納しているファイルと格納情報を求める (増分ファイルの参照先は必要に応じて開き，refsに保持する)
+		///
+		/// @note 圧縮ファイル以外のブロックはLB_CODEC_ENTRY_RAWの格納情報として返す．
+		///
+		static bool LocateBlock(const IdxBlock*                   ib,
+		                        const Vec3i&                      bsz,
+		                        const unsigned int                step,
+		                        const int                         fid,
+		                        const int                         fdid,
+		                        DataFile&                         file,
+		                        std::map<unsigned int, DataFile>& refs,
+		                        DataFile**                        src,
+		                        LBCodecEntry*                     entry);
+
+		/// LocateBlock()で求めたブロック (全コンポーネント) を読み込む
+		///
+		/// @param[in]  src        ブロックを格納しているファイル
+		/// @param[in]  entry      ブロックの格納情報
+		/// @param[out] buf        読み込み先 (src.blockBytes以上のサイズが必要)
+		/// @param[out] isNeedSwap 読み込んだブロックのバイトスワップの要否 (展開したブロックは実行環境のバイト順．1値に縮約したブロック，マスクしたブロックはファイルのバイト順で値を埋める)
+		/// @param[out] block      読み込んだブロックの先頭 (NULLの場合は常にbufへ読み込む)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note blockを指定した場合，メモリマップした非圧縮のブロックはbufへ複写せず，マップ内を指す．
+		///
+		static bool ReadBlock(DataFile& src, const LBCodecEntry& entry, unsigned char* buf, bool* isNeedSwap, const unsigned char** block = NULL);
+
+		/// LocateBlock()で求めた時間差分のブロック (全コンポーネント) を基準ステップのブロックから復元する
+		///
+		/// @param[in]  ib     ブロック情報
+		/// @param[in]  bsz    リーフブロックサイズ
+		/// @param[in]  fid    ファイル番号
+		/// @param[in]  fdid   ファイル内のブロック番号
+		/// @param[in]  src    ブロックを格納しているファイル
+		/// @param[in]  entry  ブロックの格納情報
+		/// @param[in]  refs   参照先のファイル
+		/// @param[in]  stream 逐次読み込みの状態 (基準ステップのブロックを保持していれば使用．NULL可)
+		/// @param[out] buf    復元先 (src.blockBytes以上のサイズが必要．実行環境のバイト順)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		static bool ReadDeltaBlock(const IdxBlock*                   ib,
+		                           const Vec3i&                      bsz,
+		                           const int                         fid,
+		                           const int                         fdid,
+		                           DataFile&                         src,
+		                           const LBCodecEntry&               entry,
+		                           std::map<unsigned int, DataFile>& refs,
+		                           const DataStreamState*            stream,
+		                           unsigned char*                    buf);
+
+		/// ステップstepのブロック (全コンポーネント) を実行環境のバイト順で読み込む (参照と時間差分をたどる)
+		static bool ReconstructBlock(const IdxBlock*                   ib,
+		                             const Vec3i&                      bsz,
+		                             const unsigned int                step,
+		                             const int                         fid,
+		                             const int                         fdid,
+		                             DataFile&                         file,
+		                             std::map<unsigned int, DataFile>& refs,
+		                             const DataStreamState*            stream,
+		                             unsigned char*                    buf);
+
 		/// BitVoxelサイズを取得する
 		static inline size_t GetBitVoxelSize( const LBHeader& hdr, size_t numBlocks );
 
 		/// ヘッダを読み込む
 		static inline bool LoadHeader( FILE *fp, LBHeader& hdr, bool& isNeedSwap);
+		/// ヘッダの拡張を読み込む (LB02の場合のみ．LB01の場合は既定値)
+		static inline bool LoadHeaderExt( FILE *fp, const LBHeader& hdr, LBHeaderExt& ext, const bool isNeedSwap);
+
 		/// CellIDヘッダを読み込む
-		static inline bool LoadCellIDHeader( FILE *fp, LBCellIDHeader& chdr, const bool isNeedSwap );
+		static inline bool LoadCellIDHeader( FILE *fp, LBCellIDHeader& chdr, const LBHeader& hdr, const bool isNeedSwap );
 
 		/// CellIDデータを読み込む
 		static inline bool LoadCellIDData( FILE *fp, unsigned char** data, const LBHeader& hdr, const LBCellIDHeader& chdr, const bool isNeedSwap);
 
-		/// ブロックコンテンツを読み込む
-		static unsigned char* Load_BlockContents(FILE *fp, const LBHeader& hdr, const Vec3i& bsz, const int vc, const bool isNeedSwap);
+		/// ファイルの並びのブロックコンテンツを内部構造の仮想セルサイズの並びに展開する (ファイル上の型からdstTypeに変換)
+		static unsigned char* Unpack_BlockContents(const unsigned char* buf, const LBHeader& hdr, const Vec3i& bsz, const int vc, const bool isNeedSwap, const LB_DATA_TYPE dstType);
+
+		/// ブロックコンテンツの1行をバイトスワップしてから型変換する (rowはスワップ用の一時領域)
+		static void UnpackRow(unsigned char* dst, const LB_DATA_TYPE dstType, const unsigned char* src, const LB_DATA_TYPE srcType,
+		                      const int count, const bool isNeedSwap, std::vector<unsigned char>& row);
+
+		/// ヘッダの内容がブロック情報と一致しているかを確認する
+		static bool CheckDataHeader(const std::string& source, const LBHeader& hdr, const IdxBlock* ib, const Vec3i& bsz);
+
+		/// データ型に応じて展開済みのブロックコンテンツをBlockManager配下のBlockにコピーする
+		static void CopyBlockToScalar3D(BlockManager& blockManager, const LB_DATA_TYPE dataType, const int dataClassID, const int blockID, const int vc, const unsigned char* block);
 	};
 
 } // namespace BCMFileIO
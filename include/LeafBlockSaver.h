@@ -21,6 +21,9 @@
 #define __BCMTOOLS_LEAFBLOCK_SAVER_H__
 
 #include <mpi.h>
+#include <sys/types.h>
+
+#include <vector>
 
 #include "BCMFileCommon.h"
 #include "IdxBlock.h"
@@ -32,6 +35,36 @@ class BlockManager;
 
 namespace BCMFileIO {
 
+	class GatherWriter;
+	class AsyncWriter;
+	class IOServerClient;
+	class MemoryCheckpoint;
+
+	/// 物理量の出力設定
+	struct DataIOConfig
+	{
+		MPI::Info      info;      ///< MPI-IOのヒント (共有ファイル出力時のみ使用)
+		MPI::Intracomm groupComm;  ///< I/Oグループのコミュニケータ (集約出力時のみ使用．グループ内Rank 0が集約プロセス)
+		int            groupID;    ///< I/Oグループ番号 (集約出力しない場合-1)
+		int            maxWriters; ///< 同時に出力するプロセス数の上限 (分散ファイル出力時のみ使用．0の場合制限なし)
+
+		DataIOConfig() : info(MPI::INFO_NULL), groupComm(MPI::COMM_NULL), groupID(-1), maxWriters(0) {}
+	};
+
+	/// 物理量の増分出力の状態 (プロセスごと)
+	struct DataDeltaState
+	{
+		int                        fullInterval; ///< 全ブロックを出力する間隔 (出力回数．0の場合は増分出力しない)
+		int                        count;        ///< 前回全ブロックを出力してからの出力回数
+		unsigned int               lastStep;     ///< 前回出力したタイムステップ
+		std::vector<uint64_t>      hashes;       ///< 前回出力したブロックごとのハッシュ値
+		std::vector<unsigned int>  owners;       ///< ブロックごとに内容を格納しているファイルのタイムステップ
+		LB_DELTA                   delta;        ///< 変化したブロックの時間差分形式 (LB_DELTA_NONEの場合は全体を格納)
+		std::vector<unsigned char> previous;     ///< 前回出力したブロックの並び (時間差分の基準．LB_DELTA_NONEの場合は保持しない)
+
+		DataDeltaState() : fullInterval(0), count(0), lastStep(0), delta(LB_DELTA_NONE) {}
+	};
+
 	class LeafBlockSaver {
 	public:
 
@@ -42,16 +75,74 @@ namespace BCMFileIO {
 		/// @param[in] size      リーフブロックサイズ
 		/// @param[in] numBlock  総ブロック数
 		/// @param[in] datas     CellIDが格納されたデータバッファ
-		/// @param[in] rle       RLE圧縮フラグ (trueの場合RLE圧縮を行う)
 		///
 		/// @return 成功した場合true, 失敗した場合false
 		///
+		/// @note ib->streamCodecで圧縮する．LB01で表現できない圧縮形式の場合はLB02で出力する．
+		///
 		static bool SaveCellID( const MPI::Intracomm& comm,
 								const IdxBlock*       ib,
 								const Vec3i&          size,
 								const size_t          numBlock,
-								const unsigned char*  datas,
-								bool                  rle);
+								const unsigned char*  datas);
+
+
+		/// LeafBlockファイル(CellID)の出力 (ブロックから逐次符号化)
+		///
+		/// @param[in] comm         MPIコミュニケータ
+		/// @param[in] ib           ブロック情報
+		/// @param[in] blockManager ブロックマネージャ
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ib->streamCodecはCellIDStreamEncoder::IsSupported()がtrueまたはLB_STREAM_BLOCKであること．
+		///       Scalar3Dから一定サイズのチャンク単位でBitVoxel化と圧縮を行うため，
+		///       ランク全体のCellIDやBitVoxelの一時バッファを必要としない．出力するファイルはSaveCellID()と同じ．
+		///       LB_STREAM_BLOCKの場合はブロック単位でOpenMPにより並列に符号化する．
+		///
+		static bool SaveCellID( const MPI::Intracomm& comm,
+		                        const IdxBlock*       ib,
+		                        BlockManager&         blockManager );
+
+		/// LeafBlockファイル(CellID)を1ファイル出力 (分散ファイル形式)
+		///
+		/// @param[in] filepath  出力ファイルパス
+		/// @param[in] header    リーフブロックヘッダ (numBlockはファイルに含むブロック数)
+		/// @param[in] datas     CellIDが格納されたデータバッファ
+		/// @param[in] codec     圧縮形式 (LB_STREAM_CODEC．StreamCodecの識別番号)
+		/// @param[in] param     圧縮形式のパラメータ
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 通信を行わないため，I/Oサーバからも使用される．
+		///       header.identifierは圧縮形式に応じてLB01またはLB02に置き換える．
+		///
+		static bool WriteCellIDFile( const std::string&   filepath,
+		                             const LBHeader&      header,
+		                             const unsigned char* datas,
+		                             const unsigned int   codec,
+		                             const int            param);
+
+		/// LeafBlockファイル(CellID)の出力をI/Oサーバに要求
+		///
+		/// @param[in] comm      MPIコミュニケータ
+		/// @param[in] ib        ブロック情報
+		/// @param[in] size      リーフブロックサイズ
+		/// @param[in] numBlock  総ブロック数
+		/// @param[in] datas     CellIDが格納されたデータバッファ (new[]で確保した領域．所有権を移譲)
+		/// @param[in] client    I/Oサーバへの要求の送信先
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note BitVoxel化，ib->streamCodecによる圧縮およびファイル出力はI/Oサーバで行う．
+		///       分散ファイル (ib->isGatherがfalse) のみ対応．
+		///
+		static bool SaveCellIDIOServer( const MPI::Intracomm& comm,
+		                                const IdxBlock*       ib,
+		                                const Vec3i&          size,
+		                                const size_t          numBlock,
+		                                unsigned char*        datas,
+		                                IOServerClient&       client);
 
 
 		/// LeafBlockファイル(物理量)の出力
@@ -60,23 +151,430 @@ namespace BCMFileIO {
 		/// @param[in] ib           ブロック情報
 		/// @param[in] blockManager ブロックマネージャ
 		/// @param[in] step         出力タイムステップのインデックス番号
+		/// @param[in] config       出力設定
+		/// @param[out] writtenBytes 分散ファイルの場合，自プロセスがファイルに出力したByte数 (圧縮後．NULLの場合は返さない)
 		///
 		/// @return 成功した場合true, 失敗した場合false
 		///
+		/// @note ib->isGatherがtrueの場合、全プロセスのブロックをMPI-IOで1ファイルに出力する (集団操作)．
+		///       各ブロックはグローバルなリーフ番号didから求まるオフセット
+		///       sizeof(LBHeader) + did * kind * (ブロックのByte数) に配置される．
+		///       ib->isAggregateがtrueの場合、config.groupCommの各プロセスのブロックを集約プロセスへ転送し、
+		///       I/Oグループごとに1ファイルへ出力する．ファイル内のブロックはグループ内のプロセス番号順に並ぶ．
+		///       分散ファイルの場合、config.maxWritersが正であれば同時に出力するプロセス数を制限する (集団操作)．
+		///
 		static bool SaveData(const MPI::Intracomm& comm,
 							 const IdxBlock*       ib,
 							 BlockManager&         blockManager,
-							 const unsigned int    step);
+							 const unsigned int    step,
+							 const DataIOConfig&   config = DataIOConfig(),
+							 uint64_t*             writtenBytes = NULL);
+
+		/// LeafBlockファイル(物理量)の非同期出力
+		///
+		/// @param[in]  comm         MPIコミュニケータ
+		/// @param[in]  ib           ブロック情報
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[in]  step         出力タイムステップのインデックス番号
+		/// @param[in]  asyncWriter  出力スレッド
+		/// @param[out] ticket       出力要求のチケット番号
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 自プロセスのブロックを一時バッファにコピーしてから出力スレッドに渡すため，
+		///       関数から戻った後はブロックの内容を書き換えてよい．
+		///       分散ファイル (ib->isGather, ib->isAggregateがfalse) のみ対応．
+		///
+		static bool SaveDataAsync(const MPI::Intracomm& comm,
+		                          const IdxBlock*       ib,
+		                          BlockManager&         blockManager,
+		                          const unsigned int    step,
+		                          AsyncWriter&          asyncWriter,
+		                          int*                  ticket);
+
+		/// LeafBlockファイル(物理量)の出力をI/Oサーバに要求
+		///
+		/// @param[in] comm         MPIコミュニケータ
+		/// @param[in] ib           ブロック情報
+		/// @param[in] blockManager ブロックマネージャ
+		/// @param[in] step         出力タイムステップのインデックス番号
+		/// @param[in] client       I/Oサーバへの要求の送信先
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 自プロセスのブロックを一時バッファにコピーしてノンブロッキング送信し，送信の完了を待たずに戻る．
+		///       関数から戻った後はブロックの内容を書き換えてよい．
+		///       分散ファイル (ib->isGather, ib->isAggregateがfalse) のみ対応．
+		///
+		static bool SaveDataIOServer(const MPI::Intracomm& comm,
+		                             const IdxBlock*       ib,
+		                             BlockManager&         blockManager,
+		                             const unsigned int    step,
+		                             IOServerClient&       client);
+
+		/// LeafBlockファイル(物理量)を子プロセスで出力
+		///
+		/// @param[in]  comm         MPIコミュニケータ
+		/// @param[in]  ib           ブロック情報
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[in]  step         出力タイムステップのインデックス番号
+		/// @param[out] pid          出力を行う子プロセスのプロセスID (同期出力した場合-1)
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 出力リストを作成した後にforkし，子プロセスがコピーオンライトのメモリイメージから
+		///       ファイルを出力する．子プロセスはMPI関数を呼び出さず，終了コード (成功時0) で結果を返す．
+		///       子プロセスはメモリを確保しないよう，writevの領域リストはfork前に作成する．
+		///       MPIがNICに登録した (MADV_DONTFORKを設定した) Scalar3Dの領域は子プロセスに存在することが保証されない．
+		///       その場合，子プロセスは異常終了し，出力失敗として回収される．
+		///       forkに失敗した場合およびforkが使えない環境では同期出力する．
+		///       分散ファイル (ib->isGather, ib->isAggregateがfalse) のみ対応．
+		///
+		static bool SaveDataFork(const MPI::Intracomm& comm,
+		                         const IdxBlock*       ib,
+		                         BlockManager&         blockManager,
+		                         const unsigned int    step,
+		                         pid_t*                pid);
+
+		/// LeafBlockファイル(物理量)の増分出力
+		///
+		/// @param[in]    comm         MPIコミュニケータ
+		/// @param[in]    ib           ブロック情報
+		/// @param[in]    blockManager ブロックマネージャ
+		/// @param[in]    step         出力タイムステップのインデックス番号
+		/// @param[inout] state        増分出力の状態
+		/// @param[in]    config       出力設定 (maxWritersのみ使用)
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ブロックごとのハッシュ値を前回の出力と比較し，変化したブロックのみを増分ファイル
+		///       (識別子LBD1) に格納する．変化していないブロックは内容を格納しているステップを参照する．
+		///       state.fullInterval回に1回，およびブロック数が変化した場合は全ブロックを通常の形式で出力する．
+		///       IsEncodedOutput()の場合は圧縮ファイル (識別子LBZ1) の格納情報で参照を表す．
+		///       state.deltaが設定されている場合，変化したブロックは前回出力したステップとの時間差分を
+		///       圧縮ファイルに格納する (前回出力したブロックをstate.previousに保持する)．
+		///       分散ファイル (ib->isGather, ib->isAggregateがfalse) のみ対応．
+		///
+		static bool SaveDataIncremental(const MPI::Intracomm& comm,
+		                                const IdxBlock*       ib,
+		                                BlockManager&         blockManager,
+		                                const unsigned int    step,
+		                                DataDeltaState&       state,
+		                                const DataIOConfig&   config = DataIOConfig());
+
+		/// LeafBlockファイル(物理量)のイメージをメモリ上のチェックポイントに保存
+		///
+		/// @param[in] comm         MPIコミュニケータ
+		/// @param[in] ib           ブロック情報
+		/// @param[in] blockManager ブロックマネージャ
+		/// @param[in] step         タイムステップのインデックス番号
+		/// @param[in] checkpoint   保存先のチェックポイント
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 分散ファイルと同じイメージ (ヘッダと自プロセスの全ブロック) を作成し，
+		///       自プロセスとパートナープロセスのメモリに保持する．ファイルは出力しない．(集団操作)
+		///
+		static bool SaveDataMemory(const MPI::Intracomm& comm,
+		                           const IdxBlock*       ib,
+		                           BlockManager&         blockManager,
+		                           const unsigned int    step,
+		                           MemoryCheckpoint&     checkpoint);
+
+		/// 分散ファイル形式のLeafBlockファイル(物理量)のパスを取得
+		///
+		/// @param[in] ib   ブロック情報
+		/// @param[in] step 出力タイムステップのインデックス番号
+		/// @param[in] rank 出力プロセスのランク番号
+		/// @return ファイルパス (ib->rootDirを含む)
+		///
+		static std::string GetDataFilePath(const IdxBlock* ib, const unsigned int step, const int rank);
+
+		/// 分散ファイル形式のLeafBlockファイル(CellID)のパスを取得
+		///
+		/// @param[in] ib   ブロック情報
+		/// @param[in] rank 出力プロセスのランク番号
+		/// @return ファイルパス (ib->rootDirを含む)
+		///
+		static std::string GetCellIDFilePath(const IdxBlock* ib, const int rank);
 
 	private:
+		/// CellIDをBitVoxel化し，圧縮形式で符号化
+		///
+		/// @param[in]  header   リーフブロックヘッダ (ブロックサイズ，仮想セルサイズ，ビット幅のみ使用)
+		/// @param[in]  numBlock datasに含むブロック数
+		/// @param[in]  datas    CellIDが格納されたデータバッファ
+		/// @param[in]  codec    圧縮形式 (LB_STREAM_CODEC．StreamCodecの識別番号)
+		/// @param[in]  param    圧縮形式のパラメータ
+		/// @param[out] code     符号
+		/// @param[out] compSize LBCellIDHeader::compSizeに記載する値 (LB_STREAM_RAWは0)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		static bool EncodeCellID(const LBHeader&             header,
+		                         const size_t                numBlock,
+		                         const unsigned char*        datas,
+		                         const unsigned int          codec,
+		                         const int                   param,
+		                         std::vector<unsigned char>& code,
+		                         uint64_t*                   compSize);
+
+		/// CellIDのリーフブロックヘッダを作成
+		static LBHeader CreateCellIDHeader(const IdxBlock* ib, const Vec3i& size, const size_t numBlock);
+
+		/// 符号化したCellIDを出力 (ib->isGatherに応じて分散ファイルまたは集約ファイル)
+		///
+		/// @param[in] comm        MPIコミュニケータ
+		/// @param[in] ib          ブロック情報
+		/// @param[in] header      リーフブロックヘッダ
+		/// @param[in] numBlock    自プロセスのブロック数
+		/// @param[in] code        自プロセスの符号
+		/// @param[in] compSize    LBCellIDHeader::compSizeに記載する値
+		/// @param[in] encodeError 自プロセスの符号化に失敗した場合true (集約ファイルの場合は全プロセスで中止)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		static bool SaveCellIDCode(const MPI::Intracomm&             comm,
+		                           const IdxBlock*                   ib,
+		                           LBHeader                          header,
+		                           const size_t                      numBlock,
+		                           const std::vector<unsigned char>& code,
+		                           const uint64_t                    compSize,
+		                           const bool                        encodeError);
+
+		/// 符号化したCellIDを1ファイル出力 (分散ファイル形式)
+		static bool WriteCellIDCode(const std::string&                filepath,
+		                            const LBHeader&                   header,
+		                            const uint64_t                    compSize,
+		                            const std::vector<unsigned char>& code,
+		                            const unsigned int                codec,
+		                            const int                         param);
+
+		/// CellIDをブロック単位で符号化 (LB_STREAM_BLOCK)
+		///
+		/// @param[in]  header   リーフブロックヘッダ (ブロックサイズ，仮想セルサイズのみ使用)
+		/// @param[in]  numBlock datasに含むブロック数
+		/// @param[in]  datas    CellIDが格納されたデータバッファ
+		/// @param[out] code     符号 (LBCellIDBlockEntry × numBlock, ブロックごとの符号)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ブロックごとの符号化はOpenMPにより並列に行う．符号はブロックの順に連結するため，スレッド数によらず同じ．
+		///
+		static bool EncodeCellIDBlocks(const LBHeader&             header,
+		                               const size_t                numBlock,
+		                               const unsigned char*        datas,
+		                               std::vector<unsigned char>& code);
+
+		/// CellIDをブロックマネージャから直接ブロック単位で符号化 (LB_STREAM_BLOCK)
+		///
+		/// @param[in]  ib           ブロック情報
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[out] code         符号 (EncodeCellIDBlocks()と同じ)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		static bool EncodeCellIDBlocks(const IdxBlock*             ib,
+		                               BlockManager&               blockManager,
+		                               std::vector<unsigned char>& code);
+
+		/// CellIDの1ブロックを符号化
+		///
+		/// @param[in]  p         ブロックのCellID (仮想セルを含む)
+		/// @param[in]  blockSize ブロックのセル数
+		/// @param[out] e         ブロックの索引 (offsetは設定しない)
+		/// @param[out] blockCode ブロックの符号 (上書き)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 共有状態を持たないため，複数スレッドから同時に呼び出せる．
+		///
+		static bool EncodeCellIDBlock(const unsigned char*        p,
+		                              const size_t                blockSize,
+		                              LBCellIDBlockEntry&         e,
+		                              std::vector<unsigned char>& blockCode);
+
+		/// ブロックごとの符号を索引の順に連結 (索引のoffsetを設定)
+		static void AssembleCellIDBlocks(std::vector<LBCellIDBlockEntry>&                 entries,
+		                                 const std::vector< std::vector<unsigned char> >& codes,
+		                                 std::vector<unsigned char>&                      code);
+
+		/// 出力ディレクトリを取得
+		///
+		/// @param[in] ib   ブロック情報
+		/// @param[in] step 出力タイムステップのインデックス番号
+		/// @return 出力ディレクトリ (ステップごとのサブディレクトリを含む)
+		///
+		static std::string GetOutputDirectory(const IdxBlock* ib, const unsigned int step);
+
+		/// 自プロセスのブロックをファイルイメージとして出力リストに登録 (分散ファイル用)
+		///
+		/// @param[in]  ib           ブロック情報
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[out] writer       出力リスト (ヘッダを含む)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ブロックの領域はコピーせずに登録される．
+		///
+		static bool CreateDataImage(const IdxBlock* ib, BlockManager& blockManager, GatherWriter& writer);
+
+		template<typename T>
+		static bool _CreateDataImage(const IdxBlock* ib, BlockManager& blockManager, GatherWriter& writer);
+
+		/// 自プロセスのブロックを出力ファイルのイメージとして出力リストに登録 (分散ファイル用)
+		///
+		/// @param[in]  ib           ブロック情報
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[in]  step         出力タイムステップのインデックス番号
+		/// @param[out] writer       出力リスト (ヘッダを含む)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note IsEncodedOutput()の場合は圧縮ファイルのイメージ (符号はwriterが所有するバッファに格納)，
+		///       それ以外の場合はCreateDataImage()と同じ．
+		///
+		static bool CreateOutputImage(const IdxBlock* ib, BlockManager& blockManager, const unsigned int step, GatherWriter& writer);
+
+		/// 分散ファイルを圧縮ファイル (識別子LBZ1) として出力するかを判定
+		///
+		/// @param[in] ib ブロック情報
+		/// @return ib->codec, ib->isElideConstant, ib->maskClassIDのいずれかが設定されている場合true
+		///
+		static bool IsEncodedOutput(const IdxBlock* ib){ return ib->codec != LB_CODEC_NONE || ib->isElideConstant || ib->maskClassID >= 0; }
+
+		/// ブロックごとのセルのマスクを作成
+		///
+		/// @param[in]  ib           ブロック情報 (ib->maskClassID, ib->maskTableを使用)
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[out] mask         セルごとの格納フラグ (ファイルと同じ並びのブロックを全ブロック分．マスクしない場合は空)
+		///
+		static void CreateCellMask(const IdxBlock* ib, BlockManager& blockManager, std::vector<unsigned char>& mask);
+
+		/// ファイルイメージのブロックを符号化し，圧縮ファイルのイメージを作成
+		///
+		/// @param[in]  ib     ブロック情報
+		/// @param[in]  image  CreateDataImage()で作成したイメージ
+		/// @param[in]  step   出力タイムステップのインデックス番号
+		/// @param[in]  owners   ブロックごとに内容を格納するファイルのタイムステップ (stepのブロックのみ格納)
+		/// @param[in]  mask     CreateCellMask()で作成したセルのマスク (空の場合はマスクしない)
+		/// @param[out] writer   圧縮ファイルのイメージ (imageの領域は参照しない)
+		/// @param[in]  base     時間差分の基準とするブロックの並び (ヘッダを含まない．NULLの場合は時間差分を使用しない)
+		/// @param[in]  delta    時間差分形式
+		/// @param[in]  baseStep baseのタイムステップ
+		///
+		/// @note 符号が元のブロックより大きくなる場合は符号化せずに格納する．
+		///       時間差分を使用する場合は，ブロックごとに時間差分と空間方向の符号 (ib->codec) のうち小さい方を格納する．
+		///       値が一定のコンポーネントを含むブロックは，1値に縮約した符号 (LB_CODEC_ENTRY_CONSTANT) も候補とする．
+		///       マスク外のセルを含むブロックは，他の符号によらずマスク内のセルのみを格納する (LB_CODEC_ENTRY_MASKED)．
+		///       全セルがマスク外のブロックは格納せず，格納情報のみを記録する (LB_CODEC_ENTRY_ABSENT)．
+		///
+		static void EncodeDataImage(const IdxBlock*                   ib,
+		                            const GatherWriter&               image,
+		                            const unsigned int                step,
+		                            const std::vector<unsigned int>&  owners,
+		                            const std::vector<unsigned char>& mask,
+		                            GatherWriter&                     writer,
+		                            const unsigned char*             base = NULL,
+		                            const LB_DELTA                   delta = LB_DELTA_NONE,
+		                            const unsigned int               baseStep = 0);
+
 		template<typename T>
 		static bool _SaveData(const MPI::Intracomm& comm,
 								  const IdxBlock*       ib,
 								  BlockManager&         blockManager,
-								  const unsigned int    step);
+								  const unsigned int    step,
+								  const DataIOConfig&   config,
+								  uint64_t*             writtenBytes);
+
+		/// 同時に出力するプロセス数を制限して出力リストをファイルに出力
+		///
+		/// @param[in] comm       MPIコミュニケータ
+		/// @param[in] maxWriters 同時に出力するプロセス数の上限
+		/// @param[in] outputDir  出力ディレクトリ
+		/// @param[in] filepath   出力ファイルパス
+		/// @param[in] writer     出力リスト
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note ランク番号rのプロセスはr - maxWritersからトークンを受け取ってから出力し，
+		///       出力後にr + maxWritersへトークンを渡す．
+		///
+		static bool WriteThrottled(const MPI::Intracomm& comm,
+		                           const int             maxWriters,
+		                           const std::string&    outputDir,
+		                           const std::string&    filepath,
+		                           const GatherWriter&   writer);
+
+		/// 出力リストをI/Oグループの集約プロセスへ転送し，グループごとに1ファイルへ出力
+		///
+		/// @param[in] groupComm I/Oグループのコミュニケータ
+		/// @param[in] filepath  出力ファイルパス (集約プロセスのみ使用)
+		/// @param[in] numBlock  自プロセスのブロック数
+		/// @param[in] header    リーフブロックヘッダ (集約プロセスのみ使用．numBlockはここで設定)
+		/// @param[in] writer    出力リスト (ヘッダを含まない)
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 集約プロセスはメンバプロセスのデータを一定サイズごとに受信し，
+		///       受信と書き込みを2つのバッファで交互に行う．
+		///
+		static bool WriteGroupFile(const MPI::Intracomm& groupComm,
+		                           const std::string&    filepath,
+		                           const int             numBlock,
+		                           LBHeader&             header,
+		                           const GatherWriter&   writer);
+
+		/// 出力リストをMPI-IOで共有ファイルに出力
+		///
+		/// @param[in] comm     MPIコミュニケータ
+		/// @param[in] filepath 出力ファイルパス
+		/// @param[in] info     MPI-IOのヒント
+		/// @param[in] offset   自プロセスの出力先オフセット (Byte単位)
+		/// @param[in] fileSize ファイル全体のサイズ (Byte単位)
+		/// @param[in] writer   出力リスト
+		///
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		static bool WriteSharedFile(const MPI::Intracomm& comm,
+		                            const std::string&    filepath,
+		                            const MPI::Info&      info,
+		                            const uint64_t        offset,
+		                            const uint64_t        fileSize,
+		                            const GatherWriter&   writer);
 
 		template<typename T>
 		static bool CopyScalar3DToBuffer(BlockManager& blockManager, const int dataClassID, const int dataID, const int vc, T* buf);
+
+		/// Scalar3Dの仮想セル込み領域がファイルと同じ並びで連続しているかを判定
+		///
+		/// @param[in] blockManager ブロックマネージャ
+		/// @param[in] dataClassID  データクラスID
+		/// @param[in] dataID       ブロックID (プロセス内部でのブロック番号)
+		/// @param[in] vc           ファイルに出力する仮想セルサイズ
+		/// @return 連続している場合true
+		///
+		template<typename T>
+		static bool IsFileLayout(BlockManager& blockManager, const int dataClassID, const int dataID, const int vc);
+
+		/// 自プロセスの全ブロック/全コンポーネントの領域を出力リストに登録
+		///
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[in]  ib           ブロック情報
+		/// @param[out] writer       出力リスト
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note メモリ上の並びがファイルと一致するブロックはコピーせずに登録し，
+		///       一致しないブロックのみ一時バッファに詰め替える．
+		///       ファイル上の型 (ib->dataType) がメモリ上の型と異なる場合はAddConvertedScalar3DToWriter()で変換する．
+		///
+		template<typename T>
+		static bool AddScalar3DToWriter(BlockManager& blockManager, const IdxBlock* ib, GatherWriter& writer);
+
+		/// 自プロセスの全ブロック/全コンポーネントの領域をファイル上の型に変換して出力リストに登録
+		///
+		/// @param[in]  blockManager ブロックマネージャ
+		/// @param[in]  ib           ブロック情報
+		/// @param[out] writer       出力リスト
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 変換後の領域は出力リストが保持する．ブロックごとにスレッド並列で変換する．
+		///
+		template<typename T>
+		static bool AddConvertedScalar3DToWriter(BlockManager& blockManager, const IdxBlock* ib, GatherWriter& writer);
 	};
 
 } // BCMFileIO
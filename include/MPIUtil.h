@@ -0,0 +1,45 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  MPIUtil.h
+/// @brief MPIのプロセス配置関連のユーティリティ
+///
+
+#ifndef __BCMTOOLS_MPI_UTIL_H__
+#define __BCMTOOLS_MPI_UTIL_H__
+
+#include <mpi.h>
+
+#include <vector>
+
+namespace BCMFileIO {
+
+	/// MPIのプロセス配置関連のユーティリティ
+	class MPIUtil {
+	public:
+
+		/// 各プロセスが属するノードのリーダー (ノード内の最小ランク番号) の表を取得
+		///
+		/// @param[in]  comm        MPIコミュニケータ
+		/// @param[out] leaderTable ランク番号ごとのリーダーのランク番号 (commのプロセス数の要素)
+		///
+		/// @note MPI-3以降はMPI_Comm_split_type (MPI_COMM_TYPE_SHARED)，それ以前はプロセッサ名でノードを判定する．(集団操作)
+		///
+		static void GetNodeLeaderTable(const MPI::Intracomm& comm, std::vector<int>& leaderTable);
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_MPI_UTIL_H__
@@ -0,0 +1,155 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  MemoryCheckpoint.h
+/// @brief リーフブロックファイルのイメージを自プロセスとパートナープロセスのメモリに保持するクラス
+///
+
+#ifndef __BCMTOOLS_MEMORY_CHECKPOINT_H__
+#define __BCMTOOLS_MEMORY_CHECKPOINT_H__
+
+#include <mpi.h>
+
+#include <map>
+#include <string>
+
+#include "BCMFileCommon.h"
+
+namespace BCMFileIO {
+
+	/// リーフブロックファイルのイメージを自プロセスとパートナープロセスのメモリに保持するクラス
+	///
+	/// @note 系の名称ごとに最新ステップのイメージのみを保持する．
+	///       各プロセスは自プロセスのイメージ (ローカルコピー) と，自プロセスをパートナーとする
+	///       プロセス (バディ) のイメージ (預かりコピー) を保持する．
+	///       パートナーはノード内のプロセス数ずつずらした別ノードのプロセスとする．
+	///       (ノードごとのプロセス数が揃っていない場合は同じノードになることがある)
+	///
+	class MemoryCheckpoint {
+	public:
+
+		/// コンストラクタ
+		///
+		/// @param[in] comm MPIコミュニケータ
+		///
+		/// @note commを複製し，パートナーを決定する．(集団操作)
+		///
+		MemoryCheckpoint(const MPI::Intracomm& comm);
+
+		/// デストラクタ
+		~MemoryCheckpoint();
+
+		/// イメージを保持し，パートナーへ複製
+		///
+		/// @param[in] name  系の名称
+		/// @param[in] step  タイムステップ
+		/// @param[in] image リーフブロックファイルのイメージ (new[]で確保した領域．所有権を移譲)
+		/// @param[in] size  イメージのサイズ (Byte単位)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		/// @note 同じ名称の以前のイメージは破棄される．(集団操作)
+		///
+		bool Store(const std::string& name, const unsigned int step, unsigned char* image, const uint64_t size);
+
+		/// 失われたイメージをパートナー/バディから復元
+		///
+		/// @param[in] name 系の名称
+		/// @return 全プロセスのローカルコピーが揃った場合true, 失敗した場合false
+		///
+		/// @note ローカルコピーを失ったプロセスはパートナーの預かりコピーを，
+		///       預かりコピーを失ったプロセスはバディのローカルコピーを受信する．
+		///       自プロセスとパートナーの両方で失われたイメージは復元できない．(集団操作)
+		///
+		bool Recover(const std::string& name);
+
+		/// 自プロセスのイメージ (ローカルコピーと預かりコピー) を破棄
+		///
+		/// @param[in] name 系の名称
+		///
+		/// @note メモリ内容が信頼できなくなったプロセスで呼び出し，Recover()で復元する．
+		///
+		void Discard(const std::string& name);
+
+		/// ローカルコピーを取得
+		///
+		/// @param[in]  name 系の名称
+		/// @param[out] size イメージのサイズ (Byte単位)
+		/// @param[out] step タイムステップ (NULLの場合は返さない)
+		/// @return イメージの先頭アドレス．保持していない場合NULL
+		///
+		const unsigned char* GetImage(const std::string& name, uint64_t* size, unsigned int* step = NULL) const;
+
+		/// パートナー (預かりコピーの送信先) のランク番号を取得
+		int GetPartnerRank() const { return m_partner; }
+
+		/// バディ (預かりコピーの送信元) のランク番号を取得
+		int GetBuddyRank() const { return m_buddy; }
+
+	private:
+		MemoryCheckpoint(const MemoryCheckpoint&);
+		MemoryCheckpoint& operator=(const MemoryCheckpoint&);
+
+		/// 保持するイメージ
+		struct Image
+		{
+			unsigned char* data; ///< イメージ (保持していない場合NULL)
+			uint64_t       size; ///< イメージのサイズ (Byte単位)
+			unsigned int   step; ///< タイムステップ
+
+			Image() : data(NULL), size(0), step(0) {}
+		};
+
+		/// 系ごとのイメージ
+		struct Entry
+		{
+			Image local; ///< ローカルコピー
+			Image held;  ///< 預かりコピー
+		};
+
+		/// イメージの送受信ヘッダ
+		struct ImageHeader
+		{
+			uint64_t     size;  ///< イメージのサイズ (Byte単位)
+			unsigned int step;  ///< タイムステップ
+			int          valid; ///< イメージを保持している場合1
+		};
+
+		/// パートナーとバディを決定
+		void FindPartner();
+
+		/// イメージを送受信
+		///
+		/// @param[in]  send    送信するイメージ (送信しない場合NULL)
+		/// @param[in]  dest    送信先ランク番号
+		/// @param[out] recv    受信したイメージ (受信しない場合NULL)
+		/// @param[in]  source  受信元ランク番号
+		/// @param[in]  tag     送受信に使用するタグ
+		/// @return 受信するイメージを送信元が保持していた場合true
+		///
+		bool Exchange(const Image* send, const int dest, Image* recv, const int source, const int tag);
+
+		/// イメージを解放
+		static void Release(Image& image);
+
+	private:
+		MPI::Intracomm               m_comm;    ///< イメージの送受信用コミュニケータ (複製)
+		int                          m_partner; ///< パートナーのランク番号
+		int                          m_buddy;   ///< バディのランク番号
+		std::map<std::string, Entry> m_entries; ///< 系の名称ごとのイメージ
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_MEMORY_CHECKPOINT_H__
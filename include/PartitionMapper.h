@@ -27,6 +27,7 @@
 #include "Partition.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace BCMFileIO {
 
@@ -40,6 +41,7 @@ namespace BCMFileIO {
 		{
 			int              FID;   ///< FID
 			std::vector<int> FDIDs; ///< FDIDリスト
+			std::vector<int> DIDs;  ///< FDIDsの各要素に対応するdid (I/Oグループ表を設定した場合，FIDの順はdidの順と一致しない)
 		};
 
 		/// コンストラクタ
@@ -83,19 +85,48 @@ namespace BCMFileIO {
 		///
 		int GetEnd(const int rank) const   { return partR.getEnd(rank);   }
 
+		/// 出力時のI/Oグループ表を設定 (集約出力されたファイルの読込用)
+		///
+		/// @param[in] groupTable 出力時の各プロセスのI/Oグループ番号 (要素数はファイル出力時の並列数)
+		///
+		/// @note 設定後，FIDはI/Oグループ番号となり，FDIDはグループ内のプロセス番号順に
+		///       各プロセスのブロックを連結したファイル内での相対データIDとなる．
+		///
+		void SetGroupTable(const std::vector<int>& groupTable)
+		{
+			groupIDs = groupTable;
+
+			// 同じグループ内で自身よりも前のプロセスが出力したブロック数を計算
+			std::vector<int> groupNumBlock;
+			groupOffsets.resize(groupIDs.size());
+			for(int rank = 0; rank < static_cast<int>(groupIDs.size()); rank++){
+				const int gid = groupIDs[rank];
+				if( gid >= static_cast<int>(groupNumBlock.size()) ){ groupNumBlock.resize(gid + 1, 0); }
+				groupOffsets[rank] = groupNumBlock[gid];
+				groupNumBlock[gid] += partW.getEnd(rank) - partW.getStart(rank);
+			}
+		}
+
 		/// グローバルデータID(did)が保存されているファイルのID(FID)を取得
 		///
 		/// @param[in] did did
 		/// @return didが保存されているFID
 		///
-		int GetFID(int did ){ return partW.getRank(did); }
+		int GetFID(int did ){
+			int rank = partW.getRank(did);
+			return groupIDs.size() == 0 ? rank : groupIDs[rank];
+		}
 
 		/// グローバルデータID(did)のファイル相対データID(FDID)を取得
 		///
 		/// @param[in] did did
 		/// @return didのFDID
 		///
-		int GetFDID(int did )   { return did - partW.getStart( this->GetFID(did) ); }
+		int GetFDID(int did ){
+			int rank = partW.getRank(did);
+			int base = groupOffsets.size() == 0 ? 0 : groupOffsets[rank];
+			return base + did - partW.getStart(rank);
+		}
 
 		/// FDIDリストのリストを取得
 		///
@@ -128,7 +159,9 @@ namespace BCMFileIO {
 			}
 
 			for(int did = didRange[0]; did < didRange[1]; did++){
-				fdidlists[ (GetFID(did) - fids[0]) ].FDIDs.push_back(GetFDID(did));
+				size_t i = std::lower_bound(fids.begin(), fids.end(), GetFID(did)) - fids.begin();
+				fdidlists[i].FDIDs.push_back(GetFDID(did));
+				fdidlists[i].DIDs.push_back(did);
 			}
 
 			return true;
@@ -140,6 +173,9 @@ namespace BCMFileIO {
 		Partition partR;      ///< ファイル読込時のPartition
 		const int writeProcs; ///< ファイル出力時の並列数
 		const int readProcs;  ///< ファイル読込時の並列数
+
+		std::vector<int> groupIDs;     ///< ファイル出力時の各プロセスのI/Oグループ番号 (集約出力時のみ)
+		std::vector<int> groupOffsets; ///< 各プロセスの先頭ブロックのグループファイル内での相対データID
 	};
 
 } // namespace BCMFileIO
@@ -0,0 +1,206 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  StreamCodec.h
+/// @brief バイト列の圧縮形式 (CellIDファイル用) とその登録簿
+///
+
+#ifndef __BCMTOOLS_STREAM_CODEC_H__
+#define __BCMTOOLS_STREAM_CODEC_H__
+
+#include <cstdlib>
+#include <vector>
+
+#include "BCMFileCommon.h"
+#include "BitVoxel.h"
+
+namespace BCMFileIO {
+
+	/// バイト列の圧縮形式
+	///
+	/// @note 識別番号をキーとして登録簿に登録し，LB02ファイルのLBHeaderExt::codecに記録する．
+	///       組み込みの圧縮形式 (LB_STREAM_CODEC) は初回の検索時に登録される．
+	///       利用者はLB_STREAM_USER以上の識別番号で独自の圧縮形式を登録できる．
+	///       I/Oサーバを使用する場合は，I/Oサーバのプロセスでも同じ圧縮形式を登録すること．
+	///
+	class StreamCodec {
+	public:
+
+		virtual ~StreamCodec() {}
+
+		/// 圧縮形式の名称を取得
+		virtual const char* GetName() const = 0;
+
+		/// 符号化
+		///
+		/// @param[in]  src      入力データ
+		/// @param[in]  size     入力データのサイズ (Byte単位)
+		/// @param[in]  elemSize 要素のサイズ (Byte単位．ランレングスやバイトシャッフルの単位)
+		/// @param[in]  param    符号化のパラメータ (圧縮レベルなど．0の場合は既定値)
+		/// @param[out] dst      符号 (上書き)
+		/// @return 成功した場合true, 失敗した場合false
+		///
+		virtual bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+		                    std::vector<unsigned char>& dst) const = 0;
+
+		/// 展開
+		///
+		/// @param[in]  src      符号
+		/// @param[in]  srcSize  符号のサイズ (Byte単位)
+		/// @param[in]  elemSize 要素のサイズ (Byte単位．符号化時と同じ値)
+		/// @param[out] dst      展開先
+		/// @param[in]  dstSize  展開後のサイズ (Byte単位)
+		/// @return 成功した場合true, 符号が壊れている場合false
+		///
+		virtual bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+		                    unsigned char* dst, const size_t dstSize) const = 0;
+
+		/// 圧縮形式を登録
+		///
+		/// @param[in] id    識別番号 (LB_STREAM_USER以上)
+		/// @param[in] codec 圧縮形式 (所有権は移譲しない．プログラム終了まで有効であること)
+		/// @return 成功した場合true, 識別番号が範囲外または登録済みの場合false
+		///
+		static bool Register(const unsigned int id, const StreamCodec* codec);
+
+		/// 圧縮形式を検索
+		///
+		/// @param[in] id 識別番号
+		/// @return 圧縮形式 (登録されていない場合NULL)
+		///
+		static const StreamCodec* Find(const unsigned int id);
+
+		/// LB01形式で表現できる圧縮形式かを判定
+		///
+		/// @param[in] id 識別番号
+		/// @return LB_STREAM_RAW, LB_STREAM_RLEの場合true
+		///
+		static bool IsLegacy(const unsigned int id){ return id == LB_STREAM_RAW || id == LB_STREAM_RLE; }
+
+		/// CellIDの出力に使用できる圧縮形式かを判定
+		///
+		/// @param[in] id 識別番号
+		/// @return 登録済みの圧縮形式またはLB_STREAM_BLOCKの場合true
+		///
+		/// @note LB_STREAM_BLOCKはブロックの形状を使用するため，登録簿ではなくLeafBlockSaver/LeafBlockLoaderが直接扱う．
+		///
+		static bool IsAvailable(const unsigned int id){ return id == LB_STREAM_BLOCK || Find(id) != NULL; }
+	};
+
+	/// CellIDの逐次符号化 (BitVoxel化と圧縮を一定サイズのチャンク単位で一括して行う)
+	///
+	/// @note 出力する符号はBitVoxel::Compress()した全体をStreamCodecで符号化したものと同じ．
+	///       LB_STREAM_RAW, LB_STREAM_RLE, LB_STREAM_VRLEのみ対応．
+	///
+	class CellIDStreamEncoder {
+	public:
+
+		/// コンストラクタ
+		///
+		/// @param[in]  codec    圧縮形式 (IsSupported()がtrueであること)
+		/// @param[in]  bitWidth BitVoxelのビット幅
+		/// @param[out] code     符号の出力先 (末尾に追記)
+		///
+		CellIDStreamEncoder(const unsigned int codec, const unsigned char bitWidth, std::vector<unsigned char>& code);
+
+		/// ボクセルを追加
+		///
+		/// @param[in] voxel ボクセル
+		/// @param[in] size  ボクセル数
+		///
+		void Put(const unsigned char* voxel, const size_t size);
+
+		/// 残りのボクセルを符号化して終了
+		void Finish();
+
+		/// 逐次符号化に対応した圧縮形式かを判定
+		static bool IsSupported(const unsigned int codec){ return codec == LB_STREAM_RAW || codec == LB_STREAM_RLE || codec == LB_STREAM_VRLE; }
+
+	private:
+		void Flush(const unsigned char* voxel, const size_t size);
+		void EmitRun();
+
+		unsigned int                        m_codec;     ///< 圧縮形式
+		unsigned char                       m_bitWidth;  ///< BitVoxelのビット幅
+		std::vector<unsigned char>*         m_code;      ///< 符号の出力先
+		std::vector<unsigned char>          m_voxels;    ///< チャンクのボクセル
+		size_t                              m_numVoxel;  ///< チャンクに格納済みのボクセル数
+		std::vector<BitVoxel::bitVoxelCell> m_words;     ///< チャンクのBitVoxel
+		BitVoxel::bitVoxelCell              m_runWord;   ///< 符号化中のランの要素
+		size_t                              m_runLength; ///< 符号化中のランの長さ
+	};
+
+	/// CellIDの逐次展開 (圧縮の展開とBitVoxelの展開を一定サイズのチャンク単位で一括して行う)
+	///
+	/// @note 先頭から順に読み込む場合，展開に使用するメモリはチャンクのサイズに限られる．
+	///       LB_STREAM_RAW, LB_STREAM_RLE, LB_STREAM_VRLEのみ対応．
+	///
+	class CellIDStreamDecoder {
+	public:
+
+		/// コンストラクタ
+		///
+		/// @param[in] codec      圧縮形式 (CellIDStreamEncoder::IsSupported()がtrueであること)
+		/// @param[in] bitWidth   BitVoxelのビット幅
+		/// @param[in] code       符号 (展開中は保持すること)
+		/// @param[in] codeSize   符号のサイズ (Byte単位)
+		/// @param[in] numVoxel   展開後のボクセル数
+		/// @param[in] isNeedSwap BitVoxelのバイトスワップの要否
+		///
+		CellIDStreamDecoder(const unsigned int codec, const unsigned char bitWidth, const unsigned char* code, const size_t codeSize,
+		                    const size_t numVoxel, const bool isNeedSwap);
+
+		/// 読み込み位置を移動
+		///
+		/// @param[in] pos ボクセル単位の位置
+		/// @return 成功した場合true, 範囲外または符号が壊れている場合false
+		///
+		/// @note 現在のチャンクより前に戻る場合は先頭から展開し直す．
+		///
+		bool Seek(const size_t pos);
+
+		/// 現在の位置からボクセルを読み込み
+		///
+		/// @param[out] dst  展開先
+		/// @param[in]  size ボクセル数
+		/// @return 成功した場合true, 範囲外または符号が壊れている場合false
+		///
+		bool Read(unsigned char* dst, const size_t size);
+
+	private:
+		bool NextWord(BitVoxel::bitVoxelCell* word);
+		bool SkipWords(size_t n);
+		bool Fill();
+
+		unsigned int                        m_codec;      ///< 圧縮形式
+		unsigned char                       m_bitWidth;   ///< BitVoxelのビット幅
+		const unsigned char*                m_code;       ///< 符号
+		size_t                              m_codeSize;   ///< 符号のサイズ (Byte単位)
+		size_t                              m_numVoxel;   ///< 展開後のボクセル数
+		bool                                m_isNeedSwap; ///< BitVoxelのバイトスワップの要否
+		size_t                              m_codePos;    ///< 次に読み込む符号の位置
+		size_t                              m_wordPos;    ///< 次に展開するBitVoxelの要素番号
+		BitVoxel::bitVoxelCell              m_runWord;    ///< 展開中のランの要素
+		size_t                              m_runLeft;    ///< 展開中のランの残り
+		std::vector<unsigned char>          m_voxels;     ///< 展開したチャンク
+		std::vector<BitVoxel::bitVoxelCell> m_words;      ///< チャンクのBitVoxel
+		size_t                              m_chunkBegin; ///< 展開したチャンクの先頭位置 (ボクセル単位)
+		size_t                              m_chunkSize;  ///< 展開したチャンクのボクセル数
+		size_t                              m_pos;        ///< 読み込み位置 (ボクセル単位)
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_STREAM_CODEC_H__
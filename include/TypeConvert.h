@@ -0,0 +1,80 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  TypeConvert.h
+/// @brief セルのデータ型変換ライブラリ
+///
+
+#ifndef __BCMTOOLS_TYPE_CONVERT_H__
+#define __BCMTOOLS_TYPE_CONVERT_H__
+
+#include <cstdlib>
+
+#include "BCMFileCommon.h"
+
+namespace BCMFileIO {
+
+	/// セルのデータ型変換ライブラリ (メモリ上の型とファイル上の型が異なる場合に使用)
+	///
+	/// @note 整数型を含む変換はstatic_castと同じ規則に従う (値域外の値は未定義)．
+	///       半精度 (LB_FLOAT16, LB_BFLOAT16) との変換は単精度を経由し，最近接偶数丸めとする．
+	///       倍精度から半精度への変換は単精度への丸めを経由するため，まれに2段階の丸めによる1ulpの差が生じる．
+	///       x86-64 (GCC/Clang) ではF16C命令の実装をCPUに応じて実行時に選択する．
+	///
+	class TypeConvert {
+	public:
+
+		/// データ型の1要素あたりのバイト数を取得
+		///
+		/// @param[in] type データ型
+		/// @return バイト数
+		///
+		static size_t GetSize(const LB_DATA_TYPE type);
+
+		/// データ型が有効かを判定
+		///
+		/// @param[in] type データ型
+		/// @return 有効な場合true
+		///
+		static bool IsValid(const LB_DATA_TYPE type);
+
+		/// データ型を変換
+		///
+		/// @param[in]  srcType 入力のデータ型
+		/// @param[in]  src     入力 (count要素)
+		/// @param[in]  dstType 出力のデータ型
+		/// @param[out] dst     出力 (count要素)
+		/// @param[in]  count   要素数
+		///
+		/// @note srcとdstの領域は重ならないこと．バイトオーダーは実行環境のもの．
+		///
+		static void Convert(const LB_DATA_TYPE srcType, const void* src, const LB_DATA_TYPE dstType, void* dst, const size_t count);
+
+		/// 単精度浮動小数点をIEEE754半精度に変換 (最近接偶数丸め)
+		static unsigned short FloatToHalf(const float value);
+
+		/// IEEE754半精度を単精度浮動小数点に変換
+		static float HalfToFloat(const unsigned short value);
+
+		/// 単精度浮動小数点をbfloat16に変換 (最近接偶数丸め)
+		static unsigned short FloatToBFloat16(const float value);
+
+		/// bfloat16を単精度浮動小数点に変換
+		static float BFloat16ToFloat(const unsigned short value);
+	};
+
+} // namespace BCMFileIO
+
+#endif // __BCMTOOLS_TYPE_CONVERT_H__
@@ -0,0 +1,254 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  AsyncWriter.cpp
+/// @brief バックグラウンドスレッドでファイルを出力するクラス
+///
+
+#include "AsyncWriter.h"
+#include "GatherWriter.h"
+#include "FileSystemUtil.h"
+#include "Logger.h"
+
+namespace BCMFileIO {
+
+	AsyncWriter::AsyncWriter(const int maxInFlight)
+	 : m_running(false), m_stop(false), m_nextTicket(0), m_numInFlight(0),
+	   m_maxInFlight(maxInFlight < 1 ? 1 : maxInFlight)
+	{
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init(&m_cond, NULL);
+	}
+
+	AsyncWriter::~AsyncWriter()
+	{
+		WaitAll();
+
+		pthread_mutex_lock(&m_mutex);
+		m_stop = true;
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+
+		if( m_running ){
+			pthread_join(m_thread, NULL);
+		}
+
+		pthread_cond_destroy(&m_cond);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	void AsyncWriter::SetMaxInFlight(const int maxInFlight)
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_maxInFlight = maxInFlight < 1 ? 1 : maxInFlight;
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	void AsyncWriter::WaitForSlot()
+	{
+		pthread_mutex_lock(&m_mutex);
+		while( m_numInFlight >= m_maxInFlight ){
+			pthread_cond_wait(&m_cond, &m_mutex);
+		}
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	int AsyncWriter::Submit(const std::string& filepath, GatherWriter* image)
+	{
+		Job job;
+		job.filepath = filepath;
+		job.image    = image;
+
+		return Enqueue(job);
+	}
+
+	int AsyncWriter::SubmitCopy(const std::string& source, const std::string& filepath)
+	{
+		Job job;
+		job.filepath = filepath;
+		job.source   = source;
+		job.image    = NULL;
+
+		return Enqueue(job);
+	}
+
+	int AsyncWriter::Enqueue(Job& job)
+	{
+		pthread_mutex_lock(&m_mutex);
+
+		// 出力スレッドは最初の要求時に起動
+		if( !m_running ){
+			if( pthread_create(&m_thread, NULL, ThreadMain, this) != 0 ){
+				pthread_mutex_unlock(&m_mutex);
+				Logger::Error("failed to create writer thread. [%s:%d]\n", __FILE__, __LINE__);
+
+				// スレッドを起動できない場合はその場で出力
+				bool ret = Execute(job);
+
+				pthread_mutex_lock(&m_mutex);
+				int ticket = m_nextTicket++;
+				m_states[ticket] = ret ? JOB_SUCCESS : JOB_FAILED;
+				pthread_mutex_unlock(&m_mutex);
+				return ticket;
+			}
+			m_running = true;
+		}
+
+		// 未完了の要求が最大数に達している場合は空きを待つ
+		while( m_numInFlight >= m_maxInFlight ){
+			pthread_cond_wait(&m_cond, &m_mutex);
+		}
+
+		job.ticket = m_nextTicket++;
+
+		m_queue.push_back(job);
+		m_states[job.ticket] = JOB_PENDING;
+		m_numInFlight++;
+
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+
+		return job.ticket;
+	}
+
+	bool AsyncWriter::Test(const int ticket, bool* done)
+	{
+		pthread_mutex_lock(&m_mutex);
+
+		// 状態がない発行済みのチケット番号は結果を返し済み
+		bool valid = ticket >= 0 && ticket < m_nextTicket;
+		std::map<int, int>::iterator it = m_states.find(ticket);
+		*done = valid && (it == m_states.end() || it->second != JOB_PENDING);
+
+		pthread_mutex_unlock(&m_mutex);
+
+		if( !valid ){
+			Logger::Error("invalid ticket (%d). [%s:%d]\n", ticket, __FILE__, __LINE__);
+		}
+		return valid;
+	}
+
+	bool AsyncWriter::Wait(const int ticket)
+	{
+		pthread_mutex_lock(&m_mutex);
+
+		if( ticket < 0 || ticket >= m_nextTicket ){
+			pthread_mutex_unlock(&m_mutex);
+			Logger::Error("invalid ticket (%d). [%s:%d]\n", ticket, __FILE__, __LINE__);
+			return false;
+		}
+
+		bool ret = true;
+		std::map<int, int>::iterator it = m_states.find(ticket);
+		if( it == m_states.end() ){
+			// 結果を返し済み
+			ret = m_failed.find(ticket) == m_failed.end();
+		}else{
+			while( it->second == JOB_PENDING ){
+				pthread_cond_wait(&m_cond, &m_mutex);
+			}
+			ret = Report(it);
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+
+		return ret;
+	}
+
+	bool AsyncWriter::Report(std::map<int, int>::iterator it)
+	{
+		bool ret = it->second == JOB_SUCCESS;
+		if( !ret ){
+			m_failed.insert(it->first);
+		}
+		m_states.erase(it);
+
+		return ret;
+	}
+
+	bool AsyncWriter::WaitAll()
+	{
+		pthread_mutex_lock(&m_mutex);
+
+		while( m_numInFlight != 0 ){
+			pthread_cond_wait(&m_cond, &m_mutex);
+		}
+
+		bool ret = true;
+		while( !m_states.empty() ){
+			if( !Report(m_states.begin()) ){ ret = false; }
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+
+		return ret;
+	}
+
+	int AsyncWriter::GetNumInFlight()
+	{
+		pthread_mutex_lock(&m_mutex);
+		int num = m_numInFlight;
+		pthread_mutex_unlock(&m_mutex);
+
+		return num;
+	}
+
+	void* AsyncWriter::ThreadMain(void* arg)
+	{
+		static_cast<AsyncWriter*>(arg)->Run();
+		return NULL;
+	}
+
+	bool AsyncWriter::Execute(const Job& job)
+	{
+		if( job.image == NULL ){
+			return FileSystemUtil::CopyFile(job.source, job.filepath);
+		}
+
+		bool ret = job.image->Write(job.filepath);
+		delete job.image;
+		return ret;
+	}
+
+	void AsyncWriter::Run()
+	{
+		pthread_mutex_lock(&m_mutex);
+
+		for(;;){
+			while( m_queue.empty() && !m_stop ){
+				pthread_cond_wait(&m_cond, &m_mutex);
+			}
+			if( m_queue.empty() ){ break; }
+
+			Job job = m_queue.front();
+			m_queue.pop_front();
+
+			// 出力中はロックを解放
+			pthread_mutex_unlock(&m_mutex);
+
+			bool ret = Execute(job);
+
+			pthread_mutex_lock(&m_mutex);
+
+			m_states[job.ticket] = ret ? JOB_SUCCESS : JOB_FAILED;
+			m_numInFlight--;
+			pthread_cond_broadcast(&m_cond);
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+} // namespace BCMFileIO
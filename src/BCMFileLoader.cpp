@@ -41,6 +41,7 @@
 
 #include "BCMFileCommon.h"
 #include "LeafBlockLoader.h"
+#include "MemoryCheckpoint.h"
 #include "FileSystemUtil.h"
 #include "ErrorUtil.h"
 #include "Logger.h"
@@ -59,7 +60,9 @@ namespace BCMFileIO {
 	 : m_blockManager(BlockManager::getInstance()),
 	   m_comm(m_blockManager.getCommunicator()),
 	   m_octree(NULL),
-	   m_pmapper(NULL)
+	   m_pmapper(NULL),
+	   m_gmapper(NULL),
+	   m_mappedRead(false)
 	{
 
 		std::string dir = FileSystemUtil:: GetDirectory(FileSystemUtil::ConvertPath(idxFilename));
@@ -81,7 +84,9 @@ namespace BCMFileIO {
 	BCMFileLoader::~BCMFileLoader()
 	{
 		if(m_pmapper != NULL) delete m_pmapper;
+		if(m_gmapper != NULL) delete m_gmapper;
 		if(m_octree  != NULL) delete m_octree;
+		ClearSequentialState();
 	}
 
 	bool BCMFileLoader::LoadAdditionalIndex(const std::string& filepath)
@@ -291,6 +296,7 @@ namespace BCMFileIO {
 				tp->getLabels(lbls);
 
 				IdxProc proc;
+				proc.groupID = -1;
 				for(vector<string>::iterator it = lbls.begin(); it != lbls.end(); ++it){
 					string valStr;
 					tp->getValue(*it, valStr);
@@ -310,6 +316,11 @@ namespace BCMFileIO {
 						proc.rangeMax = static_cast<unsigned int>(range[1]);
 						continue;
 					}
+
+					if( CompStr(*it, "IOGroupID") == 0 ){
+						proc.groupID = atoi(valStr.c_str());
+						continue;
+					}
 				}
 				procList.push_back(proc);
 
@@ -427,6 +438,11 @@ namespace BCMFileIO {
 				continue;
 			}
 
+			if( CompStr(*it, "GhostCellSize") == 0 ){
+				ib->ghostVC = atoi(valStr.c_str());
+				continue;
+			}
+
 			if( CompStr(*it, "Prefix") == 0 ){
 				ib->prefix = valStr;
 				hasPrefix = true;
@@ -450,6 +466,45 @@ namespace BCMFileIO {
 				}else{
 					ib->isStepSubDir = false;
 				}
+				continue;
+			}
+
+			if( CompStr(*it, "GatherMode") == 0 ){
+				if( CompStr(valStr, "distributed") == 0){
+					ib->isGather    = false;
+					ib->isAggregate = false;
+				}else if( CompStr(valStr, "gathered") == 0){
+					ib->isGather    = true;
+					ib->isAggregate = false;
+				}else if( CompStr(valStr, "aggregated") == 0){
+					ib->isGather    = false;
+					ib->isAggregate = true;
+				}else{
+					Logger::Error("value (%s) of keyword [GatherMode] is invalid.\n", valStr.c_str());
+					return false;
+				}
+				continue;
+			}
+
+			if( CompStr(*it, "Codec") == 0 ){
+				if( CompStr(valStr, "none") == 0){
+					ib->codec = LB_CODEC_NONE;
+				}else if( CompStr(valStr, "lorenzo") == 0){
+					ib->codec = LB_CODEC_LORENZO;
+				}else if( CompStr(valStr, "abserr") == 0){
+					ib->codec = LB_CODEC_ABSERR;
+				}else if( CompStr(valStr, "relerr") == 0){
+					ib->codec = LB_CODEC_RELERR;
+				}else{
+					Logger::Error("value (%s) of keyword [Codec] is invalid.\n", valStr.c_str());
+					return false;
+				}
+				continue;
+			}
+
+			if( CompStr(*it, "ErrorBound") == 0 ){
+				ib->errorBound = atof(valStr.c_str());
+				continue;
 			}
 		}
 
@@ -459,8 +514,8 @@ namespace BCMFileIO {
 		}
 
 		ib->dataClassID.clear();
-		int bitWidthTable[10] = {
-			8, 8, 16, 16, 32, 32, 64, 64, 32, 64
+		int bitWidthTable[12] = {
+			8, 8, 16, 16, 32, 32, 64, 64, 32, 64, 16, 16
 		};
 		ib->bitWidth = bitWidthTable[(int)(ib->dataType)];
 
@@ -602,6 +657,20 @@ namespace BCMFileIO {
 		m_octree  = new BCMOctree(rootGrid, pedigrees);
 		m_pmapper = new PartitionMapper(m_idxProcList.size(), numProcs, header.numLeaf);
 
+		// 集約出力されている場合，I/Oグループ単位のファイルを参照するマッパを作成
+		if( m_idxProcList.size() != 0 && m_idxProcList[0].groupID >= 0 ){
+			vector<int> groupTable(m_idxProcList.size());
+			for(vector<IdxProc>::iterator it = m_idxProcList.begin(); it != m_idxProcList.end(); ++it){
+				if( it->rank >= groupTable.size() || it->groupID < 0 ){
+					Logger::Error("IOGroupID of Rank %d is invalid. [%s:%d]\n", it->rank, __FILE__, __LINE__);
+					return false;
+				}
+				groupTable[it->rank] = it->groupID;
+			}
+			m_gmapper = new PartitionMapper(m_idxProcList.size(), numProcs, header.numLeaf);
+			m_gmapper->SetGroupTable(groupTable);
+		}
+
 		// Make and register Block
 		Partition part(numProcs, header.numLeaf);
 		BlockFactory factory(m_octree, &part, bcsetter, Vec3r(header.org), rootRegion.x, m_leafBlockSize);
@@ -646,18 +715,19 @@ namespace BCMFileIO {
 		{
 			if( ib->dataClassID.size() == 0 ){
 				ib->dataClassID.resize(static_cast<size_t>(ib->kind));
+				const LB_DATA_TYPE memType = ib->GetMemoryType();
 				for(int i = 0; i < static_cast<int>(ib->kind); i++){
-					if     (ib->dataType == LB_FLOAT32){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<f32>, Scalar3DUpdater<f32> >(vc); }
-					else if(ib->dataType == LB_FLOAT64){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<f64>, Scalar3DUpdater<f64> >(vc); }
+					if     (memType == LB_FLOAT32){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<f32>, Scalar3DUpdater<f32> >(vc); }
+					else if(memType == LB_FLOAT64){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<f64>, Scalar3DUpdater<f64> >(vc); }
 					#if 0 // TODO
-					else if(ib->dataType == LB_INT8   ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D< s8>, Scalar3DUpdater< s8> >(vc); }
-					else if(ib->dataType == LB_UINT8  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D< u8>, Scalar3DUpdater< u8> >(vc); }
-					else if(ib->dataType == LB_INT16  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<s16>, Scalar3DUpdater<s16> >(vc); }
-					else if(ib->dataType == LB_UINT16 ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<u16>, Scalar3DUpdater<u16> >(vc); }
-					else if(ib->dataType == LB_INT32  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<s32>, Scalar3DUpdater<s32> >(vc); }
-					else if(ib->dataType == LB_UINT32 ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<u32>, Scalar3DUpdater<u32> >(vc); }
-					else if(ib->dataType == LB_INT64  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<s64>, Scalar3DUpdater<s64> >(vc); }
-					else if(ib->dataType == LB_UINT64 ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<u64>, Scalar3DUpdater<u64> >(vc); }
+					else if(memType == LB_INT8   ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D< s8>, Scalar3DUpdater< s8> >(vc); }
+					else if(memType == LB_UINT8  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D< u8>, Scalar3DUpdater< u8> >(vc); }
+					else if(memType == LB_INT16  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<s16>, Scalar3DUpdater<s16> >(vc); }
+					else if(memType == LB_UINT16 ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<u16>, Scalar3DUpdater<u16> >(vc); }
+					else if(memType == LB_INT32  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<s32>, Scalar3DUpdater<s32> >(vc); }
+					else if(memType == LB_UINT32 ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<u32>, Scalar3DUpdater<u32> >(vc); }
+					else if(memType == LB_INT64  ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<s64>, Scalar3DUpdater<s64> >(vc); }
+					else if(memType == LB_UINT64 ){ ib->dataClassID[i] = m_blockManager.setDataClass< Scalar3D<u64>, Scalar3DUpdater<u64> >(vc); }
 					#endif
 					m_blockManager.prepareForVCUpdate(ib->dataClassID[i], GetUniqueTag(), separateVCUpdate);
 					ib->separateVCUpdate = separateVCUpdate;
@@ -757,71 +827,215 @@ namespace BCMFileIO {
 			// cidCapsulesから逐次データを展開しBlockManager配下のBlockへデータをコピー
 			for(vector<PartitionMapper::FDIDList>::iterator file = fdidlists.begin(); file != fdidlists.end(); ++file){
 
-				// rleおよびbitVoxelの圧縮を展開
-				unsigned char* voxels = LeafBlockLoader::DecompCellIDData( header, cidCapsules[fid] );
-
-				// 展開したvoxelsからブロックごとにデータをコピー
-				for( vector<int>::iterator fdid = file->FDIDs.begin(); fdid != file->FDIDs.end(); ++fdid){
-					Vec3i ibsz( bsz.x + vc*2,     bsz.y + vc*2,     bsz.z + vc*2    );   // 内部ブロックサイズ (仮想セル込み)
-					Vec3i fbsz( bsz.x + ib->vc*2, bsz.y + ib->vc*2, bsz.z + ib->vc*2);   // ファイルブロックサイズ (仮想セル込み)
-					unsigned char* block = new unsigned char[ibsz.x * ibsz.y * ibsz.z];  // データコピー用一時バッファを準備
-					memset(block, 0, sizeof(unsigned char) * ibsz.x * ibsz.y * ibsz.z);  // 一時バッファの0クリア
-					unsigned char *pv = &voxels[ (fbsz.x * fbsz.y * fbsz.z) * (*fdid) ];
-
-					// ファイルから読み込んだCellIDを一時バッファにコピー (仮想セルサイズの不一致への対応)
-					if( vc > ib->vc ){
-						unsigned int vcd = vc - ib->vc;
-						for(int z = 0; z < fbsz.z; z++){
-							for(int y = 0; y < fbsz.y; y++){
-								size_t ibloc = 0 + vcd + ( (y + vcd) + (z + vcd) * ibsz.y ) * ibsz.x;
-								size_t fbloc = 0 +     + (  y        +  z        * fbsz.y ) * fbsz.x;
-								memcpy(&block[ibloc], &pv[fbloc], sizeof(unsigned char) * fbsz.x );
-							}
+				// 必要なブロックのみ逐次展開 (カプセルのdataはreaderで解放)
+				LeafBlockLoader::CellIDBlockReader reader(header, cidCapsules[fid]);
+				const Vec3i ibsz( bsz.x + vc*2,     bsz.y + vc*2,     bsz.z + vc*2    );   // 内部ブロックサイズ (仮想セル込み)
+				const Vec3i fbsz( bsz.x + ib->vc*2, bsz.y + ib->vc*2, bsz.z + ib->vc*2);   // ファイルブロックサイズ (仮想セル込み)
+				const int   nfdid = static_cast<int>(file->FDIDs.size());
+
+				// 展開したブロックごとにデータをコピー (ブロック単位符号はブロックごとに並列に展開)
+				int errCount = 0;
+#ifdef _OPENMP
+				#pragma omp parallel if(reader.IsRandomAccess()) reduction(+:errCount)
+#endif
+				{
+					unsigned char* pv    = new unsigned char[fbsz.x * fbsz.y * fbsz.z];  // 展開用一時バッファ
+					unsigned char* block = new unsigned char[ibsz.x * ibsz.y * ibsz.z];  // データコピー用一時バッファ
+
+#ifdef _OPENMP
+					#pragma omp for schedule(dynamic)
+#endif
+					for(int j = 0; j < nfdid; j++){
+						if( errCount != 0 || !reader.Read(file->FDIDs[j], pv) ){
+							errCount++;
+							continue;
 						}
-					}else{
-						unsigned int vcd = ib->vc - vc;
-						for(int z = 0; z < ibsz.z; z++){
-							for(int y = 0; y < ibsz.y; y++){
-								size_t ibloc = 0 +     + (  y        +  z        * ibsz.y ) * ibsz.x;
-								size_t fbloc = 0 + vcd + ( (y + vcd) + (z + vcd) * fbsz.y ) * fbsz.x;
-								memcpy(&block[ibloc], &pv[fbloc], sizeof(unsigned char) * ibsz.x );
+						memset(block, 0, sizeof(unsigned char) * ibsz.x * ibsz.y * ibsz.z);  // 一時バッファの0クリア
+
+						// ファイルから読み込んだCellIDを一時バッファにコピー (仮想セルサイズの不一致への対応)
+						if( vc > ib->vc ){
+							unsigned int vcd = vc - ib->vc;
+							for(int z = 0; z < fbsz.z; z++){
+								for(int y = 0; y < fbsz.y; y++){
+									size_t ibloc = 0 + vcd + ( (y + vcd) + (z + vcd) * ibsz.y ) * ibsz.x;
+									size_t fbloc = 0 +     + (  y        +  z        * fbsz.y ) * fbsz.x;
+									memcpy(&block[ibloc], &pv[fbloc], sizeof(unsigned char) * fbsz.x );
+								}
+							}
+						}else{
+							unsigned int vcd = ib->vc - vc;
+							for(int z = 0; z < ibsz.z; z++){
+								for(int y = 0; y < ibsz.y; y++){
+									size_t ibloc = 0 +     + (  y        +  z        * ibsz.y ) * ibsz.x;
+									size_t fbloc = 0 + vcd + ( (y + vcd) + (z + vcd) * fbsz.y ) * fbsz.x;
+									memcpy(&block[ibloc], &pv[fbloc], sizeof(unsigned char) * ibsz.x );
+								}
 							}
 						}
+						// ブロックマネージャ配下のブロックに値をコピー
+						LeafBlockLoader::CopyBufferToScalar3D(m_blockManager, dataClassID[0], did + j, vc, static_cast<const unsigned char*>(block));
 					}
-					// ブロックマネージャ配下のブロックに値をコピー
-					LeafBlockLoader::CopyBufferToScalar3D(m_blockManager, dataClassID[0], did, vc, static_cast<const unsigned char*>(block));
-					did++;
+
 					delete [] block;
+					delete [] pv;
 				}
+				if( errCount != 0 ){ err = true; }
+				did += nfdid;
 
-				delete [] voxels;
 				fid++;
+
+				if( err ){
+					// 展開していないデータを破棄
+					for(size_t i = fid; i < cidCapsules.size(); i++){
+						delete [] cidCapsules[i].data;
+					}
+					break;
+				}
 			}
+
+			if( ErrorUtil::reduceError(err) ){ return false; }
 		}
 		else
 		{
+			if( ib->isAggregate && m_gmapper == NULL ){
+				Logger::Error("IOGroupID is not found in process information. [%s:%d]\n", __FILE__, __LINE__);
+				err = true;
+			}
+			if( ErrorUtil::reduceError(err) ){ return false; }
+
 			// ファイルからデータを読み込み、ブロックマネージャ配下のブロックに値をコピー
-			if( ErrorUtil::reduceError(!LeafBlockLoader::LoadData( m_comm, ib, m_blockManager, m_pmapper, vc, step)) ){
+			ib->stageDir     = m_stageDir;
+			ib->isMappedRead = m_mappedRead;
+			PartitionMapper* pmapper = ib->isAggregate ? m_gmapper : m_pmapper;
+			if( ErrorUtil::reduceError(!LeafBlockLoader::LoadData( m_comm, ib, m_blockManager, pmapper, vc, step)) ){
 				return false;
 			}
-			// 現在の仮想セルサイズがファイルに記載されている仮想セルサイズよりも大きい場合、仮想セルの同期を行う
-			if( vc > ib->vc ){
-				for(int i = 0; i < static_cast<int>(ib->kind); i++){
-					if( ib->separateVCUpdate ){
-						m_blockManager.updateVC_X(dataClassID[i]);
-						m_blockManager.updateVC_Y(dataClassID[i]);
-						m_blockManager.updateVC_Z(dataClassID[i]);
-					}
-					else{
-						m_blockManager.updateVC(dataClassID[i]);
-					}
-				}
+			UpdateVirtualCells(ib, vc);
+		}
+
+		return true;
+	}
+
+	bool BCMFileLoader::LoadLeafBlockSequential(int *dataClassID, const std::string& name, const unsigned int vc,
+	                                            const unsigned int step, const bool separateVCUpdate)
+	{
+		bool err = false;
+
+		IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("No such name as \"%s\" in loaded index.[%s:%d]\n", name.c_str(), __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID ){
+			Logger::Error("sequential load supports Data only (%s). [%s:%d]\n", name.c_str(), __FILE__, __LINE__);
+			err = true;
+		}else if( ib->isAggregate && m_gmapper == NULL ){
+			Logger::Error("IOGroupID is not found in process information. [%s:%d]\n", __FILE__, __LINE__);
+			err = true;
+		}
+		if( ErrorUtil::reduceError(err) ){ return false; }
+
+		if( ErrorUtil::reduceError( !CreateLeafBlock(dataClassID, name, vc, separateVCUpdate) ) ){ return false; }
+
+		DataStreamState*& stream = m_streamStates[ib->name];
+		if( stream == NULL ){
+			stream = new DataStreamState;
+		}
+
+		// 前回読み込んだブロックを時間差分の基準としてファイルから読み込み，今回のブロックを保持
+		ib->stageDir     = m_stageDir;
+		ib->isMappedRead = m_mappedRead;
+		PartitionMapper* pmapper = ib->isAggregate ? m_gmapper : m_pmapper;
+		if( ErrorUtil::reduceError(!LeafBlockLoader::LoadData( m_comm, ib, m_blockManager, pmapper, vc, step, stream)) ){
+			return false;
+		}
+		UpdateVirtualCells(ib, vc);
+
+		return true;
+	}
+
+	void BCMFileLoader::ClearSequentialState(const std::string& name)
+	{
+		std::map<std::string, DataStreamState*>::iterator it = m_streamStates.begin();
+		while( it != m_streamStates.end() ){
+			if( name.empty() || it->first == name ){
+				delete it->second;
+				m_streamStates.erase(it++);
+			}else{
+				++it;
 			}
 		}
+	}
+
+	bool BCMFileLoader::LoadLeafBlockMemory(int *dataClassID, const std::string& name, const unsigned int vc,
+	                                        MemoryCheckpoint& checkpoint, const bool separateVCUpdate)
+	{
+		bool err = false;
+
+		IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("No such name as \"%s\" in loaded index.[%s:%d]\n", name.c_str(), __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID ){
+			Logger::Error("memory checkpoint supports Data only (%s). [%s:%d]\n", name.c_str(), __FILE__, __LINE__);
+			err = true;
+		}
+		if( ErrorUtil::reduceError(err) ){ return false; }
+
+		if( ErrorUtil::reduceError( !CreateLeafBlock(dataClassID, name, vc, separateVCUpdate) ) ){ return false; }
+
+		// 失われたイメージをパートナーから復元し，自プロセスのイメージからブロックに値をコピー
+		if( !checkpoint.Recover(ib->name) ){ return false; }
+
+		uint64_t size = 0;
+		const unsigned char* image = checkpoint.GetImage(ib->name, &size);
+		if( ErrorUtil::reduceError( !LeafBlockLoader::LoadDataImage(ib, m_blockManager, vc, image, size) ) ){
+			return false;
+		}
+
+		UpdateVirtualCells(ib, vc);
 
 		return true;
 	}
 
+	void BCMFileLoader::UpdateVirtualCells(const IdxBlock* ib, const unsigned int vc)
+	{
+		// 現在の仮想セルサイズがファイルに記載されている仮想セルサイズよりも大きい場合、仮想セルの同期を行う
+		if( vc <= ib->vc ){ return; }
+
+		for(int i = 0; i < static_cast<int>(ib->kind); i++){
+			if( ib->separateVCUpdate ){
+				m_blockManager.updateVC_X(ib->dataClassID[i]);
+				m_blockManager.updateVC_Y(ib->dataClassID[i]);
+				m_blockManager.updateVC_Z(ib->dataClassID[i]);
+			}
+			else{
+				m_blockManager.updateVC(ib->dataClassID[i]);
+			}
+		}
+
+		// 同期で設定されない外部境界の仮想セルを設定
+		std::map<std::string, OuterBoundaryFunc>::const_iterator func = m_outerBoundaryFuncs.find(ib->name);
+		if( func == m_outerBoundaryFuncs.end() ){ return; }
+
+		for(int id = 0; id < m_blockManager.getNumBlock(); id++){
+			for(int i = 0; i < static_cast<int>(ib->kind); i++){
+				func->second(m_blockManager.getBlock(id), ib->dataClassID[i], vc);
+			}
+		}
+	}
+
+	void BCMFileLoader::SetStagingDirectory(const std::string& dir)
+	{
+		m_stageDir = dir.empty() ? std::string("") : FileSystemUtil::FixDirectoryPath(dir);
+	}
+
+	void BCMFileLoader::SetMappedRead(const bool enable)
+	{
+		m_mappedRead = enable;
+	}
+
 	const IdxStep* BCMFileLoader::GetStep(const std::string& name ) const
 	{
 		const IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
@@ -831,6 +1045,64 @@ namespace BCMFileIO {
 		return &(ib->step);
 	}
 
+	bool BCMFileLoader::GetCodec(const std::string& name, LB_CODEC* codec, double* errorBound) const
+	{
+		const IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ) return false;
+
+		if( codec      != NULL ){ *codec      = ib->codec; }
+		if( errorBound != NULL ){ *errorBound = ib->errorBound; }
+
+		return true;
+	}
+
+	bool BCMFileLoader::SetMaskFillValue(const std::string& name, const double value)
+	{
+		IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ) return false;
+
+		ib->maskFillValue = value;
+
+		return true;
+	}
+
+	bool BCMFileLoader::SetMemoryDataType(const std::string& name, const LB_DATA_TYPE dataType)
+	{
+		IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ) return false;
+
+		if( ib->kind == LB_CELLID || !ib->dataClassID.empty() ){
+			Logger::Error("%s's memory DataType cannot be changed. [%s:%d]\n", name.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+		if( dataType != LB_FLOAT32 && dataType != LB_FLOAT64 ){
+			Logger::Error("invalid memory DataType (%d) [%s:%d]\n", dataType, __FILE__, __LINE__);
+			return false;
+		}
+
+		ib->memoryType = static_cast<int>(dataType);
+
+		return true;
+	}
+
+	bool BCMFileLoader::SetOuterBoundaryFunc(const std::string& name, OuterBoundaryFunc func)
+	{
+		IdxBlock* ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ) return false;
+
+		if( func != NULL ){
+			m_outerBoundaryFuncs[name] = func;
+		}else{
+			m_outerBoundaryFuncs.erase(name);
+		}
+
+		return true;
+	}
+
 	int BCMFileLoader::GetUniqueTag(){
 		static const int tagBase = 1000;
 		static int       conter = 0;
@@ -899,10 +1171,10 @@ namespace BCMFileIO {
 
 	bool BCMFileLoader::GetType(const std::string& typeStr, LB_DATA_TYPE &retType){
 		bool status = false;
-		const char *typeList[10] = {
-			"Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32", "Int64", "UInt64", "Float32", "Float64"
+		const char *typeList[12] = {
+			"Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32", "Int64", "UInt64", "Float32", "Float64", "Float16", "BFloat16"
 		};
-		for(int i = 0; i < 10; i++){
+		for(int i = 0; i < 12; i++){
 			if(CompStr(typeStr, typeList[i]) == 0){
 				status = true;
 				retType = (LB_DATA_TYPE)(i);
@@ -26,13 +26,24 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <sys/wait.h>
 
 #include "ErrorUtil.h"
 #include "FileSystemUtil.h"
+#include "MPIUtil.h"
 
 #include "BCMFileCommon.h"
+#include "BlockCodec.h"
+#include "TypeConvert.h"
+#include "StreamCodec.h"
 #include "BCMFileSaver.h"
 #include "LeafBlockSaver.h"
+#include "IOServer.h"
+#include "MemoryCheckpoint.h"
+#include "LeafBlockLoader.h"
 #include "Logger.h"
 
 #include "Scalar3D.h"
@@ -40,15 +51,34 @@
 
 #include "Vec3.h"
 
-#define ENABLE_RLE_ENCODE
-
 using namespace Vec3class;
 
 namespace BCMFileIO {
 
 	BCMFileSaver::BCMFileSaver( const Vec3r& globalOrigin, const Vec3r& globalRegion, const BCMOctree* octree, const std::string dir )
 	 : m_blockManager(BlockManager::getInstance()), m_comm(m_blockManager.getCommunicator()),
-	   m_octree(octree), m_globalOrigin(globalOrigin), m_globalRegion(globalRegion)
+	   m_octree(octree), m_globalOrigin(globalOrigin), m_globalRegion(globalRegion),
+	   m_asyncDepth(2), m_forkOutput(false),
+	   m_throttleAdaptive(false), m_throttleDirection(-1),
+	   m_ioClient(NULL), m_stageKeepLocal(true),
+	   m_drainer(INT_MAX) // 確定待ちの出力単位数で制限するため，コピー要求数は制限しない
+	{
+		m_targetDir = FileSystemUtil::FixDirectoryPath(dir);
+
+		m_unit.length   = std::string("NonDimensional");
+		m_unit.L0_scale = 1.0;
+		m_unit.velocity = std::string("NonDimensional");
+		m_unit.V0_scale = 1.0;
+	}
+
+	BCMFileSaver::BCMFileSaver( const Vec3r& globalOrigin, const Vec3r& globalRegion, const BCMOctree* octree,
+	                            const MPI::Intracomm& comm, const std::string dir )
+	 : m_blockManager(BlockManager::getInstance()), m_comm(comm),
+	   m_octree(octree), m_globalOrigin(globalOrigin), m_globalRegion(globalRegion),
+	   m_asyncDepth(2), m_forkOutput(false),
+	   m_throttleAdaptive(false), m_throttleDirection(-1),
+	   m_ioClient(NULL), m_stageKeepLocal(true),
+	   m_drainer(INT_MAX) // 確定待ちの出力単位数で制限するため，コピー要求数は制限しない
 	{
 		m_targetDir = FileSystemUtil::FixDirectoryPath(dir);
 
@@ -60,7 +90,22 @@ namespace BCMFileIO {
 
 	BCMFileSaver::~BCMFileSaver()
 	{
+		// 未完了の非同期出力を待つ
+		m_asyncWriter.WaitAll();
+		ReapForkedWriters(0);
 
+		if( !MPI::Is_finalized() ){
+			if( m_ioClient != NULL ){
+				m_ioClient->Close();
+			}
+			if( m_ioConfig.info != MPI::INFO_NULL ){
+				m_ioConfig.info.Free();
+			}
+			if( m_ioConfig.groupComm != MPI::COMM_NULL ){
+				m_ioConfig.groupComm.Free();
+			}
+		}
+		delete m_ioClient;
 	}
 
 	bool BCMFileSaver::RegisterCellIDInformation( const int          dataClassID,
@@ -108,9 +153,25 @@ namespace BCMFileIO {
                                              const std::string&  extension,
                                              const IdxStep&      step,
                                              const std::string&  dataDir,
-                                             const bool          stepSubDir )
+                                             const bool          stepSubDir,
+                                             const bool          gather,
+                                             const LB_CODEC      codec,
+                                             const double        errorBound )
 	{
 		if(!dataClassID){ return false; }
+		if( !BlockCodec::IsSupported(codec, dataType) ){
+			Logger::Error("codec(%d) does not support DataType(%d) [%s:%d]\n", codec, dataType, __FILE__, __LINE__);
+			return false;
+		}
+		// 集約出力 (SetAggregation()後に登録したData) もブロックをそのまま出力するため圧縮不可
+		if( codec != LB_CODEC_NONE && (gather || m_ioConfig.groupComm != MPI::COMM_NULL) ){
+			Logger::Error("codec(%d) supports distributed mode only [%s:%d]\n", codec, __FILE__, __LINE__);
+			return false;
+		}
+		if( BlockCodec::IsLossy(codec) && !(errorBound > 0.0) ){
+			Logger::Error("errorBound(%e) of codec(%d) must be positive [%s:%d]\n", errorBound, codec, __FILE__, __LINE__);
+			return false;
+		}
 		for(int i = 0; i < static_cast<int>(kind); i++){
 			if(dataClassID[i] < 0){
 				Logger::Error("dataClassID(%d) is invalid) [%s:%d]\n", dataClassID[i], __FILE__, __LINE__);
@@ -124,8 +185,8 @@ namespace BCMFileIO {
 		}
 
 
-		unsigned int bitWidthTable[10] = {
-			8, 8, 16, 16, 32, 32, 64, 64, 32, 64
+		unsigned int bitWidthTable[12] = {
+			8, 8, 16, 16, 32, 32, 64, 64, 32, 64, 16, 16
 		};
 
 
@@ -145,7 +206,11 @@ namespace BCMFileIO {
 		ib.name         = name;
 		ib.prefix       = prefix;
 		ib.extension    = extension;
+		ib.codec        = codec;
+		ib.errorBound   = BlockCodec::IsLossy(codec) ? errorBound : 0.0;
 		ib.isStepSubDir = stepSubDir;
+		ib.isGather     = gather;
+		ib.isAggregate  = !gather && m_ioConfig.groupComm != MPI::COMM_NULL;
 		ib.step         = step;
 
 		m_idxBlockList.push_back(ib);
@@ -160,37 +225,340 @@ namespace BCMFileIO {
 	}
 
 
+	bool BCMFileSaver::SetIOHint( const std::string& key, const std::string& value )
+	{
+		if( m_ioConfig.info == MPI::INFO_NULL ){
+			m_ioConfig.info = MPI::Info::Create();
+		}
+		m_ioConfig.info.Set(key.c_str(), value.c_str());
+		return true;
+	}
+
+
+	bool BCMFileSaver::SetAggregation( const int groupSize )
+	{
+		using namespace std;
+
+		if( groupSize < 0 ){
+			Logger::Error("groupSize(%d) is invalid. [%s:%d]\n", groupSize, __FILE__, __LINE__);
+			return false;
+		}
+
+		const int rank = m_comm.Get_rank();
+
+		int groupID = 0;
+		if( groupSize > 0 ){
+			groupID = rank / groupSize;
+		}else{
+			// 同じノードのプロセスのうち最小のランク番号 (リーダー) の表
+			vector<int> leaderTable;
+			MPIUtil::GetNodeLeaderTable(m_comm, leaderTable);
+
+			// リーダーのランク番号順にグループ番号を割り当てる
+			const int leader = leaderTable[rank];
+			for(int i = 0; i < leader; i++){
+				if( leaderTable[i] == i ){ groupID++; }
+			}
+		}
+
+		return SetAggregationGroup(groupID);
+	}
+
+	bool BCMFileSaver::SetAggregationGroup( const int groupID )
+	{
+		using namespace std;
+
+		bool err = false;
+		if( groupID < 0 ){
+			Logger::Error("groupID(%d) is invalid. [%s:%d]\n", groupID, __FILE__, __LINE__);
+			err = true;
+		}
+
+		// 集約出力は圧縮・定数省略・マスク・増分出力に対応しないため，設定済みのDataがある場合はエラー
+		for(vector<IdxBlock>::const_iterator it = m_idxBlockList.begin(); it != m_idxBlockList.end(); ++it){
+			if( it->kind == LB_CELLID || it->isGather ){ continue; }
+			if( it->codec != LB_CODEC_NONE || it->isElideConstant || it->maskClassID >= 0 ||
+			    m_deltaStates.find(it->name) != m_deltaStates.end() ){
+				Logger::Error("%s has options for distributed output only (codec, constant elision, cell mask or incremental output). [%s:%d]\n",
+				              it->name.c_str(), __FILE__, __LINE__);
+				err = true;
+			}
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		const int rank = m_comm.Get_rank();
+
+		if( m_ioConfig.groupComm != MPI::COMM_NULL ){
+			m_ioConfig.groupComm.Free();
+		}
+		m_ioConfig.groupComm = m_comm.Split(groupID, rank);
+		m_ioConfig.groupID   = groupID;
+
+		for(vector<IdxBlock>::iterator it = m_idxBlockList.begin(); it != m_idxBlockList.end(); ++it){
+			if( it->kind != LB_CELLID ){
+				it->isAggregate = !it->isGather;
+			}
+		}
+
+		return true;
+	}
+
+
+	bool BCMFileSaver::SetIOServer( const MPI::Intracomm& comm, const int numServers )
+	{
+		if( numServers < 1 || numServers >= comm.Get_size() ){
+			Logger::Error("numServers(%d) is invalid. [%s:%d]\n", numServers, __FILE__, __LINE__);
+			return false;
+		}
+		if( m_ioClient != NULL ){
+			Logger::Error("I/O server is already set. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		m_ioClient = new IOServerClient(comm, numServers, m_asyncDepth);
+		return true;
+	}
+
+
+	bool BCMFileSaver::CloseIOServer()
+	{
+		bool err = false;
+		if( m_ioClient != NULL ){
+			err = !m_ioClient->Close();
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){
+			Logger::Error("I/O server failed to write file. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		return true;
+	}
+
+
+	bool BCMFileSaver::SetStaging( const std::string& localDir, const bool keepLocal )
+	{
+		bool ret = true;
+		if( IsStaging() ){
+			ret = WaitStaging();
+		}
+
+		m_stageDir       = localDir.empty() ? std::string("") : FileSystemUtil::FixDirectoryPath(localDir);
+		m_stageKeepLocal = keepLocal;
+		return ret;
+	}
+
+
+	bool BCMFileSaver::WaitStaging()
+	{
+		if( !CommitStaging(0) ){
+			Logger::Error("Staging [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		return true;
+	}
+
+
+	void BCMFileSaver::StageFile(const std::string& relPath, std::vector<StagedFile>& group)
+	{
+		StagedFile sf;
+		sf.localPath = m_stageDir  + relPath;
+		sf.finalPath = m_targetDir + relPath;
+
+		// 以前の出力の確定記録は無効 (確定時に作り直す)
+		FileSystemUtil::RemoveCommitStamp(sf.localPath);
+
+		// コピー先のディレクトリはここで作成 (コピースレッドはファイルのコピーのみ行う)
+		std::string dir = FileSystemUtil::GetDirectory(sf.finalPath);
+		if( FileSystemUtil::CreateDirectory(dir, dir.find("/") == 0 ? true : false) ){
+			sf.ticket = m_drainer.SubmitCopy(sf.localPath, sf.finalPath + std::string(".drain"));
+		}else{
+			sf.ticket = STAGE_FAILED;
+		}
+
+		group.push_back(sf);
+	}
+
+
+	bool BCMFileSaver::CommitStaging(const size_t maxRemain)
+	{
+		bool err = false;
+
+		while( !m_stageGroups.empty() ){
+			std::vector<StagedFile>& group = m_stageGroups.front();
+			const bool wait = m_stageGroups.size() > maxRemain;
+
+			// 自プロセスのコピー要求を回収
+			int state[2] = { 0, 0 }; // { 未完了, 失敗 }
+			for(std::vector<StagedFile>::iterator it = group.begin(); it != group.end(); ++it){
+				if( it->ticket < 0 ){ continue; }
+				bool done = false;
+				if( !wait && m_drainer.Test(it->ticket, &done) && !done ){
+					state[0] = 1;
+					continue;
+				}
+				it->ticket = m_drainer.Wait(it->ticket) ? STAGE_DRAINED : STAGE_FAILED;
+			}
+			for(std::vector<StagedFile>::iterator it = group.begin(); it != group.end(); ++it){
+				if( it->ticket == STAGE_FAILED ){ state[1] = 1; }
+			}
+
+			int gstate[2] = { 0, 0 };
+			m_comm.Allreduce(state, gstate, 2, MPI::INT, MPI::MAX);
+
+			// コピーが完了していないプロセスがある場合は次回に持ち越す
+			if( gstate[0] != 0 ){ break; }
+
+			for(std::vector<StagedFile>::iterator it = group.begin(); it != group.end(); ++it){
+				std::string drainPath = it->finalPath + std::string(".drain");
+				if( gstate[1] != 0 ){
+					// いずれかのプロセスが失敗した出力単位は確定しない
+					remove(drainPath.c_str());
+					continue;
+				}
+				if( rename(drainPath.c_str(), it->finalPath.c_str()) != 0 ){
+					Logger::Error("cannot rename file (%s). [%s:%d]\n", drainPath.c_str(), __FILE__, __LINE__);
+					err = true;
+					continue;
+				}
+				if( !m_stageKeepLocal ){
+					remove(it->localPath.c_str());
+				}else if( !FileSystemUtil::WriteCommitStamp(it->localPath, it->finalPath) ){
+					// 確定記録がない一時出力先のファイルは読み込み時に使用されないだけのため，エラーとしない
+					Logger::Warn("cannot write commit stamp (%s). [%s:%d]\n", it->localPath.c_str(), __FILE__, __LINE__);
+				}
+			}
+			if( gstate[1] != 0 ){
+				Logger::Error("failed to drain staged files. [%s:%d]\n", __FILE__, __LINE__);
+				err = true;
+			}
+
+			m_stageGroups.pop_front();
+		}
+
+		return !ErrorUtil::reduceError(err, m_comm);
+	}
+
+
+	bool BCMFileSaver::SetWriteThrottle( const int maxWriters, const bool adaptive )
+	{
+		if( maxWriters < 0 ){
+			Logger::Error("maxWriters(%d) is invalid. [%s:%d]\n", maxWriters, __FILE__, __LINE__);
+			return false;
+		}
+
+		m_ioConfig.maxWriters = maxWriters;
+		m_throttleAdaptive    = adaptive && maxWriters > 0;
+		m_throttleDirection   = -1;
+		m_throttleSamples.clear();
+		return true;
+	}
+
+
+	void BCMFileSaver::AdaptWriteThrottle(const std::string& name, const uint64_t bytes, const double elapsed)
+	{
+		// 全プロセスの出力量 (圧縮後のファイルサイズ) と最大出力時間からスループットを求める
+		const double localBytes = static_cast<double>(bytes);
+		double totalBytes  = 0.0;
+		double maxElapsed  = 0.0;
+		m_comm.Allreduce(&localBytes, &totalBytes, 1, MPI::DOUBLE, MPI::SUM);
+		m_comm.Allreduce(&elapsed, &maxElapsed, 1, MPI::DOUBLE, MPI::MAX);
+		if( maxElapsed <= 0.0 ){ return; }
+
+		const double throughput = totalBytes / maxElapsed;
+
+		// 系ごとの最初の観測値は基準として記録のみ
+		std::map<std::string, ThrottleSample>::iterator it = m_throttleSamples.find(name);
+		if( it == m_throttleSamples.end() ){
+			ThrottleSample& sample = m_throttleSamples[name];
+			sample.maxWriters = m_ioConfig.maxWriters;
+			sample.throughput = throughput;
+			return;
+		}
+
+		// 前回と異なる上限で同じ系のスループットが低下した場合は調整方向を反転
+		if( it->second.maxWriters != m_ioConfig.maxWriters && throughput < it->second.throughput ){
+			m_throttleDirection = -m_throttleDirection;
+		}
+		it->second.maxWriters = m_ioConfig.maxWriters;
+		it->second.throughput = throughput;
+
+		int maxWriters = m_ioConfig.maxWriters;
+		maxWriters = m_throttleDirection > 0 ? maxWriters * 2 : maxWriters / 2;
+		if( maxWriters < 1 ){ maxWriters = 1; m_throttleDirection = 1; }
+		if( maxWriters > m_comm.Get_size() ){ maxWriters = m_comm.Get_size(); m_throttleDirection = -1; }
+
+		m_ioConfig.maxWriters = maxWriters;
+	}
+
+
 	bool BCMFileSaver::Save()
 	{
 		using namespace std;
 
 		string octFilename("tree.oct");
-		string octFilepath = m_targetDir + octFilename;
+		string octFilepath = GetWriteDirectory() + octFilename;
 		//if( m_comm.Get_rank() == 0) Logger::Info("Output Files are : IDX[%s], OCT[%s]\n", idxFilepath.c_str(), octFilepath.c_str());
 
 		bool err = false;
 
-		if( m_comm.Get_rank() == 0 ){
+		// I/Oサーバを使用する場合，出力ディレクトリはI/Oサーバが作成
+		if( m_comm.Get_rank() == 0 && m_ioClient == NULL ){
 			err = !FileSystemUtil::CreateDirectory(m_targetDir, m_targetDir.find("/") == 0 ? true : false);
+			if( !err && IsStaging() ){
+				err = !FileSystemUtil::CreateDirectory(m_stageDir, m_stageDir.find("/") == 0 ? true : false);
+			}
 		}else{
 			err = false;
 		}
-		if( ErrorUtil::reduceError(err) ){
+		if( ErrorUtil::reduceError(err, m_comm) ){
 			return false;
 		}
 
-		err = ErrorUtil::reduceError( !SaveIndex(octFilename, m_octree->getNumLeafNode()) );
+		err = ErrorUtil::reduceError( !SaveIndex(octFilename, m_octree->getNumLeafNode()), m_comm );
 		if( err ){
 			Logger::Error("faild to save index file. [%s:%d]\n", __FILE__, __LINE__);
 			return false;
 		}
 
-		err = ErrorUtil::reduceError( !SaveOctree(octFilepath, m_octree) );
+		err = ErrorUtil::reduceError( !SaveOctree(octFilepath, m_octree), m_comm );
 		if( err ){
 			Logger::Error("faild to save octree file. [%s:%d]\n", __FILE__, __LINE__);
 			return false;
 		}
 
+		// I/Oサーバから結果を受信済みの出力を確認
+		if( m_ioClient != NULL ){
+			err = ErrorUtil::reduceError( !m_ioClient->CollectStatus(false), m_comm );
+			if( err ){
+				Logger::Error("I/O server failed to write file. [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
+
+		// 一時出力先のインデックスファイルとOctreeを出力ディレクトリへコピー
+		if( IsStaging() ){
+			vector<StagedFile> group;
+			if( m_comm.Get_rank() == 0 ){
+				bool hasCellID = false;
+				bool hasData   = false;
+				for(vector<IdxBlock>::iterator it = m_idxBlockList.begin(); it != m_idxBlockList.end(); ++it){
+					if( it->kind == LB_CELLID ){ hasCellID = true; }
+					else                       { hasData   = true; }
+				}
+				StageFile(string("proc.bcm"), group);
+				if( hasCellID ){ StageFile(string("cellid.bcm"), group); }
+				if( hasData   ){ StageFile(string("data.bcm"),   group); }
+				StageFile(octFilename, group);
+			}
+			m_stageGroups.push_back(group);
+
+			if( !CommitStaging(static_cast<size_t>(m_asyncDepth)) ){
+				Logger::Error("Staging [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
+
 		return true;
 	}
 
@@ -208,10 +576,42 @@ namespace BCMFileIO {
 			err = true;
 		}
 
-		if( ErrorUtil::reduceError(err) ){ return false; }
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
 		err = false;
 
-		if( ib->kind == LB_CELLID )
+		// 前回までに子プロセスで出力したファイルの結果を回収 (出力中の子プロセス数を上限未満に抑える)
+		if( m_forkOutput ){
+			if( ErrorUtil::reduceError( !ReapForkedWriters(static_cast<size_t>(m_asyncDepth - 1)), m_comm ) ){
+				Logger::Error("Save Leaf Block (Fork) [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
+
+		// 段階出力の場合，分散ファイルは一時出力先へ出力 (確定待ちの出力単位数を上限未満に抑える)
+		const bool staged = IsStaging() && !ib->isGather && !ib->isAggregate;
+		IdxBlock stagedIB;
+		if( staged ){
+			if( !CommitStaging(static_cast<size_t>(m_asyncDepth - 1)) ){
+				Logger::Error("Staging [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+			stagedIB = *ib;
+			stagedIB.rootDir = m_stageDir;
+			ib = &stagedIB;
+		}
+
+		if( ib->kind == LB_CELLID && m_ioClient != NULL && !ib->isGather )
+		{
+			unsigned char *data = GetCellIDBlock(ib, m_blockManager);
+			err = !LeafBlockSaver::SaveCellIDIOServer(m_comm, ib, m_blockManager.getSize(), m_blockManager.getNumBlock(), data, *m_ioClient);
+			err = !m_ioClient->CollectStatus(false) || err;
+
+			if( ErrorUtil::reduceError(err, m_comm) ){
+				Logger::Error("Save Leaf Block (CellID) [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
+		else if( ib->kind == LB_CELLID )
 		{
 			string lbdir = ib->rootDir + ib->dataDir;
 			if( ib->isGather ){
@@ -220,42 +620,523 @@ namespace BCMFileIO {
 				err = !FileSystemUtil::CreateDirectory(lbdir, lbdir.find("/") == 0 ? true : false);
 			}
 
-			if( ErrorUtil::reduceError(err) ){
+			if( ErrorUtil::reduceError(err, m_comm) ){
 				Logger::Error("Cannot Create Output Directory (%s) [%s:%d]\n", lbdir.c_str(), __FILE__, __LINE__);
 				return false;
 			}
 
-			unsigned char *data = GetCellIDBlock(ib, m_blockManager);
-			if( data == NULL ){
-				err = true;
-			} else {
-#ifdef ENABLE_RLE_ENCODE
-				err = !LeafBlockSaver::SaveCellID(m_comm, ib, m_blockManager.getSize(), m_blockManager.getNumBlock(), data, true);
-#else
-				err = !LeafBlockSaver::SaveCellID(m_comm, ib, m_blockManager.getSize(), m_blockManager.getNumBlock(), data, false);
-#endif // ENABLE_RLE_ENCODE
-				delete [] data;
+			if( CellIDStreamEncoder::IsSupported(ib->streamCodec) || ib->streamCodec == LB_STREAM_BLOCK ){
+				// ブロックから逐次またはブロック単位で符号化 (ランク全体のCellIDを作成しない)
+				err = !LeafBlockSaver::SaveCellID(m_comm, ib, m_blockManager);
+			}else{
+				unsigned char *data = GetCellIDBlock(ib, m_blockManager);
+				if( data == NULL ){
+					err = true;
+				} else {
+					err = !LeafBlockSaver::SaveCellID(m_comm, ib, m_blockManager.getSize(), m_blockManager.getNumBlock(), data);
+					delete [] data;
+				}
 			}
 
-			if( ErrorUtil::reduceError(err) ){
+			if( ErrorUtil::reduceError(err, m_comm) ){
 				Logger::Error("Save Leaf Block (CellID) [%s:%d]\n", __FILE__, __LINE__);
 				return false;
 			}
 		}
+		else if( m_deltaStates.find(ib->name) != m_deltaStates.end() && !ib->isGather && !ib->isAggregate )
+		{
+			err = !LeafBlockSaver::SaveDataIncremental(m_comm, ib, m_blockManager, step, m_deltaStates[ib->name], m_ioConfig);
+
+			if( ErrorUtil::reduceError(err, m_comm) ){
+				Logger::Error("Save Leaf Block (Incremental) [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
+		else if( m_ioClient != NULL && !ib->isGather && !ib->isAggregate )
+		{
+			err = !LeafBlockSaver::SaveDataIOServer(m_comm, ib, m_blockManager, step, *m_ioClient);
+			err = !m_ioClient->CollectStatus(false) || err;
+
+			if( ErrorUtil::reduceError(err, m_comm) ){
+				Logger::Error("Save Leaf Block (I/O Server) [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
+		else if( m_forkOutput && !staged && !ib->isGather && !ib->isAggregate )
+		{
+			pid_t pid = -1;
+			err = !LeafBlockSaver::SaveDataFork(m_comm, ib, m_blockManager, step, &pid);
+			if( pid > 0 ){
+				m_forkedWriters.push_back(pid);
+			}
+
+			if( ErrorUtil::reduceError(err, m_comm) ){
+				Logger::Error("Save Leaf Block (Fork) [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
+		}
 		else
 		{
-			err = !LeafBlockSaver::SaveData(m_comm, ib, m_blockManager, step);
+			double   t0 = MPI::Wtime();
+			uint64_t writtenBytes = 0;
+			err = !LeafBlockSaver::SaveData(m_comm, ib, m_blockManager, step, m_ioConfig, &writtenBytes);
+			double   elapsed = MPI::Wtime() - t0;
 
-			if( ErrorUtil::reduceError(err) ){
+			if( ErrorUtil::reduceError(err, m_comm) ){
 				Logger::Error("Save Leaf Block (Scalar) [%s:%d]\n", __FILE__, __LINE__);
 				return false;
 			}
+
+			if( m_throttleAdaptive && !ib->isGather && !ib->isAggregate ){
+				AdaptWriteThrottle(ib->name, writtenBytes, elapsed);
+			}
+		}
+
+		// 一時出力先のファイルを出力ディレクトリへコピー
+		if( staged ){
+			const string filepath = ib->kind == LB_CELLID ? LeafBlockSaver::GetCellIDFilePath(ib, m_comm.Get_rank())
+			                                              : LeafBlockSaver::GetDataFilePath(ib, step, m_comm.Get_rank());
+			vector<StagedFile> group;
+			StageFile(filepath.substr(m_stageDir.size()), group);
+			m_stageGroups.push_back(group);
+
+			if( !CommitStaging(static_cast<size_t>(m_asyncDepth)) ){
+				Logger::Error("Staging [%s:%d]\n", __FILE__, __LINE__);
+				return false;
+			}
 		}
 
 		return true;
 
 	}
 
+	bool BCMFileSaver::SetIncrementalOutput(const char* name, const int fullInterval, const LB_DELTA delta)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID || ib->isGather || ib->isAggregate ){
+			Logger::Error("incremental output supports distributed Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( fullInterval < 0 ){
+			Logger::Error("invalid interval (%d). [%s:%d]\n", fullInterval, __FILE__, __LINE__);
+			err = true;
+		}else if( delta != LB_DELTA_NONE && BlockCodec::IsLossy(ib->codec) ){
+			// 時間差分の基準は読み込み時に復元した値と一致する必要がある
+			Logger::Error("temporal delta requires lossless codec (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		m_deltaStates.erase(ib->name);
+		if( fullInterval > 0 ){
+			m_deltaStates[ib->name].fullInterval = fullInterval;
+			m_deltaStates[ib->name].delta        = delta;
+		}
+
+		return true;
+	}
+
+	bool BCMFileSaver::SetCellIDCodec(const char* name, const unsigned int codec, const int param)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind != LB_CELLID ){
+			Logger::Error("%s is not CellID. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( !StreamCodec::IsAvailable(codec) ){
+			Logger::Error("codec(%u) is not registered. [%s:%d]\n", codec, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		ib->streamCodec      = codec;
+		ib->streamCodecParam = param;
+
+		return true;
+	}
+
+	bool BCMFileSaver::SetConstantElision(const char* name, const bool enable)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID || ib->isGather || ib->isAggregate ){
+			Logger::Error("constant elision supports distributed Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		ib->isElideConstant = enable;
+
+		return true;
+	}
+
+	bool BCMFileSaver::SetCellMask(const char* name, const int cellIDClassID, CellMaskPredicate isActive)
+	{
+		// 判定関数は設定時に全CellIDについて評価して格納フラグの表にする
+		std::vector<unsigned char> table;
+		if( cellIDClassID >= 0 && isActive != NULL ){
+			table.resize(256);
+			for(int i = 0; i < 256; i++){
+				table[i] = isActive(static_cast<unsigned char>(i)) ? 1 : 0;
+			}
+		}
+		return SetCellMaskTable(name, cellIDClassID, table);
+	}
+
+	bool BCMFileSaver::SetCellMask(const char* name, const int cellIDClassID, const unsigned char inactiveID)
+	{
+		std::vector<unsigned char> table(256, 1);
+		table[inactiveID] = 0;
+		return SetCellMaskTable(name, cellIDClassID, table);
+	}
+
+	bool BCMFileSaver::SetCellMaskTable(const char* name, const int cellIDClassID, const std::vector<unsigned char>& table)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID || ib->isGather || ib->isAggregate ){
+			Logger::Error("cell mask supports distributed Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( cellIDClassID >= 0 ){
+			if( table.size() != 256 ){
+				Logger::Error("cell mask predicate is NULL (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+				err = true;
+			}
+			// マスクに使用するデータクラスがCellIDであり，物理量と同じ範囲の仮想セルを持つことを確認
+			// (内部セルのみ出力する場合も，出力を省略した仮想セルを含む元の仮想セルサイズで比較)
+			const int vc = static_cast<int>(ib->vc + ib->ghostVC);
+			for(int id = 0; !err && id < m_blockManager.getNumBlock(); id++){
+				Scalar3D<unsigned char>* mesh = dynamic_cast< Scalar3D<unsigned char>* >(m_blockManager.getBlock(id)->getDataClass(cellIDClassID));
+				if( mesh == NULL ){
+					Logger::Error("dataClassID(%d) is not CellID. [%s:%d]\n", cellIDClassID, __FILE__, __LINE__);
+					err = true;
+				}else if( mesh->getVCsize() < vc ){
+					Logger::Error("CellID(%d)'s vc(%d) is smaller than %s's vc(%d). [%s:%d]\n", cellIDClassID, mesh->getVCsize(), name, vc, __FILE__, __LINE__);
+					err = true;
+				}
+			}
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		ib->maskClassID = cellIDClassID >= 0 ? cellIDClassID : -1;
+		ib->maskTable   = ib->maskClassID >= 0 ? table : std::vector<unsigned char>();
+
+		return true;
+	}
+
+	bool BCMFileSaver::SetOutputDataType(const char* name, const LB_DATA_TYPE dataType)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID ){
+			Logger::Error("output DataType supports Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( !TypeConvert::IsValid(dataType) ){
+			Logger::Error("invalid DataType (%d) [%s:%d]\n", dataType, __FILE__, __LINE__);
+			err = true;
+		}else if( !BlockCodec::IsSupported(ib->codec, dataType) ){
+			Logger::Error("codec(%d) does not support DataType(%d) [%s:%d]\n", ib->codec, dataType, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		// メモリ上の型はRegister時のデータ型のまま保持
+		if( ib->memoryType < 0 ){
+			ib->memoryType = static_cast<int>(ib->dataType);
+		}
+		ib->dataType = dataType;
+		ib->bitWidth = static_cast<unsigned int>(TypeConvert::GetSize(dataType) * 8);
+
+		return true;
+	}
+
+	bool BCMFileSaver::SetInteriorOutput(const char* name, const bool enable)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID ){
+			Logger::Error("interior output supports Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		// 出力する仮想セルサイズを0とし，Register時の仮想セルサイズを保持
+		if( enable && ib->ghostVC == 0 ){
+			ib->ghostVC = ib->vc;
+			ib->vc      = 0;
+		}else if( !enable && ib->ghostVC != 0 ){
+			ib->vc      = ib->ghostVC;
+			ib->ghostVC = 0;
+		}
+
+		return true;
+	}
+
+	bool BCMFileSaver::CompactLeafBlock(const char* name, const unsigned int step)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID || ib->isGather || ib->isAggregate ){
+			Logger::Error("compaction supports distributed Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		err = !LeafBlockLoader::CompactDataFile(ib, m_blockManager.getSize(), step, m_comm.Get_rank());
+
+		if( ErrorUtil::reduceError(err, m_comm) ){
+			Logger::Error("Compact Leaf Block [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		// 以降の増分ファイルは変換したステップのみを参照する
+		std::map<std::string, DataDeltaState>::iterator it = m_deltaStates.find(ib->name);
+		if( it != m_deltaStates.end() && !it->second.owners.empty() && it->second.lastStep == step ){
+			it->second.owners.assign(it->second.owners.size(), step);
+		}
+
+		return true;
+	}
+
+	bool BCMFileSaver::SaveLeafBlockMemory(const char* name, const unsigned int step, MemoryCheckpoint& checkpoint)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID ){
+			Logger::Error("memory checkpoint supports Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		if( !LeafBlockSaver::SaveDataMemory(m_comm, ib, m_blockManager, step, checkpoint) ){
+			Logger::Error("Save Leaf Block (Memory) [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool BCMFileSaver::RestoreLeafBlockMemory(const char* name, MemoryCheckpoint& checkpoint, unsigned int* step)
+	{
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}else if( ib->kind == LB_CELLID ){
+			Logger::Error("memory checkpoint supports Data only (%s). [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		if( !checkpoint.Recover(ib->name) ){
+			return false;
+		}
+
+		uint64_t size = 0;
+		const unsigned char* image = checkpoint.GetImage(ib->name, &size, step);
+		err = !LeafBlockLoader::LoadDataImage(ib, m_blockManager, ib->vc, image, size);
+
+		if( ErrorUtil::reduceError(err, m_comm) ){
+			Logger::Error("Restore Leaf Block (Memory) [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool BCMFileSaver::SaveLeafBlockAsync(const char* name, unsigned int step, int* handle )
+	{
+		if( handle != NULL ){ *handle = -1; }
+
+		bool err = false;
+
+		IdxBlock *ib = IdxBlock::find(m_idxBlockList, name);
+
+		if( ib == NULL ){
+			Logger::Error("%s is not registerd. [%s:%d]\n", name, __FILE__, __LINE__);
+			err = true;
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){ return false; }
+
+		// 分散ファイル以外は出力時に通信が必要なため同期出力 (I/Oサーバ使用時は送信後すぐに戻る)
+		// 増分出力は前回の出力との比較が必要なため同期出力
+		if( ib->kind == LB_CELLID || ib->isGather || ib->isAggregate || m_ioClient != NULL || IsStaging() ||
+		    m_deltaStates.find(ib->name) != m_deltaStates.end() ){
+			return SaveLeafBlock(name, step);
+		}
+
+		int ticket = -1;
+		err = !LeafBlockSaver::SaveDataAsync(m_comm, ib, m_blockManager, step, m_asyncWriter, &ticket);
+
+		if( ErrorUtil::reduceError(err, m_comm) ){
+			Logger::Error("Save Leaf Block (Scalar) [%s:%d]\n", __FILE__, __LINE__);
+			if( ticket >= 0 ){ m_asyncWriter.Wait(ticket); }
+			return false;
+		}
+
+		if( handle != NULL ){ *handle = ticket; }
+
+		return true;
+	}
+
+	bool BCMFileSaver::TestLeafBlock(const int handle, bool* done)
+	{
+		if( handle < 0 ){
+			*done = true;
+			return true;
+		}
+
+		return m_asyncWriter.Test(handle, done);
+	}
+
+	bool BCMFileSaver::WaitLeafBlock(const int handle)
+	{
+		bool err = false;
+		if( handle >= 0 ){
+			err = !m_asyncWriter.Wait(handle);
+		}
+
+		if( ErrorUtil::reduceError(err, m_comm) ){
+			Logger::Error("Save Leaf Block (Async) [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		return true;
+	}
+
+	bool BCMFileSaver::WaitAllLeafBlock()
+	{
+		bool err = !m_asyncWriter.WaitAll();
+
+		if( ErrorUtil::reduceError(err, m_comm) ){
+			Logger::Error("Save Leaf Block (Async) [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		return true;
+	}
+
+	bool BCMFileSaver::SetAsyncDepth(const int depth)
+	{
+		if( depth < 1 ){
+			Logger::Error("depth(%d) is invalid. [%s:%d]\n", depth, __FILE__, __LINE__);
+			return false;
+		}
+		m_asyncWriter.SetMaxInFlight(depth);
+		if( m_ioClient != NULL ){
+			m_ioClient->SetMaxInFlight(depth);
+		}
+		m_asyncDepth = depth;
+		return true;
+	}
+
+	bool BCMFileSaver::SetForkOutput(const bool enable)
+	{
+		bool ret = true;
+		if( m_forkOutput && !enable ){
+			ret = WaitForkOutput();
+		}
+		m_forkOutput = enable;
+		return ret;
+	}
+
+	bool BCMFileSaver::WaitForkOutput()
+	{
+		if( ErrorUtil::reduceError( !ReapForkedWriters(0), m_comm ) ){
+			Logger::Error("Save Leaf Block (Fork) [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		return true;
+	}
+
+	bool BCMFileSaver::ReapForkedWriters(const size_t maxRemain)
+	{
+		bool ret = true;
+
+		std::vector<pid_t> remain;
+		for(std::vector<pid_t>::iterator it = m_forkedWriters.begin(); it != m_forkedWriters.end(); ++it){
+			// 終了済みの子プロセスを回収 (待機しない)
+			int status = 0;
+			pid_t r = waitpid(*it, &status, WNOHANG);
+			if( r == 0 ){
+				remain.push_back(*it);
+				continue;
+			}
+			if( r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ){
+				Logger::Error("forked writer (pid %d) failed. [%s:%d]\n", static_cast<int>(*it), __FILE__, __LINE__);
+				ret = false;
+			}
+		}
+
+		// 残りが多い場合は古いものから終了を待つ
+		size_t head = 0;
+		while( remain.size() - head > maxRemain ){
+			int status = 0;
+			pid_t r;
+			while( (r = waitpid(remain[head], &status, 0)) < 0 && errno == EINTR ){}
+			if( r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ){
+				Logger::Error("forked writer (pid %d) failed. [%s:%d]\n", static_cast<int>(remain[head]), __FILE__, __LINE__);
+				ret = false;
+			}
+			head++;
+		}
+
+		m_forkedWriters.assign(remain.begin() + head, remain.end());
+
+		return ret;
+	}
+
 	bool BCMFileSaver::SaveIndexProc(const std::string& filepath, const Partition& part)
 	{
 		using namespace std;
@@ -291,6 +1172,10 @@ namespace BCMFileIO {
 			m_comm.Send(hostname, nameLen, MPI::CHAR, 0, m_comm.Get_rank());
 		}
 
+		// Gather I/O Group IDs
+		vector<int> groupIDTable(m_comm.Get_size());
+		m_comm.Gather(&m_ioConfig.groupID, 1, MPI::INT, &groupIDTable[0], 1, MPI::INT, 0);
+
 		if( m_comm.Get_rank() != 0){
 			return true;
 		}
@@ -304,8 +1189,8 @@ namespace BCMFileIO {
 		int  RankID        = 0;
 		int  GroupID       = 0;
 
-		MPI_Comm_size(MPI_COMM_WORLD, &NumberOfRank);
-		MPI_Comm_rank(MPI_COMM_WORLD, &RankID);
+		NumberOfRank = m_comm.Get_size();
+		RankID       = m_comm.Get_rank();
 
 		os << "MPI {" << endl;
 		os << "  NumberOfRank   = " << NumberOfRank   << endl;
@@ -320,24 +1205,17 @@ namespace BCMFileIO {
 			os << "    ID         = "   << proc << endl;
 			os << "    HostName   = \"" << hostnameList[proc] << "\"" << endl;
 			os << "    BlockRange = @range(" << part.getStart(proc) <<  "," << part.getEnd(proc) - 1 << ")" << endl;
+			if( groupIDTable[proc] >= 0 ){
+				os << "    IOGroupID  = " << groupIDTable[proc] << endl;
+			}
 			os << "  }" << endl << endl;
 		}
 		os << "}" << endl;
 
-		ofstream ofs(filepath.c_str());
-		if( !ofs ){
-			Logger::Error("failed to open file (%s) .[%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
-			for(int i = 0; i < m_comm.Get_size(); i++) delete [] hostnameList[i];
-			delete hostnameList;
-			return false;
-		}
-
-		ofs << os.str();
-
 		for(int i = 0; i < m_comm.Get_size(); i++) delete [] hostnameList[i];
 		delete hostnameList;
 
-		return true;
+		return WriteIndexFile(filepath, os.str());
 	}
 
 	bool BCMFileSaver::SaveIndexCellID(const std::string& procName, const std::string& octName)
@@ -395,15 +1273,7 @@ namespace BCMFileIO {
 		os << "  }" << endl;
 		os << "}" << endl;
 
-		std::string filepath = m_targetDir + std::string("cellid.bcm");
-		ofstream ofs( filepath.c_str() );
-		if( !ofs ){
-			Logger::Error("failed to open file (%s) .[%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
-			return false;
-		}
-
-		ofs << os.str();
-		return true;
+		return WriteIndexFile(GetWriteDirectory() + std::string("cellid.bcm"), os.str());
 	}
 
 	bool BCMFileSaver::SaveIndexData(const std::string& procName, const std::string& octName)
@@ -427,8 +1297,8 @@ namespace BCMFileIO {
 		os.setf(ios::scientific);
 		os.precision(6);
 
-		const char *typeStr[10] = {
-			"Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32", "Int64", "UInt64", "Float32", "Float64"
+		const char *typeStr[12] = {
+			"Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32", "Int64", "UInt64", "Float32", "Float64", "Float16", "BFloat16"
 		};
 
 		// write Data Information
@@ -460,10 +1330,23 @@ namespace BCMFileIO {
 			os << "    NumberOfComponents = "   << ((*it)->kind == LB_SCALAR ? 1 : 3) << endl;
 			os << "    Type               = \"" << typeStr[(int)((*it)->dataType)]    << "\"" << endl;
 			os << "    VirtualCellSize    = "   << (*it)->vc                          << endl;
+			if( (*it)->ghostVC != 0 ){
+				os << "    GhostCellSize      = "   << (*it)->ghostVC                     << endl;
+			}
 			os << "    DirectoryPath      = \"" << (*it)->dataDir                     << "\"" << endl;
 			os << "    Prefix             = \"" << (*it)->prefix                      << "\"" << endl;
 			os << "    Extension          = \"" << (*it)->extension                   << "\"" << endl;
 			os << "    StepSubDirectory   = \"" << ((*it)->isStepSubDir ? string("true") : string("false")) << "\"" << endl;
+			os << "    GatherMode         = \"" << ((*it)->isGather ? string("gathered") : (*it)->isAggregate ? string("aggregated") : string("distributed")) << "\"" << endl;
+			if( (*it)->codec != LB_CODEC_NONE && !(*it)->isAggregate ){
+				const char *codecStr[4] = { "none", "lorenzo", "abserr", "relerr" };
+				os << "    Codec              = \"" << codecStr[(int)((*it)->codec)] << "\"" << endl;
+				if( BlockCodec::IsLossy((*it)->codec) ){
+					os.precision(17);
+					os << "    ErrorBound         = "   << (*it)->errorBound << endl;
+					os.precision(6);
+				}
+			}
 
 			os << endl;
 			unsigned int stepRange[3] = { (*it)->step.GetRangeMin(), (*it)->step.GetRangeMax(), (*it)->step.GetRangeInterval() };
@@ -493,14 +1376,26 @@ namespace BCMFileIO {
 		}
 		os << "}" << endl;
 
-		std::string filepath = m_targetDir + std::string("data.bcm");
+		return WriteIndexFile(GetWriteDirectory() + std::string("data.bcm"), os.str());
+	}
+
+	bool BCMFileSaver::WriteIndexFile(const std::string& filepath, const std::string& content)
+	{
+		using namespace std;
+
+		if( m_ioClient != NULL ){
+			unsigned char* buf = new unsigned char[content.size()];
+			memcpy(buf, content.c_str(), content.size());
+			return m_ioClient->WriteFile(filepath, buf, content.size());
+		}
+
 		ofstream ofs( filepath.c_str() );
 		if( !ofs ){
 			Logger::Error("failed to open file (%s) .[%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
 			return false;
 		}
 
-		ofs << os.str();
+		ofs << content;
 		return true;
 	}
 
@@ -521,10 +1416,10 @@ namespace BCMFileIO {
 		Partition part(m_comm.Get_size(), numLeaf);
 
 		std::string procName("proc.bcm");
-		std::string procPath = m_targetDir + procName;
-		if( ErrorUtil::reduceError(!SaveIndexProc(procPath, part)) )      { Logger::Error("%s:%d\n", __FILE__, __LINE__); return false; }
-		if( ErrorUtil::reduceError(!SaveIndexCellID(procName, octName)) ) { Logger::Error("%s:%d\n", __FILE__, __LINE__); return false; }
-		if( ErrorUtil::reduceError(!SaveIndexData(procName, octName)) )   { Logger::Error("%s:%d\n", __FILE__, __LINE__); return false; }
+		std::string procPath = GetWriteDirectory() + procName;
+		if( ErrorUtil::reduceError(!SaveIndexProc(procPath, part), m_comm) )      { Logger::Error("%s:%d\n", __FILE__, __LINE__); return false; }
+		if( ErrorUtil::reduceError(!SaveIndexCellID(procName, octName), m_comm) ) { Logger::Error("%s:%d\n", __FILE__, __LINE__); return false; }
+		if( ErrorUtil::reduceError(!SaveIndexData(procName, octName), m_comm) )   { Logger::Error("%s:%d\n", __FILE__, __LINE__); return false; }
 
 		return true;
 	}
@@ -537,12 +1432,6 @@ namespace BCMFileIO {
 			return true;
 		}
 
-		FILE *fp = NULL;
-		if( (fp = fopen(filepath.c_str(), "wb")) == NULL ){
-			Logger::Error("faild open file (%s) .[%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
-			return false;
-		}
-
 		OctHeader header;
 		header.identifier = OCTREE_FILE_IDENTIFIER;
 
@@ -573,6 +1462,22 @@ namespace BCMFileIO {
 
 		header.maxLevel = maxLevel;
 
+		if( m_ioClient != NULL ){
+			const size_t size = sizeof(header) + sizeof(Pedigree) * pedigs.size();
+			unsigned char* buf = new unsigned char[size];
+			memcpy(buf, &header, sizeof(header));
+			if( !pedigs.empty() ){
+				memcpy(buf + sizeof(header), &pedigs[0], sizeof(Pedigree) * pedigs.size());
+			}
+			return m_ioClient->WriteFile(filepath, buf, size);
+		}
+
+		FILE *fp = NULL;
+		if( (fp = fopen(filepath.c_str(), "wb")) == NULL ){
+			Logger::Error("faild open file (%s) .[%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+
 		fwrite(&header, sizeof(header), 1, fp);
 		fwrite(&pedigs[0], sizeof(Pedigree), pedigs.size(), fp);
 
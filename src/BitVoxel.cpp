@@ -21,10 +21,218 @@
 
 #include "BitVoxel.h"
 
+// x86-64のGCC/ClangではBMI2 (pext/pdep) の実装を実行時に選択
+#if defined(__x86_64__) && ( defined(__clang__) || ( defined(__GNUC__) && !defined(__INTEL_COMPILER) && \
+    ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) )
+#define BITVOXEL_USE_BMI2
+#include <immintrin.h>
+#include <stdint.h>
+#endif
+
 namespace BCMFileIO
 {
 	typedef unsigned int bitVoxelCell;
 
+	namespace {
+
+		/// ビットボクセル圧縮 (ビット幅ごと．ビットボクセル1要素単位で処理)
+		///
+		/// @param[out] dst   ビットボクセル (要素beginから)
+		/// @param[in]  src   ボクセル
+		/// @param[in]  size  ボクセル数
+		/// @param[in]  begin 処理を開始するビットボクセルの要素番号
+		///
+		template<unsigned int BW>
+		void CompressKernel(bitVoxelCell* dst, const unsigned char* src, const size_t size, const size_t begin)
+		{
+			const unsigned int VPC  = (sizeof(bitVoxelCell) * 8) / BW;
+			const bitVoxelCell mask = (1u << BW) - 1;
+			const size_t full = size / VPC;
+
+			for(size_t w = begin; w < full; w++){
+				const unsigned char* p = &src[w * VPC];
+				bitVoxelCell c = 0;
+				for(unsigned int k = 0; k < VPC; k++){
+					c |= (p[k] & mask) << (k * BW);
+				}
+				dst[w] = c;
+			}
+
+			const size_t rest = size - full * VPC;
+			if( rest != 0 && full >= begin ){
+				const unsigned char* p = &src[full * VPC];
+				bitVoxelCell c = 0;
+				for(unsigned int k = 0; k < rest; k++){
+					c |= (p[k] & mask) << (k * BW);
+				}
+				dst[full] = c;
+			}
+		}
+
+		/// ビットボクセル展開 (ビット幅ごと．ビットボクセル1要素単位で処理)
+		///
+		/// @param[out] dst   ボクセル
+		/// @param[in]  src   ビットボクセル
+		/// @param[in]  size  ボクセル数
+		/// @param[in]  begin 処理を開始するビットボクセルの要素番号
+		///
+		template<unsigned int BW>
+		void DecompressKernel(unsigned char* dst, const bitVoxelCell* src, const size_t size, const size_t begin)
+		{
+			const unsigned int VPC  = (sizeof(bitVoxelCell) * 8) / BW;
+			const bitVoxelCell mask = (1u << BW) - 1;
+			const size_t full = size / VPC;
+
+			for(size_t w = begin; w < full; w++){
+				unsigned char* p = &dst[w * VPC];
+				const bitVoxelCell c = src[w];
+				for(unsigned int k = 0; k < VPC; k++){
+					p[k] = static_cast<unsigned char>((c >> (k * BW)) & mask);
+				}
+			}
+
+			const size_t rest = size - full * VPC;
+			if( rest != 0 && full >= begin ){
+				unsigned char* p = &dst[full * VPC];
+				const bitVoxelCell c = src[full];
+				for(unsigned int k = 0; k < rest; k++){
+					p[k] = static_cast<unsigned char>((c >> (k * BW)) & mask);
+				}
+			}
+		}
+
+#ifdef BITVOXEL_USE_BMI2
+		/// 8ボクセル単位の抽出マスク (最後の8ボクセルはビットボクセル1要素に収まる分のみ)
+		template<unsigned int BW>
+		struct Bmi2Mask
+		{
+			enum { VPC = 32 / BW, NCHUNK = (VPC + 7) / 8, LAST = VPC - (NCHUNK - 1) * 8 };
+
+			static uint64_t Full(){ return 0x0101010101010101ULL * ((1u << BW) - 1); }
+			static uint64_t Last(){ return LAST == 8 ? Full() : Full() & ((1ULL << (LAST * 8)) - 1); }
+		};
+
+		/// ビットボクセル圧縮 (BMI2．8ボクセルを1命令で詰める)
+		template<unsigned int BW>
+		__attribute__((target("bmi2")))
+		void CompressKernelBmi2(bitVoxelCell* dst, const unsigned char* src, const size_t size)
+		{
+			typedef Bmi2Mask<BW> M;
+			const uint64_t full = M::Full();
+			const uint64_t last = M::Last();
+
+			// 8Byte単位の読み込みが末尾を超えない範囲を処理し，残りは汎用の実装で処理
+			const size_t n = size >= M::NCHUNK * 8 ? (size - M::NCHUNK * 8) / M::VPC + 1 : 0;
+			for(size_t w = 0; w < n; w++){
+				const unsigned char* p = &src[w * M::VPC];
+				bitVoxelCell c = 0;
+				for(unsigned int k = 0; k < M::NCHUNK; k++){
+					uint64_t v;
+					memcpy(&v, &p[k * 8], sizeof(uint64_t));
+					c |= static_cast<bitVoxelCell>(_pext_u64(v, k == M::NCHUNK - 1 ? last : full)) << (k * 8 * BW);
+				}
+				dst[w] = c;
+			}
+			CompressKernel<BW>(dst, src, size, n);
+		}
+
+		/// ビットボクセル展開 (BMI2．1命令で8ボクセルに展開)
+		template<unsigned int BW>
+		__attribute__((target("bmi2")))
+		void DecompressKernelBmi2(unsigned char* dst, const bitVoxelCell* src, const size_t size)
+		{
+			typedef Bmi2Mask<BW> M;
+			const uint64_t full = M::Full();
+			const uint64_t last = M::Last();
+
+			// 8Byte単位の書き込みが末尾を超えない範囲を処理 (超過分は次の要素で上書き)
+			const size_t n = size >= M::NCHUNK * 8 ? (size - M::NCHUNK * 8) / M::VPC + 1 : 0;
+			for(size_t w = 0; w < n; w++){
+				unsigned char* p = &dst[w * M::VPC];
+				const uint64_t c = src[w];
+				for(unsigned int k = 0; k < M::NCHUNK; k++){
+					const uint64_t v = _pdep_u64(c >> (k * 8 * BW), k == M::NCHUNK - 1 ? last : full);
+					memcpy(&p[k * 8], &v, sizeof(uint64_t));
+				}
+			}
+			DecompressKernel<BW>(dst, src, size, n);
+		}
+
+		/// BMI2が使用可能かを判定
+		bool HasBmi2()
+		{
+			static const bool hasBmi2 = __builtin_cpu_supports("bmi2") != 0;
+			return hasBmi2;
+		}
+#endif // BITVOXEL_USE_BMI2
+
+		/// ビットボクセル圧縮 (ビット幅9以上．各ボクセルの下位8bitのみ格納)
+		void CompressWide(bitVoxelCell* dst, const unsigned char* src, const size_t size, const unsigned int bitWidth)
+		{
+			const unsigned int VPC = (sizeof(bitVoxelCell) * 8) / bitWidth;
+			const size_t bsz = size / VPC + (size % VPC == 0 ? 0 : 1);
+
+			for(size_t w = 0; w < bsz; w++){
+				const size_t n = w * VPC + VPC <= size ? VPC : size - w * VPC;
+				bitVoxelCell c = 0;
+				for(unsigned int k = 0; k < n; k++){
+					c |= static_cast<bitVoxelCell>(src[w * VPC + k]) << (k * bitWidth);
+				}
+				dst[w] = c;
+			}
+		}
+
+		/// ビットボクセル展開 (ビット幅9以上)
+		void DecompressWide(unsigned char* dst, const bitVoxelCell* src, const size_t size, const unsigned int bitWidth)
+		{
+			const unsigned int VPC = (sizeof(bitVoxelCell) * 8) / bitWidth;
+
+			for(size_t i = 0; i < size; i++){
+				dst[i] = static_cast<unsigned char>(src[i / VPC] >> ((i % VPC) * bitWidth));
+			}
+		}
+
+		typedef void (*CompressFunc)(bitVoxelCell*, const unsigned char*, const size_t);
+		typedef void (*DecompressFunc)(unsigned char*, const bitVoxelCell*, const size_t);
+
+		template<unsigned int BW>
+		void CompressGeneric(bitVoxelCell* dst, const unsigned char* src, const size_t size){ CompressKernel<BW>(dst, src, size, 0); }
+
+		template<unsigned int BW>
+		void DecompressGeneric(unsigned char* dst, const bitVoxelCell* src, const size_t size){ DecompressKernel<BW>(dst, src, size, 0); }
+
+		/// ビット幅 (1-8) に対応する圧縮の実装を取得
+		CompressFunc GetCompressFunc(const unsigned char bitWidth)
+		{
+#ifdef BITVOXEL_USE_BMI2
+			static const CompressFunc bmi2[8] = {
+				CompressKernelBmi2<1>, CompressKernelBmi2<2>, CompressKernelBmi2<3>, CompressKernelBmi2<4>,
+				CompressKernelBmi2<5>, CompressKernelBmi2<6>, CompressKernelBmi2<7>, CompressKernelBmi2<8> };
+			if( HasBmi2() ){ return bmi2[bitWidth - 1]; }
+#endif // BITVOXEL_USE_BMI2
+			static const CompressFunc generic[8] = {
+				CompressGeneric<1>, CompressGeneric<2>, CompressGeneric<3>, CompressGeneric<4>,
+				CompressGeneric<5>, CompressGeneric<6>, CompressGeneric<7>, CompressGeneric<8> };
+			return generic[bitWidth - 1];
+		}
+
+		/// ビット幅 (1-8) に対応する展開の実装を取得
+		DecompressFunc GetDecompressFunc(const unsigned char bitWidth)
+		{
+#ifdef BITVOXEL_USE_BMI2
+			static const DecompressFunc bmi2[8] = {
+				DecompressKernelBmi2<1>, DecompressKernelBmi2<2>, DecompressKernelBmi2<3>, DecompressKernelBmi2<4>,
+				DecompressKernelBmi2<5>, DecompressKernelBmi2<6>, DecompressKernelBmi2<7>, DecompressKernelBmi2<8> };
+			if( HasBmi2() ){ return bmi2[bitWidth - 1]; }
+#endif // BITVOXEL_USE_BMI2
+			static const DecompressFunc generic[8] = {
+				DecompressGeneric<1>, DecompressGeneric<2>, DecompressGeneric<3>, DecompressGeneric<4>,
+				DecompressGeneric<5>, DecompressGeneric<6>, DecompressGeneric<7>, DecompressGeneric<8> };
+			return generic[bitWidth - 1];
+		}
+
+	} // namespace
+
 	BitVoxel::BitVoxel()
 	{
 	}
@@ -41,23 +249,12 @@ namespace BCMFileIO
 
 	bitVoxelCell* BitVoxel::Compress( size_t* bitVoxelSize, const size_t voxelSize, const unsigned char* voxel, const unsigned char  bitWidth)
 	{
-		const unsigned char vox_per_cell = (sizeof(bitVoxelCell) * 8) / bitWidth;
-		size_t bsz  = voxelSize / vox_per_cell + (voxelSize % vox_per_cell == 0 ? 0 : 1);
+		const size_t bsz = GetSize(voxelSize, bitWidth);
 
 		bitVoxelCell* bitVoxel = new bitVoxelCell[bsz];
-		memset(bitVoxel, 0, sizeof(bitVoxelCell) * bsz);
-
-		unsigned char mask = 0;
-		for(int i = 0; i < bitWidth; i++) mask += (1 << i);
 
-		for(size_t i = 0; i < voxelSize; i++){
-			size_t       cellIdx =  i / vox_per_cell;
-			unsigned int bitIdx  = (i % vox_per_cell) * bitWidth;
-
-			unsigned char c = voxel[i];
-
-			bitVoxel[cellIdx] += (c & mask) << bitIdx;
-		}
+		// 全要素を書き込むため0クリアは不要
+		CompressTo(bitVoxel, voxelSize, voxel, bitWidth);
 
 		*bitVoxelSize = bsz;
 		return bitVoxel;
@@ -66,22 +263,29 @@ namespace BCMFileIO
 
 	unsigned char* BitVoxel::Decompress( const size_t voxelSize, const bitVoxelCell* bitVoxel, const unsigned char  bitWidth)
 	{
-		const unsigned char vox_per_cell = (sizeof(bitVoxelCell) * 8) / bitWidth;
-
 		unsigned char* voxel = new unsigned char[voxelSize];
-		memset(voxel, 0, sizeof(unsigned char) * voxelSize);
 
-		unsigned char mask = 0;
-		for(int i = 0; i < bitWidth; i++) mask += (1 << i);
+		DecompressTo(voxel, voxelSize, bitVoxel, bitWidth);
 
-		for(size_t i = 0; i < voxelSize; i++){
-			size_t       cellIdx =  i / vox_per_cell;
-			unsigned int bitIdx  = (i % vox_per_cell) * bitWidth;
+		return voxel;
+	}
 
-			voxel[i] = (bitVoxel[cellIdx] >> bitIdx) & mask;
+	void BitVoxel::CompressTo( bitVoxelCell* bitVoxel, const size_t voxelSize, const unsigned char* voxel, const unsigned char bitWidth)
+	{
+		if( bitWidth > 8 ){
+			CompressWide(bitVoxel, voxel, voxelSize, bitWidth);
+		}else{
+			GetCompressFunc(bitWidth)(bitVoxel, voxel, voxelSize);
 		}
+	}
 
-		return voxel;
+	void BitVoxel::DecompressTo( unsigned char* voxel, const size_t voxelSize, const bitVoxelCell* bitVoxel, const unsigned char bitWidth)
+	{
+		if( bitWidth > 8 ){
+			DecompressWide(voxel, bitVoxel, voxelSize, bitWidth);
+		}else{
+			GetDecompressFunc(bitWidth)(voxel, bitVoxel, voxelSize);
+		}
 	}
 
 
@@ -0,0 +1,793 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  BlockCodec.cpp
+/// @brief 物理量リーフブロックの圧縮/展開ライブラリ
+///
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "BlockCodec.h"
+#include "BitVoxel.h"
+#include "TypeConvert.h"
+
+namespace BCMFileIO {
+
+	namespace {
+		/// 連長符号の制御バイト : 最上位ビットが1の場合ゼロラン，0の場合リテラル (下位7bitが長さ-1)
+		const unsigned char RUN_ZERO_FLAG = 0x80;
+
+		/// 1つの制御バイトで表す最大の長さ
+		const size_t RUN_MAX_LENGTH = 128;
+
+		/// 浮動小数点のビット列を大小関係を保つ符号なし整数に変換
+		template<typename U>
+		inline U ToOrdered(const U bits)
+		{
+			const U sign = static_cast<U>(1) << (sizeof(U) * 8 - 1);
+			return (bits & sign) ? static_cast<U>(~bits) : static_cast<U>(bits | sign);
+		}
+
+		/// ToOrdered()の逆変換
+		template<typename U>
+		inline U FromOrdered(const U value)
+		{
+			const U sign = static_cast<U>(1) << (sizeof(U) * 8 - 1);
+			return (value & sign) ? static_cast<U>(value & ~sign) : static_cast<U>(~value);
+		}
+
+		/// 量子化符号の形式 (符号の先頭1Byte)
+		enum QuantizeMode
+		{
+			QUANTIZE_MODE_QUANTIZED = 0, ///< 量子化 (続いてビット数1Byte, 量子化幅8Byte, 連長符号)
+			QUANTIZE_MODE_LOSSLESS  = 1  ///< 誤差上限を満たせないため可逆に符号化 (続いてLB_CODEC_LORENZOの符号)
+		};
+
+		/// 量子化符号のヘッダサイズ (形式, ビット数, 量子化幅)
+		const size_t QUANTIZE_HEADER_SIZE = 10;
+
+		/// 3次元Lorenzo予測の残差を計算 (isXorがtrueの場合はXOR，falseの場合は差分．符号なし整数の循環演算)
+		template<typename U>
+		void LorenzoForward(const Vec3i& size, const int numComponent, const U* value, U* residual, const bool isXor)
+		{
+			const size_t sx  = size.x;
+			const size_t sxy = sx * size.y;
+			const size_t n   = sxy * size.z;
+
+			// ブロック外の隣接セルとして参照する0の列
+			const std::vector<U> zeros(sx, 0);
+
+			for(int c = 0; c < numComponent; c++){
+				for(int z = 0; z < size.z; z++){
+					for(int y = 0; y < size.y; y++){
+						const size_t base = c * n + y * sx + z * sxy;
+						const U* cur = &value[base];
+						const U* py  = y > 0           ? cur - sx       : &zeros[0];
+						const U* pz  = z > 0           ? cur - sxy      : &zeros[0];
+						const U* pyz = y > 0 && z > 0  ? cur - sx - sxy : &zeros[0];
+						U* res = &residual[base];
+
+						U pred = py[0] + pz[0] - pyz[0];
+						res[0] = isXor ? static_cast<U>(cur[0] ^ pred) : static_cast<U>(cur[0] - pred);
+						for(size_t x = 1; x < sx; x++){
+							pred = cur[x-1] + py[x] + pz[x] - py[x-1] - pz[x-1] - pyz[x] + pyz[x-1];
+							res[x] = isXor ? static_cast<U>(cur[x] ^ pred) : static_cast<U>(cur[x] - pred);
+						}
+					}
+				}
+			}
+		}
+
+		/// LorenzoForward()の逆変換 (valueを残差から値へ置き換える)
+		template<typename U>
+		void LorenzoInverse(const Vec3i& size, const int numComponent, U* value, const bool isXor)
+		{
+			const size_t sx  = size.x;
+			const size_t sxy = sx * size.y;
+			const size_t n   = sxy * size.z;
+
+			const std::vector<U> zeros(sx, 0);
+
+			for(int c = 0; c < numComponent; c++){
+				for(int z = 0; z < size.z; z++){
+					for(int y = 0; y < size.y; y++){
+						const size_t base = c * n + y * sx + z * sxy;
+						U* cur = &value[base];
+						const U* py  = y > 0           ? cur - sx       : &zeros[0];
+						const U* pz  = z > 0           ? cur - sxy      : &zeros[0];
+						const U* pyz = y > 0 && z > 0  ? cur - sx - sxy : &zeros[0];
+
+						U pred = py[0] + pz[0] - pyz[0];
+						cur[0] = isXor ? static_cast<U>(cur[0] ^ pred) : static_cast<U>(cur[0] + pred);
+						for(size_t x = 1; x < sx; x++){
+							pred = cur[x-1] + py[x] + pz[x] - py[x-1] - pz[x-1] - pyz[x] + pyz[x-1];
+							cur[x] = isXor ? static_cast<U>(cur[x] ^ pred) : static_cast<U>(cur[x] + pred);
+						}
+					}
+				}
+			}
+		}
+
+		/// 下位width Byteを上位から順にバイトプレーンへ分割
+		template<typename U>
+		void SplitPlanes(const U* value, const size_t count, const size_t width, unsigned char* planes)
+		{
+			for(size_t k = 0; k < width; k++){
+				const unsigned int shift = static_cast<unsigned int>(8 * (width - 1 - k));
+				unsigned char* plane = &planes[k * count];
+				for(size_t i = 0; i < count; i++){
+					plane[i] = static_cast<unsigned char>(value[i] >> shift);
+				}
+			}
+		}
+
+		/// SplitPlanes()の逆変換
+		template<typename U>
+		void MergePlanes(const unsigned char* planes, const size_t count, const size_t width, U* value)
+		{
+			for(size_t i = 0; i < count; i++){ value[i] = 0; }
+			for(size_t k = 0; k < width; k++){
+				const unsigned int shift = static_cast<unsigned int>(8 * (width - 1 - k));
+				const unsigned char* plane = &planes[k * count];
+				for(size_t i = 0; i < count; i++){
+					value[i] |= static_cast<U>(plane[i]) << shift;
+				}
+			}
+		}
+
+		/// 下位bits bitを上位から順にビットプレーンへ分割 (1プレーンは(count+7)/8 Byte，先頭の値を最上位ビットに格納)
+		void SplitBitPlanes(const uint64_t* value, const size_t count, const size_t bits, unsigned char* planes)
+		{
+			const size_t planeBytes = (count + 7) / 8;
+			for(size_t k = 0; k < bits; k++){
+				const unsigned int shift = static_cast<unsigned int>(bits - 1 - k);
+				unsigned char* plane = &planes[k * planeBytes];
+				for(size_t j = 0; j < planeBytes; j++){
+					const size_t end = j * 8 + 8 < count ? j * 8 + 8 : count;
+					unsigned char byte = 0;
+					for(size_t i = j * 8; i < end; i++){
+						byte |= static_cast<unsigned char>(((value[i] >> shift) & 1) << (7 - (i - j * 8)));
+					}
+					plane[j] = byte;
+				}
+			}
+		}
+
+		/// SplitBitPlanes()の逆変換
+		void MergeBitPlanes(const unsigned char* planes, const size_t count, const size_t bits, uint64_t* value)
+		{
+			const size_t planeBytes = (count + 7) / 8;
+			for(size_t i = 0; i < count; i++){ value[i] = 0; }
+			for(size_t k = 0; k < bits; k++){
+				const unsigned int shift = static_cast<unsigned int>(bits - 1 - k);
+				const unsigned char* plane = &planes[k * planeBytes];
+				for(size_t i = 0; i < count; i++){
+					value[i] |= static_cast<uint64_t>((plane[i / 8] >> (7 - i % 8)) & 1) << shift;
+				}
+			}
+		}
+	}
+
+	bool BlockCodec::IsSupported(const LB_CODEC codec, const LB_DATA_TYPE dataType)
+	{
+		if( codec == LB_CODEC_NONE ){ return true; }
+		if( codec == LB_CODEC_LORENZO || codec == LB_CODEC_ABSERR || codec == LB_CODEC_RELERR ){
+			return dataType == LB_FLOAT32 || dataType == LB_FLOAT64;
+		}
+		return false;
+	}
+
+	void BlockCodec::Encode(const LB_CODEC       codec,
+	                        const LB_DATA_TYPE   dataType,
+	                        const Vec3i&         size,
+	                        const int            numComponent,
+	                        const double         errorBound,
+	                        const unsigned char* src,
+	                        std::vector<unsigned char>& dst)
+	{
+		dst.clear();
+
+		if( codec == LB_CODEC_LORENZO ){
+			if     ( dataType == LB_FLOAT32 ){ EncodeLorenzo<uint32_t>(size, numComponent, src, dst); }
+			else if( dataType == LB_FLOAT64 ){ EncodeLorenzo<uint64_t>(size, numComponent, src, dst); }
+		}
+		else if( codec == LB_CODEC_ABSERR || codec == LB_CODEC_RELERR ){
+			const bool relative = codec == LB_CODEC_RELERR;
+			if     ( dataType == LB_FLOAT32 ){ EncodeQuantize<float,  uint32_t>(size, numComponent, errorBound, relative, src, dst); }
+			else if( dataType == LB_FLOAT64 ){ EncodeQuantize<double, uint64_t>(size, numComponent, errorBound, relative, src, dst); }
+		}
+	}
+
+	bool BlockCodec::Decode(const LB_CODEC       codec,
+	                        const LB_DATA_TYPE   dataType,
+	                        const Vec3i&         size,
+	                        const int            numComponent,
+	                        const unsigned char* src,
+	                        const size_t         srcSize,
+	                        unsigned char*       dst)
+	{
+		if( codec == LB_CODEC_LORENZO ){
+			if     ( dataType == LB_FLOAT32 ){ return DecodeLorenzo<uint32_t>(size, numComponent, src, srcSize, dst); }
+			else if( dataType == LB_FLOAT64 ){ return DecodeLorenzo<uint64_t>(size, numComponent, src, srcSize, dst); }
+		}
+		else if( codec == LB_CODEC_ABSERR || codec == LB_CODEC_RELERR ){
+			if     ( dataType == LB_FLOAT32 ){ return DecodeQuantize<float,  uint32_t>(size, numComponent, src, srcSize, dst); }
+			else if( dataType == LB_FLOAT64 ){ return DecodeQuantize<double, uint64_t>(size, numComponent, src, srcSize, dst); }
+		}
+
+		return false;
+	}
+
+	void BlockCodec::EncodeDelta(const LB_DELTA       delta,
+	                             const LB_DATA_TYPE   dataType,
+	                             const Vec3i&         size,
+	                             const int            numComponent,
+	                             const unsigned char* src,
+	                             const unsigned char* base,
+	                             std::vector<unsigned char>& dst)
+	{
+		dst.clear();
+
+		if( delta != LB_DELTA_XOR && delta != LB_DELTA_SUB ){ return; }
+
+		const bool isXor   = delta == LB_DELTA_XOR;
+		const bool isFloat = dataType == LB_FLOAT32 || dataType == LB_FLOAT64 || dataType == LB_FLOAT16 || dataType == LB_BFLOAT16;
+		switch( dataType ){
+			case LB_INT8   : case LB_UINT8   : EncodeDelta<uint8_t >(isXor, isFloat, size, numComponent, src, base, dst); break;
+			case LB_INT16  : case LB_UINT16  : case LB_FLOAT16 : case LB_BFLOAT16 : EncodeDelta<uint16_t>(isXor, isFloat, size, numComponent, src, base, dst); break;
+			case LB_INT32  : case LB_UINT32  : case LB_FLOAT32 : EncodeDelta<uint32_t>(isXor, isFloat, size, numComponent, src, base, dst); break;
+			case LB_INT64  : case LB_UINT64  : case LB_FLOAT64 : EncodeDelta<uint64_t>(isXor, isFloat, size, numComponent, src, base, dst); break;
+		}
+	}
+
+	bool BlockCodec::DecodeDelta(const LB_DELTA       delta,
+	                             const LB_DATA_TYPE   dataType,
+	                             const Vec3i&         size,
+	                             const int            numComponent,
+	                             const unsigned char* src,
+	                             const size_t         srcSize,
+	                             const unsigned char* base,
+	                             unsigned char*       dst)
+	{
+		if( delta != LB_DELTA_XOR && delta != LB_DELTA_SUB ){ return false; }
+
+		const bool isXor   = delta == LB_DELTA_XOR;
+		const bool isFloat = dataType == LB_FLOAT32 || dataType == LB_FLOAT64 || dataType == LB_FLOAT16 || dataType == LB_BFLOAT16;
+		switch( dataType ){
+			case LB_INT8   : case LB_UINT8   : return DecodeDelta<uint8_t >(isXor, isFloat, size, numComponent, src, srcSize, base, dst);
+			case LB_INT16  : case LB_UINT16  : case LB_FLOAT16 : case LB_BFLOAT16 : return DecodeDelta<uint16_t>(isXor, isFloat, size, numComponent, src, srcSize, base, dst);
+			case LB_INT32  : case LB_UINT32  : case LB_FLOAT32 : return DecodeDelta<uint32_t>(isXor, isFloat, size, numComponent, src, srcSize, base, dst);
+			case LB_INT64  : case LB_UINT64  : case LB_FLOAT64 : return DecodeDelta<uint64_t>(isXor, isFloat, size, numComponent, src, srcSize, base, dst);
+		}
+
+		return false;
+	}
+
+	bool BlockCodec::EncodeConstant(const LB_DATA_TYPE   dataType,
+	                                const Vec3i&         size,
+	                                const int            numComponent,
+	                                const unsigned char* src,
+	                                std::vector<unsigned char>& dst)
+	{
+		dst.clear();
+
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		const size_t typeByte  = typeByteTable[dataType];
+		const size_t count     = static_cast<size_t>(size.x) * size.y * size.z;
+		const size_t compBytes = count * typeByte;
+		if( count == 0 || numComponent <= 0 ){ return false; }
+
+		std::vector<unsigned char> isConstant(numComponent, 1);
+		size_t codeSize = numComponent;
+		bool   hasConstant = false;
+		for(int c = 0; c < numComponent; c++){
+			const unsigned char* comp = &src[c * compBytes];
+			for(size_t i = typeByte; i < compBytes; i += typeByte){
+				if( memcmp(&comp[i], comp, typeByte) != 0 ){ isConstant[c] = 0; break; }
+			}
+			codeSize   += isConstant[c] ? typeByte : compBytes;
+			hasConstant = hasConstant || isConstant[c];
+		}
+		if( !hasConstant ){ return false; }
+
+		dst.reserve(codeSize);
+		dst.insert(dst.end(), isConstant.begin(), isConstant.end());
+		for(int c = 0; c < numComponent; c++){
+			const unsigned char* comp = &src[c * compBytes];
+			dst.insert(dst.end(), comp, comp + (isConstant[c] ? typeByte : compBytes));
+		}
+		return true;
+	}
+
+	bool BlockCodec::DecodeConstant(const LB_DATA_TYPE   dataType,
+	                                const Vec3i&         size,
+	                                const int            numComponent,
+	                                const unsigned char* src,
+	                                const size_t         srcSize,
+	                                unsigned char*       dst)
+	{
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		const size_t typeByte  = typeByteTable[dataType];
+		const size_t count     = static_cast<size_t>(size.x) * size.y * size.z;
+		const size_t compBytes = count * typeByte;
+		if( numComponent <= 0 || srcSize < static_cast<size_t>(numComponent) ){ return false; }
+
+		size_t pos = numComponent;
+		for(int c = 0; c < numComponent; c++){
+			unsigned char* comp = &dst[c * compBytes];
+			if( src[c] > 1 ){ return false; }
+			if( src[c] == 0 ){
+				if( srcSize - pos < compBytes ){ return false; }
+				memcpy(comp, &src[pos], compBytes);
+				pos += compBytes;
+				continue;
+			}
+			if( srcSize - pos < typeByte ){ return false; }
+			// 1値を書き込んだ後，書き込み済みの領域を倍々に複製して埋める
+			size_t filled = compBytes != 0 ? typeByte : 0;
+			if( filled != 0 ){ memcpy(comp, &src[pos], typeByte); }
+			while( filled < compBytes ){
+				const size_t n = std::min(filled, compBytes - filled);
+				memcpy(&comp[filled], comp, n);
+				filled += n;
+			}
+			pos += typeByte;
+		}
+		return pos == srcSize;
+	}
+
+	bool BlockCodec::EncodeMasked(const LB_DATA_TYPE   dataType,
+	                              const Vec3i&         size,
+	                              const int            numComponent,
+	                              const unsigned char* src,
+	                              const unsigned char* active,
+	                              std::vector<unsigned char>& dst)
+	{
+		dst.clear();
+
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		const size_t typeByte  = typeByteTable[dataType];
+		const size_t count     = static_cast<size_t>(size.x) * size.y * size.z;
+		const size_t compBytes = count * typeByte;
+		if( count == 0 || numComponent <= 0 ){ return false; }
+
+		size_t numActive = 0;
+		for(size_t i = 0; i < count; i++){
+			if( active[i] != 0 ){ numActive++; }
+		}
+		if( numActive == count ){ return false; }
+
+		const size_t maskBytes = BitVoxel::GetSize(count, 1) * sizeof(BitVoxel::bitVoxelCell);
+		dst.resize(maskBytes + numActive * typeByte * numComponent);
+
+		std::vector<unsigned char> bits(count);
+		for(size_t i = 0; i < count; i++){
+			bits[i] = active[i] != 0 ? 1 : 0;
+		}
+		BitVoxel::CompressTo(reinterpret_cast<BitVoxel::bitVoxelCell*>(&dst[0]), count, &bits[0], 1);
+
+		unsigned char* p = &dst[maskBytes];
+		for(int c = 0; c < numComponent; c++){
+			const unsigned char* comp = &src[c * compBytes];
+			for(size_t i = 0; i < count; i++){
+				if( bits[i] == 0 ){ continue; }
+				memcpy(p, &comp[i * typeByte], typeByte);
+				p += typeByte;
+			}
+		}
+		return true;
+	}
+
+	bool BlockCodec::DecodeMasked(const LB_DATA_TYPE   dataType,
+	                              const Vec3i&         size,
+	                              const int            numComponent,
+	                              const unsigned char* src,
+	                              const size_t         srcSize,
+	                              const double         fill,
+	                              const bool           isNeedSwap,
+	                              unsigned char*       dst)
+	{
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		const size_t typeByte  = typeByteTable[dataType];
+		const size_t count     = static_cast<size_t>(size.x) * size.y * size.z;
+		const size_t compBytes = count * typeByte;
+		const size_t numWord   = BitVoxel::GetSize(count, 1);
+		const size_t maskBytes = numWord * sizeof(BitVoxel::bitVoxelCell);
+		if( count == 0 || numComponent <= 0 || srcSize < maskBytes ){ return false; }
+
+		std::vector<BitVoxel::bitVoxelCell> words(numWord);
+		memcpy(&words[0], src, maskBytes);
+		if( isNeedSwap ){
+			for(size_t i = 0; i < numWord; i++){ BSwap32(&words[i]); }
+		}
+		std::vector<unsigned char> bits(count);
+		BitVoxel::DecompressTo(&bits[0], count, &words[0], 1);
+
+		size_t numActive = 0;
+		for(size_t i = 0; i < count; i++){
+			numActive += bits[i];
+		}
+		if( srcSize - maskBytes != numActive * typeByte * numComponent ){ return false; }
+
+		// マスク外の値 (符号と同じバイト順)
+		unsigned char value[8];
+		ConvertFillValue(dataType, fill, isNeedSwap, value);
+
+		const unsigned char* p = &src[maskBytes];
+		for(int c = 0; c < numComponent; c++){
+			unsigned char* comp = &dst[c * compBytes];
+			for(size_t i = 0; i < count; i++){
+				if( bits[i] != 0 ){
+					memcpy(&comp[i * typeByte], p, typeByte);
+					p += typeByte;
+				}else{
+					memcpy(&comp[i * typeByte], value, typeByte);
+				}
+			}
+		}
+		return true;
+	}
+
+	void BlockCodec::Fill(const LB_DATA_TYPE dataType,
+	                      const Vec3i&       size,
+	                      const int          numComponent,
+	                      const double       fill,
+	                      const bool         isNeedSwap,
+	                      unsigned char*     dst)
+	{
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		const size_t typeByte = typeByteTable[dataType];
+		const size_t total    = static_cast<size_t>(size.x) * size.y * size.z * numComponent * typeByte;
+		if( total == 0 ){ return; }
+
+		// 1値を書き込んだ後，書き込み済みの領域を倍々に複製して埋める
+		ConvertFillValue(dataType, fill, isNeedSwap, dst);
+		size_t filled = typeByte;
+		while( filled < total ){
+			const size_t n = std::min(filled, total - filled);
+			memcpy(&dst[filled], dst, n);
+			filled += n;
+		}
+	}
+
+	void BlockCodec::ConvertFillValue(const LB_DATA_TYPE dataType, const double fill, const bool isNeedSwap, unsigned char* value)
+	{
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		const size_t typeByte = typeByteTable[dataType];
+
+		switch( dataType ){
+			case LB_INT8    : { char               v = static_cast<char              >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_UINT8   : { unsigned char      v = static_cast<unsigned char     >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_INT16   : { short              v = static_cast<short             >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_UINT16  : { unsigned short     v = static_cast<unsigned short    >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_INT32   : { int                v = static_cast<int               >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_UINT32  : { unsigned int       v = static_cast<unsigned int      >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_INT64   : { long long          v = static_cast<long long         >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_UINT64  : { unsigned long long v = static_cast<unsigned long long>(fill); memcpy(value, &v, typeByte); break; }
+			case LB_FLOAT32 : { float              v = static_cast<float             >(fill); memcpy(value, &v, typeByte); break; }
+			case LB_FLOAT16 : { unsigned short     v = TypeConvert::FloatToHalf(static_cast<float>(fill));     memcpy(value, &v, typeByte); break; }
+			case LB_BFLOAT16: { unsigned short     v = TypeConvert::FloatToBFloat16(static_cast<float>(fill)); memcpy(value, &v, typeByte); break; }
+			default         : { double             v = fill;                                  memcpy(value, &v, typeByte); break; }
+		}
+		if( isNeedSwap ){
+			if     ( typeByte == 2 ){ BSwap16(value); }
+			else if( typeByte == 4 ){ BSwap32(value); }
+			else if( typeByte == 8 ){ BSwap64(value); }
+		}
+	}
+
+	template<typename U>
+	void BlockCodec::EncodeDelta(const bool isXor, const bool isFloat, const Vec3i& size, const int numComponent,
+	                             const unsigned char* src, const unsigned char* base, std::vector<unsigned char>& dst)
+	{
+		const size_t count = static_cast<size_t>(size.x) * size.y * size.z * numComponent;
+		const size_t width = sizeof(U);
+
+		if( count == 0 ){ return; }
+
+		std::vector<U> value(count);
+		std::vector<U> prev(count);
+		memcpy(&value[0], src,  sizeof(U) * count);
+		memcpy(&prev[0],  base, sizeof(U) * count);
+
+		std::vector<U> residual(count);
+		if( isXor ){
+			for(size_t i = 0; i < count; i++){
+				residual[i] = static_cast<U>(value[i] ^ prev[i]);
+			}
+		}else{
+			// 差分 (浮動小数点は大小関係を保つ整数の差分) は空間的に滑らかなため，さらにLorenzo予測する
+			for(size_t i = 0; i < count; i++){
+				value[i] = isFloat ? static_cast<U>(ToOrdered(value[i]) - ToOrdered(prev[i])) : static_cast<U>(value[i] - prev[i]);
+			}
+			LorenzoForward(size, numComponent, &value[0], &residual[0], false);
+
+			// 小さな負の残差の上位バイトも0になるようジグザグ変換
+			for(size_t i = 0; i < count; i++){
+				const U r    = residual[i];
+				const U sign = static_cast<U>(r >> (sizeof(U) * 8 - 1));
+				residual[i] = static_cast<U>(static_cast<U>(r << 1) ^ static_cast<U>(0 - sign));
+			}
+		}
+
+		std::vector<unsigned char> planes(width * count);
+		SplitPlanes(&residual[0], count, width, &planes[0]);
+
+		EncodeRun(&planes[0], planes.size(), dst);
+	}
+
+	template<typename U>
+	bool BlockCodec::DecodeDelta(const bool isXor, const bool isFloat, const Vec3i& size, const int numComponent,
+	                             const unsigned char* src, const size_t srcSize, const unsigned char* base, unsigned char* dst)
+	{
+		const size_t count = static_cast<size_t>(size.x) * size.y * size.z * numComponent;
+		const size_t width = sizeof(U);
+
+		if( count == 0 ){ return srcSize == 0; }
+
+		std::vector<unsigned char> planes(width * count);
+		if( !DecodeRun(src, srcSize, &planes[0], planes.size()) ){
+			return false;
+		}
+
+		std::vector<U> value(count);
+		std::vector<U> prev(count);
+		MergePlanes(&planes[0], count, width, &value[0]);
+		memcpy(&prev[0], base, sizeof(U) * count);
+
+		if( isXor ){
+			for(size_t i = 0; i < count; i++){
+				value[i] = static_cast<U>(value[i] ^ prev[i]);
+			}
+		}else{
+			for(size_t i = 0; i < count; i++){
+				const U z = value[i];
+				value[i] = static_cast<U>(static_cast<U>(z >> 1) ^ static_cast<U>(0 - static_cast<U>(z & 1)));
+			}
+			LorenzoInverse(size, numComponent, &value[0], false);
+
+			for(size_t i = 0; i < count; i++){
+				value[i] = isFloat ? FromOrdered(static_cast<U>(ToOrdered(prev[i]) + value[i])) : static_cast<U>(prev[i] + value[i]);
+			}
+		}
+		memcpy(dst, &value[0], sizeof(U) * count);
+
+		return true;
+	}
+
+	template<typename U>
+	void BlockCodec::EncodeLorenzo(const Vec3i& size, const int numComponent, const unsigned char* src, std::vector<unsigned char>& dst)
+	{
+		const size_t count = static_cast<size_t>(size.x) * size.y * size.z * numComponent;
+		const size_t width = sizeof(U);
+
+		if( count == 0 ){ return; }
+
+		std::vector<U> value(count);
+		memcpy(&value[0], src, sizeof(U) * count);
+		for(size_t i = 0; i < count; i++){
+			value[i] = ToOrdered(value[i]);
+		}
+
+		std::vector<U> residual(count);
+		LorenzoForward(size, numComponent, &value[0], &residual[0], true);
+
+		std::vector<unsigned char> planes(width * count);
+		SplitPlanes(&residual[0], count, width, &planes[0]);
+
+		EncodeRun(&planes[0], planes.size(), dst);
+	}
+
+	template<typename U>
+	bool BlockCodec::DecodeLorenzo(const Vec3i& size, const int numComponent, const unsigned char* src, const size_t srcSize, unsigned char* dst)
+	{
+		const size_t count = static_cast<size_t>(size.x) * size.y * size.z * numComponent;
+		const size_t width = sizeof(U);
+
+		if( count == 0 ){ return srcSize == 0; }
+
+		std::vector<unsigned char> planes(width * count);
+		if( !DecodeRun(src, srcSize, &planes[0], planes.size()) ){
+			return false;
+		}
+
+		std::vector<U> value(count);
+		MergePlanes(&planes[0], count, width, &value[0]);
+
+		LorenzoInverse(size, numComponent, &value[0], true);
+
+		for(size_t i = 0; i < count; i++){
+			value[i] = FromOrdered(value[i]);
+		}
+		memcpy(dst, &value[0], sizeof(U) * count);
+
+		return true;
+	}
+
+	template<typename T, typename U>
+	void BlockCodec::EncodeQuantize(const Vec3i& size, const int numComponent, const double bound, const bool relative,
+	                                const unsigned char* src, std::vector<unsigned char>& dst)
+	{
+		// 量子化した整数の絶対値の上限 (倍精度で正確に表せる範囲)
+		const double quantLimit = 4503599627370496.0; // 2^52
+
+		const size_t count = static_cast<size_t>(size.x) * size.y * size.z * numComponent;
+
+		if( count == 0 ){ return; }
+
+		std::vector<T> value(count);
+		memcpy(&value[0], src, sizeof(T) * count);
+
+		// 相対指定の場合はブロック内の値の範囲から誤差上限を求める (非有限値を含む場合は範囲も非有限)
+		double eb = bound;
+		if( relative ){
+			double vmin = value[0];
+			double vmax = value[0];
+			for(size_t i = 0; i < count; i++){
+				const double x = value[i];
+				if( !(x - x == 0.0) ){ vmin = vmax = x; break; }
+				if( x < vmin ){ vmin = x; }
+				if( x > vmax ){ vmax = x; }
+			}
+			eb = bound * (vmax - vmin);
+		}
+
+		// 量子化し，全セルの復元値が誤差上限を満たすかを確認
+		const double step = 2.0 * eb;
+		bool quantized = eb > 0.0 && eb - eb == 0.0;
+
+		std::vector<uint64_t> quant(quantized ? count : 0);
+		for(size_t i = 0; quantized && i < count; i++){
+			const double x = value[i];
+			const double t = x / step;
+			if( !(fabs(t) < quantLimit) ){
+				quantized = false;
+				break;
+			}
+			const int64_t k = static_cast<int64_t>(floor(t + 0.5));
+			const T recon = static_cast<T>(static_cast<double>(k) * step);
+			if( !(fabs(static_cast<double>(recon) - x) <= eb) ){
+				quantized = false;
+				break;
+			}
+			quant[i] = static_cast<uint64_t>(k);
+		}
+
+		if( !quantized ){
+			dst.push_back(static_cast<unsigned char>(QUANTIZE_MODE_LOSSLESS));
+			EncodeLorenzo<U>(size, numComponent, src, dst);
+			return;
+		}
+
+		// 予測の差分をジグザグ変換し，必要なビット数を求める
+		std::vector<uint64_t> residual(count);
+		LorenzoForward(size, numComponent, &quant[0], &residual[0], false);
+
+		uint64_t maxValue = 0;
+		for(size_t i = 0; i < count; i++){
+			const uint64_t r = residual[i];
+			residual[i] = (r << 1) ^ ((r >> 63) != 0 ? ~static_cast<uint64_t>(0) : 0);
+			if( residual[i] > maxValue ){ maxValue = residual[i]; }
+		}
+
+		size_t bits = 1;
+		while( bits < 64 && (maxValue >> bits) != 0 ){ bits++; }
+
+		// ヘッダ (形式, ビット数, 量子化幅のビット列をリトルエンディアンで格納)
+		uint64_t stepBits = 0;
+		memcpy(&stepBits, &step, sizeof(double));
+		dst.push_back(static_cast<unsigned char>(QUANTIZE_MODE_QUANTIZED));
+		dst.push_back(static_cast<unsigned char>(bits));
+		for(int b = 0; b < 8; b++){
+			dst.push_back(static_cast<unsigned char>(stepBits >> (8 * b)));
+		}
+
+		// 小さな差分は下位の数プレーンのみに現れ，上位プレーンはゼロランになる
+		std::vector<unsigned char> planes(bits * ((count + 7) / 8));
+		SplitBitPlanes(&residual[0], count, bits, &planes[0]);
+
+		EncodeRun(&planes[0], planes.size(), dst);
+	}
+
+	template<typename T, typename U>
+	bool BlockCodec::DecodeQuantize(const Vec3i& size, const int numComponent, const unsigned char* src, const size_t srcSize, unsigned char* dst)
+	{
+		const size_t count = static_cast<size_t>(size.x) * size.y * size.z * numComponent;
+
+		if( count == 0 ){ return srcSize == 0; }
+		if( srcSize < 1 ){ return false; }
+
+		if( src[0] == QUANTIZE_MODE_LOSSLESS ){
+			return DecodeLorenzo<U>(size, numComponent, src + 1, srcSize - 1, dst);
+		}
+
+		if( src[0] != QUANTIZE_MODE_QUANTIZED || srcSize < QUANTIZE_HEADER_SIZE ){ return false; }
+
+		const size_t bits = src[1];
+		if( bits < 1 || bits > 64 ){ return false; }
+
+		uint64_t stepBits = 0;
+		for(int b = 0; b < 8; b++){
+			stepBits |= static_cast<uint64_t>(src[2 + b]) << (8 * b);
+		}
+		double step = 0.0;
+		memcpy(&step, &stepBits, sizeof(double));
+
+		std::vector<unsigned char> planes(bits * ((count + 7) / 8));
+		if( !DecodeRun(src + QUANTIZE_HEADER_SIZE, srcSize - QUANTIZE_HEADER_SIZE, &planes[0], planes.size()) ){
+			return false;
+		}
+
+		std::vector<uint64_t> quant(count);
+		MergeBitPlanes(&planes[0], count, bits, &quant[0]);
+		for(size_t i = 0; i < count; i++){
+			const uint64_t z = quant[i];
+			quant[i] = (z >> 1) ^ ((z & 1) != 0 ? ~static_cast<uint64_t>(0) : 0);
+		}
+
+		LorenzoInverse(size, numComponent, &quant[0], false);
+
+		std::vector<T> value(count);
+		for(size_t i = 0; i < count; i++){
+			value[i] = static_cast<T>(static_cast<double>(static_cast<int64_t>(quant[i])) * step);
+		}
+		memcpy(dst, &value[0], sizeof(T) * count);
+
+		return true;
+	}
+
+	void BlockCodec::EncodeRun(const unsigned char* src, const size_t size, std::vector<unsigned char>& dst)
+	{
+		size_t i = 0;
+		while( i < size ){
+			size_t j = i;
+			if( src[i] == 0 ){
+				while( j < size && src[j] == 0 && j - i < RUN_MAX_LENGTH ){ j++; }
+				dst.push_back(static_cast<unsigned char>(RUN_ZERO_FLAG | (j - i - 1)));
+			}else{
+				// 2つ以上続く0の手前までをリテラルとする (単独の0はリテラルに含める)
+				while( j < size && j - i < RUN_MAX_LENGTH && !(src[j] == 0 && j + 1 < size && src[j+1] == 0) ){ j++; }
+				dst.push_back(static_cast<unsigned char>(j - i - 1));
+				dst.insert(dst.end(), src + i, src + j);
+			}
+			i = j;
+		}
+	}
+
+	bool BlockCodec::DecodeRun(const unsigned char* src, const size_t srcSize, unsigned char* dst, const size_t dstSize)
+	{
+		size_t p = 0;
+		size_t q = 0;
+		while( p < srcSize ){
+			const unsigned char c   = src[p++];
+			const size_t        len = static_cast<size_t>(c & ~RUN_ZERO_FLAG) + 1;
+			if( q + len > dstSize ){ return false; }
+
+			if( c & RUN_ZERO_FLAG ){
+				memset(dst + q, 0, len);
+			}else{
+				if( p + len > srcSize ){ return false; }
+				memcpy(dst + q, src + p, len);
+				p += len;
+			}
+			q += len;
+		}
+
+		return q == dstSize;
+	}
+
+} // namespace BCMFileIO
@@ -25,7 +25,7 @@
 
 namespace BCMFileIO {
 
-	bool ErrorUtil::reduceError(const bool err, MPI::Intracomm& comm) {
+	bool ErrorUtil::reduceError(const bool err, const MPI::Intracomm& comm) {
 		int ierr_s = err ? 1 : 0;
     int ierr_r = ierr_s;
 		comm.Allreduce(&ierr_s, &ierr_r, 1, MPI::INT, MPI::BOR);
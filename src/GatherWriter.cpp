@@ -0,0 +1,246 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  GatherWriter.cpp
+/// @brief 複数のメモリ領域を1ファイルにまとめて出力するクラス (scatter/gather I/O)
+///
+
+#include "GatherWriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Logger.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace BCMFileIO {
+
+	GatherWriter::GatherWriter() : m_size(0)
+	{
+	}
+
+	GatherWriter::~GatherWriter()
+	{
+		Clear();
+	}
+
+	void GatherWriter::Add(const void* ptr, const size_t size)
+	{
+		if( size == 0 ){ return; }
+
+		m_size += size;
+
+		// 直前の領域と連続している場合は統合
+		if( m_segments.size() != 0 ){
+			struct iovec& last = m_segments.back();
+			if( static_cast<unsigned char*>(last.iov_base) + last.iov_len == static_cast<const unsigned char*>(ptr) ){
+				last.iov_len += size;
+				return;
+			}
+		}
+
+		struct iovec seg;
+		seg.iov_base = const_cast<void*>(ptr);
+		seg.iov_len  = size;
+		m_segments.push_back(seg);
+	}
+
+	void GatherWriter::AddRange(const GatherWriter& src, const size_t begin, const size_t size)
+	{
+		size_t pos = 0;
+		const size_t end = begin + size;
+		for(std::vector<struct iovec>::const_iterator it = src.m_segments.begin(); it != src.m_segments.end() && pos < end; ++it){
+			size_t segBegin = std::max(pos, begin);
+			size_t segEnd   = std::min(pos + it->iov_len, end);
+			if( segBegin < segEnd ){
+				Add(static_cast<unsigned char*>(it->iov_base) + (segBegin - pos), segEnd - segBegin);
+			}
+			pos += it->iov_len;
+		}
+	}
+
+	unsigned char* GatherWriter::Allocate(const size_t size)
+	{
+		unsigned char* buf = new unsigned char[size];
+		m_buffers.push_back(buf);
+		return buf;
+	}
+
+	bool GatherWriter::Write(const std::string& filepath) const
+	{
+		int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if( fd < 0 ){
+			Logger::Error("fileopen err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+
+		bool ret = Write(fd);
+
+		if( close(fd) != 0 ){ ret = false; }
+
+		if( !ret ){
+			Logger::Error("write err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+		}
+		return ret;
+	}
+
+	bool GatherWriter::Write(const int fd) const
+	{
+		std::vector<struct iovec> iov;
+		PrepareIov(iov);
+
+		return Write(fd, iov);
+	}
+
+	bool GatherWriter::Write(const int fd, std::vector<struct iovec>& iov)
+	{
+		// writevは一度にIOV_MAX個までの領域しか扱えないため分割して出力
+		size_t head = 0;
+		while( head < iov.size() ){
+			int cnt = static_cast<int>( std::min(iov.size() - head, static_cast<size_t>(IOV_MAX)) );
+
+			ssize_t wsz = writev(fd, &iov[head], cnt);
+			if( wsz < 0 ){
+				if( errno == EINTR ){ continue; }
+				return false;
+			}
+
+			// 書き込み済みの領域を進める (部分書き込みにも対応)
+			size_t rest = static_cast<size_t>(wsz);
+			while( head < iov.size() && rest >= iov[head].iov_len ){
+				rest -= iov[head].iov_len;
+				head++;
+			}
+			if( rest != 0 ){
+				iov[head].iov_base = static_cast<unsigned char*>(iov[head].iov_base) + rest;
+				iov[head].iov_len -= rest;
+			}
+		}
+		return true;
+	}
+
+	void GatherWriter::CreateDatatype(const size_t begin, const size_t size, MPI_Datatype* type) const
+	{
+		// MPI_Type_create_hindexedのブロック長はint型のため，大きな領域は分割して記述
+		const size_t maxLen = static_cast<size_t>(1) << 30;
+
+		std::vector<int>      lens;
+		std::vector<MPI_Aint> disps;
+
+		size_t pos = 0;
+		const size_t end = begin + size;
+		for(std::vector<struct iovec>::const_iterator it = m_segments.begin(); it != m_segments.end() && pos < end; ++it){
+			size_t segBegin = std::max(pos, begin);
+			size_t segEnd   = std::min(pos + it->iov_len, end);
+			if( segBegin < segEnd ){
+				unsigned char* p = static_cast<unsigned char*>(it->iov_base) + (segBegin - pos);
+				size_t rest = segEnd - segBegin;
+				while( rest != 0 ){
+					size_t len = std::min(rest, maxLen);
+					MPI_Aint addr;
+					MPI_Get_address(p, &addr);
+					lens.push_back(static_cast<int>(len));
+					disps.push_back(addr);
+					p    += len;
+					rest -= len;
+				}
+			}
+			pos += it->iov_len;
+		}
+
+		if( lens.size() == 0 ){
+			MPI_Type_contiguous(0, MPI_BYTE, type);
+		}else{
+			MPI_Type_create_hindexed(static_cast<int>(lens.size()), &lens[0], &disps[0], MPI_BYTE, type);
+		}
+		MPI_Type_commit(type);
+	}
+
+	uint64_t GatherWriter::Hash(const size_t begin, const size_t size) const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+
+		size_t pos = 0;
+		const size_t end = begin + size;
+		for(std::vector<struct iovec>::const_iterator it = m_segments.begin(); it != m_segments.end() && pos < end; ++it){
+			size_t segBegin = std::max(pos, begin);
+			size_t segEnd   = std::min(pos + it->iov_len, end);
+			if( segBegin < segEnd ){
+				const unsigned char* p = static_cast<const unsigned char*>(it->iov_base) + (segBegin - pos);
+				for(size_t i = segBegin; i < segEnd; i++){
+					hash ^= *p++;
+					hash *= 1099511628211ULL;
+				}
+			}
+			pos += it->iov_len;
+		}
+
+		return hash;
+	}
+
+	bool GatherWriter::WriteAtAll(MPI_File fh, const MPI_Offset offset) const
+	{
+		MPI_Datatype type;
+		CreateDatatype(0, m_size, &type);
+
+		MPI_Status status;
+		int err = MPI_File_write_at_all(fh, offset, MPI_BOTTOM, 1, type, &status);
+
+		MPI_Type_free(&type);
+
+		return err == MPI_SUCCESS;
+	}
+
+	void GatherWriter::CopyTo(unsigned char* dst) const
+	{
+		for(std::vector<struct iovec>::const_iterator it = m_segments.begin(); it != m_segments.end(); ++it){
+			memcpy(dst, it->iov_base, it->iov_len);
+			dst += it->iov_len;
+		}
+	}
+
+	void GatherWriter::CopyTo(unsigned char* dst, const size_t begin, const size_t size) const
+	{
+		size_t pos = 0;
+		const size_t end = begin + size;
+		for(std::vector<struct iovec>::const_iterator it = m_segments.begin(); it != m_segments.end() && pos < end; ++it){
+			size_t segBegin = std::max(pos, begin);
+			size_t segEnd   = std::min(pos + it->iov_len, end);
+			if( segBegin < segEnd ){
+				memcpy(dst, static_cast<unsigned char*>(it->iov_base) + (segBegin - pos), segEnd - segBegin);
+				dst += segEnd - segBegin;
+			}
+			pos += it->iov_len;
+		}
+	}
+
+	void GatherWriter::Clear()
+	{
+		for(std::vector<unsigned char*>::iterator it = m_buffers.begin(); it != m_buffers.end(); ++it){
+			delete [] *it;
+		}
+		m_buffers.clear();
+		m_segments.clear();
+		m_size = 0;
+	}
+
+} // namespace BCMFileIO
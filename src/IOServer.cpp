@@ -0,0 +1,280 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  IOServer.cpp
+/// @brief 計算プロセスから受け取ったデータをファイルに出力するI/Oサーバ
+///
+
+#include "IOServer.h"
+#include "GatherWriter.h"
+#include "LeafBlockSaver.h"
+#include "FileSystemUtil.h"
+#include "Logger.h"
+
+#include <cstring>
+
+namespace BCMFileIO {
+
+	namespace {
+		/// 要求の送受信に使用するタグ
+		const int IOSERVER_TAG_REQUEST = 0x4849;
+
+		/// ファイルパスおよびデータの送受信に使用するタグ
+		const int IOSERVER_TAG_DATA    = 0x484A;
+
+		/// 出力結果の返信に使用するタグ
+		const int IOSERVER_TAG_STATUS  = 0x484B;
+
+		/// 1回の送受信の最大サイズ (Byte単位)
+		const uint64_t IOSERVER_CHUNK_SIZE = static_cast<uint64_t>(1) << 30;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	IOServer::IOServer(const MPI::Intracomm& comm, const int numServers)
+	 : m_comm(comm.Dup()), m_numServers(numServers)
+	{
+
+	}
+
+	IOServer::~IOServer()
+	{
+		if( !MPI::Is_finalized() ){
+			m_comm.Free();
+		}
+	}
+
+	bool IOServer::IsServer(const MPI::Intracomm& comm, const int numServers)
+	{
+		return comm.Get_rank() >= comm.Get_size() - numServers;
+	}
+
+	MPI::Intracomm IOServer::SplitComm(const MPI::Intracomm& comm, const int numServers)
+	{
+		return comm.Split(IsServer(comm, numServers) ? 1 : 0, comm.Get_rank());
+	}
+
+	int IOServer::GetServerRank(const int commSize, const int numServers, const int clientRank)
+	{
+		return commSize - numServers + clientRank % numServers;
+	}
+
+	bool IOServer::Run()
+	{
+		const int numClients = m_comm.Get_size() - m_numServers;
+		const int serverID   = m_comm.Get_rank() - numClients;
+
+		if( serverID < 0 ){
+			Logger::Error("rank %d is not an I/O server. [%s:%d]\n", m_comm.Get_rank(), __FILE__, __LINE__);
+			return false;
+		}
+
+		// 担当する計算プロセス数
+		int numActive = numClients > serverID ? (numClients - serverID + m_numServers - 1) / m_numServers : 0;
+
+		bool ret = true;
+		while( numActive > 0 ){
+			MPI::Status status;
+			m_comm.Probe(MPI::ANY_SOURCE, IOSERVER_TAG_REQUEST, status);
+			const int source = status.Get_source();
+
+			IOServerRequest request;
+			m_comm.Recv(&request, sizeof(IOServerRequest), MPI::BYTE, source, IOSERVER_TAG_REQUEST);
+
+			if( request.type == IOSERVER_CLOSE ){
+				numActive--;
+				continue;
+			}
+
+			int result = Process(source, request) ? 0 : 1;
+			if( result != 0 ){
+				ret = false;
+			}
+
+			// 出力結果を要求元へ返信
+			m_comm.Send(&result, 1, MPI::INT, source, IOSERVER_TAG_STATUS);
+		}
+
+		return ret;
+	}
+
+	bool IOServer::Process(const int source, const IOServerRequest& request)
+	{
+		using namespace std;
+
+		// ファイルパスとデータを受信 (同じ送信元からの受信は送信順に照合される)
+		vector<char> path(request.pathLength + 1, '\0');
+		m_comm.Recv(&path[0], request.pathLength, MPI::CHAR, source, IOSERVER_TAG_DATA);
+		string filepath(&path[0]);
+
+		unsigned char* data = new unsigned char[request.dataSize];
+		for(uint64_t p = 0; p < request.dataSize; p += IOSERVER_CHUNK_SIZE){
+			uint64_t len = request.dataSize - p < IOSERVER_CHUNK_SIZE ? request.dataSize - p : IOSERVER_CHUNK_SIZE;
+			m_comm.Recv(data + p, static_cast<int>(len), MPI::BYTE, source, IOSERVER_TAG_DATA);
+		}
+
+		string dir = FileSystemUtil::GetDirectory(filepath);
+		bool ret = FileSystemUtil::CreateDirectory(dir, dir.find("/") == 0 ? true : false);
+
+		if( ret ){
+			if( request.type == IOSERVER_WRITE_CELLID ){
+				ret = LeafBlockSaver::WriteCellIDFile(filepath, request.header, data, request.codec, request.codecParam);
+			}else{
+				GatherWriter writer;
+				writer.Add(data, request.dataSize);
+				ret = writer.Write(filepath);
+			}
+		}
+
+		if( !ret ){
+			Logger::Error("failed to write file (%s) requested by rank %d. [%s:%d]\n", filepath.c_str(), source, __FILE__, __LINE__);
+		}
+
+		delete [] data;
+
+		return ret;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	IOServerClient::IOServerClient(const MPI::Intracomm& comm, const int numServers, const int maxInFlight)
+	 : m_comm(comm.Dup()), m_server(IOServer::GetServerRank(comm.Get_size(), numServers, comm.Get_rank())),
+	   m_maxInFlight(maxInFlight < 1 ? 1 : maxInFlight), m_closed(false), m_numFailed(0)
+	{
+
+	}
+
+	IOServerClient::~IOServerClient()
+	{
+		if( !MPI::Is_finalized() ){
+			WaitAll();
+			m_comm.Free();
+		}
+	}
+
+	void IOServerClient::SetMaxInFlight(const int maxInFlight)
+	{
+		m_maxInFlight = maxInFlight < 1 ? 1 : maxInFlight;
+	}
+
+	bool IOServerClient::WriteFile(const std::string& filepath, unsigned char* data, const uint64_t size)
+	{
+		IOServerRequest request;
+		memset(&request, 0, sizeof(IOServerRequest));
+		request.type = IOSERVER_WRITE_FILE;
+
+		return Send(request, filepath, data, size);
+	}
+
+	bool IOServerClient::WriteCellID(const std::string& filepath, const LBHeader& header, unsigned char* data, const uint64_t size,
+	                                 const unsigned int codec, const int param)
+	{
+		IOServerRequest request;
+		memset(&request, 0, sizeof(IOServerRequest));
+		request.type       = IOSERVER_WRITE_CELLID;
+		request.header     = header;
+		request.codec      = codec;
+		request.codecParam = param;
+
+		return Send(request, filepath, data, size);
+	}
+
+	bool IOServerClient::Send(const IOServerRequest& request, const std::string& filepath, unsigned char* data, const uint64_t size)
+	{
+		if( m_closed ){
+			Logger::Error("I/O server is already closed. [%s:%d]\n", __FILE__, __LINE__);
+			delete [] data;
+			return false;
+		}
+
+		// 処理中の要求が最大数に達している場合は古いものから完了を待つ
+		Reap(static_cast<size_t>(m_maxInFlight - 1));
+
+		PendingSend* ps = new PendingSend;
+		ps->request            = request;
+		ps->request.pathLength = static_cast<int>(filepath.size());
+		ps->request.dataSize   = size;
+		ps->filepath           = filepath;
+		ps->data               = data;
+		ps->status             = 0;
+
+		// 送信バッファは完了まで保持する必要があるため，PendingSendの領域から送信
+		ps->requests.push_back( m_comm.Isend(&ps->request, sizeof(IOServerRequest), MPI::BYTE, m_server, IOSERVER_TAG_REQUEST) );
+		ps->requests.push_back( m_comm.Isend(ps->filepath.c_str(), ps->request.pathLength, MPI::CHAR, m_server, IOSERVER_TAG_DATA) );
+		for(uint64_t p = 0; p < size; p += IOSERVER_CHUNK_SIZE){
+			uint64_t len = size - p < IOSERVER_CHUNK_SIZE ? size - p : IOSERVER_CHUNK_SIZE;
+			ps->requests.push_back( m_comm.Isend(data + p, static_cast<int>(len), MPI::BYTE, m_server, IOSERVER_TAG_DATA) );
+		}
+		ps->requests.push_back( m_comm.Irecv(&ps->status, 1, MPI::INT, m_server, IOSERVER_TAG_STATUS) );
+
+		m_pending.push_back(ps);
+
+		// 完了済みの要求を回収 (待機しない)
+		Reap(static_cast<size_t>(m_maxInFlight));
+
+		return true;
+	}
+
+	void IOServerClient::Reap(const size_t maxRemain)
+	{
+		while( !m_pending.empty() ){
+			PendingSend* ps = m_pending.front();
+
+			if( m_pending.size() > maxRemain ){
+				MPI::Request::Waitall(static_cast<int>(ps->requests.size()), &ps->requests[0]);
+			}else if( !MPI::Request::Testall(static_cast<int>(ps->requests.size()), &ps->requests[0]) ){
+				break;
+			}
+
+			if( ps->status != 0 ){
+				Logger::Error("I/O server failed to write file (%s). [%s:%d]\n", ps->filepath.c_str(), __FILE__, __LINE__);
+				m_numFailed++;
+			}
+
+			delete [] ps->data;
+			delete ps;
+			m_pending.pop_front();
+		}
+	}
+
+	bool IOServerClient::CollectStatus(const bool wait)
+	{
+		Reap(wait ? 0 : m_pending.size());
+
+		bool ret = m_numFailed == 0;
+		m_numFailed = 0;
+		return ret;
+	}
+
+	bool IOServerClient::WaitAll()
+	{
+		return CollectStatus(true);
+	}
+
+	bool IOServerClient::Close()
+	{
+		if( m_closed ){ return CollectStatus(true); }
+
+		bool ret = WaitAll();
+
+		IOServerRequest request;
+		memset(&request, 0, sizeof(IOServerRequest));
+		request.type = IOSERVER_CLOSE;
+		m_comm.Send(&request, sizeof(IOServerRequest), MPI::BYTE, m_server, IOSERVER_TAG_REQUEST);
+
+		m_closed = true;
+
+		return ret;
+	}
+
+} // namespace BCMFileIO
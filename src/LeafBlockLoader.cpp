@@ -20,13 +20,21 @@
 #include "LeafBlockLoader.h"
 
 #include <vector>
+#include <algorithm>
 #include <string>
+#include <map>
+#include <cstdio>
 #include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "BitVoxel.h"
-#include "BCMRLE.h"
+#include "BlockCodec.h"
+#include "TypeConvert.h"
+#include "StreamCodec.h"
 #include "ErrorUtil.h"
 #include "Logger.h"
+#include "FileSystemUtil.h"
 
 #include "BCMTypes.h"
 #include "Vec3.h"
@@ -39,6 +47,33 @@ namespace BCMFileIO {
 
 	inline void DUMMY(void*){}
 
+	/// LeafBlockファイルの識別子 (通常，LB02，増分，圧縮) かを判定
+	inline bool IsDataIdentifier(const unsigned int identifier)
+	{
+		return identifier == LEAFBLOCK_FILE_IDENTIFIER       ||
+		       identifier == LEAFBLOCK_FILE_IDENTIFIER_V2    ||
+		       identifier == LEAFBLOCK_DELTA_FILE_IDENTIFIER ||
+		       identifier == LEAFBLOCK_CODEC_FILE_IDENTIFIER;
+	}
+
+	/// 時間差分のブロックかを判定
+	inline bool IsDeltaEntry(const LBCodecEntry& entry)
+	{
+		return (entry.flags & (LB_CODEC_ENTRY_DELTA_XOR | LB_CODEC_ENTRY_DELTA_SUB)) != 0;
+	}
+
+	/// ブロック内の全セルをバイトスワップ
+	inline void SwapBlock(const unsigned char dataType, unsigned char* buf, const size_t bytes)
+	{
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		static void (*BSwap[12])(void*) = { DUMMY, DUMMY, BSwap16, BSwap16, BSwap32, BSwap32, BSwap64, BSwap64, BSwap32, BSwap64, BSwap16, BSwap16 };
+
+		const size_t typeByte = typeByteTable[dataType];
+		for(size_t i = 0; i + typeByte <= bytes; i += typeByte){
+			BSwap[dataType](&buf[i]);
+		}
+	}
+
 	inline size_t LeafBlockLoader::GetBitVoxelSize( const LBHeader& hdr, size_t numBlocks ) {
 		size_t blockSize = (hdr.size[0] + hdr.vc * 2) * (hdr.size[1] + hdr.vc * 2) * (hdr.size[2] + hdr.vc * 2);
 		return BitVoxel::GetSize(blockSize * numBlocks, hdr.bitWidth);
@@ -48,10 +83,10 @@ namespace BCMFileIO {
 	{
 		fread(&hdr, sizeof(LBHeader), 1, fp);
 
-		if( hdr.identifier != LEAFBLOCK_FILE_IDENTIFIER ){
+		if( !IsDataIdentifier(hdr.identifier) ){
 			BSwap32(&hdr.identifier);
 
-			if( hdr.identifier != LEAFBLOCK_FILE_IDENTIFIER ){
+			if( !IsDataIdentifier(hdr.identifier) ){
 				return false;
 			}
 
@@ -71,14 +106,51 @@ namespace BCMFileIO {
 		return true;
 	}
 
-	inline bool LeafBlockLoader::LoadCellIDHeader( FILE *fp, LBCellIDHeader& chdr, const bool isNeedSwap )
+	inline bool LeafBlockLoader::LoadHeaderExt( FILE *fp, const LBHeader& hdr, LBHeaderExt& ext, const bool isNeedSwap)
+	{
+		ext = LBHeaderExt();
+		if( hdr.identifier != LEAFBLOCK_FILE_IDENTIFIER_V2 ){
+			ext.codec = LB_STREAM_RLE;
+			return true;
+		}
+
+		if( fread(&ext, sizeof(LBHeaderExt), 1, fp) != 1 ){
+			Logger::Error("header extension is broken [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		if( isNeedSwap ){
+			BSwap32(&ext.codec);
+			BSwap32(&ext.param);
+			BSwap64(&ext.reserved);
+		}
+		if( !StreamCodec::IsAvailable(ext.codec) ){
+			Logger::Error("codec(%u) is not registered [%s:%d]\n", ext.codec, __FILE__, __LINE__);
+			return false;
+		}
+		return true;
+	}
+
+	/// CellIDカプセルに展開方法を設定
+	inline void SetCapsuleCodec(CellIDCapsule& cc, const LBHeader& hdr, const LBHeaderExt& ext, const bool isNeedSwap)
+	{
+		if( hdr.identifier == LEAFBLOCK_FILE_IDENTIFIER_V2 ){
+			cc.codec      = ext.codec;
+			cc.isNeedSwap = isNeedSwap;
+		}else{
+			// LB01は圧縮サイズ0が圧縮なし，それ以外はRLE (読み込み時にスワップ済み)
+			cc.codec      = cc.header.compSize == 0 ? LB_STREAM_RAW : LB_STREAM_RLE;
+			cc.isNeedSwap = false;
+		}
+	}
+
+	inline bool LeafBlockLoader::LoadCellIDHeader( FILE *fp, LBCellIDHeader& chdr, const LBHeader& hdr, const bool isNeedSwap )
 	{
 		fread(&chdr, sizeof(LBCellIDHeader), 1, fp);
 		if( isNeedSwap ){
 			BSwap64(&chdr.numBlock);
 			BSwap64(&chdr.compSize);
 		}
-		if(chdr.compSize != 0 && (chdr.compSize % sizeof(GridRleCode)) != 0){
+		if(hdr.identifier == LEAFBLOCK_FILE_IDENTIFIER && chdr.compSize != 0 && (chdr.compSize % sizeof(GridRleCode)) != 0){
 			Logger::Error("compress size is invalid\n");
 			return false;
 		}
@@ -98,7 +170,8 @@ namespace BCMFileIO {
 
 		fread(*data, sizeof(unsigned char), sz, fp);
 
-		if( isNeedSwap ){
+		// LB02の符号はバイト順を保存しないため，展開後にスワップする
+		if( isNeedSwap && hdr.identifier == LEAFBLOCK_FILE_IDENTIFIER ){
 			if( chdr.compSize == 0 ){
 				size_t bitVoxelSize = GetBitVoxelSize(hdr, chdr.numBlock);
 				bitVoxelCell* bitVoxel = reinterpret_cast<bitVoxelCell*>(*data);
@@ -164,10 +237,17 @@ namespace BCMFileIO {
 				fclose(fp); err = true; break;
 			}
 
+			LBHeaderExt ext;
+			if( !LoadHeaderExt(fp, hdr, ext, isNeedSwap) ){
+				Logger::Error("%s's header extension is invalid [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+				fclose(fp); err = true; break;
+			}
+
 			CellIDCapsule cc;
-			if( !LoadCellIDHeader(fp, cc.header, isNeedSwap) ){
+			if( !LoadCellIDHeader(fp, cc.header, hdr, isNeedSwap) ){
 				fclose(fp); err = true; break;
 			}
+			SetCapsuleCodec(cc, hdr, ext, isNeedSwap);
 
 			LoadCellIDData(fp, &cc.data, hdr, cc.header, isNeedSwap);
 
@@ -245,6 +325,14 @@ namespace BCMFileIO {
 
 			header = hdr;
 
+			LBHeaderExt ext;
+			if( !LoadHeaderExt(fp, hdr, ext, isNeedSwap) ){
+				Logger::Error("%s's header extension is invalid [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+				// ファイルロードエラーを全プロセスに通知
+				unsigned char loadError = 1; comm.Bcast(&loadError, 1, MPI::CHAR, 0);
+				fclose(fp); return false;
+			}
+
 			uint64_t wnp = 0;
 			fread(&wnp, sizeof(uint64_t), 1, fp);
 			if( isNeedSwap ){
@@ -260,7 +348,7 @@ namespace BCMFileIO {
 
 			vector<LBCellIDHeader> chs(wnp);
 			for(int i = 0; i < wnp; i++){
-				if( !LoadCellIDHeader(fp, chs[i], isNeedSwap) ){
+				if( !LoadCellIDHeader(fp, chs[i], hdr, isNeedSwap) ){
 					// ファイルロードエラーを全プロセスに通知
 					unsigned char loadError = 1; comm.Bcast(&loadError, 1, MPI::CHAR, 0);
 					fclose(fp); return false;
@@ -283,6 +371,10 @@ namespace BCMFileIO {
 			comm.Bcast(&header, sizeof(LBHeader), MPI::CHAR, 0);
 			// Gridヘッダ情報をブロードキャスト
 			comm.Bcast(&chs[0], wnp * sizeof(LBCellIDHeader), MPI::CHAR, 0);
+			// ヘッダの拡張とバイトスワップの要否をブロードキャスト
+			unsigned char swapFlag = isNeedSwap ? 1 : 0;
+			comm.Bcast(&ext, sizeof(LBHeaderExt), MPI::CHAR, 0);
+			comm.Bcast(&swapFlag, 1, MPI::CHAR, 0);
 
 			// 各計算ノードにデータを送信
 			for(int i = 1; i < comm.Get_size(); i++){
@@ -313,6 +405,7 @@ namespace BCMFileIO {
 				CellIDCapsule cc;
 				cc.header = chs[file->FID];
 				cc.data   = contents[file->FID];
+				SetCapsuleCodec(cc, header, ext, isNeedSwap);
 				cidCapsules.push_back(cc);
 				freeMask[file->FID] = false;
 			}
@@ -341,11 +434,18 @@ namespace BCMFileIO {
 			vector<LBCellIDHeader> chs(wnp);
 			comm.Bcast(&chs[0], wnp * sizeof(LBCellIDHeader), MPI::CHAR, 0);
 
+			// ヘッダの拡張とバイトスワップの要否を取得
+			LBHeaderExt   ext;
+			unsigned char swapFlag = 0;
+			comm.Bcast(&ext, sizeof(LBHeaderExt), MPI::CHAR, 0);
+			comm.Bcast(&swapFlag, 1, MPI::CHAR, 0);
+
 			vector<PartitionMapper::FDIDList> fdidlists;
 			pmapper->GetFDIDLists(rank, fdidlists);
 			for(vector<PartitionMapper::FDIDList>::iterator file = fdidlists.begin(); file != fdidlists.end(); ++file){
 				CellIDCapsule cc;
 				cc.header = chs[file->FID];
+				SetCapsuleCodec(cc, header, ext, swapFlag != 0);
 				size_t sz = 0;
 				if( chs[file->FID].compSize == 0){
 					sz = GetBitVoxelSize(header, chs[file->FID].numBlock) * sizeof(bitVoxelCell);
@@ -372,14 +472,48 @@ namespace BCMFileIO {
 		size_t blockSize = (header.size[0] + header.vc*2) * (header.size[1] + header.vc*2) * (header.size[2] + header.vc*2);
 		size_t dataSize  = blockSize * cc.header.numBlock;
 
-		bitVoxelCell* bitVoxel = NULL;
-		if( cc.header.compSize != 0){
-			size_t bitVoxelSize = BitVoxel::GetSize(dataSize, header.bitWidth);
-			size_t dsize = bitVoxelSize * sizeof(bitVoxelCell);
-			bitVoxel = BCMRLE::Decode<bitVoxelCell, unsigned char>(cc.data, cc.header.compSize, dsize);
+		// ブロック単位符号はブロックごとに並列に展開
+		if( cc.codec == LB_STREAM_BLOCK ){
+			ret = new unsigned char[dataSize];
+			const int numBlock = static_cast<int>(cc.header.numBlock);
+			int err = 0;
+#ifdef _OPENMP
+			#pragma omp parallel for schedule(dynamic) reduction(+:err)
+#endif
+			for(int n = 0; n < numBlock; n++){
+				if( !DecompCellIDBlock(header, cc, n, &ret[blockSize * n]) ){ err++; }
+			}
+			if( err != 0 ){
+				delete [] ret;
+				ret = NULL;
+			}
 			delete [] cc.data;
-		}else{
+			return ret;
+		}
+
+		size_t bitVoxelSize = BitVoxel::GetSize(dataSize, header.bitWidth);
+		size_t dsize        = bitVoxelSize * sizeof(bitVoxelCell);
+
+		bitVoxelCell* bitVoxel = NULL;
+		if( cc.codec == LB_STREAM_RAW && cc.header.compSize == 0 ){
 			bitVoxel = reinterpret_cast<bitVoxelCell*>(cc.data);
+		}else{
+			const StreamCodec* codec = StreamCodec::Find(cc.codec);
+			bitVoxel = new bitVoxelCell[bitVoxelSize];
+			if( codec == NULL ||
+			    !codec->Decode(cc.data, static_cast<size_t>(cc.header.compSize), sizeof(bitVoxelCell), reinterpret_cast<unsigned char*>(bitVoxel), dsize) ){
+				Logger::Error("failed to decode CellID (codec %u) [%s:%d]\n", cc.codec, __FILE__, __LINE__);
+				delete [] bitVoxel;
+				delete [] cc.data;
+				return NULL;
+			}
+			delete [] cc.data;
+		}
+
+		if( cc.isNeedSwap ){
+			for(size_t i = 0; i < bitVoxelSize; i++){
+				BSwap32(&bitVoxel[i]);
+			}
 		}
 
 		ret = BitVoxel::Decompress(dataSize, bitVoxel, header.bitWidth);
@@ -389,29 +523,155 @@ namespace BCMFileIO {
 		return ret;
 	}
 
+	bool LeafBlockLoader::DecompCellIDBlock( const LBHeader &header, const CellIDCapsule& cc, const size_t index, unsigned char* dst)
+	{
+		const size_t blockSize = (header.size[0] + header.vc*2) * (header.size[1] + header.vc*2) * (header.size[2] + header.vc*2);
+		const size_t dirSize   = sizeof(LBCellIDBlockEntry) * cc.header.numBlock;
+
+		if( index >= cc.header.numBlock || cc.header.compSize < dirSize ){
+			Logger::Error("CellID block directory is broken [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		LBCellIDBlockEntry e;
+		memcpy(&e, &cc.data[sizeof(LBCellIDBlockEntry) * index], sizeof(LBCellIDBlockEntry));
+		if( cc.isNeedSwap ){
+			BSwap64(&e.offset);
+			BSwap32(&e.size);
+		}
+
+		const size_t codeSize = cc.header.compSize - dirSize;
+		if( e.offset > codeSize || e.size > codeSize - e.offset ){
+			Logger::Error("CellID block(%d) is out of range [%s:%d]\n", static_cast<int>(index), __FILE__, __LINE__);
+			return false;
+		}
+
+		if( e.mode == LB_CELLID_BLOCK_UNIFORM ){
+			memset(dst, e.value, blockSize);
+			return true;
+		}
+
+		if( e.bitWidth == 0 || e.bitWidth > 8 ){
+			Logger::Error("CellID block(%d) has invalid bitWidth(%d) [%s:%d]\n", static_cast<int>(index), e.bitWidth, __FILE__, __LINE__);
+			return false;
+		}
+
+		const unsigned char* code = &cc.data[dirSize + e.offset];
+		const size_t bitVoxelSize = BitVoxel::GetSize(blockSize, e.bitWidth);
+		const size_t dsize        = bitVoxelSize * sizeof(bitVoxelCell);
+
+		bitVoxelCell* bitVoxel = new bitVoxelCell[bitVoxelSize];
+		bool ret = false;
+		if( e.mode == LB_CELLID_BLOCK_BITVOXEL ){
+			if( e.size == dsize ){
+				memcpy(bitVoxel, code, dsize);
+				ret = true;
+			}
+		}else if( e.mode == LB_CELLID_BLOCK_RLE || e.mode == LB_CELLID_BLOCK_VRLE ){
+			const StreamCodec* codec = StreamCodec::Find(e.mode == LB_CELLID_BLOCK_RLE ? LB_STREAM_RLE : LB_STREAM_VRLE);
+			ret = codec->Decode(code, e.size, sizeof(bitVoxelCell), reinterpret_cast<unsigned char*>(bitVoxel), dsize);
+		}
+		if( !ret ){
+			Logger::Error("failed to decode CellID block(%d) (mode %d) [%s:%d]\n", static_cast<int>(index), e.mode, __FILE__, __LINE__);
+			delete [] bitVoxel;
+			return false;
+		}
+
+		if( cc.isNeedSwap ){
+			for(size_t i = 0; i < bitVoxelSize; i++){
+				BSwap32(&bitVoxel[i]);
+			}
+		}
+
+		unsigned char* voxel = BitVoxel::Decompress(blockSize, bitVoxel, e.bitWidth);
+		memcpy(dst, voxel, blockSize);
+
+		delete [] voxel;
+		delete [] bitVoxel;
+
+		return true;
+	}
+
+	LeafBlockLoader::CellIDBlockReader::CellIDBlockReader(const LBHeader& header, const CellIDCapsule& cc)
+		: m_header(header), m_capsule(cc), m_stream(NULL), m_voxels(NULL)
+	{
+		m_blockSize = (header.size[0] + header.vc*2) * (header.size[1] + header.vc*2) * (header.size[2] + header.vc*2);
+
+		if( CellIDStreamEncoder::IsSupported(cc.codec) ){
+			// LB01の圧縮なしは圧縮サイズ0
+			const size_t codeSize = cc.codec == LB_STREAM_RAW && cc.header.compSize == 0 ?
+			                        GetBitVoxelSize(header, cc.header.numBlock) * sizeof(bitVoxelCell) : cc.header.compSize;
+			m_stream = new CellIDStreamDecoder(cc.codec, static_cast<unsigned char>(header.bitWidth), cc.data, codeSize,
+			                                   m_blockSize * cc.header.numBlock, cc.isNeedSwap);
+		}
+	}
+
+	LeafBlockLoader::CellIDBlockReader::~CellIDBlockReader()
+	{
+		delete m_stream;
+		delete [] m_voxels;
+		delete [] m_capsule.data;
+	}
+
+	bool LeafBlockLoader::CellIDBlockReader::IsRandomAccess() const
+	{
+		return m_capsule.codec == LB_STREAM_BLOCK;
+	}
+
+	bool LeafBlockLoader::CellIDBlockReader::Read(const size_t index, unsigned char* dst)
+	{
+		if( index >= m_capsule.header.numBlock ){
+			Logger::Error("CellID block(%d) is out of range [%s:%d]\n", static_cast<int>(index), __FILE__, __LINE__);
+			return false;
+		}
+
+		if( m_capsule.codec == LB_STREAM_BLOCK ){
+			return DecompCellIDBlock(m_header, m_capsule, index, dst);
+		}
+
+		if( m_stream != NULL ){
+			if( !m_stream->Seek(m_blockSize * index) || !m_stream->Read(dst, m_blockSize) ){
+				Logger::Error("failed to decode CellID block(%d) (codec %u) [%s:%d]\n", static_cast<int>(index), m_capsule.codec, __FILE__, __LINE__);
+				return false;
+			}
+			return true;
+		}
+
+		// 逐次展開に対応しない圧縮形式は全体を展開 (dataはDecompCellIDData()で解放される)
+		if( m_voxels == NULL ){
+			if( m_capsule.data == NULL ){ return false; }
+			m_voxels = DecompCellIDData(m_header, m_capsule);
+			m_capsule.data = NULL;
+			if( m_voxels == NULL ){ return false; }
+		}
+		memcpy(dst, &m_voxels[m_blockSize * index], m_blockSize);
+		return true;
+	}
+
 	////////////////////////////////////////////////////////////////////////
 
-	unsigned char* LeafBlockLoader::Load_BlockContents(FILE *fp, const LBHeader& hdr, const Vec3i& bsz, const int vc, const bool isNeedSwap)
+	unsigned char* LeafBlockLoader::Unpack_BlockContents(const unsigned char* buf, const LBHeader& hdr, const Vec3i& bsz, const int vc, const bool isNeedSwap, const LB_DATA_TYPE dstType)
 	{
-		const static size_t typeByteTable[10] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
-		static void (*BSwap[10])(void*) = { DUMMY, DUMMY, BSwap16, BSwap16, BSwap32, BSwap32, BSwap64, BSwap64, BSwap32, BSwap64 };
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		static void (*BSwap[12])(void*) = { DUMMY, DUMMY, BSwap16, BSwap16, BSwap32, BSwap32, BSwap64, BSwap64, BSwap32, BSwap64, BSwap16, BSwap16 };
+
+		const LB_DATA_TYPE srcType   = static_cast<LB_DATA_TYPE>(hdr.dataType);
+		const bool         isConvert = srcType != dstType;
 
 		size_t typeByte = typeByteTable[hdr.dataType];
+		size_t dstByte  = typeByteTable[dstType];
 
 		Vec3i ibsz( bsz.x + vc*2,     bsz.y + vc*2,     bsz.z + vc*2);
 		Vec3i fbsz( bsz.x + hdr.vc*2, bsz.y + hdr.vc*2, bsz.z + hdr.vc*2);
 
-		unsigned char* block = new unsigned char[ibsz.x * ibsz.y * ibsz.z * typeByte];
-		unsigned char* buf   = new unsigned char[fbsz.x * fbsz.y * fbsz.z * typeByte];
+		unsigned char* block = new unsigned char[ibsz.x * ibsz.y * ibsz.z * dstByte];
 
-		memset(block, 0, sizeof(unsigned char) * ibsz.x * ibsz.y * ibsz.z * typeByte);
+		memset(block, 0, sizeof(unsigned char) * ibsz.x * ibsz.y * ibsz.z * dstByte);
 
-		fread(buf, sizeof(unsigned char), fbsz.x * fbsz.y * fbsz.z * typeByte, fp);
-
-		if( isNeedSwap ){
-			for(int i = 0; i < fbsz.x * fbsz.y * fbsz.z; i++){
-				BSwap[hdr.dataType](&buf[i * typeByte]);
-			}
+		// 型変換する場合は1行ずつ (バイトスワップしてから) 変換してコピー
+		std::vector<unsigned char> row;
+		if( isConvert && isNeedSwap ){
+			row.resize(std::max(ibsz.x, fbsz.x) * typeByte);
 		}
 
 		if( vc > hdr.vc ){
@@ -420,7 +680,11 @@ namespace BCMFileIO {
 				for(int y = 0; y < fbsz.y; y++){
 					size_t ibloc = 0 + vcd + ( (y + vcd) + (z + vcd) * ibsz.y ) * ibsz.x;
 					size_t fbloc = 0 +     + (  y        +  z        * fbsz.y ) * fbsz.x;
-					memcpy(&block[ibloc * typeByte], &buf[fbloc * typeByte], typeByte * fbsz.x );
+					if( isConvert ){
+						UnpackRow(&block[ibloc * dstByte], dstType, &buf[fbloc * typeByte], srcType, fbsz.x, isNeedSwap, row);
+					}else{
+						memcpy(&block[ibloc * typeByte], &buf[fbloc * typeByte], typeByte * fbsz.x );
+					}
 				}
 			}
 		}else{
@@ -429,106 +693,753 @@ namespace BCMFileIO {
 				for(int y = 0; y < ibsz.y; y++){
 					size_t ibloc = 0 +     + (  y        +  z        * ibsz.y ) * ibsz.x;
 					size_t fbloc = 0 + vcd + ( (y + vcd) + (z + vcd) * fbsz.y ) * fbsz.x;
-					memcpy(&block[ibloc * typeByte], &buf[fbloc * typeByte], typeByte * ibsz.x );
+					if( isConvert ){
+						UnpackRow(&block[ibloc * dstByte], dstType, &buf[fbloc * typeByte], srcType, ibsz.x, isNeedSwap, row);
+					}else{
+						memcpy(&block[ibloc * typeByte], &buf[fbloc * typeByte], typeByte * ibsz.x );
+					}
 				}
 			}
 		}
 
-		delete [] buf;
+		// 入力元を書き換えないよう，コピー後の領域でバイトスワップ (0埋めした仮想セルはスワップしても0)
+		if( isNeedSwap && !isConvert ){
+			for(int i = 0; i < ibsz.x * ibsz.y * ibsz.z; i++){
+				BSwap[hdr.dataType](&block[i * typeByte]);
+			}
+		}
+
 		return block;
 	}
 
+	void LeafBlockLoader::UnpackRow(unsigned char* dst, const LB_DATA_TYPE dstType, const unsigned char* src, const LB_DATA_TYPE srcType,
+	                                const int count, const bool isNeedSwap, std::vector<unsigned char>& row)
+	{
+		if( isNeedSwap ){
+			const size_t typeByte = TypeConvert::GetSize(srcType);
+			memcpy(&row[0], src, typeByte * count);
+			SwapBlock(static_cast<unsigned char>(srcType), &row[0], typeByte * count);
+			src = &row[0];
+		}
+		TypeConvert::Convert(srcType, src, dstType, dst, count);
+	}
+
+	bool LeafBlockLoader::CheckDataHeader(const std::string& source, const LBHeader& hdr, const IdxBlock* ib, const Vec3i& bsz)
+	{
+		if(hdr.kind != static_cast<unsigned char>(ib->kind) ){
+			Logger::Error("%s's kind(%d) is not corresponds IndexFile(%d) [%s:%d]\n", source.c_str(), hdr.kind, ib->kind, __FILE__, __LINE__);
+			return false;
+		}
+
+		if(hdr.dataType != static_cast<unsigned char>(ib->dataType)){
+			Logger::Error("%s's Type(%d) is not corresponds IndexFile(%d). [%s:%d]\n", source.c_str(), hdr.dataType, ib->dataType, __FILE__, __LINE__);
+			return false;
+		}
+
+		if(hdr.vc != ib->vc ){
+			Logger::Error("%s's vc(%d) is not corresponds IndexFile(%d). [%s:%d]\n", source.c_str(), hdr.vc, ib->vc, __FILE__, __LINE__);
+			return false;
+		}
+
+		if(hdr.size[0] != bsz.x || hdr.size[1] != bsz.y || hdr.size[2] != bsz.z){
+			Logger::Error("%s's size(%3d, %3d, %3d) is not corresponds IndexFile(%3d, %3d, %3d). [%s:%d]\n",
+			     source.c_str(), hdr.size[0], hdr.size[1], hdr.size[2], bsz.x, bsz.y, bsz.z, __FILE__, __LINE__);
+			return false;
+		}
+
+		return true;
+	}
+
+	void LeafBlockLoader::CopyBlockToScalar3D(BlockManager& blockManager, const LB_DATA_TYPE dataType, const int dataClassID, const int blockID, const int vc, const unsigned char* block)
+	{
+		if     (dataType == LB_INT8   ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const  s8*>(block)); }
+		else if(dataType == LB_UINT8  ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const  u8*>(block)); }
+		else if(dataType == LB_INT16  ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const s16*>(block)); }
+		else if(dataType == LB_UINT16 ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const u16*>(block)); }
+		else if(dataType == LB_INT32  ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const s32*>(block)); }
+		else if(dataType == LB_UINT32 ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const u32*>(block)); }
+		else if(dataType == LB_INT64  ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const s64*>(block)); }
+		else if(dataType == LB_UINT64 ){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const u64*>(block)); }
+		else if(dataType == LB_FLOAT32){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const f32*>(block)); }
+		else if(dataType == LB_FLOAT64){ CopyBufferToScalar3D(blockManager, dataClassID, blockID, vc, reinterpret_cast<const f64*>(block)); }
+	}
+
 	bool LeafBlockLoader::LoadData(const MPI::Intracomm& comm,
 								   const IdxBlock*       ib,
 								   BlockManager&         blockManager,
 								   PartitionMapper*      pmapper,
 								   const int             vc,
-								   const unsigned int    step )
+								   const unsigned int    step,
+								   DataStreamState*      stream )
 	{
 		using namespace std;
 		vector<PartitionMapper::FDIDList> fdidlists;
-		pmapper->GetFDIDLists(comm.Get_rank(), fdidlists);
+		if( ib->isGather ){
+			// 共有ファイルの場合，ブロックの位置はグローバルなリーフ番号から直接求まる
+			fdidlists.resize(1);
+			fdidlists[0].FID = 0;
+			for(int did = pmapper->GetStart(comm.Get_rank()); did < pmapper->GetEnd(comm.Get_rank()); did++){
+				fdidlists[0].FDIDs.push_back(did);
+				fdidlists[0].DIDs.push_back(did);
+			}
+		}else{
+			pmapper->GetFDIDLists(comm.Get_rank(), fdidlists);
+		}
 
 		Vec3i bsz = blockManager.getSize();
 
-		int did = 0;
+		// 逐次読み込みの場合は今回読み込んだブロックを保持
+		DataStreamState::BlockMap loaded;
+
+		// ファイルの並び (集約ファイルの場合はI/Oグループ番号順) はブロックの並びと一致しないため，
+		// 格納先のブロック番号はdidから求める
+		const int startDID = pmapper->GetStart(comm.Get_rank());
+
 		for(vector<PartitionMapper::FDIDList>::iterator file = fdidlists.begin(); file != fdidlists.end(); ++file){
-			char filename[128];
-			sprintf(filename, "%s_%010d_%06d.%s", ib->prefix.c_str(), step, file->FID, ib->extension.c_str());
+			if( file->FDIDs.size() == 0 ){ continue; }
 
-			string dirpath = ib->rootDir + ib->dataDir;
-			if(ib->isStepSubDir){
-				char stepDirName[128];
-				sprintf(stepDirName, "%010d/", step);
-				dirpath += string(stepDirName);
+			DataFile data;
+			if( !OpenDataFile(GetDataFilePath(ib, step, file->FID), ib, bsz, data, true) ){
+				CloseDataFile(data);
+				if( stream != NULL ){ *stream = DataStreamState(); }
+				return false;
 			}
 
-			string filepath = dirpath + string(filename);
+			// 増分ファイルが参照する他のステップのファイル
+			map<unsigned int, DataFile> refs;
+
+			const size_t compBytes = static_cast<size_t>(data.blockBytes) / static_cast<size_t>(ib->kind);
+			vector<unsigned char> buf(static_cast<size_t>(data.blockBytes));
+
+			bool ret = true;
+			for(size_t n = 0; n < file->FDIDs.size(); n++){
+				const int    fdid = file->FDIDs[n];
+				const int    did  = file->DIDs[n] - startDID;
+				DataFile*    src = NULL;
+				LBCodecEntry entry;
+				if( !LocateBlock(ib, bsz, step, file->FID, fdid, data, refs, &src, &entry) ){
+					ret = false;
+					break;
+				}
 
-			FILE *fp = NULL;
-			if( (fp = fopen(filepath.c_str(), "rb")) == NULL ) {
-				Logger::Error("Cannnot open file (%s) [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+				// メモリマップした非圧縮のブロックは複写せずマップ内から展開する
+				const unsigned char* block = &buf[0];
+				bool isNeedSwap = false;
+				bool status     = false;
+				if( IsDeltaEntry(entry) ){
+					// 時間差分は基準ステップのブロックから復元
+					status = ReadDeltaBlock(ib, bsz, file->FID, fdid, *src, entry, refs, stream, &buf[0]);
+				}else{
+					status = ReadBlock(*src, entry, &buf[0], &isNeedSwap, &block);
+				}
+				if( !status ){
+					Logger::Error("block %d of file %d (step %d) is broken. [%s:%d]\n", fdid, file->FID, entry.step, __FILE__, __LINE__);
+					ret = false;
+					break;
+				}
+
+				if( stream != NULL ){
+					vector<unsigned char>& keep = loaded[make_pair(file->FID, fdid)];
+					keep.assign(block, block + buf.size());
+					if( isNeedSwap ){ SwapBlock(src->hdr.dataType, &keep[0], keep.size()); }
+				}
+
+				for(int i = 0; i < static_cast<int>(ib->kind); i++){
+					int dcid = ib->dataClassID[i];
+					unsigned char* unpacked = Unpack_BlockContents(&block[i * compBytes], src->hdr, bsz, vc, isNeedSwap, ib->GetMemoryType());
+					CopyBlockToScalar3D(blockManager, ib->GetMemoryType(), dcid, did, vc, unpacked);
+					delete [] unpacked;
+				}
+			}
+
+			CloseDataFile(data);
+			for(map<unsigned int, DataFile>::iterator it = refs.begin(); it != refs.end(); ++it){
+				CloseDataFile(it->second);
+			}
+
+			if( !ret ){
+				if( stream != NULL ){ *stream = DataStreamState(); }
 				return false;
 			}
+		}
 
-			bool isNeedSwap = false;
-			LBHeader hdr;
+		if( stream != NULL ){
+			stream->blocks.swap(loaded);
+			stream->step    = step;
+			stream->isValid = true;
+		}
 
-			if( !LoadHeader(fp, hdr, isNeedSwap) ){
-				Logger::Error("%s is not leafBlock file [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+		return true;
+	}
+
+	std::string LeafBlockLoader::GetDataFilePath(const IdxBlock* ib, const unsigned int step, const int fid)
+	{
+		using namespace std;
+
+		char filename[128];
+		if( ib->isGather ){
+			sprintf(filename, "%s_%010d.%s", ib->prefix.c_str(), step, ib->extension.c_str());
+		}else{
+			sprintf(filename, "%s_%010d_%06d.%s", ib->prefix.c_str(), step, fid, ib->extension.c_str());
+		}
+
+		string dirpath = ib->rootDir + ib->dataDir;
+		if(ib->isStepSubDir){
+			char stepDirName[128];
+			sprintf(stepDirName, "%010d/", step);
+			dirpath += string(stepDirName);
+		}
+
+		string filepath = dirpath + string(filename);
+
+		// 段階出力の一時ディレクトリに確定済みのコピーが残っている場合はそちらを読み込む
+		// (以前の実行や中断したコピーで残ったファイルは確定記録と一致しないため使用しない)
+		if( !ib->stageDir.empty() && !ib->isGather ){
+			string stagedPath = ib->stageDir + filepath.substr(ib->rootDir.size());
+			if( FileSystemUtil::IsCommittedCopy(stagedPath, filepath) ){
+				filepath = stagedPath;
+			}
+		}
+
+		return filepath;
+	}
+
+	bool LeafBlockLoader::OpenDataFile(const std::string& filepath, const IdxBlock* ib, const Vec3i& bsz, DataFile& file, const bool sequential)
+	{
+		if( (file.fp = fopen(filepath.c_str(), "rb")) == NULL ) {
+			Logger::Error("Cannnot open file (%s) [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+
+		if( !LoadHeader(file.fp, file.hdr, file.isNeedSwap) ){
+			Logger::Error("%s is not leafBlock file [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+		if( file.hdr.identifier == LEAFBLOCK_FILE_IDENTIFIER_V2 ){
+			Logger::Error("%s is CellID file [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+
+		if( !CheckDataHeader(filepath, file.hdr, ib, bsz) ){
+			return false;
+		}
+		file.fillValue = ib->maskFillValue;
+
+		// 増分ファイルの場合はブロック参照を読み込む
+		file.entries.clear();
+		if( file.hdr.identifier == LEAFBLOCK_DELTA_FILE_IDENTIFIER && file.hdr.numBlock > 0 ){
+			file.entries.resize(file.hdr.numBlock);
+			if( fread(&file.entries[0], sizeof(LBDeltaEntry), file.entries.size(), file.fp) != file.entries.size() ){
+				Logger::Error("%s's block reference is broken [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
 				return false;
 			}
+			if( file.isNeedSwap ){
+				for(size_t i = 0; i < file.entries.size(); i++){
+					BSwap32(&file.entries[i].step);
+					BSwap32(&file.entries[i].index);
+				}
+			}
+		}
 
-			if(hdr.kind != static_cast<unsigned char>(ib->kind) ){
-				Logger::Error("%s's kind(%d) is not corresponds IndexFile(%d) [%s:%d]\n", filepath.c_str(), hdr.kind, ib->kind, __FILE__, __LINE__);
+		// 圧縮ファイルの場合は符号化情報とブロックごとの格納情報を読み込む
+		file.blocks.clear();
+		if( file.hdr.identifier == LEAFBLOCK_CODEC_FILE_IDENTIFIER ){
+			LBCodecHeader codec;
+			if( fread(&codec, sizeof(LBCodecHeader), 1, file.fp) != 1 ){
+				Logger::Error("%s's codec header is broken [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+				return false;
+			}
+			if( file.isNeedSwap ){
+				BSwap32(&codec.codec);
+				BSwap32(&codec.baseStep);
+			}
+			file.codec    = static_cast<LB_CODEC>(codec.codec);
+			file.baseStep = codec.baseStep;
+			if( !BlockCodec::IsSupported(file.codec, static_cast<LB_DATA_TYPE>(file.hdr.dataType)) ){
+				Logger::Error("%s's codec(%d) is not supported [%s:%d]\n", filepath.c_str(), codec.codec, __FILE__, __LINE__);
 				return false;
 			}
 
-			if(hdr.dataType != static_cast<unsigned char>(ib->dataType)){
-				Logger::Error("%s's Type(%d) is not corresponds IndexFile(%d). [%s:%d]\n", filepath.c_str(), hdr.dataType, ib->dataType, __FILE__, __LINE__);
+			if( file.hdr.numBlock > 0 ){
+				file.blocks.resize(file.hdr.numBlock);
+				if( fread(&file.blocks[0], sizeof(LBCodecEntry), file.blocks.size(), file.fp) != file.blocks.size() ){
+					Logger::Error("%s's block table is broken [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+					return false;
+				}
+				if( file.isNeedSwap ){
+					for(size_t i = 0; i < file.blocks.size(); i++){
+						BSwap64(&file.blocks[i].offset);
+						BSwap64(&file.blocks[i].size);
+						BSwap32(&file.blocks[i].step);
+						BSwap32(&file.blocks[i].flags);
+					}
+				}
+			}
+		}
+
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		size_t typeByte = typeByteTable[file.hdr.dataType];
+		Vec3i fbsz( bsz.x + file.hdr.vc*2, bsz.y + file.hdr.vc*2, bsz.z + file.hdr.vc*2);
+
+		file.dataStart  = ftello(file.fp);
+		file.blockBytes = static_cast<off_t>(typeByte) * (fbsz.x * fbsz.y * fbsz.z) * static_cast<size_t>(file.hdr.kind);
+
+		// ブロックはマップ内を直接参照する (同じファイルを開く他のプロセスやステップとページキャッシュを共有)
+		// マップできない場合 (空のファイル，マップに対応しないファイルシステム) はstdioで読み込む
+		struct stat st;
+		if( ib->isMappedRead && fstat(fileno(file.fp), &st) == 0 && st.st_size > 0 ){
+			void* addr = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fileno(file.fp), 0);
+			if( addr != MAP_FAILED ){
+				file.mapped     = static_cast<const unsigned char*>(addr);
+				file.mappedSize = static_cast<uint64_t>(st.st_size);
+#ifdef MADV_SEQUENTIAL
+				// 先頭から読むファイルは先読みを強め，参照先のファイルは先読みしない
+				madvise(addr, static_cast<size_t>(st.st_size), sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+			}
+		}
+
+		return true;
+	}
+
+	void LeafBlockLoader::CloseDataFile(DataFile& file)
+	{
+		if( file.mapped != NULL ){
+			munmap(const_cast<unsigned char*>(file.mapped), static_cast<size_t>(file.mappedSize));
+			file.mapped     = NULL;
+			file.mappedSize = 0;
+		}
+		if( file.fp != NULL ){
+			fclose(file.fp);
+			file.fp = NULL;
+		}
+	}
+
+	const unsigned char* LeafBlockLoader::FetchBlock(DataFile& src, const uint64_t offset, const size_t size, unsigned char* buf)
+	{
+		if( src.mapped != NULL ){
+			if( offset > src.mappedSize || size > src.mappedSize - offset ){
+				return NULL;
+			}
+			return src.mapped + offset;
+		}
+
+		// 読み込み位置が連続しない場合 (集約ファイル，増分ファイル，圧縮ファイル) のみシーク
+		if( ftello(src.fp) != static_cast<off_t>(offset) && fseeko(src.fp, static_cast<off_t>(offset), SEEK_SET) != 0 ){
+			return NULL;
+		}
+		if( fread(buf, 1, size, src.fp) != size ){
+			return NULL;
+		}
+		return buf;
+	}
+
+	LeafBlockLoader::DataFile* LeafBlockLoader::OpenReference(const IdxBlock*                   ib,
+	                                                          const Vec3i&                      bsz,
+	                                                          const unsigned int                step,
+	                                                          const int                         fid,
+	                                                          const uint64_t                    numBlock,
+	                                                          std::map<unsigned int, DataFile>& refs)
+	{
+		using namespace std;
+
+		map<unsigned int, DataFile>::iterator it = refs.find(step);
+		if( it != refs.end() ){
+			return &it->second;
+		}
+
+		DataFile& ref = refs[step];
+		if( !OpenDataFile(GetDataFilePath(ib, step, fid), ib, bsz, ref) ){
+			return NULL;
+		}
+		if( ref.hdr.numBlock != numBlock ){
+			Logger::Error("numBlock of step %d (%d) does not match referring file (%d). [%s:%d]\n",
+			     step, static_cast<int>(ref.hdr.numBlock), static_cast<int>(numBlock), __FILE__, __LINE__);
+			return NULL;
+		}
+
+		return &ref;
+	}
+
+	bool LeafBlockLoader::LocateBlock(const IdxBlock*                      ib,
+	                                  const Vec3i&                         bsz,
+	                                  const unsigned int                   step,
+	                                  const int                            fid,
+	                                  const int                            fdid,
+	                                  DataFile&                            file,
+	                                  std::map<unsigned int, DataFile>&    refs,
+	                                  DataFile**                           src,
+	                                  LBCodecEntry*                        entry)
+	{
+		using namespace std;
+
+		if( fdid < 0 || static_cast<uint64_t>(fdid) >= file.hdr.numBlock ){
+			Logger::Error("block %d is out of range (step %d, file %d). [%s:%d]\n", fdid, step, fid, __FILE__, __LINE__);
+			return false;
+		}
+
+		// 増分ファイル，圧縮ファイルの参照を，ブロックを格納しているファイルまでたどる
+		DataFile* cur = &file;
+		unsigned int owner = step;
+		for(;;){
+			unsigned int next = owner;
+			if( cur->hdr.identifier == LEAFBLOCK_DELTA_FILE_IDENTIFIER ){ next = cur->entries[fdid].step; }
+			if( cur->hdr.identifier == LEAFBLOCK_CODEC_FILE_IDENTIFIER ){ next = cur->blocks[fdid].step;  }
+			if( next == owner ){ break; }
+
+			// 参照は必ず過去のステップを指す (循環の防止)
+			if( next > owner ){
+				Logger::Error("invalid block reference (step %d -> %d, block %d). [%s:%d]\n", owner, next, fdid, __FILE__, __LINE__);
 				return false;
 			}
+			owner = next;
 
-			if(hdr.vc != ib->vc ){
-				Logger::Error("%s's vc(%d) is not corresponds IndexFile(%d). [%s:%d]\n", filepath.c_str(), hdr.vc, ib->vc, __FILE__, __LINE__);
+			if( (cur = OpenReference(ib, bsz, owner, fid, file.hdr.numBlock, refs)) == NULL ){
 				return false;
 			}
+		}
+
+		*src = cur;
+
+		if( cur->hdr.identifier == LEAFBLOCK_CODEC_FILE_IDENTIFIER ){
+			*entry = cur->blocks[fdid];
+			return true;
+		}
+
+		const off_t index = cur->hdr.identifier == LEAFBLOCK_DELTA_FILE_IDENTIFIER ? cur->entries[fdid].index : fdid;
+
+		entry->offset = static_cast<uint64_t>(cur->dataStart + index * cur->blockBytes);
+		entry->size   = static_cast<uint64_t>(cur->blockBytes);
+		entry->step   = owner;
+		entry->flags  = LB_CODEC_ENTRY_RAW;
+
+		return true;
+	}
+
+	bool LeafBlockLoader::ReadBlock(DataFile& src, const LBCodecEntry& entry, unsigned char* buf, bool* isNeedSwap, const unsigned char** block)
+	{
+		using namespace std;
+
+		const size_t blockBytes = static_cast<size_t>(src.blockBytes);
 
-			if(hdr.size[0] != bsz.x || hdr.size[1] != bsz.y || hdr.size[2] != bsz.z){
-				Logger::Error("%s's size(%3d, %3d, %3d) is not corresponds IndexFile(%3d, %3d, %3d). [%s:%d]\n",
-				     filepath.c_str(), hdr.size[0], hdr.size[1], hdr.size[2], bsz.x, bsz.y, bsz.z, __FILE__, __LINE__);
+		// 格納されていないブロックは全セルを指定した値で埋める (ファイルのバイト順)
+		if( entry.flags & LB_CODEC_ENTRY_ABSENT ){
+			*isNeedSwap = src.isNeedSwap;
+			const Vec3i fbsz( src.hdr.size[0] + src.hdr.vc*2, src.hdr.size[1] + src.hdr.vc*2, src.hdr.size[2] + src.hdr.vc*2 );
+			BlockCodec::Fill(static_cast<LB_DATA_TYPE>(src.hdr.dataType), fbsz, static_cast<int>(src.hdr.kind), src.fillValue, src.isNeedSwap, buf);
+			return entry.size == 0;
+		}
+
+		if( entry.flags & LB_CODEC_ENTRY_RAW ){
+			*isNeedSwap = src.isNeedSwap;
+			const unsigned char* data = entry.size == blockBytes ? FetchBlock(src, entry.offset, blockBytes, buf) : NULL;
+			if( data == NULL ){
 				return false;
 			}
+			// 型変換は要素単位で参照するため，データ型の境界に揃っていないマップ内の領域は複写する
+			const size_t typeByte = TypeConvert::GetSize(static_cast<LB_DATA_TYPE>(src.hdr.dataType));
+			if( block != NULL && reinterpret_cast<size_t>(data) % typeByte == 0 ){
+				*block = data;
+			}else if( data != buf ){
+				memcpy(buf, data, blockBytes);
+			}
+			return true;
+		}
 
-			const static size_t typeByteTable[10] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
-			size_t typeByte = typeByteTable[hdr.dataType];
-			Vec3i fbsz( bsz.x + hdr.vc*2, bsz.y + hdr.vc*2, bsz.z + hdr.vc*2);
+		const Vec3i fbsz( src.hdr.size[0] + src.hdr.vc*2, src.hdr.size[1] + src.hdr.vc*2, src.hdr.size[2] + src.hdr.vc*2 );
 
-			fseek(fp, file->FDIDs[0] * typeByte * (fbsz.x * fbsz.y * fbsz.z) * static_cast<size_t>(ib->kind), SEEK_CUR);
+		// 符号は元のブロックに縮約のフラグまたはマスクを加えたサイズを超えない
+		const size_t maskBytes = BitVoxel::GetSize(static_cast<size_t>(fbsz.x) * fbsz.y * fbsz.z, 1) * sizeof(bitVoxelCell);
+		const size_t codeSize  = static_cast<size_t>(entry.size);
+		if( codeSize == 0 || codeSize > blockBytes + src.hdr.kind + maskBytes ){
+			return false;
+		}
 
-			for(vector<int>::iterator fdid = file->FDIDs.begin(); fdid != file->FDIDs.end(); ++fdid){
-				for(int i = 0; i < static_cast<int>(ib->kind); i++){
-					int dcid = ib->dataClassID[i];
-					unsigned char* block = Load_BlockContents(fp, hdr, bsz, vc, isNeedSwap);
-
-					if     (ib->dataType == LB_INT8   ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast< s8*>(block)); }
-					else if(ib->dataType == LB_UINT8  ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast< u8*>(block)); }
-					else if(ib->dataType == LB_INT16  ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<s16*>(block)); }
-					else if(ib->dataType == LB_UINT16 ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<u16*>(block)); }
-					else if(ib->dataType == LB_INT32  ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<s32*>(block)); }
-					else if(ib->dataType == LB_UINT32 ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<u32*>(block)); }
-					else if(ib->dataType == LB_INT64  ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<s64*>(block)); }
-					else if(ib->dataType == LB_UINT64 ){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<u64*>(block)); }
-					else if(ib->dataType == LB_FLOAT32){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<f32*>(block)); }
-					else if(ib->dataType == LB_FLOAT64){ CopyBufferToScalar3D(blockManager, dcid, did, vc, reinterpret_cast<f64*>(block)); }
-
-					delete [] block;
-				}
+		// メモリマップしている場合は符号をマップ内から直接展開する
+		vector<unsigned char> scratch(src.mapped == NULL ? codeSize : 0);
+		const unsigned char* code = FetchBlock(src, entry.offset, codeSize, src.mapped == NULL ? &scratch[0] : NULL);
+		if( code == NULL ){
+			return false;
+		}
+
+		// 1値に縮約したコンポーネントは値で埋める (ファイルのバイト順のまま)
+		if( entry.flags & LB_CODEC_ENTRY_CONSTANT ){
+			*isNeedSwap = src.isNeedSwap;
+			return BlockCodec::DecodeConstant(static_cast<LB_DATA_TYPE>(src.hdr.dataType), fbsz, static_cast<int>(src.hdr.kind),
+			                                  code, codeSize, buf);
+		}
+
+		// マスク外のセルは指定した値で埋める (ファイルのバイト順)
+		if( entry.flags & LB_CODEC_ENTRY_MASKED ){
+			*isNeedSwap = src.isNeedSwap;
+			return BlockCodec::DecodeMasked(static_cast<LB_DATA_TYPE>(src.hdr.dataType), fbsz, static_cast<int>(src.hdr.kind),
+			                                code, codeSize, src.fillValue, src.isNeedSwap, buf);
+		}
+
+		// 展開したブロックは実行環境のバイト順
+		*isNeedSwap = false;
+		return BlockCodec::Decode(src.codec, static_cast<LB_DATA_TYPE>(src.hdr.dataType), fbsz, static_cast<int>(src.hdr.kind),
+		                          code, codeSize, buf);
+	}
+
+	bool LeafBlockLoader::ReadDeltaBlock(const IdxBlock*                   ib,
+	                                     const Vec3i&                      bsz,
+	                                     const int                         fid,
+	                                     const int                         fdid,
+	                                     DataFile&                         src,
+	                                     const LBCodecEntry&               entry,
+	                                     std::map<unsigned int, DataFile>& refs,
+	                                     const DataStreamState*            stream,
+	                                     unsigned char*                    buf)
+	{
+		using namespace std;
 
-				did++;
+		const size_t       blockBytes = static_cast<size_t>(src.blockBytes);
+		const unsigned int baseStep   = src.baseStep;
+
+		// 基準は必ず過去のステップを指す (循環の防止)
+		if( baseStep >= entry.step ){
+			Logger::Error("invalid delta base (step %d -> %d, block %d). [%s:%d]\n", entry.step, baseStep, fdid, __FILE__, __LINE__);
+			return false;
+		}
+
+		// 基準ステップのブロック (逐次読み込みで保持していればそれを使用し，なければキーフレームまでたどって復元)
+		vector<unsigned char> base(blockBytes);
+		DataStreamState::BlockMap::const_iterator cached;
+		if( stream != NULL && stream->isValid && stream->step == baseStep &&
+		    (cached = stream->blocks.find(make_pair(fid, fdid))) != stream->blocks.end() && cached->second.size() == blockBytes ){
+			memcpy(&base[0], &cached->second[0], blockBytes);
+		}else{
+			DataFile* ref = OpenReference(ib, bsz, baseStep, fid, src.hdr.numBlock, refs);
+			if( ref == NULL || !ReconstructBlock(ib, bsz, baseStep, fid, fdid, *ref, refs, stream, &base[0]) ){
+				return false;
 			}
+		}
 
-			fclose(fp);
+		const size_t codeSize = static_cast<size_t>(entry.size);
+		vector<unsigned char> scratch(src.mapped == NULL ? codeSize : 0);
+		const unsigned char* code = codeSize == 0 ? NULL : FetchBlock(src, entry.offset, codeSize, src.mapped == NULL ? &scratch[0] : NULL);
+		if( code == NULL ){
+			return false;
+		}
+
+		const Vec3i fbsz( src.hdr.size[0] + src.hdr.vc*2, src.hdr.size[1] + src.hdr.vc*2, src.hdr.size[2] + src.hdr.vc*2 );
+		const LB_DELTA delta = (entry.flags & LB_CODEC_ENTRY_DELTA_XOR) ? LB_DELTA_XOR : LB_DELTA_SUB;
+		return BlockCodec::DecodeDelta(delta, static_cast<LB_DATA_TYPE>(src.hdr.dataType), fbsz, static_cast<int>(src.hdr.kind),
+		                               code, codeSize, &base[0], buf);
+	}
+
+	bool LeafBlockLoader::ReconstructBlock(const IdxBlock*                   ib,
+	                                       const Vec3i&                      bsz,
+	                                       const unsigned int                step,
+	                                       const int                         fid,
+	                                       const int                         fdid,
+	                                       DataFile&                         file,
+	                                       std::map<unsigned int, DataFile>& refs,
+	                                       const DataStreamState*            stream,
+	                                       unsigned char*                    buf)
+	{
+		DataFile*    src = NULL;
+		LBCodecEntry entry;
+		if( !LocateBlock(ib, bsz, step, fid, fdid, file, refs, &src, &entry) ){
+			return false;
+		}
+
+		if( IsDeltaEntry(entry) ){
+			return ReadDeltaBlock(ib, bsz, fid, fdid, *src, entry, refs, stream, buf);
+		}
+
+		bool isNeedSwap = false;
+		if( !ReadBlock(*src, entry, buf, &isNeedSwap) ){
+			return false;
+		}
+		if( isNeedSwap ){
+			SwapBlock(src->hdr.dataType, buf, static_cast<size_t>(src->blockBytes));
+		}
+
+		return true;
+	}
+
+	bool LeafBlockLoader::CompactDataFile(const IdxBlock* ib, const Vec3i& bsz, const unsigned int step, const int fid)
+	{
+		using namespace std;
+
+		// 一時出力先ではなく出力ディレクトリのファイルを対象とする
+		IdxBlock target = *ib;
+		target.stageDir = "";
+
+		const string filepath = GetDataFilePath(&target, step, fid);
+
+		DataFile data;
+		if( !OpenDataFile(filepath, &target, bsz, data, true) ){
+			CloseDataFile(data);
+			return false;
+		}
+
+		// 他のステップを参照しないファイルは対象外
+		bool hasReference = data.hdr.identifier == LEAFBLOCK_DELTA_FILE_IDENTIFIER;
+		for(size_t i = 0; i < data.blocks.size(); i++){
+			if( data.blocks[i].step != step || IsDeltaEntry(data.blocks[i]) ){ hasReference = true; }
+		}
+		if( !hasReference ){
+			CloseDataFile(data);
+			return true;
+		}
+
+		const string tmppath = filepath + ".compact";
+		FILE* out = fopen(tmppath.c_str(), "wb");
+		if( out == NULL ){
+			Logger::Error("Cannnot open file (%s) [%s:%d]\n", tmppath.c_str(), __FILE__, __LINE__);
+			CloseDataFile(data);
+			return false;
+		}
+
+		// 圧縮ファイルは同じ圧縮形式の符号をそのまま複写する (非可逆圧縮の誤差を重ねないよう符号化し直さない)
+		// 1値に縮約したブロックはバイト順が同じ場合のみそのまま複写する
+		// 時間差分は復元して符号化せずに格納する
+		const bool   encode     = data.hdr.identifier == LEAFBLOCK_CODEC_FILE_IDENTIFIER;
+		const size_t numBlock   = static_cast<size_t>(data.hdr.numBlock);
+		const size_t blockBytes = static_cast<size_t>(data.blockBytes);
+
+		// ヘッダ (実行環境のバイト順) と，圧縮ファイルの場合は符号化情報と格納情報の領域を出力
+		LBHeader header   = data.hdr;
+		header.identifier = encode ? LEAFBLOCK_CODEC_FILE_IDENTIFIER : LEAFBLOCK_FILE_IDENTIFIER;
+		bool ret = fwrite(&header, sizeof(LBHeader), 1, out) == 1;
+
+		LBCodecHeader codec;
+		codec.codec    = static_cast<unsigned int>(data.codec);
+		codec.baseStep = 0;
+		vector<LBCodecEntry> blocks(encode ? numBlock : 0);
+		if( encode ){
+			ret = ret && fwrite(&codec, sizeof(LBCodecHeader), 1, out) == 1;
+			ret = ret && (numBlock == 0 || fwrite(&blocks[0], sizeof(LBCodecEntry), numBlock, out) == numBlock);
+		}
+
+		uint64_t offset = sizeof(LBHeader) + (encode ? sizeof(LBCodecHeader) + sizeof(LBCodecEntry) * numBlock : 0);
+
+		// 参照先のファイルからブロックを集めてファイル内のブロック順に出力
+		map<unsigned int, DataFile> refs;
+		vector<unsigned char> buf(blockBytes);
+		for(size_t fdid = 0; ret && blockBytes != 0 && fdid < numBlock; fdid++){
+			DataFile*    src = NULL;
+			LBCodecEntry entry;
+			if( !LocateBlock(&target, bsz, step, fid, static_cast<int>(fdid), data, refs, &src, &entry) ){
+				ret = false;
+				break;
+			}
+
+			// 格納されていないブロックは格納情報のみ引き継ぐ
+			const bool absent = encode && entry.flags == LB_CODEC_ENTRY_ABSENT;
+			const bool copy = encode && ((entry.flags == 0 && src->codec == data.codec) ||
+			                             ((entry.flags == LB_CODEC_ENTRY_CONSTANT || entry.flags == LB_CODEC_ENTRY_MASKED) && !src->isNeedSwap));
+			bool isNeedSwap = false;
+			size_t size = absent ? 0 : copy ? static_cast<size_t>(entry.size) : blockBytes;
+			if( buf.size() < size ){ buf.resize(size); }
+			if( absent ){
+				ret = true;
+			}
+			else if( copy ){
+				const unsigned char* code = size == 0 ? NULL : FetchBlock(*src, entry.offset, size, &buf[0]);
+				if( (ret = code != NULL) && code != &buf[0] ){ memcpy(&buf[0], code, size); }
+			}
+			else if( IsDeltaEntry(entry) ){
+				ret = ReadDeltaBlock(&target, bsz, fid, static_cast<int>(fdid), *src, entry, refs, NULL, &buf[0]);
+			}
+			else{
+				ret = ReadBlock(*src, entry, &buf[0], &isNeedSwap);
+			}
+			if( !ret ){
+				Logger::Error("failed to read block %d for %s. [%s:%d]\n", static_cast<int>(fdid), filepath.c_str(), __FILE__, __LINE__);
+				break;
+			}
+			if( isNeedSwap ){
+				SwapBlock(data.hdr.dataType, &buf[0], blockBytes);
+			}
+
+			if( encode ){
+				blocks[fdid].offset = absent ? 0 : offset;
+				blocks[fdid].size   = size;
+				blocks[fdid].step   = step;
+				blocks[fdid].flags  = absent || copy ? entry.flags : static_cast<unsigned int>(LB_CODEC_ENTRY_RAW);
+				offset += size;
+			}
+
+			if( fwrite(&buf[0], 1, size, out) != size ){
+				Logger::Error("failed to write block %d of %s. [%s:%d]\n", static_cast<int>(fdid), tmppath.c_str(), __FILE__, __LINE__);
+				ret = false;
+			}
+		}
+
+		// 圧縮ファイルの格納情報を確定
+		if( ret && encode && numBlock != 0 ){
+			ret = fseeko(out, static_cast<off_t>(sizeof(LBHeader) + sizeof(LBCodecHeader)), SEEK_SET) == 0 &&
+			      fwrite(&blocks[0], sizeof(LBCodecEntry), numBlock, out) == numBlock;
+		}
+
+		if( fclose(out) != 0 ){ ret = false; }
+
+		CloseDataFile(data);
+		for(map<unsigned int, DataFile>::iterator it = refs.begin(); it != refs.end(); ++it){
+			CloseDataFile(it->second);
+		}
+
+		if( ret && rename(tmppath.c_str(), filepath.c_str()) != 0 ){
+			Logger::Error("cannot rename %s to %s. [%s:%d]\n", tmppath.c_str(), filepath.c_str(), __FILE__, __LINE__);
+			ret = false;
+		}
+		if( !ret ){
+			remove(tmppath.c_str());
+		}
+
+		return ret;
+	}
+
+	bool LeafBlockLoader::LoadDataImage(const IdxBlock*       ib,
+	                                    BlockManager&         blockManager,
+	                                    const int             vc,
+	                                    const unsigned char*  image,
+	                                    const uint64_t        size)
+	{
+		const std::string source("checkpoint image of " + ib->name);
+
+		LBHeader hdr;
+		if( image == NULL || size < sizeof(LBHeader) ){
+			Logger::Error("%s is not found. [%s:%d]\n", source.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+		memcpy(&hdr, image, sizeof(LBHeader));
+
+		// メモリ上のイメージは同じ環境で作成されるため，バイトスワップは不要
+		if( hdr.identifier != LEAFBLOCK_FILE_IDENTIFIER ){
+			Logger::Error("%s is not leafBlock image [%s:%d]\n", source.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+
+		Vec3i bsz = blockManager.getSize();
+		if( !CheckDataHeader(source, hdr, ib, bsz) ){
+			return false;
+		}
+
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		size_t typeByte = typeByteTable[hdr.dataType];
+		Vec3i fbsz( bsz.x + hdr.vc*2, bsz.y + hdr.vc*2, bsz.z + hdr.vc*2);
+		const uint64_t compBytes = static_cast<uint64_t>(typeByte) * (fbsz.x * fbsz.y * fbsz.z);
+
+		if( hdr.numBlock != static_cast<uint64_t>(blockManager.getNumBlock()) ||
+		    size != sizeof(LBHeader) + hdr.numBlock * compBytes * static_cast<uint64_t>(ib->kind) ){
+			Logger::Error("%s's numBlock(%d) is not corresponds BlockManager(%d). [%s:%d]\n",
+			     source.c_str(), static_cast<int>(hdr.numBlock), blockManager.getNumBlock(), __FILE__, __LINE__);
+			return false;
+		}
+
+		const unsigned char* p = image + sizeof(LBHeader);
+		for(int did = 0; did < blockManager.getNumBlock(); did++){
+			for(int i = 0; i < static_cast<int>(ib->kind); i++){
+				unsigned char* block = Unpack_BlockContents(p, hdr, bsz, vc, false, ib->GetMemoryType());
+				CopyBlockToScalar3D(blockManager, ib->GetMemoryType(), ib->dataClassID[i], did, vc, block);
+				delete [] block;
+				p += compBytes;
+			}
 		}
 
 		return true;
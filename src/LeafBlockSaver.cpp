@@ -20,11 +20,17 @@
 #include "LeafBlockSaver.h"
 #include "BCMFileCommon.h"
 #include "BitVoxel.h"
-#include "BCMRLE.h"
+#include "BlockCodec.h"
+#include "TypeConvert.h"
+#include "StreamCodec.h"
 #include "ErrorUtil.h"
 #include "Logger.h"
 
 #include "FileSystemUtil.h"
+#include "GatherWriter.h"
+#include "AsyncWriter.h"
+#include "IOServer.h"
+#include "MemoryCheckpoint.h"
 
 #include "BlockManager.h"
 #include "Scalar3D.h"
@@ -32,6 +38,11 @@
 #include "BCMTypes.h"
 #include "Vec3.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace Vec3class;
 
 namespace BCMFileIO {
@@ -40,16 +51,65 @@ namespace BCMFileIO {
                                     const IdxBlock*       ib,
                                     const Vec3i&          size,
                                     const size_t          numBlock,
-                                    const unsigned char*  datas,
-                                    bool                  rle )
+                                    const unsigned char*  datas)
 	{
-		using namespace std;
+		LBHeader header = CreateCellIDHeader(ib, size, numBlock);
 
-		int rank = comm.Get_rank();
+		// 自プロセスの担当ブロックをBitVoxel化して圧縮
+		std::vector<unsigned char> code;
+		uint64_t compSize = 0;
+		const bool err = !EncodeCellID(header, numBlock, datas, ib->streamCodec, ib->streamCodecParam, code, &compSize);
+
+		return SaveCellIDCode(comm, ib, header, numBlock, code, compSize, err);
+	}
+
+	bool LeafBlockSaver::SaveCellID(const MPI::Intracomm& comm,
+	                                const IdxBlock*       ib,
+	                                BlockManager&         blockManager)
+	{
+		const Vec3i  size     = blockManager.getSize();
+		const size_t numBlock = blockManager.getNumBlock();
+		const int    vc       = ib->vc;
+
+		LBHeader header = CreateCellIDHeader(ib, size, numBlock);
+
+		std::vector<unsigned char> code;
+		if( ib->streamCodec == LB_STREAM_BLOCK ){
+			// ブロック単位で並列に符号化
+			const bool err = !EncodeCellIDBlocks(ib, blockManager, code);
+			return SaveCellIDCode(comm, ib, header, numBlock, code, code.size(), err);
+		}
+
+		// ブロックから1行ずつBitVoxel化して圧縮 (ランク全体のCellIDやBitVoxelは作成しない)
+		CellIDStreamEncoder encoder(ib->streamCodec, static_cast<unsigned char>(ib->bitWidth), code);
+		std::vector<unsigned char> row(size.x + vc*2);
+		for(size_t id = 0; id < numBlock; id++){
+			BlockBase* block = blockManager.getBlock(id);
+			Scalar3D<unsigned char>* mesh = dynamic_cast< Scalar3D<unsigned char>* >(block->getDataClass(ib->dataClassID[0]));
+			const unsigned char* data = mesh->getData();
+			Index3DS idx = mesh->getIndex();
+
+			for(int z = -vc; z < size.z + vc; z++){
+				for(int y = -vc; y < size.y + vc; y++){
+					for(int x = -vc; x < size.x + vc; x++){
+						row[x + vc] = data[ idx(x, y, z) ];
+					}
+					encoder.Put(&row[0], row.size());
+				}
+			}
+		}
+		encoder.Finish();
+
+		// LB01は圧縮サイズ0で圧縮なしを表す
+		const uint64_t compSize = ib->streamCodec == LB_STREAM_RAW ? 0 : code.size();
 
-		// リーフブロックヘッダを準備
+		return SaveCellIDCode(comm, ib, header, numBlock, code, compSize, false);
+	}
+
+	LBHeader LeafBlockSaver::CreateCellIDHeader(const IdxBlock* ib, const Vec3i& size, const size_t numBlock)
+	{
 		LBHeader header;
-		header.identifier = LEAFBLOCK_FILE_IDENTIFIER;
+		header.identifier = StreamCodec::IsLegacy(ib->streamCodec) ? LEAFBLOCK_FILE_IDENTIFIER : LEAFBLOCK_FILE_IDENTIFIER_V2;
 		header.kind       = static_cast<unsigned char>(ib->kind);
 		header.dataType   = static_cast<unsigned char>(ib->dataType);
 		header.bitWidth   = static_cast<unsigned short>(ib->bitWidth);
@@ -57,84 +117,88 @@ namespace BCMFileIO {
 		header.size[0]    = size.x;
 		header.size[1]    = size.y;
 		header.size[2]    = size.z;
-		header.numBlock   = 0; // temporary
+		header.numBlock   = numBlock;
+		return header;
+	}
 
-		int vc = ib->vc;
-		// 自プロセスの担当ブロックの保存用一時バッファサイズを計算
-		const size_t tsz = (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2) * numBlock;
+	bool LeafBlockSaver::SaveCellIDCode(const MPI::Intracomm&             comm,
+	                                    const IdxBlock*                   ib,
+	                                    LBHeader                          header,
+	                                    const size_t                      numBlock,
+	                                    const std::vector<unsigned char>& code,
+	                                    const uint64_t                    compSize,
+	                                    const bool                        encodeError)
+	{
+		using namespace std;
 
-		// 自プロセスの担当ブロックをBitVoxel化
-		size_t bitVoxelSize = 0;
-		bitVoxelCell* bitVoxel = BitVoxel::Compress(&bitVoxelSize, tsz, datas, ib->bitWidth);
+		int rank = comm.Get_rank();
 
-		// リーフブロックのCellIDヘッダを準備
-		LBCellIDHeader ch;
-		ch.numBlock = numBlock;
-
-		// BitVoxelバッファのサイズ(Byte単位)を計算
-		size_t bvs = bitVoxelSize * sizeof(bitVoxelCell);
-		unsigned char* rleBuf = NULL;
-		unsigned char* dp     = NULL;
-
-		if( rle ){ // RLE圧縮の場合
-			size_t rleSize = 0;
-			// BitVoxelをRLE圧縮
-			rleBuf = BCMRLE::Encode<bitVoxelCell, unsigned char>(bitVoxel, bvs, &rleSize);
-			// リーフブロックのCellIDヘッダに圧縮サイズを記載
-			ch.compSize = rleSize;
-			dp = rleBuf;
-		}else{ // RLEなしの場合
-			// リーフブロックのCellIDヘッダに圧縮サイズ(=0)を記載
-			ch.compSize = 0;
-			dp = reinterpret_cast<unsigned char*>(bitVoxel);
-		}
-
-		if( ib->isGather ){ // GatherMode = "Gathered"
-			int *numBlockTable      = NULL;
-			int *leafBlockSizeTable = NULL;
-			int bSz = ch.compSize == 0 ? bvs : static_cast<int>(ch.compSize);
-			int nb  = static_cast<int>(ch.numBlock);
-			if(rank == 0 ){
-				numBlockTable      = new int[comm.Get_size()]; // 各ランクのブロック数取得バッファ
-				leafBlockSizeTable = new int[comm.Get_size()]; // 各ランクのデータサイズ取得バッファ
+		if( !ib->isGather ){ // GatherMode = "Distributed"
+			if( encodeError ){
+				return false;
 			}
+			return WriteCellIDCode(GetCellIDFilePath(ib, rank), header, compSize, code, ib->streamCodec, ib->streamCodecParam);
+		}
 
-			// 各ランクのブロック数を集約
-			comm.Gather(&bSz, 1, MPI::INT, leafBlockSizeTable, 1, MPI::INT, 0);
-			// 各ランクのデータサイズを集約
-			comm.Gather(&nb,  1, MPI::INT, numBlockTable,      1, MPI::INT, 0);
+		// GatherMode = "Gathered"
+		if( ErrorUtil::reduceError(encodeError, comm) ){
+			return false;
+		}
+		header.numBlock = 0; // 各ランクのブロック数の合計
 
-			unsigned char* rcvBuf = NULL;
-			int *displs = NULL;
+		int *numBlockTable      = NULL;
+		int *leafBlockSizeTable = NULL;
+		int bSz = static_cast<int>(code.size());
+		int nb  = static_cast<int>(numBlock);
+		if(rank == 0 ){
+			numBlockTable      = new int[comm.Get_size()]; // 各ランクのブロック数取得バッファ
+			leafBlockSizeTable = new int[comm.Get_size()]; // 各ランクのデータサイズ取得バッファ
+		}
 
-			uint64_t allSz = 0;
-			if( rank == 0 ){
-				displs = new int[comm.Get_size()];
-				for(int i = 0; i < comm.Get_size(); i++){
-					displs[i] = allSz;
-					allSz += leafBlockSizeTable[i];
-				}
-				rcvBuf = new unsigned char[allSz];
-			}
-			// 各ランクの圧縮済みCellIDバッファを集約
-			comm.Gatherv(dp, bSz, MPI::UNSIGNED_CHAR, rcvBuf, leafBlockSizeTable, displs, MPI::UNSIGNED_CHAR, 0);
+		// 各ランクのブロック数を集約
+		comm.Gather(&bSz, 1, MPI::INT, leafBlockSizeTable, 1, MPI::INT, 0);
+		// 各ランクのデータサイズを集約
+		comm.Gather(&nb,  1, MPI::INT, numBlockTable,      1, MPI::INT, 0);
 
-			if( rank == 0 ){
-				char filename[128];
-				sprintf(filename, "%s.%s", ib->prefix.c_str(), ib->extension.c_str());
-				string filepath = ib->rootDir + ib->dataDir + string(filename);
-				FILE *fp = NULL;
-				if( (fp = fopen(filepath.c_str(), "wb")) == NULL) {
-					Logger::Error("fileopen error <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
-					return false;
-				}
+		unsigned char* rcvBuf = NULL;
+		int *displs = NULL;
 
+		uint64_t allSz = 0;
+		if( rank == 0 ){
+			displs = new int[comm.Get_size()];
+			for(int i = 0; i < comm.Get_size(); i++){
+				displs[i] = allSz;
+				allSz += leafBlockSizeTable[i];
+			}
+			rcvBuf = new unsigned char[allSz];
+		}
+		// 各ランクの圧縮済みCellIDバッファを集約
+		comm.Gatherv(code.empty() ? NULL : &code[0], bSz, MPI::UNSIGNED_CHAR, rcvBuf, leafBlockSizeTable, displs, MPI::UNSIGNED_CHAR, 0);
+
+		bool ret = true;
+		if( rank == 0 ){
+			char filename[128];
+			sprintf(filename, "%s.%s", ib->prefix.c_str(), ib->extension.c_str());
+			string filepath = ib->rootDir + ib->dataDir + string(filename);
+			FILE *fp = NULL;
+			if( (fp = fopen(filepath.c_str(), "wb")) == NULL) {
+				Logger::Error("fileopen error <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+				ret = false;
+			}else{
 				for(int i = 0; i < comm.Get_size(); i++){
 					header.numBlock += numBlockTable[i];
 				}
 				// ヘッダを出力
 				fwrite(&header, sizeof(header), 1, fp);
 
+				// LB02の場合はヘッダの拡張を出力
+				if( header.identifier == LEAFBLOCK_FILE_IDENTIFIER_V2 ){
+					LBHeaderExt ext;
+					ext.codec = ib->streamCodec;
+					ext.param = ib->streamCodecParam;
+					fwrite(&ext, sizeof(LBHeaderExt), 1, fp);
+				}
+
 				uint64_t number_of_procs = comm.Get_size();
 				// プロセス数を出力
 				fwrite(&number_of_procs, sizeof(uint64_t), 1, fp);
@@ -142,7 +206,7 @@ namespace BCMFileIO {
 				for(int i = 0; i < comm.Get_size(); i++){
 					LBCellIDHeader ch;
 					ch.numBlock = numBlockTable[i];
-					ch.compSize = rle ? leafBlockSizeTable[i] : 0;
+					ch.compSize = ib->streamCodec == LB_STREAM_RAW ? 0 : leafBlockSizeTable[i];
 					// 圧縮サイズを出力
 					fwrite(&ch, sizeof(LBCellIDHeader), 1, fp);
 				}
@@ -150,46 +214,299 @@ namespace BCMFileIO {
 				fwrite(rcvBuf, sizeof(unsigned char), allSz, fp);
 
 				fclose(fp);
-
-			}
-			// 各メモリの解放
-			if( rank == 0){
-				delete [] numBlockTable;
-				delete [] leafBlockSizeTable;
-				delete [] displs;
-				delete [] rcvBuf;
 			}
+		}
+		// 各メモリの解放
+		if( rank == 0){
+			delete [] numBlockTable;
+			delete [] leafBlockSizeTable;
+			delete [] displs;
+			delete [] rcvBuf;
+		}
 
-		}else{ // GatherMode = "Distributed"
+		return ret;
+	}
 
-			// write file
-			char filename[128];
-			sprintf(filename, "%s_%06d.%s", ib->prefix.c_str(), rank, ib->extension.c_str());
-			string filepath = ib->rootDir + ib->dataDir + string(filename);
-			FILE *fp = NULL;
-			if( (fp = fopen(filepath.c_str(), "wb")) == NULL) {
-				Logger::Error("fileopen error <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+	bool LeafBlockSaver::EncodeCellID(const LBHeader&             header,
+	                                  const size_t                numBlock,
+	                                  const unsigned char*        datas,
+	                                  const unsigned int          codec,
+	                                  const int                   param,
+	                                  std::vector<unsigned char>& code,
+	                                  uint64_t*                   compSize)
+	{
+		if( codec == LB_STREAM_BLOCK ){
+			if( !EncodeCellIDBlocks(header, numBlock, datas, code) ){
 				return false;
 			}
+			*compSize = code.size();
+			return true;
+		}
+
+		const StreamCodec* sc = StreamCodec::Find(codec);
+		if( sc == NULL ){
+			Logger::Error("codec(%u) is not registered [%s:%d]\n", codec, __FILE__, __LINE__);
+			return false;
+		}
 
-			header.numBlock = numBlock;
+		const size_t vc = header.vc;
 
-			fwrite(&header, sizeof(LBHeader),     1, fp);
-			fwrite(&ch,     sizeof(LBCellIDHeader), 1, fp);
+		// 自プロセスの担当ブロックの保存用一時バッファサイズを計算
+		const size_t tsz = (header.size[0] + vc*2) * (header.size[1] + vc*2) * (header.size[2] + vc*2) * numBlock;
 
-			size_t dsz = ch.compSize == 0 ? bvs : ch.compSize;
+		// 自プロセスの担当ブロックをBitVoxel化
+		size_t bitVoxelSize = 0;
+		bitVoxelCell* bitVoxel = BitVoxel::Compress(&bitVoxelSize, tsz, datas, header.bitWidth);
 
-			fwrite(dp, sizeof(unsigned char), dsz, fp);
+		// BitVoxelを要素単位で圧縮 (LB_STREAM_RLEはBCMRLE<bitVoxelCell, unsigned char>と同じ符号)
+		const bool ret = sc->Encode(reinterpret_cast<const unsigned char*>(bitVoxel), bitVoxelSize * sizeof(bitVoxelCell),
+		                            sizeof(bitVoxelCell), param, code);
+		delete [] bitVoxel;
 
-			fclose(fp);
+		if( !ret ){
+			Logger::Error("failed to encode CellID with codec(%s) [%s:%d]\n", sc->GetName(), __FILE__, __LINE__);
+			return false;
 		}
 
+		// LB01は圧縮サイズ0で圧縮なしを表す
+		*compSize = codec == LB_STREAM_RAW ? 0 : code.size();
+
+		return true;
+	}
+
+	bool LeafBlockSaver::EncodeCellIDBlocks(const LBHeader&             header,
+	                                        const size_t                numBlock,
+	                                        const unsigned char*        datas,
+	                                        std::vector<unsigned char>& code)
+	{
+		const size_t vc        = header.vc;
+		const size_t blockSize = (header.size[0] + vc*2) * (header.size[1] + vc*2) * (header.size[2] + vc*2);
+
+		std::vector<LBCellIDBlockEntry>          entries(numBlock);
+		std::vector< std::vector<unsigned char> > codes(numBlock);
+
+		// ブロックごとに独立に符号化 (符号はスレッド数によらない)
+		int err = 0;
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic) reduction(+:err)
+#endif
+		for(int n = 0; n < static_cast<int>(numBlock); n++){
+			if( !EncodeCellIDBlock(&datas[blockSize * n], blockSize, entries[n], codes[n]) ){ err++; }
+		}
+		if( err != 0 ){
+			return false;
+		}
+
+		AssembleCellIDBlocks(entries, codes, code);
+		return true;
+	}
+
+	bool LeafBlockSaver::EncodeCellIDBlocks(const IdxBlock*             ib,
+	                                        BlockManager&               blockManager,
+	                                        std::vector<unsigned char>& code)
+	{
+		const Vec3i  size      = blockManager.getSize();
+		const int    numBlock  = blockManager.getNumBlock();
+		const int    vc        = ib->vc;
+		const size_t blockSize = (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2);
+
+		std::vector<LBCellIDBlockEntry>          entries(numBlock);
+		std::vector< std::vector<unsigned char> > codes(numBlock);
+
+		// スレッドごとに1ブロック分のバッファへ複写して符号化 (符号はスレッド数によらない)
+		int err = 0;
+#ifdef _OPENMP
+		#pragma omp parallel reduction(+:err)
+#endif
+		{
+			std::vector<unsigned char> buf(blockSize);
+#ifdef _OPENMP
+			#pragma omp for schedule(dynamic)
+#endif
+			for(int n = 0; n < numBlock; n++){
+				CopyScalar3DToBuffer(blockManager, ib->dataClassID[0], n, vc, &buf[0]);
+				if( !EncodeCellIDBlock(&buf[0], blockSize, entries[n], codes[n]) ){ err++; }
+			}
+		}
+		if( err != 0 ){
+			return false;
+		}
+
+		AssembleCellIDBlocks(entries, codes, code);
+		return true;
+	}
+
+	bool LeafBlockSaver::EncodeCellIDBlock(const unsigned char*        p,
+	                                       const size_t                blockSize,
+	                                       LBCellIDBlockEntry&         e,
+	                                       std::vector<unsigned char>& blockCode)
+	{
+		unsigned char vmin = p[0];
+		unsigned char vmax = p[0];
+		for(size_t i = 1; i < blockSize; i++){
+			vmin = std::min(vmin, p[i]);
+			vmax = std::max(vmax, p[i]);
+		}
+
+		memset(&e, 0, sizeof(LBCellIDBlockEntry));
+		blockCode.clear();
+
+		// ブロック内の値が一様な場合は値のみ
+		if( vmin == vmax ){
+			e.mode  = LB_CELLID_BLOCK_UNIFORM;
+			e.value = vmin;
+			return true;
+		}
+
+		// ビット幅はブロック内の最大値から決定
+		unsigned char bitWidth = 1;
+		while( (vmax >> bitWidth) != 0 ){ bitWidth++; }
+
+		size_t bitVoxelSize = 0;
+		bitVoxelCell* bitVoxel = BitVoxel::Compress(&bitVoxelSize, blockSize, p, bitWidth);
+		const unsigned char* bv = reinterpret_cast<const unsigned char*>(bitVoxel);
+		const size_t bvBytes    = bitVoxelSize * sizeof(bitVoxelCell);
+
+		// BitVoxelとそのRLE，可変長RLEのうち最小のものを格納
+		std::vector<unsigned char> rleCode;
+		if( !StreamCodec::Find(LB_STREAM_RLE)->Encode(bv, bvBytes, sizeof(bitVoxelCell), 0, rleCode) ||
+		    !StreamCodec::Find(LB_STREAM_VRLE)->Encode(bv, bvBytes, sizeof(bitVoxelCell), 0, blockCode) ){
+			delete [] bitVoxel;
+			Logger::Error("failed to encode CellID block [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+		e.bitWidth = bitWidth;
+		if( blockCode.size() < bvBytes && blockCode.size() <= rleCode.size() ){
+			e.mode = LB_CELLID_BLOCK_VRLE;
+		}else if( rleCode.size() < bvBytes ){
+			e.mode = LB_CELLID_BLOCK_RLE;
+			blockCode.swap(rleCode);
+		}else{
+			e.mode = LB_CELLID_BLOCK_BITVOXEL;
+			blockCode.assign(bv, bv + bvBytes);
+		}
+		e.size = static_cast<unsigned int>(blockCode.size());
 		delete [] bitVoxel;
-		if( rleBuf != NULL ) delete [] rleBuf;
 
 		return true;
 	}
 
+	void LeafBlockSaver::AssembleCellIDBlocks(std::vector<LBCellIDBlockEntry>&                entries,
+	                                          const std::vector< std::vector<unsigned char> >& codes,
+	                                          std::vector<unsigned char>&                     code)
+	{
+		const size_t dirSize = sizeof(LBCellIDBlockEntry) * entries.size();
+
+		size_t total = dirSize;
+		for(size_t n = 0; n < entries.size(); n++){
+			entries[n].offset = total - dirSize;
+			total += codes[n].size();
+		}
+
+		code.resize(total);
+		if( !entries.empty() ){
+			memcpy(&code[0], &entries[0], dirSize);
+		}
+		for(size_t n = 0; n < entries.size(); n++){
+			if( !codes[n].empty() ){
+				memcpy(&code[dirSize + entries[n].offset], &codes[n][0], codes[n].size());
+			}
+		}
+	}
+
+	bool LeafBlockSaver::WriteCellIDFile(const std::string&   filepath,
+	                                     const LBHeader&      header,
+	                                     const unsigned char* datas,
+	                                     const unsigned int   codec,
+	                                     const int            param)
+	{
+		// 自プロセスの担当ブロックをBitVoxel化して圧縮
+		std::vector<unsigned char> code;
+		uint64_t compSize = 0;
+		if( !EncodeCellID(header, static_cast<size_t>(header.numBlock), datas, codec, param, code, &compSize) ){
+			return false;
+		}
+
+		return WriteCellIDCode(filepath, header, compSize, code, codec, param);
+	}
+
+	bool LeafBlockSaver::WriteCellIDCode(const std::string&                filepath,
+	                                     const LBHeader&                   header,
+	                                     const uint64_t                    compSize,
+	                                     const std::vector<unsigned char>& code,
+	                                     const unsigned int                codec,
+	                                     const int                         param)
+	{
+		const bool isLegacy = StreamCodec::IsLegacy(codec);
+
+		// リーフブロックのCellIDヘッダを準備
+		LBCellIDHeader ch;
+		ch.numBlock = header.numBlock;
+		ch.compSize = compSize;
+
+		LBHeader hdr   = header;
+		hdr.identifier = isLegacy ? LEAFBLOCK_FILE_IDENTIFIER : LEAFBLOCK_FILE_IDENTIFIER_V2;
+
+		LBHeaderExt ext;
+		ext.codec = codec;
+		ext.param = param;
+
+		bool ret = true;
+
+		FILE *fp = NULL;
+		if( (fp = fopen(filepath.c_str(), "wb")) == NULL) {
+			Logger::Error("fileopen error <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			ret = false;
+		}else{
+			fwrite(&hdr, sizeof(LBHeader),     1, fp);
+			if( !isLegacy ){
+				fwrite(&ext, sizeof(LBHeaderExt), 1, fp);
+			}
+			fwrite(&ch,  sizeof(LBCellIDHeader), 1, fp);
+
+			if( !code.empty() ){
+				fwrite(&code[0], sizeof(unsigned char), code.size(), fp);
+			}
+
+			fclose(fp);
+		}
+
+		return ret;
+	}
+
+	bool LeafBlockSaver::SaveCellIDIOServer(const MPI::Intracomm& comm,
+	                                        const IdxBlock*       ib,
+	                                        const Vec3i&          size,
+	                                        const size_t          numBlock,
+	                                        unsigned char*        datas,
+	                                        IOServerClient&       client)
+	{
+		using namespace std;
+
+		if( ib->isGather ){
+			Logger::Error("I/O server output supports distributed mode only. [%s:%d]\n", __FILE__, __LINE__);
+			delete [] datas;
+			return false;
+		}
+
+		LBHeader header;
+		header.identifier = LEAFBLOCK_FILE_IDENTIFIER;
+		header.kind       = static_cast<unsigned char>(ib->kind);
+		header.dataType   = static_cast<unsigned char>(ib->dataType);
+		header.bitWidth   = static_cast<unsigned short>(ib->bitWidth);
+		header.vc         = ib->vc;
+		header.size[0]    = size.x;
+		header.size[1]    = size.y;
+		header.size[2]    = size.z;
+		header.numBlock   = numBlock;
+
+		const size_t vc  = ib->vc;
+		const size_t tsz = (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2) * numBlock;
+
+		// BitVoxel化および圧縮はI/Oサーバで行う
+		return client.WriteCellID(GetCellIDFilePath(ib, comm.Get_rank()), header, datas, tsz, ib->streamCodec, ib->streamCodecParam);
+	}
+
 
 	/////////////////////////////////////////////////////////////////////////////////////////////
 	template<typename T>
@@ -213,18 +530,818 @@ namespace BCMFileIO {
 		return true;
 	}
 
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	bool LeafBlockSaver::IsFileLayout(BlockManager& blockManager, const int dataClassID, const int dataID, const int vc)
+	{
+		Vec3i size = blockManager.getSize();
+
+		BlockBase* block = blockManager.getBlock(dataID);
+		Scalar3D<T>* mesh = dynamic_cast< Scalar3D<T>* >(block->getDataClass(dataClassID));
+		Index3DS idx = mesh->getIndex();
+
+		// 仮想セル込みの領域がファイルと同じ並び (x, y, zの順に連続) であるかを判定
+		const size_t sx   = size.x + vc*2;
+		const size_t sy   = size.y + vc*2;
+		const size_t base = idx(-vc, -vc, -vc);
+
+		if( idx(-vc+1, -vc,   -vc  ) - base != 1       ){ return false; }
+		if( idx(-vc,   -vc+1, -vc  ) - base != sx      ){ return false; }
+		if( idx(-vc,   -vc,   -vc+1) - base != sx * sy ){ return false; }
+
+		return true;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	bool LeafBlockSaver::AddScalar3DToWriter(BlockManager& blockManager, const IdxBlock* ib, GatherWriter& writer)
+	{
+		Vec3i size = blockManager.getSize();
+
+		const int    vc       = ib->vc;
+		const int    numComp  = static_cast<int>(ib->dataClassID.size());
+		const int    numBlock = blockManager.getNumBlock();
+		const size_t sz       = (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2);
+
+		// ファイル上の型がメモリ上の型と異なる場合は変換して出力
+		if( ib->dataType != ib->GetMemoryType() ){
+			return AddConvertedScalar3DToWriter<T>(blockManager, ib, writer);
+		}
+
+		// メモリ上の並びがファイルと異なるブロックの数を数える
+		size_t numPack = 0;
+		for(int id = 0; id < numBlock; ++id){
+			for(int comp = 0; comp < numComp; comp++){
+				if( !IsFileLayout<T>(blockManager, ib->dataClassID[comp], id, vc) ){ numPack++; }
+			}
+		}
+
+		// 並びが異なるブロック用の一時バッファをまとめて確保
+		T* pack = NULL;
+		if( numPack != 0 ){
+			pack = reinterpret_cast<T*>(writer.Allocate(sizeof(T) * sz * numPack));
+		}
+
+		for(int id = 0; id < numBlock; ++id){
+			for(int comp = 0; comp < numComp; comp++){
+				const int dcid = ib->dataClassID[comp];
+
+				if( IsFileLayout<T>(blockManager, dcid, id, vc) ){
+					// Scalar3Dの領域を直接出力 (コピーなし)
+					BlockBase* block = blockManager.getBlock(id);
+					Scalar3D<T>* mesh = dynamic_cast< Scalar3D<T>* >(block->getDataClass(dcid));
+					Index3DS idx = mesh->getIndex();
+					writer.Add(&mesh->getData()[idx(-vc, -vc, -vc)], sizeof(T) * sz);
+				}else{
+					// 一時バッファに詰め替えて出力
+					CopyScalar3DToBuffer(blockManager, dcid, id, vc, pack);
+					writer.Add(pack, sizeof(T) * sz);
+					pack += sz;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	bool LeafBlockSaver::AddConvertedScalar3DToWriter(BlockManager& blockManager, const IdxBlock* ib, GatherWriter& writer)
+	{
+		Vec3i size = blockManager.getSize();
+
+		const int          vc       = ib->vc;
+		const int          numComp  = static_cast<int>(ib->dataClassID.size());
+		const int          numBlock = blockManager.getNumBlock();
+		const size_t       sz       = (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2);
+		const LB_DATA_TYPE memType  = ib->GetMemoryType();
+		const size_t       fileByte = TypeConvert::GetSize(ib->dataType);
+
+		if( numBlock == 0 || numComp == 0 ){
+			return true;
+		}
+
+		// 全ブロック/全コンポーネント分のファイル上の型の領域を確保し，ブロックごとに変換
+		unsigned char* conv = reinterpret_cast<unsigned char*>(writer.Allocate(fileByte * sz * numBlock * numComp));
+
+#ifdef _OPENMP
+		#pragma omp parallel
+#endif
+		{
+			std::vector<T> pack;
+#ifdef _OPENMP
+			#pragma omp for schedule(dynamic)
+#endif
+			for(int n = 0; n < numBlock * numComp; n++){
+				const int id   = n / numComp;
+				const int dcid = ib->dataClassID[n % numComp];
+				unsigned char* dst = &conv[fileByte * sz * n];
+
+				if( IsFileLayout<T>(blockManager, dcid, id, vc) ){
+					// Scalar3Dの領域から直接変換
+					BlockBase* block = blockManager.getBlock(id);
+					Scalar3D<T>* mesh = dynamic_cast< Scalar3D<T>* >(block->getDataClass(dcid));
+					Index3DS idx = mesh->getIndex();
+					TypeConvert::Convert(memType, &mesh->getData()[idx(-vc, -vc, -vc)], ib->dataType, dst, sz);
+				}else{
+					// 一時バッファに詰め替えてから変換
+					pack.resize(sz);
+					CopyScalar3DToBuffer(blockManager, dcid, id, vc, &pack[0]);
+					TypeConvert::Convert(memType, &pack[0], ib->dataType, dst, sz);
+				}
+			}
+		}
+
+		writer.Add(conv, fileByte * sz * numBlock * numComp);
+
+		return true;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	bool LeafBlockSaver::WriteSharedFile(const MPI::Intracomm& comm,
+	                                     const std::string&    filepath,
+	                                     const MPI::Info&      info,
+	                                     const uint64_t        offset,
+	                                     const uint64_t        fileSize,
+	                                     const GatherWriter&   writer)
+	{
+		MPI_File fh;
+		int err = MPI_File_open(comm, const_cast<char*>(filepath.c_str()), MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &fh);
+		if( err != MPI_SUCCESS ){
+			Logger::Error("fileopen err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			return false;
+		}
+
+		// 既存ファイルを上書きする場合に備え，ファイルサイズを確定
+		bool ret = MPI_File_set_size(fh, static_cast<MPI_Offset>(fileSize)) == MPI_SUCCESS;
+
+		if( !writer.WriteAtAll(fh, static_cast<MPI_Offset>(offset)) ){
+			Logger::Error("write err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+			ret = false;
+		}
+
+		MPI_File_close(&fh);
+
+		return ret;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	std::string LeafBlockSaver::GetOutputDirectory(const IdxBlock* ib, const unsigned int step)
+	{
+		std::string outputDir = ib->rootDir + ib->dataDir;
+		if(ib->isStepSubDir){
+			char stepDirName[128];
+			sprintf(stepDirName, "%010d/", step);
+			outputDir += std::string(stepDirName);
+		}
+		return outputDir;
+	}
+
+	std::string LeafBlockSaver::GetDataFilePath(const IdxBlock* ib, const unsigned int step, const int rank)
+	{
+		char filename[128];
+		sprintf(filename, "%s_%010d_%06d.%s", ib->prefix.c_str(), step, rank, ib->extension.c_str());
+		return GetOutputDirectory(ib, step) + std::string(filename);
+	}
+
+	std::string LeafBlockSaver::GetCellIDFilePath(const IdxBlock* ib, const int rank)
+	{
+		char filename[128];
+		sprintf(filename, "%s_%06d.%s", ib->prefix.c_str(), rank, ib->extension.c_str());
+		return ib->rootDir + ib->dataDir + std::string(filename);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	bool LeafBlockSaver::_CreateDataImage(const IdxBlock* ib, BlockManager& blockManager, GatherWriter& writer)
+	{
+		Vec3i size = blockManager.getSize();
+
+		LBHeader* header   = reinterpret_cast<LBHeader*>(writer.Allocate(sizeof(LBHeader)));
+		header->identifier = LEAFBLOCK_FILE_IDENTIFIER;
+		header->kind       = static_cast<unsigned char>(ib->kind);
+		header->dataType   = static_cast<unsigned char>(ib->dataType);
+		header->bitWidth   = static_cast<unsigned short>(ib->bitWidth);
+		header->vc         = ib->vc;
+		header->size[0]    = size.x;
+		header->size[1]    = size.y;
+		header->size[2]    = size.z;
+		header->numBlock   = blockManager.getNumBlock();
+		writer.Add(header, sizeof(LBHeader));
+
+		return AddScalar3DToWriter<T>(blockManager, ib, writer);
+	}
+
+	bool LeafBlockSaver::CreateDataImage(const IdxBlock* ib, BlockManager& blockManager, GatherWriter& writer)
+	{
+		bool status = false;
+		const LB_DATA_TYPE memType = ib->GetMemoryType();
+		if     ( memType == LB_INT8   ) { status = _CreateDataImage< s8>(ib, blockManager, writer); }
+		else if( memType == LB_UINT8  ) { status = _CreateDataImage< u8>(ib, blockManager, writer); }
+		else if( memType == LB_INT16  ) { status = _CreateDataImage<s16>(ib, blockManager, writer); }
+		else if( memType == LB_UINT16 ) { status = _CreateDataImage<u16>(ib, blockManager, writer); }
+		else if( memType == LB_INT32  ) { status = _CreateDataImage<s32>(ib, blockManager, writer); }
+		else if( memType == LB_UINT32 ) { status = _CreateDataImage<u32>(ib, blockManager, writer); }
+		else if( memType == LB_INT64  ) { status = _CreateDataImage<s64>(ib, blockManager, writer); }
+		else if( memType == LB_UINT64 ) { status = _CreateDataImage<u64>(ib, blockManager, writer); }
+		else if( memType == LB_FLOAT32) { status = _CreateDataImage<f32>(ib, blockManager, writer); }
+		else if( memType == LB_FLOAT64) { status = _CreateDataImage<f64>(ib, blockManager, writer); }
+		else{
+			Logger::Error("invalid DataType (%d)[%s:%d]\n", memType, __FILE__, __LINE__);
+		}
+		return status;
+	}
+
+	bool LeafBlockSaver::CreateOutputImage(const IdxBlock* ib, BlockManager& blockManager, const unsigned int step, GatherWriter& writer)
+	{
+		if( !IsEncodedOutput(ib) ){
+			return CreateDataImage(ib, blockManager, writer);
+		}
+
+		GatherWriter image;
+		if( !CreateDataImage(ib, blockManager, image) ){
+			return false;
+		}
+
+		std::vector<unsigned char> mask;
+		CreateCellMask(ib, blockManager, mask);
+
+		EncodeDataImage(ib, image, step, std::vector<unsigned int>(blockManager.getNumBlock(), step), mask, writer);
+
+		return true;
+	}
+
+	void LeafBlockSaver::CreateCellMask(const IdxBlock* ib, BlockManager& blockManager, std::vector<unsigned char>& mask)
+	{
+		mask.clear();
+		if( ib->maskClassID < 0 || ib->maskTable.size() != 256 ){
+			return;
+		}
+
+		const Vec3i  size     = blockManager.getSize();
+		const int    vc       = static_cast<int>(ib->vc);
+		const size_t count    = static_cast<size_t>(size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2);
+		const int    numBlock = blockManager.getNumBlock();
+
+		// CellIDをファイルと同じ並びで取得し，格納フラグに変換
+		mask.resize(count * numBlock);
+		for(int id = 0; id < numBlock; id++){
+			unsigned char* m = &mask[count * id];
+			CopyScalar3DToBuffer(blockManager, ib->maskClassID, id, vc, m);
+			for(size_t i = 0; i < count; i++){
+				m[i] = ib->maskTable[m[i]];
+			}
+		}
+	}
+
+	void LeafBlockSaver::EncodeDataImage(const IdxBlock*                   ib,
+	                                     const GatherWriter&               image,
+	                                     const unsigned int                step,
+	                                     const std::vector<unsigned int>&  owners,
+	                                     const std::vector<unsigned char>& mask,
+	                                     GatherWriter&                     writer,
+	                                     const unsigned char*             base,
+	                                     const LB_DELTA                   delta,
+	                                     const unsigned int               baseStep)
+	{
+		using namespace std;
+
+		const size_t numBlock   = owners.size();
+		const size_t blockBytes = numBlock != 0 ? (image.GetSize() - sizeof(LBHeader)) / numBlock : 0;
+
+		LBHeader* header = reinterpret_cast<LBHeader*>(writer.Allocate(sizeof(LBHeader)));
+		memcpy(header, image.GetSegment(0).iov_base, sizeof(LBHeader));
+		header->identifier = LEAFBLOCK_CODEC_FILE_IDENTIFIER;
+		writer.Add(header, sizeof(LBHeader));
+
+		LBCodecHeader* codec = reinterpret_cast<LBCodecHeader*>(writer.Allocate(sizeof(LBCodecHeader)));
+		codec->codec    = static_cast<unsigned int>(ib->codec);
+		codec->baseStep = base != NULL ? baseStep : 0;
+		writer.Add(codec, sizeof(LBCodecHeader));
+
+		LBCodecEntry* entries = reinterpret_cast<LBCodecEntry*>(writer.Allocate(sizeof(LBCodecEntry) * numBlock));
+		writer.Add(entries, sizeof(LBCodecEntry) * numBlock);
+
+		const Vec3i fbsz(header->size[0] + header->vc*2, header->size[1] + header->vc*2, header->size[2] + header->vc*2);
+
+		uint64_t offset = sizeof(LBHeader) + sizeof(LBCodecHeader) + sizeof(LBCodecEntry) * numBlock;
+		vector<unsigned char> raw(blockBytes);
+		vector<unsigned char> code;
+		vector<unsigned char> deltaCode;
+		vector<unsigned char> constCode;
+		const size_t count = static_cast<size_t>(fbsz.x) * fbsz.y * fbsz.z;
+		for(size_t did = 0; did < numBlock; did++){
+			LBCodecEntry& entry = entries[did];
+			entry.step   = owners[did];
+			entry.offset = 0;
+			entry.size   = 0;
+			entry.flags  = 0;
+			if( owners[did] != step || blockBytes == 0 ){ continue; }
+
+			// 全セルがマスク外 (物体内部) のブロックは格納しない
+			if( !mask.empty() && find(mask.begin() + count * did, mask.begin() + count * (did + 1), 1) == mask.begin() + count * (did + 1) ){
+				entry.flags = LB_CODEC_ENTRY_ABSENT;
+				continue;
+			}
+
+			image.CopyTo(&raw[0], sizeof(LBHeader) + did * blockBytes, blockBytes);
+
+			// 符号の方が大きい場合は符号化せずに格納
+			const unsigned char* src = &raw[0];
+			entry.size  = blockBytes;
+			entry.flags = LB_CODEC_ENTRY_RAW;
+
+			// マスク外のセルを含むブロックはマスク内のセルのみ格納 (マスク外の値は読み込み時に埋めるため他の符号は使用しない)
+			if( !mask.empty() && BlockCodec::EncodeMasked(ib->dataType, fbsz, static_cast<int>(ib->kind), &raw[0], &mask[count * did], code) ){
+				entry.offset = offset;
+				entry.size   = code.size();
+				entry.flags  = LB_CODEC_ENTRY_MASKED;
+
+				unsigned char* buf = writer.Allocate(code.size());
+				memcpy(buf, &code[0], code.size());
+				writer.Add(buf, code.size());
+
+				offset += entry.size;
+				continue;
+			}
+
+			// 値が一定のコンポーネントを1値に縮約 (全コンポーネントが一定の場合は他の符号化を省略)
+			bool isUniform = false;
+			if( BlockCodec::EncodeConstant(ib->dataType, fbsz, static_cast<int>(ib->kind), &raw[0], constCode) && constCode.size() < entry.size ){
+				src         = &constCode[0];
+				entry.size  = constCode.size();
+				entry.flags = LB_CODEC_ENTRY_CONSTANT;
+				isUniform   = find(constCode.begin(), constCode.begin() + ib->kind, 0) == constCode.begin() + ib->kind;
+			}
+
+			if( ib->codec != LB_CODEC_NONE && !isUniform ){
+				BlockCodec::Encode(ib->codec, ib->dataType, fbsz, static_cast<int>(ib->kind), ib->errorBound, &raw[0], code);
+				if( code.size() != 0 && code.size() < entry.size ){
+					src         = &code[0];
+					entry.size  = code.size();
+					entry.flags = 0;
+				}
+			}
+
+			// 時間差分の方が小さい場合は時間差分を格納
+			if( base != NULL && !isUniform ){
+				BlockCodec::EncodeDelta(delta, ib->dataType, fbsz, static_cast<int>(ib->kind), &raw[0], &base[did * blockBytes], deltaCode);
+				if( deltaCode.size() != 0 && deltaCode.size() < entry.size ){
+					src         = &deltaCode[0];
+					entry.size  = deltaCode.size();
+					entry.flags = delta == LB_DELTA_XOR ? LB_CODEC_ENTRY_DELTA_XOR : LB_CODEC_ENTRY_DELTA_SUB;
+				}
+			}
+
+			entry.offset = offset;
+
+			unsigned char* buf = writer.Allocate(static_cast<size_t>(entry.size));
+			memcpy(buf, src, static_cast<size_t>(entry.size));
+			writer.Add(buf, static_cast<size_t>(entry.size));
+
+			offset += entry.size;
+		}
+	}
+
+	bool LeafBlockSaver::SaveDataAsync(const MPI::Intracomm& comm,
+	                                   const IdxBlock*       ib,
+	                                   BlockManager&         blockManager,
+	                                   const unsigned int    step,
+	                                   AsyncWriter&          asyncWriter,
+	                                   int*                  ticket)
+	{
+		using namespace std;
+
+		if( ib->isGather || ib->isAggregate ){
+			Logger::Error("asynchronous output supports distributed mode only. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		string outputDir = GetOutputDirectory(ib, step);
+		if( !FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false) ){
+			return false;
+		}
+
+		// 一時バッファを確保する前に出力要求の空きを待つ
+		asyncWriter.WaitForSlot();
+
+		// Scalar3Dを直接参照する出力リスト (圧縮する場合は符号) を作成し，1つの一時バッファにまとめてコピー
+		GatherWriter writer;
+		if( !CreateOutputImage(ib, blockManager, step, writer) ){
+			return false;
+		}
+
+		GatherWriter* image = new GatherWriter;
+		unsigned char* buf = image->Allocate(writer.GetSize());
+		writer.CopyTo(buf);
+		image->Add(buf, writer.GetSize());
+
+		*ticket = asyncWriter.Submit(GetDataFilePath(ib, step, comm.Get_rank()), image);
+
+		return true;
+	}
+
+	bool LeafBlockSaver::SaveDataIOServer(const MPI::Intracomm& comm,
+	                                      const IdxBlock*       ib,
+	                                      BlockManager&         blockManager,
+	                                      const unsigned int    step,
+	                                      IOServerClient&       client)
+	{
+		using namespace std;
+
+		if( ib->isGather || ib->isAggregate ){
+			Logger::Error("I/O server output supports distributed mode only. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		// Scalar3Dを直接参照する出力リスト (圧縮する場合は符号) を作成し，送信用の一時バッファにまとめてコピー
+		GatherWriter writer;
+		if( !CreateOutputImage(ib, blockManager, step, writer) ){
+			return false;
+		}
+
+		unsigned char* buf = new unsigned char[writer.GetSize()];
+		writer.CopyTo(buf);
+
+		// 出力ディレクトリの作成およびファイル出力はI/Oサーバで行う
+		return client.WriteFile(GetDataFilePath(ib, step, comm.Get_rank()), buf, writer.GetSize());
+	}
+
+	bool LeafBlockSaver::SaveDataIncremental(const MPI::Intracomm& comm,
+	                                         const IdxBlock*       ib,
+	                                         BlockManager&         blockManager,
+	                                         const unsigned int    step,
+	                                         DataDeltaState&       state,
+	                                         const DataIOConfig&   config)
+	{
+		using namespace std;
+
+		if( ib->isGather || ib->isAggregate ){
+			Logger::Error("incremental output supports distributed mode only. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		// Scalar3Dを直接参照する出力リスト (ヘッダと全ブロック) を作成
+		GatherWriter image;
+		if( !CreateDataImage(ib, blockManager, image) ){
+			return false;
+		}
+
+		const size_t numBlock   = static_cast<size_t>(blockManager.getNumBlock());
+		const size_t blockBytes = numBlock != 0 ? (image.GetSize() - sizeof(LBHeader)) / numBlock : 0;
+
+		// ブロックごとのハッシュ値を計算
+		vector<uint64_t> hashes(numBlock);
+		for(size_t did = 0; did < numBlock; did++){
+			hashes[did] = image.Hash(sizeof(LBHeader) + did * blockBytes, blockBytes);
+		}
+
+		// 全ブロック出力の間隔に達した場合，前回とブロック数が異なる場合，全ブロックが変化した場合は全ブロックを出力
+		bool full = state.count == 0 || state.fullInterval <= 1 || state.hashes.size() != numBlock || step <= state.lastStep;
+		if( !full ){
+			size_t numChanged = 0;
+			for(size_t did = 0; did < numBlock; did++){
+				if( hashes[did] != state.hashes[did] ){ numChanged++; }
+			}
+			// 時間差分を使用する場合は全ブロックが変化しても差分を出力
+			full = numChanged == numBlock && state.delta == LB_DELTA_NONE;
+		}
+
+		// 変化していないブロックは前回までに格納したステップを参照
+		vector<unsigned int> owners(numBlock, step);
+		if( !full ){
+			for(size_t did = 0; did < numBlock; did++){
+				if( hashes[did] == state.hashes[did] ){ owners[did] = state.owners[did]; }
+			}
+		}
+
+		// 時間差分は前回出力したブロックを基準とする (マスクする場合，読み込み時の基準と一致しないため使用しない)
+		const bool temporal = !full && state.delta != LB_DELTA_NONE && state.previous.size() == numBlock * blockBytes && ib->maskClassID < 0;
+
+		vector<unsigned char> mask;
+		CreateCellMask(ib, blockManager, mask);
+
+		GatherWriter output;
+		if( IsEncodedOutput(ib) || temporal ){
+			// 圧縮ファイルは格納情報でブロックの参照と時間差分を表す
+			EncodeDataImage(ib, image, step, owners, mask, output,
+			                temporal ? &state.previous[0] : NULL, state.delta, state.lastStep);
+		}else if( !full ){
+			LBHeader* header = reinterpret_cast<LBHeader*>(output.Allocate(sizeof(LBHeader)));
+			memcpy(header, image.GetSegment(0).iov_base, sizeof(LBHeader));
+			header->identifier = LEAFBLOCK_DELTA_FILE_IDENTIFIER;
+			output.Add(header, sizeof(LBHeader));
+
+			LBDeltaEntry* entries = reinterpret_cast<LBDeltaEntry*>(output.Allocate(sizeof(LBDeltaEntry) * numBlock));
+			output.Add(entries, sizeof(LBDeltaEntry) * numBlock);
+
+			// 変化したブロックのみ格納
+			unsigned int numStored = 0;
+			for(size_t did = 0; did < numBlock; did++){
+				entries[did].step = owners[did];
+				if( owners[did] == step ){
+					entries[did].index = numStored++;
+					output.AddRange(image, sizeof(LBHeader) + did * blockBytes, blockBytes);
+				}else{
+					entries[did].index = 0;
+				}
+			}
+		}
+
+		const GatherWriter& writer = full && !IsEncodedOutput(ib) ? image : output;
+
+		// 次回の時間差分の基準として今回のブロックを保持
+		vector<unsigned char> previous;
+		if( state.delta != LB_DELTA_NONE && numBlock * blockBytes != 0 ){
+			previous.resize(numBlock * blockBytes);
+			image.CopyTo(&previous[0], sizeof(LBHeader), previous.size());
+		}
+
+		string outputDir = GetOutputDirectory(ib, step);
+		string filepath  = GetDataFilePath(ib, step, comm.Get_rank());
+
+		bool ret = false;
+		if( config.maxWriters > 0 && config.maxWriters < comm.Get_size() ){
+			ret = WriteThrottled(comm, config.maxWriters, outputDir, filepath, writer);
+		}else{
+			FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false);
+			ret = writer.Write(filepath);
+		}
+
+		if( ret ){
+			state.hashes.swap(hashes);
+			state.owners.swap(owners);
+			state.previous.swap(previous);
+			state.lastStep = step;
+			state.count    = state.fullInterval > 1 ? (state.count + 1) % state.fullInterval : 0;
+		}else{
+			// 出力に失敗した場合，次回は全ブロックを出力
+			state.hashes.clear();
+			state.owners.clear();
+			state.previous.clear();
+			state.count = 0;
+		}
+
+		return ret;
+	}
+
+	bool LeafBlockSaver::SaveDataMemory(const MPI::Intracomm& comm,
+	                                    const IdxBlock*       ib,
+	                                    BlockManager&         blockManager,
+	                                    const unsigned int    step,
+	                                    MemoryCheckpoint&     checkpoint)
+	{
+		// Scalar3Dを直接参照する出力リストを作成し，保持用のバッファにまとめてコピー
+		GatherWriter writer;
+		bool err = !CreateDataImage(ib, blockManager, writer);
+
+		if( ErrorUtil::reduceError(err, comm) ){ return false; }
+
+		unsigned char* buf = new unsigned char[writer.GetSize()];
+		writer.CopyTo(buf);
+
+		return checkpoint.Store(ib->name, step, buf, writer.GetSize());
+	}
+
+	bool LeafBlockSaver::SaveDataFork(const MPI::Intracomm& comm,
+	                                  const IdxBlock*       ib,
+	                                  BlockManager&         blockManager,
+	                                  const unsigned int    step,
+	                                  pid_t*                pid)
+	{
+		using namespace std;
+
+		*pid = -1;
+
+		if( ib->isGather || ib->isAggregate ){
+			Logger::Error("forked output supports distributed mode only. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		string outputDir = GetOutputDirectory(ib, step);
+		if( !FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false) ){
+			return false;
+		}
+
+		// Scalar3Dを直接参照する出力リストを作成 (fork後は子プロセスのコピーオンライトの領域を参照する．圧縮する場合はfork前に符号化する)
+		GatherWriter writer;
+		if( !CreateOutputImage(ib, blockManager, step, writer) ){
+			return false;
+		}
+
+		string filepath = GetDataFilePath(ib, step, comm.Get_rank());
+
+#ifndef _WIN32
+		// 他のスレッドがmallocのロックを保持したままforkする場合があるため，
+		// 子プロセスで使用する領域リストはfork前に作成する
+		vector<struct iovec> iov;
+		writer.PrepareIov(iov);
+
+		pid_t child = fork();
+		if( child == 0 ){
+			// 子プロセス : open/writev/close/_exitのみ使用し (メモリ確保，MPI関数およびロガーは使用しない)，
+			//              出力結果を終了コードで返す
+			int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			bool ret = fd >= 0 && GatherWriter::Write(fd, iov);
+			if( fd >= 0 && close(fd) != 0 ){ ret = false; }
+			_exit(ret ? 0 : 1);
+		}
+		if( child > 0 ){
+			*pid = child;
+			return true;
+		}
+		Logger::Error("fork failed. output synchronously. [%s:%d]\n", __FILE__, __LINE__);
+#endif
+		return writer.Write(filepath);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	bool LeafBlockSaver::WriteThrottled(const MPI::Intracomm& comm,
+	                                    const int             maxWriters,
+	                                    const std::string&    outputDir,
+	                                    const std::string&    filepath,
+	                                    const GatherWriter&   writer)
+	{
+		// トークンの送受信に使用するタグ
+		const int tag = 0x4844;
+
+		const int rank  = comm.Get_rank();
+		const int nproc = comm.Get_size();
+
+		// ランク番号をmaxWritersで割った余りごとの列でトークンを順に渡す
+		// (同時にファイルを開いて書き込むプロセス数はmaxWriters以下となる)
+		unsigned char token = 0;
+		if( rank >= maxWriters ){
+			comm.Recv(&token, 1, MPI::UNSIGNED_CHAR, rank - maxWriters, tag);
+		}
+
+		bool ret = FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false);
+		if( ret ){
+			ret = writer.Write(filepath);
+		}
+
+		// 出力に失敗した場合もトークンは渡す
+		if( rank + maxWriters < nproc ){
+			comm.Send(&token, 1, MPI::UNSIGNED_CHAR, rank + maxWriters, tag);
+		}
+
+		return ret;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////
+	bool LeafBlockSaver::WriteGroupFile(const MPI::Intracomm& groupComm,
+	                                    const std::string&    filepath,
+	                                    const int             numBlock,
+	                                    LBHeader&             header,
+	                                    const GatherWriter&   writer)
+	{
+		using namespace std;
+
+		// 集約プロセスが一度に受信するサイズ (Byte単位)
+		const size_t chunkSize = static_cast<size_t>(64) << 20;
+		const int    tag       = 0;
+
+		const int grank = groupComm.Get_rank();
+		const int gsize = groupComm.Get_size();
+
+		// 各プロセスのブロック数と出力サイズを集約プロセスに集める
+		uint64_t myInfo[2] = { static_cast<uint64_t>(numBlock), static_cast<uint64_t>(writer.GetSize()) };
+		vector<uint64_t> infoTable(grank == 0 ? gsize * 2 : 2);
+		groupComm.Gather(myInfo, sizeof(uint64_t) * 2, MPI::BYTE, &infoTable[0], sizeof(uint64_t) * 2, MPI::BYTE, 0);
+
+		// 集約プロセスがファイルを開けたかを通知
+		int fd = -1;
+		unsigned char openError = 0;
+		if( grank == 0 ){
+			fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			if( fd < 0 ){
+				Logger::Error("fileopen err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+				openError = 1;
+			}
+		}
+		groupComm.Bcast(&openError, 1, MPI::CHAR, 0);
+		if( openError == 1 ){
+			return false;
+		}
+
+		if( grank != 0 ){
+			// 出力リストをchunkSizeごとにコピーせずに送信
+			for(size_t begin = 0; begin < writer.GetSize(); begin += chunkSize){
+				MPI_Datatype type;
+				writer.CreateDatatype(begin, std::min(chunkSize, writer.GetSize() - begin), &type);
+				groupComm.Send(MPI::BOTTOM, 1, MPI::Datatype(type), 0, tag);
+				MPI_Type_free(&type);
+			}
+
+			// 集約プロセスの書き込み結果を受け取る
+			unsigned char writeError = 0;
+			groupComm.Bcast(&writeError, 1, MPI::CHAR, 0);
+			return writeError == 0;
+		}
+
+		// ヘッダ, 自プロセスのブロックの順に出力
+		uint64_t maxSize = 0;
+		header.numBlock = 0;
+		for(int i = 0; i < gsize; i++){
+			header.numBlock += infoTable[i * 2];
+			if( i != 0 ){ maxSize = std::max(maxSize, infoTable[i * 2 + 1]); }
+		}
+
+		bool ret = true;
+		{
+			GatherWriter hw;
+			hw.Add(&header, sizeof(LBHeader));
+			ret = hw.Write(fd) && writer.Write(fd);
+		}
+
+		// メンバプロセスのブロックを受信しながら出力 (受信と書き込みを重ねるため2つのバッファを交互に使用)
+		const size_t bufSize = static_cast<size_t>( std::min(static_cast<uint64_t>(chunkSize), maxSize) );
+		unsigned char* buf[2] = { NULL, NULL };
+		if( bufSize != 0 ){
+			buf[0] = new unsigned char[bufSize];
+			buf[1] = new unsigned char[bufSize];
+		}
+
+		for(int src = 1; src < gsize; src++){
+			const size_t srcSize  = static_cast<size_t>(infoTable[src * 2 + 1]);
+			const size_t numChunk = (srcSize + chunkSize - 1) / chunkSize;
+			if( numChunk == 0 ){ continue; }
+
+			MPI::Request req[2];
+			req[0] = groupComm.Irecv(buf[0], static_cast<int>(std::min(chunkSize, srcSize)), MPI::BYTE, src, tag);
+			for(size_t c = 0; c < numChunk; c++){
+				const size_t len = std::min(chunkSize, srcSize - c * chunkSize);
+				if( c + 1 < numChunk ){
+					const size_t nlen = std::min(chunkSize, srcSize - (c + 1) * chunkSize);
+					req[(c + 1) % 2] = groupComm.Irecv(buf[(c + 1) % 2], static_cast<int>(nlen), MPI::BYTE, src, tag);
+				}
+				req[c % 2].Wait();
+
+				// 書き込みに失敗した場合も，メンバプロセスの送信を完了させるため受信は継続する
+				if( ret ){
+					GatherWriter cw;
+					cw.Add(buf[c % 2], len);
+					ret = cw.Write(fd);
+				}
+			}
+		}
+
+		delete [] buf[0];
+		delete [] buf[1];
+
+		if( close(fd) != 0 ){ ret = false; }
+
+		if( !ret ){
+			Logger::Error("write err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
+		}
+
+		// 書き込み結果をメンバプロセスに通知
+		unsigned char writeError = ret ? 0 : 1;
+		groupComm.Bcast(&writeError, 1, MPI::CHAR, 0);
+
+		return ret;
+	}
+
 	/////////////////////////////////////////////////////////////////////////////////////////////
 	template<typename T>
 	bool LeafBlockSaver::_SaveData(const MPI::Intracomm& comm,
 								   const IdxBlock*       ib,
 								   BlockManager&         blockManager,
-								   const unsigned int    step)
+								   const unsigned int    step,
+								   const DataIOConfig&   config,
+								   uint64_t*             writtenBytes)
 	{
 		using namespace std;
 		int rank = comm.Get_rank();
 
+		if( writtenBytes != NULL ){ *writtenBytes = 0; }
+
 		Vec3i size = blockManager.getSize();
 
+		int vc = ib->vc;
+		const size_t blockBytes = TypeConvert::GetSize(ib->dataType) * (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2) * static_cast<size_t>(ib->kind);
+
+		// 共有ファイルの場合，自プロセスの先頭ブロックのグローバルなリーフ番号と総ブロック数を取得
+		uint64_t didStart = 0;
+		uint64_t numBlock = blockManager.getNumBlock();
+		if( ib->isGather ){
+			vector<int> numBlockTable(comm.Get_size());
+			int nb = blockManager.getNumBlock();
+			comm.Allgather(&nb, 1, MPI::INT, &numBlockTable[0], 1, MPI::INT);
+			numBlock = 0;
+			for(int i = 0; i < comm.Get_size(); i++){
+				if( i == rank ){ didStart = numBlock; }
+				numBlock += numBlockTable[i];
+			}
+		}
+
+		if( ib->isAggregate && config.groupComm == MPI::COMM_NULL ){
+			Logger::Error("I/O group is not configured. [%s:%d]\n", __FILE__, __LINE__);
+			return false;
+		}
+
+		GatherWriter writer;
+
 		LBHeader header;
 		header.identifier = LEAFBLOCK_FILE_IDENTIFIER;
 		header.kind       = static_cast<unsigned char>(ib->kind);
@@ -234,65 +1351,100 @@ namespace BCMFileIO {
 		header.size[0]    = size.x;
 		header.size[1]    = size.y;
 		header.size[2]    = size.z;
-		header.numBlock   = blockManager.getNumBlock();
+		header.numBlock   = numBlock;
 
-		int vc = ib->vc;
-		const size_t sz = (size.x + vc*2) * (size.y + vc*2) * (size.z + vc*2);
+		// ヘッダは分散ファイルの場合は各プロセス，共有ファイルの場合はRank 0のみ出力
+		// (集約ファイルの場合は集約プロセスがWriteGroupFileで出力)
+		if( !ib->isAggregate && (!ib->isGather || rank == 0) ){
+			writer.Add(&header, sizeof(LBHeader));
+		}
 
-		string outputDir = ib->rootDir + ib->dataDir;
-		if(ib->isStepSubDir){
-			char stepDirName[128];
-			sprintf(stepDirName, "%010d/", step);
-			outputDir += std::string(stepDirName);
+		// 全ブロック/全コンポーネントの領域を出力リストに登録
+		if( !AddScalar3DToWriter<T>(blockManager, ib, writer) ){
+			return false;
 		}
 
-		FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false);
+		string outputDir = GetOutputDirectory(ib, step);
 
-		FILE *fp = NULL;
 		char filename[128];
-		sprintf(filename, "%s_%010d_%06d.%s", ib->prefix.c_str(), step, rank, ib->extension.c_str());
+		if( ib->isGather ){
+			sprintf(filename, "%s_%010d.%s", ib->prefix.c_str(), step, ib->extension.c_str());
+		}else if( ib->isAggregate ){
+			sprintf(filename, "%s_%010d_%06d.%s", ib->prefix.c_str(), step, config.groupID, ib->extension.c_str());
+		}else{
+			sprintf(filename, "%s_%010d_%06d.%s", ib->prefix.c_str(), step, rank, ib->extension.c_str());
+		}
 
 		string filepath = outputDir + string(filename);
 
-		if( (fp = fopen(filepath.c_str(), "wb")) == NULL){
-			Logger::Error("fileopen err <%s>. [%s:%d]\n", filepath.c_str(), __FILE__, __LINE__);
-			return false;
-		}
+		if( ib->isGather ){
+			bool err = false;
+			if( rank == 0 ){
+				err = !FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false);
+			}
+			if( ErrorUtil::reduceError(err, comm) ){
+				return false;
+			}
 
-		fwrite(&header, sizeof(header), 1, fp);
+			uint64_t offset   = rank == 0 ? 0 : sizeof(LBHeader) + didStart * blockBytes;
+			uint64_t fileSize = sizeof(LBHeader) + numBlock * blockBytes;
+			return WriteSharedFile(comm, filepath, config.info, offset, fileSize, writer);
+		}
 
-		for(int id = 0; id < blockManager.getNumBlock(); ++id){
-			for(int comp = 0; comp < static_cast<int>(ib->dataClassID.size()); comp++){
-				T* buf = new T[sz];
-				CopyScalar3DToBuffer(blockManager, ib->dataClassID[comp], id, vc, buf);
-				fwrite(buf, sizeof(T), sz, fp);
-				delete buf;
+		if( ib->isAggregate ){
+			bool err = false;
+			if( config.groupComm.Get_rank() == 0 ){
+				err = !FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false);
+			}
+			unsigned char dirError = err ? 1 : 0;
+			config.groupComm.Bcast(&dirError, 1, MPI::CHAR, 0);
+			if( dirError == 1 ){
+				return false;
 			}
+
+			return WriteGroupFile(config.groupComm, filepath, blockManager.getNumBlock(), header, writer);
 		}
 
-		fclose(fp);
+		// 圧縮する場合は符号化したイメージを出力
+		GatherWriter encoded;
+		if( IsEncodedOutput(ib) ){
+			vector<unsigned char> mask;
+			CreateCellMask(ib, blockManager, mask);
+			EncodeDataImage(ib, writer, step, vector<unsigned int>(blockManager.getNumBlock(), step), mask, encoded);
+		}
+		const GatherWriter& output = IsEncodedOutput(ib) ? encoded : writer;
+		if( writtenBytes != NULL ){ *writtenBytes = output.GetSize(); }
 
-		return true;
+		if( config.maxWriters > 0 && config.maxWriters < comm.Get_size() ){
+			return WriteThrottled(comm, config.maxWriters, outputDir, filepath, output);
+		}
+
+		FileSystemUtil::CreateDirectory(outputDir, outputDir.find("/") == 0 ? true : false);
+
+		return output.Write(filepath);
 	}
 
 	bool LeafBlockSaver::SaveData(const MPI::Intracomm& comm,
 								  const IdxBlock*       ib,
 								  BlockManager&         blockManager,
-								  const unsigned int    step)
+								  const unsigned int    step,
+								  const DataIOConfig&   config,
+								  uint64_t*             writtenBytes)
 	{
 		bool status = false;
-		if     ( ib->dataType == LB_INT8   ) { status = _SaveData< s8>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_UINT8  ) { status = _SaveData< u8>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_INT16  ) { status = _SaveData<s16>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_UINT16 ) { status = _SaveData<u16>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_INT32  ) { status = _SaveData<s32>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_UINT32 ) { status = _SaveData<u32>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_INT64  ) { status = _SaveData<s64>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_UINT64 ) { status = _SaveData<u64>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_FLOAT32) { status = _SaveData<f32>(comm, ib, blockManager, step); }
-		else if( ib->dataType == LB_FLOAT64) { status = _SaveData<f64>(comm, ib, blockManager, step); }
+		const LB_DATA_TYPE memType = ib->GetMemoryType();
+		if     ( memType == LB_INT8   ) { status = _SaveData< s8>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_UINT8  ) { status = _SaveData< u8>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_INT16  ) { status = _SaveData<s16>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_UINT16 ) { status = _SaveData<u16>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_INT32  ) { status = _SaveData<s32>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_UINT32 ) { status = _SaveData<u32>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_INT64  ) { status = _SaveData<s64>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_UINT64 ) { status = _SaveData<u64>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_FLOAT32) { status = _SaveData<f32>(comm, ib, blockManager, step, config, writtenBytes); }
+		else if( memType == LB_FLOAT64) { status = _SaveData<f64>(comm, ib, blockManager, step, config, writtenBytes); }
 		else{
-			Logger::Error("invalid DataType (%d)[%s:%d]\n", ib->dataType, __FILE__, __LINE__);
+			Logger::Error("invalid DataType (%d)[%s:%d]\n", memType, __FILE__, __LINE__);
 			return false;
 		}
 
@@ -0,0 +1,57 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  MPIUtil.cpp
+/// @brief MPIのプロセス配置関連のユーティリティ
+///
+
+#include "MPIUtil.h"
+
+#include <cstring>
+
+namespace BCMFileIO {
+
+	void MPIUtil::GetNodeLeaderTable(const MPI::Intracomm& comm, std::vector<int>& leaderTable)
+	{
+		using namespace std;
+
+		const int rank = comm.Get_rank();
+		const int size = comm.Get_size();
+
+		// 同じノードのプロセスのうち最小のランク番号 (リーダー) を求める
+		int leader = rank;
+#if MPI_VERSION >= 3
+		MPI_Comm node;
+		MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+		MPI_Bcast(&leader, 1, MPI_INT, 0, node);
+		MPI_Comm_free(&node);
+#else
+		char hostname[MPI_MAX_PROCESSOR_NAME] = {0};
+		int nameLen;
+		MPI_Get_processor_name(hostname, &nameLen);
+		vector<char> hostnameTable(MPI_MAX_PROCESSOR_NAME * size);
+		comm.Allgather(hostname, MPI_MAX_PROCESSOR_NAME, MPI::CHAR, &hostnameTable[0], MPI_MAX_PROCESSOR_NAME, MPI::CHAR);
+		for(int i = 0; i < rank; i++){
+			if( strncmp(&hostnameTable[i * MPI_MAX_PROCESSOR_NAME], hostname, MPI_MAX_PROCESSOR_NAME) == 0 ){
+				leader = i;
+				break;
+			}
+		}
+#endif
+		leaderTable.resize(size);
+		comm.Allgather(&leader, 1, MPI::INT, &leaderTable[0], 1, MPI::INT);
+	}
+
+} // namespace BCMFileIO
@@ -0,0 +1,248 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  MemoryCheckpoint.cpp
+/// @brief リーフブロックファイルのイメージを自プロセスとパートナープロセスのメモリに保持するクラス
+///
+
+#include "MemoryCheckpoint.h"
+#include "ErrorUtil.h"
+#include "MPIUtil.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace BCMFileIO {
+
+	namespace {
+		/// Store()の送受信に使用するタグ
+		const int MEMCKPT_TAG_STORE = 0x4D43;
+
+		/// Recover()でローカルコピーの復元に使用するタグ
+		const int MEMCKPT_TAG_LOCAL = 0x4D44;
+
+		/// Recover()で預かりコピーの復元に使用するタグ
+		const int MEMCKPT_TAG_HELD  = 0x4D45;
+
+		/// 1回の送受信の最大サイズ (Byte単位)
+		const uint64_t MEMCKPT_CHUNK_SIZE = static_cast<uint64_t>(1) << 30;
+	}
+
+	MemoryCheckpoint::MemoryCheckpoint(const MPI::Intracomm& comm)
+	 : m_comm(comm.Dup()), m_partner(0), m_buddy(0)
+	{
+		FindPartner();
+	}
+
+	MemoryCheckpoint::~MemoryCheckpoint()
+	{
+		for(std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it){
+			Release(it->second.local);
+			Release(it->second.held);
+		}
+
+		if( !MPI::Is_finalized() ){
+			m_comm.Free();
+		}
+	}
+
+	void MemoryCheckpoint::FindPartner()
+	{
+		using namespace std;
+
+		const int rank = m_comm.Get_rank();
+		const int size = m_comm.Get_size();
+
+		// 同じノードのプロセスのうち最小のランク番号 (リーダー) の表
+		vector<int> leaderTable;
+		MPIUtil::GetNodeLeaderTable(m_comm, leaderTable);
+
+		// ノードごとにまとめたランク順を作成し，ノード内の最大プロセス数だけずらしたプロセスをパートナーとする
+		vector< pair<int, int> > order(size);
+		vector<int> numLocal(size, 0);
+		for(int i = 0; i < size; i++){
+			order[i] = make_pair(leaderTable[i], i);
+			numLocal[leaderTable[i]]++;
+		}
+		sort(order.begin(), order.end());
+
+		int shift = *max_element(numLocal.begin(), numLocal.end());
+		if( shift == size ){
+			// 1ノードの場合は半分ずらす
+			shift = size / 2;
+		}
+
+		int pos = 0;
+		while( order[pos].second != rank ){ pos++; }
+
+		m_partner = order[(pos + shift) % size].second;
+		m_buddy   = order[(pos - shift + size) % size].second;
+	}
+
+	bool MemoryCheckpoint::Store(const std::string& name, const unsigned int step, unsigned char* image, const uint64_t size)
+	{
+		Entry& entry = m_entries[name];
+
+		Release(entry.local);
+		entry.local.data = image;
+		entry.local.size = size;
+		entry.local.step = step;
+
+		if( m_partner == m_comm.Get_rank() ){
+			// 1プロセスの場合は複製しない
+			return true;
+		}
+
+		bool err = !Exchange(&entry.local, m_partner, &entry.held, m_buddy, MEMCKPT_TAG_STORE);
+		if( err ){
+			Logger::Error("failed to receive checkpoint image of %s from rank %d. [%s:%d]\n", name.c_str(), m_buddy, __FILE__, __LINE__);
+		}
+
+		return !ErrorUtil::reduceError(err, m_comm);
+	}
+
+	bool MemoryCheckpoint::Recover(const std::string& name)
+	{
+		using namespace std;
+
+		const int rank = m_comm.Get_rank();
+		const int size = m_comm.Get_size();
+		const bool single = m_partner == rank;
+
+		Entry& entry = m_entries[name];
+
+		// 各プロセスで失われたイメージ (ローカルコピー，預かりコピー) を集める
+		int lost[2] = { entry.local.data == NULL ? 1 : 0, entry.held.data == NULL && !single ? 1 : 0 };
+		vector<int> lostTable(size * 2);
+		m_comm.Allgather(lost, 2, MPI::INT, &lostTable[0], 2, MPI::INT);
+
+		bool recover = false;
+		for(int i = 0; i < size * 2; i++){
+			if( lostTable[i] != 0 ){ recover = true; }
+		}
+		if( !recover ){ return true; }
+
+		bool err = false;
+		if( single ){
+			err = lost[0] != 0;
+		}else{
+			// ローカルコピーを失ったプロセスはパートナーの預かりコピーを受信
+			const bool sendHeld = lostTable[m_buddy * 2 + 0] != 0;
+			if( !Exchange(sendHeld ? &entry.held : NULL, m_buddy, lost[0] ? &entry.local : NULL, m_partner, MEMCKPT_TAG_LOCAL) ){
+				err = true;
+			}
+
+			// 預かりコピーを失ったプロセスはバディのローカルコピーを受信
+			const bool sendLocal = lostTable[m_partner * 2 + 1] != 0;
+			if( !Exchange(sendLocal ? &entry.local : NULL, m_partner, lost[1] ? &entry.held : NULL, m_buddy, MEMCKPT_TAG_HELD) ){
+				err = true;
+			}
+		}
+
+		if( err ){
+			Logger::Error("cannot recover checkpoint image of %s. [%s:%d]\n", name.c_str(), __FILE__, __LINE__);
+		}
+
+		return !ErrorUtil::reduceError(err, m_comm);
+	}
+
+	void MemoryCheckpoint::Discard(const std::string& name)
+	{
+		std::map<std::string, Entry>::iterator it = m_entries.find(name);
+		if( it == m_entries.end() ){ return; }
+
+		Release(it->second.local);
+		Release(it->second.held);
+	}
+
+	const unsigned char* MemoryCheckpoint::GetImage(const std::string& name, uint64_t* size, unsigned int* step) const
+	{
+		std::map<std::string, Entry>::const_iterator it = m_entries.find(name);
+		if( it == m_entries.end() || it->second.local.data == NULL ){
+			*size = 0;
+			return NULL;
+		}
+
+		*size = it->second.local.size;
+		if( step != NULL ){ *step = it->second.local.step; }
+
+		return it->second.local.data;
+	}
+
+	bool MemoryCheckpoint::Exchange(const Image* send, const int dest, Image* recv, const int source, const int tag)
+	{
+		using namespace std;
+
+		// ヘッダを送受信
+		ImageHeader sendHeader, recvHeader;
+		memset(&sendHeader, 0, sizeof(ImageHeader));
+		memset(&recvHeader, 0, sizeof(ImageHeader));
+
+		vector<MPI::Request> requests;
+		if( recv != NULL ){
+			requests.push_back( m_comm.Irecv(&recvHeader, sizeof(ImageHeader), MPI::BYTE, source, tag) );
+		}
+		if( send != NULL ){
+			sendHeader.size  = send->data != NULL ? send->size : 0;
+			sendHeader.step  = send->step;
+			sendHeader.valid = send->data != NULL ? 1 : 0;
+			requests.push_back( m_comm.Isend(&sendHeader, sizeof(ImageHeader), MPI::BYTE, dest, tag) );
+		}
+		if( !requests.empty() ){
+			MPI::Request::Waitall(static_cast<int>(requests.size()), &requests[0]);
+		}
+
+		// イメージを一定サイズごとに送受信
+		bool ret = true;
+		requests.clear();
+		if( recv != NULL ){
+			Release(*recv);
+			if( recvHeader.valid != 0 ){
+				recv->data = new unsigned char[recvHeader.size];
+				recv->size = recvHeader.size;
+				recv->step = recvHeader.step;
+				for(uint64_t p = 0; p < recv->size; p += MEMCKPT_CHUNK_SIZE){
+					uint64_t len = recv->size - p < MEMCKPT_CHUNK_SIZE ? recv->size - p : MEMCKPT_CHUNK_SIZE;
+					requests.push_back( m_comm.Irecv(recv->data + p, static_cast<int>(len), MPI::BYTE, source, tag) );
+				}
+			}else{
+				ret = false;
+			}
+		}
+		if( send != NULL && send->data != NULL ){
+			for(uint64_t p = 0; p < send->size; p += MEMCKPT_CHUNK_SIZE){
+				uint64_t len = send->size - p < MEMCKPT_CHUNK_SIZE ? send->size - p : MEMCKPT_CHUNK_SIZE;
+				requests.push_back( m_comm.Isend(send->data + p, static_cast<int>(len), MPI::BYTE, dest, tag) );
+			}
+		}
+		if( !requests.empty() ){
+			MPI::Request::Waitall(static_cast<int>(requests.size()), &requests[0]);
+		}
+
+		return ret;
+	}
+
+	void MemoryCheckpoint::Release(Image& image)
+	{
+		delete [] image.data;
+		image.data = NULL;
+		image.size = 0;
+		image.step = 0;
+	}
+
+} // namespace BCMFileIO
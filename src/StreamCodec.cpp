@@ -0,0 +1,626 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  StreamCodec.cpp
+/// @brief バイト列の圧縮形式 (CellIDファイル用) とその登録簿
+///
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <pthread.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif // HAVE_ZSTD
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#include <climits>
+#endif // HAVE_LZ4
+
+#include "StreamCodec.h"
+#include "Logger.h"
+
+namespace BCMFileIO {
+
+	namespace {
+
+		/// 圧縮なし
+		class RawCodec : public StreamCodec {
+		public:
+			const char* GetName() const { return "raw"; }
+
+			bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+			            std::vector<unsigned char>& dst) const
+			{
+				dst.assign(src, src + size);
+				return true;
+			}
+
+			bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+			            unsigned char* dst, const size_t dstSize) const
+			{
+				if( srcSize != dstSize ){ return false; }
+				memcpy(dst, src, dstSize);
+				return true;
+			}
+		};
+
+		/// 要素単位のランレングス符号 (要素 + 1Byteのラン長の並び．BCMRLEと同じ)
+		class RleCodec : public StreamCodec {
+		public:
+			const char* GetName() const { return "rle"; }
+
+			bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+			            std::vector<unsigned char>& dst) const
+			{
+				dst.clear();
+				if( elemSize == 0 || size % elemSize != 0 ){ return false; }
+
+				const unsigned char maxCount = static_cast<unsigned char>(~0);
+				size_t i = 0;
+				while( i < size ){
+					const unsigned char* d = &src[i];
+					unsigned char len = 1;
+					i += elemSize;
+					while( i < size && len < maxCount && memcmp(&src[i], d, elemSize) == 0 ){
+						len++;
+						i += elemSize;
+					}
+					dst.insert(dst.end(), d, d + elemSize);
+					dst.push_back(len);
+				}
+				return true;
+			}
+
+			bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+			            unsigned char* dst, const size_t dstSize) const
+			{
+				if( elemSize == 0 || srcSize % (elemSize + 1) != 0 ){ return false; }
+
+				size_t pos = 0;
+				for(size_t i = 0; i < srcSize; i += elemSize + 1){
+					const unsigned char len = src[i + elemSize];
+					if( dstSize - pos < static_cast<size_t>(len) * elemSize ){ return false; }
+					for(unsigned char l = 0; l < len; l++){
+						memcpy(&dst[pos], &src[i], elemSize);
+						pos += elemSize;
+					}
+				}
+				return pos == dstSize;
+			}
+		};
+
+		/// 可変長整数 (7bitずつ，下位から) を追記
+		inline void PutVarint(size_t value, std::vector<unsigned char>& dst)
+		{
+			while( value >= 0x80 ){
+				dst.push_back(static_cast<unsigned char>(value | 0x80));
+				value >>= 7;
+			}
+			dst.push_back(static_cast<unsigned char>(value));
+		}
+
+		/// 可変長整数を読み込み (符号が途切れている場合false)
+		inline bool GetVarint(const unsigned char* src, const size_t srcSize, size_t* pos, size_t* value)
+		{
+			*value = 0;
+			for(unsigned int shift = 0; *pos < srcSize && shift < sizeof(size_t) * 8; shift += 7){
+				const unsigned char c = src[(*pos)++];
+				*value |= static_cast<size_t>(c & 0x7F) << shift;
+				if( (c & 0x80) == 0 ){ return true; }
+			}
+			return false;
+		}
+
+		/// 要素単位の可変長ラン長符号 ((ラン長 - 1)の可変長整数 + 要素の並び)
+		///
+		/// @note ラン長に上限がないため，一様な領域は1レコードになる．
+		///       展開時は要素を1回複写した後，複写済みの範囲を倍々に複写して埋める．
+		class VarintRleCodec : public StreamCodec {
+		public:
+			const char* GetName() const { return "vrle"; }
+
+			bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+			            std::vector<unsigned char>& dst) const
+			{
+				dst.clear();
+				if( elemSize == 0 || size % elemSize != 0 ){ return false; }
+
+				size_t i = 0;
+				while( i < size ){
+					const unsigned char* d = &src[i];
+					size_t j = i + elemSize;
+					while( j < size && memcmp(&src[j], d, elemSize) == 0 ){ j += elemSize; }
+					PutVarint((j - i) / elemSize - 1, dst);
+					dst.insert(dst.end(), d, d + elemSize);
+					i = j;
+				}
+				return true;
+			}
+
+			bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+			            unsigned char* dst, const size_t dstSize) const
+			{
+				if( elemSize == 0 || dstSize % elemSize != 0 ){ return false; }
+
+				size_t pos = 0;
+				size_t out = 0;
+				while( pos < srcSize ){
+					size_t run = 0;
+					if( !GetVarint(src, srcSize, &pos, &run) || srcSize - pos < elemSize ){ return false; }
+					if( run >= (dstSize - out) / elemSize ){ return false; }
+
+					const size_t len = (run + 1) * elemSize;
+					unsigned char* d = &dst[out];
+					memcpy(d, &src[pos], elemSize);
+					for(size_t n = elemSize; n < len; n *= 2){
+						memcpy(&d[n], d, std::min(n, len - n));
+					}
+					pos += elemSize;
+					out += len;
+				}
+				return out == dstSize;
+			}
+		};
+
+		/// バイトシャッフル + LZ77符号
+		///
+		/// @note 要素をバイト位置ごとのプレーンに並べ替えた後 (端数のByteはそのまま末尾)，
+		///       (リテラル長, リテラル, 一致長 - LZ_MIN_MATCH, 距離) の並びで符号化する．
+		///       一致の探索は4Byteのハッシュで直近の位置のみを候補とする．
+		class ShuffleLzCodec : public StreamCodec {
+		public:
+			const char* GetName() const { return "shuffle-lz"; }
+
+			bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+			            std::vector<unsigned char>& dst) const
+			{
+				dst.clear();
+				if( elemSize == 0 ){ return false; }
+
+				std::vector<unsigned char> planes(size);
+				Shuffle(src, size, elemSize, planes.empty() ? NULL : &planes[0]);
+
+				const unsigned char* p = planes.empty() ? NULL : &planes[0];
+				std::vector<size_t> table(static_cast<size_t>(1) << LZ_HASH_BITS, 0);
+				dst.reserve(size / 4 + 16);
+
+				size_t anchor = 0;
+				size_t i      = 0;
+				while( i + LZ_MIN_MATCH <= size ){
+					const size_t h    = Hash(&p[i]);
+					const size_t cand = table[h];
+					table[h] = i + 1;
+					if( cand == 0 || memcmp(&p[cand - 1], &p[i], LZ_MIN_MATCH) != 0 ){
+						i++;
+						continue;
+					}
+
+					const size_t ref = cand - 1;
+					size_t len = LZ_MIN_MATCH;
+					while( i + len < size && p[ref + len] == p[i + len] ){ len++; }
+
+					PutVarint(i - anchor, dst);
+					dst.insert(dst.end(), &p[anchor], &p[anchor] + (i - anchor));
+					PutVarint(len - LZ_MIN_MATCH, dst);
+					PutVarint(i - ref, dst);
+
+					i     += len;
+					anchor = i;
+				}
+
+				PutVarint(size - anchor, dst);
+				if( size > anchor ){ dst.insert(dst.end(), &p[anchor], &p[anchor] + (size - anchor)); }
+				return true;
+			}
+
+			bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+			            unsigned char* dst, const size_t dstSize) const
+			{
+				if( elemSize == 0 ){ return false; }
+
+				std::vector<unsigned char> planes(dstSize);
+				unsigned char* p = planes.empty() ? NULL : &planes[0];
+
+				size_t pos = 0;
+				size_t out = 0;
+				for(;;){
+					size_t lit = 0;
+					if( !GetVarint(src, srcSize, &pos, &lit) || srcSize - pos < lit || dstSize - out < lit ){ return false; }
+					if( lit != 0 ){ memcpy(&p[out], &src[pos], lit); }
+					pos += lit;
+					out += lit;
+					if( out == dstSize ){ break; }
+
+					size_t len = 0, dist = 0;
+					if( !GetVarint(src, srcSize, &pos, &len) || !GetVarint(src, srcSize, &pos, &dist) ){ return false; }
+					len += LZ_MIN_MATCH;
+					if( dist == 0 || dist > out || dstSize - out < len ){ return false; }
+					// 重なりのある一致は1Byteずつ複写
+					for(size_t k = 0; k < len; k++){ p[out + k] = p[out - dist + k]; }
+					out += len;
+				}
+				if( pos != srcSize ){ return false; }
+
+				Unshuffle(p, dstSize, elemSize, dst);
+				return true;
+			}
+
+		private:
+			enum { LZ_MIN_MATCH = 4, LZ_HASH_BITS = 15 };
+
+			static size_t Hash(const unsigned char* p)
+			{
+				const uint32_t v = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+				                   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+				return static_cast<size_t>((v * 2654435761U) >> (32 - LZ_HASH_BITS));
+			}
+
+			static void Shuffle(const unsigned char* src, const size_t size, const size_t elemSize, unsigned char* dst)
+			{
+				const size_t n = size / elemSize;
+				for(size_t b = 0; b < elemSize; b++){
+					for(size_t i = 0; i < n; i++){ dst[b * n + i] = src[i * elemSize + b]; }
+				}
+				for(size_t i = n * elemSize; i < size; i++){ dst[i] = src[i]; }
+			}
+
+			static void Unshuffle(const unsigned char* src, const size_t size, const size_t elemSize, unsigned char* dst)
+			{
+				const size_t n = size / elemSize;
+				for(size_t b = 0; b < elemSize; b++){
+					for(size_t i = 0; i < n; i++){ dst[i * elemSize + b] = src[b * n + i]; }
+				}
+				for(size_t i = n * elemSize; i < size; i++){ dst[i] = src[i]; }
+			}
+		};
+
+#ifdef HAVE_ZSTD
+		/// zstd (paramは圧縮レベル)
+		class ZstdCodec : public StreamCodec {
+		public:
+			const char* GetName() const { return "zstd"; }
+
+			bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+			            std::vector<unsigned char>& dst) const
+			{
+				dst.resize(ZSTD_compressBound(size));
+				const size_t ret = ZSTD_compress(dst.empty() ? NULL : &dst[0], dst.size(), src, size, param != 0 ? param : 3);
+				if( ZSTD_isError(ret) ){
+					Logger::Error("zstd error (%s) [%s:%d]\n", ZSTD_getErrorName(ret), __FILE__, __LINE__);
+					dst.clear();
+					return false;
+				}
+				dst.resize(ret);
+				return true;
+			}
+
+			bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+			            unsigned char* dst, const size_t dstSize) const
+			{
+				const size_t ret = ZSTD_decompress(dst, dstSize, src, srcSize);
+				return !ZSTD_isError(ret) && ret == dstSize;
+			}
+		};
+#endif // HAVE_ZSTD
+
+#ifdef HAVE_LZ4
+		/// LZ4 (paramは加速度．大きいほど高速で低圧縮)
+		class Lz4Codec : public StreamCodec {
+		public:
+			const char* GetName() const { return "lz4"; }
+
+			bool Encode(const unsigned char* src, const size_t size, const size_t elemSize, const int param,
+			            std::vector<unsigned char>& dst) const
+			{
+				dst.clear();
+				if( size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE) ){ return false; }
+				dst.resize(LZ4_compressBound(static_cast<int>(size)));
+				const int ret = LZ4_compress_fast(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(&dst[0]),
+				                                  static_cast<int>(size), static_cast<int>(dst.size()), param > 0 ? param : 1);
+				if( ret <= 0 && size != 0 ){
+					dst.clear();
+					return false;
+				}
+				dst.resize(ret);
+				return true;
+			}
+
+			bool Decode(const unsigned char* src, const size_t srcSize, const size_t elemSize,
+			            unsigned char* dst, const size_t dstSize) const
+			{
+				if( srcSize > static_cast<size_t>(INT_MAX) || dstSize > static_cast<size_t>(INT_MAX) ){ return false; }
+				const int ret = LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+				                                    static_cast<int>(srcSize), static_cast<int>(dstSize));
+				return ret >= 0 && static_cast<size_t>(ret) == dstSize;
+			}
+		};
+#endif // HAVE_LZ4
+
+		typedef std::map<unsigned int, const StreamCodec*> CodecMap;
+
+		pthread_once_t  g_codecOnce  = PTHREAD_ONCE_INIT;
+		pthread_mutex_t g_codecMutex = PTHREAD_MUTEX_INITIALIZER;
+
+		CodecMap& GetCodecMap()
+		{
+			static CodecMap codecs;
+			return codecs;
+		}
+
+		/// 組み込みの圧縮形式を登録
+		void RegisterBuiltinCodecs()
+		{
+			static RawCodec       raw;
+			static RleCodec       rle;
+			static ShuffleLzCodec shuffleLz;
+			static VarintRleCodec vrle;
+
+			CodecMap& codecs = GetCodecMap();
+			codecs[LB_STREAM_RAW]        = &raw;
+			codecs[LB_STREAM_RLE]        = &rle;
+			codecs[LB_STREAM_SHUFFLE_LZ] = &shuffleLz;
+			codecs[LB_STREAM_VRLE]       = &vrle;
+#ifdef HAVE_ZSTD
+			static ZstdCodec zstd;
+			codecs[LB_STREAM_ZSTD] = &zstd;
+#endif // HAVE_ZSTD
+#ifdef HAVE_LZ4
+			static Lz4Codec lz4;
+			codecs[LB_STREAM_LZ4] = &lz4;
+#endif // HAVE_LZ4
+		}
+
+	} // namespace
+
+	namespace {
+		/// 逐次符号化/展開のチャンクサイズ (BitVoxelの要素数)
+		const size_t CELLID_STREAM_CHUNK = 4096;
+
+		/// BitVoxel 1要素に格納するボクセル数
+		inline size_t VoxelsPerWord(const unsigned char bitWidth){ return (sizeof(bitVoxelCell) * 8) / bitWidth; }
+	} // namespace
+
+	CellIDStreamEncoder::CellIDStreamEncoder(const unsigned int codec, const unsigned char bitWidth, std::vector<unsigned char>& code)
+		: m_codec(codec), m_bitWidth(bitWidth), m_code(&code),
+		  m_voxels(CELLID_STREAM_CHUNK * VoxelsPerWord(bitWidth)), m_numVoxel(0), m_words(CELLID_STREAM_CHUNK),
+		  m_runWord(0), m_runLength(0)
+	{
+	}
+
+	void CellIDStreamEncoder::Put(const unsigned char* voxel, const size_t size)
+	{
+		const size_t chunk = m_voxels.size();
+
+		size_t i = 0;
+		while( i < size ){
+			// チャンク単位の入力は複写せずに符号化
+			if( m_numVoxel == 0 && size - i >= chunk ){
+				Flush(&voxel[i], chunk);
+				i += chunk;
+				continue;
+			}
+			const size_t n = std::min(chunk - m_numVoxel, size - i);
+			memcpy(&m_voxels[m_numVoxel], &voxel[i], n);
+			m_numVoxel += n;
+			i += n;
+			if( m_numVoxel == chunk ){
+				Flush(&m_voxels[0], chunk);
+				m_numVoxel = 0;
+			}
+		}
+	}
+
+	void CellIDStreamEncoder::Finish()
+	{
+		if( m_numVoxel != 0 ){
+			Flush(&m_voxels[0], m_numVoxel);
+			m_numVoxel = 0;
+		}
+		if( m_runLength != 0 ){
+			EmitRun();
+		}
+	}
+
+	void CellIDStreamEncoder::Flush(const unsigned char* voxel, const size_t size)
+	{
+		const size_t nw = BitVoxel::GetSize(size, m_bitWidth);
+		BitVoxel::CompressTo(&m_words[0], size, voxel, m_bitWidth);
+
+		if( m_codec == LB_STREAM_RAW ){
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(&m_words[0]);
+			m_code->insert(m_code->end(), p, p + nw * sizeof(bitVoxelCell));
+			return;
+		}
+
+		const size_t maxLength = m_codec == LB_STREAM_RLE ? static_cast<unsigned char>(~0) : ~static_cast<size_t>(0);
+		for(size_t w = 0; w < nw; w++){
+			if( m_runLength != 0 && m_words[w] == m_runWord && m_runLength < maxLength ){
+				m_runLength++;
+				continue;
+			}
+			if( m_runLength != 0 ){
+				EmitRun();
+			}
+			m_runWord   = m_words[w];
+			m_runLength = 1;
+		}
+	}
+
+	void CellIDStreamEncoder::EmitRun()
+	{
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(&m_runWord);
+		if( m_codec == LB_STREAM_RLE ){
+			m_code->insert(m_code->end(), p, p + sizeof(bitVoxelCell));
+			m_code->push_back(static_cast<unsigned char>(m_runLength));
+		}else{
+			PutVarint(m_runLength - 1, *m_code);
+			m_code->insert(m_code->end(), p, p + sizeof(bitVoxelCell));
+		}
+		m_runLength = 0;
+	}
+
+	CellIDStreamDecoder::CellIDStreamDecoder(const unsigned int codec, const unsigned char bitWidth, const unsigned char* code, const size_t codeSize,
+	                                         const size_t numVoxel, const bool isNeedSwap)
+		: m_codec(codec), m_bitWidth(bitWidth), m_code(code), m_codeSize(codeSize), m_numVoxel(numVoxel), m_isNeedSwap(isNeedSwap),
+		  m_codePos(0), m_wordPos(0), m_runWord(0), m_runLeft(0),
+		  m_voxels(CELLID_STREAM_CHUNK * VoxelsPerWord(bitWidth)), m_words(CELLID_STREAM_CHUNK),
+		  m_chunkBegin(0), m_chunkSize(0), m_pos(0)
+	{
+	}
+
+	bool CellIDStreamDecoder::Seek(const size_t pos)
+	{
+		if( pos > m_numVoxel ){ return false; }
+		m_pos = pos;
+		return true;
+	}
+
+	bool CellIDStreamDecoder::Read(unsigned char* dst, const size_t size)
+	{
+		if( size > m_numVoxel - m_pos ){ return false; }
+
+		const size_t chunk = m_voxels.size();
+
+		size_t i = 0;
+		while( i < size ){
+			if( m_pos < m_chunkBegin || m_pos >= m_chunkBegin + m_chunkSize ){
+				const size_t target = m_pos / chunk;
+				// 展開済みの位置より前に戻る場合は先頭から展開し直す
+				if( target * CELLID_STREAM_CHUNK < m_wordPos ){
+					m_codePos = 0;
+					m_wordPos = 0;
+					m_runLeft = 0;
+				}
+				if( !SkipWords(target * CELLID_STREAM_CHUNK - m_wordPos) || !Fill() ){ return false; }
+			}
+			const size_t n = std::min(size - i, m_chunkBegin + m_chunkSize - m_pos);
+			memcpy(&dst[i], &m_voxels[m_pos - m_chunkBegin], n);
+			m_pos += n;
+			i     += n;
+		}
+		return true;
+	}
+
+	bool CellIDStreamDecoder::NextWord(bitVoxelCell* word)
+	{
+		if( m_codec == LB_STREAM_RAW ){
+			if( m_codeSize - m_codePos < sizeof(bitVoxelCell) ){ return false; }
+			memcpy(word, &m_code[m_codePos], sizeof(bitVoxelCell));
+			m_codePos += sizeof(bitVoxelCell);
+			return true;
+		}
+
+		// 長さ0のランは読み飛ばす (RLE)
+		while( m_runLeft == 0 ){
+			if( m_codec == LB_STREAM_RLE ){
+				if( m_codeSize - m_codePos < sizeof(bitVoxelCell) + 1 ){ return false; }
+				memcpy(&m_runWord, &m_code[m_codePos], sizeof(bitVoxelCell));
+				m_runLeft  = m_code[m_codePos + sizeof(bitVoxelCell)];
+				m_codePos += sizeof(bitVoxelCell) + 1;
+			}else{
+				size_t run = 0;
+				if( !GetVarint(m_code, m_codeSize, &m_codePos, &run) || m_codeSize - m_codePos < sizeof(bitVoxelCell) ){ return false; }
+				if( run == ~static_cast<size_t>(0) ){ return false; }
+				memcpy(&m_runWord, &m_code[m_codePos], sizeof(bitVoxelCell));
+				m_runLeft  = run + 1;
+				m_codePos += sizeof(bitVoxelCell);
+			}
+		}
+		*word = m_runWord;
+		m_runLeft--;
+		return true;
+	}
+
+	bool CellIDStreamDecoder::SkipWords(size_t n)
+	{
+		if( m_codec == LB_STREAM_RAW ){
+			if( (m_codeSize - m_codePos) / sizeof(bitVoxelCell) < n ){ return false; }
+			m_codePos += n * sizeof(bitVoxelCell);
+			m_wordPos += n;
+			return true;
+		}
+
+		bitVoxelCell word;
+		while( n != 0 ){
+			if( m_runLeft == 0 ){
+				// 次のランの先頭の要素を読み込み，残りはまとめて読み飛ばす
+				if( !NextWord(&word) ){ return false; }
+				n--;
+				m_wordPos++;
+				continue;
+			}
+			const size_t k = std::min(n, m_runLeft);
+			m_runLeft -= k;
+			m_wordPos += k;
+			n         -= k;
+		}
+		return true;
+	}
+
+	bool CellIDStreamDecoder::Fill()
+	{
+		const size_t chunk   = m_voxels.size();
+		const size_t begin   = m_wordPos / CELLID_STREAM_CHUNK * chunk;
+		const size_t nvoxel  = std::min(chunk, m_numVoxel - begin);
+		const size_t nw      = BitVoxel::GetSize(nvoxel, m_bitWidth);
+
+		for(size_t w = 0; w < nw; w++){
+			if( !NextWord(&m_words[w]) ){ return false; }
+			if( m_isNeedSwap ){ BSwap32(&m_words[w]); }
+		}
+		m_wordPos += nw;
+
+		BitVoxel::DecompressTo(&m_voxels[0], nvoxel, &m_words[0], m_bitWidth);
+		m_chunkBegin = begin;
+		m_chunkSize  = nvoxel;
+		return true;
+	}
+
+	bool StreamCodec::Register(const unsigned int id, const StreamCodec* codec)
+	{
+		if( id < LB_STREAM_USER || codec == NULL ){
+			Logger::Error("codec id(%u) must be %d or more [%s:%d]\n", id, LB_STREAM_USER, __FILE__, __LINE__);
+			return false;
+		}
+
+		pthread_once(&g_codecOnce, RegisterBuiltinCodecs);
+
+		pthread_mutex_lock(&g_codecMutex);
+		const bool ret = GetCodecMap().insert(std::make_pair(id, codec)).second;
+		pthread_mutex_unlock(&g_codecMutex);
+
+		if( !ret ){
+			Logger::Error("codec id(%u) is already registered [%s:%d]\n", id, __FILE__, __LINE__);
+		}
+		return ret;
+	}
+
+	const StreamCodec* StreamCodec::Find(const unsigned int id)
+	{
+		pthread_once(&g_codecOnce, RegisterBuiltinCodecs);
+
+		pthread_mutex_lock(&g_codecMutex);
+		const CodecMap& codecs = GetCodecMap();
+		CodecMap::const_iterator it = codecs.find(id);
+		const StreamCodec* codec = it != codecs.end() ? it->second : NULL;
+		pthread_mutex_unlock(&g_codecMutex);
+
+		return codec;
+	}
+
+} // namespace BCMFileIO
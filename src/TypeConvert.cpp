@@ -0,0 +1,296 @@
+/*
+###################################################################################
+#
+# HDMlib - Data management library for hierarchical Cartesian data structure
+#
+# Copyright (c) 2014-2017 Advanced Institute for Computational Science (AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2017 Research Institute for Information Technology (RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+///
+/// @file  TypeConvert.cpp
+/// @brief セルのデータ型変換ライブラリ
+///
+
+#include <cstring>
+
+#include "TypeConvert.h"
+
+// x86-64のGCC/ClangではF16C (vcvtps2ph/vcvtph2ps) の実装を実行時に選択
+#if defined(__x86_64__) && ( defined(__clang__) || ( defined(__GNUC__) && !defined(__INTEL_COMPILER) && \
+    ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) )
+#define TYPECONVERT_USE_F16C
+#include <immintrin.h>
+#endif
+
+namespace BCMFileIO
+{
+	namespace {
+
+		/// 半精度を経由する変換で使用する単精度の一時領域の要素数
+		const size_t CHUNK_SIZE = 1024;
+
+		inline unsigned int FloatBits(const float v){ unsigned int x; memcpy(&x, &v, sizeof(x)); return x; }
+		inline float BitsFloat(const unsigned int x){ float v; memcpy(&v, &x, sizeof(v)); return v; }
+
+		/// 単精度 -> IEEE754半精度 (最近接偶数丸め．NaNは上位の仮数を保ったquiet NaN)
+		inline unsigned short ToHalf(const float value)
+		{
+			const unsigned int x    = FloatBits(value);
+			const unsigned int sign = (x >> 16) & 0x8000;
+			unsigned int       ax   = x & 0x7fffffff;
+
+			if( ax > 0x7f800000 ){
+				return static_cast<unsigned short>(sign | 0x7e00 | ((ax >> 13) & 0x3ff));
+			}
+			// 65520以上は無限大に丸められる
+			if( ax >= 0x477ff000 ){
+				return static_cast<unsigned short>(sign | 0x7c00);
+			}
+			// 2^-14未満は非正規化数 (0.5を加えて仮数の最下位を2^-24に揃え，FPUの丸めを利用)
+			if( ax < 0x38800000 ){
+				const float a = BitsFloat(ax) + 0.5f;
+				return static_cast<unsigned short>(sign | (FloatBits(a) - 0x3f000000));
+			}
+			// 指数のバイアスを127から15に変更し，下位13bitを最近接偶数丸め
+			ax += 0xc8000fff + ((ax >> 13) & 1);
+			return static_cast<unsigned short>(sign | (ax >> 13));
+		}
+
+		/// IEEE754半精度 -> 単精度 (誤差なし)
+		inline float FromHalf(const unsigned short value)
+		{
+			const unsigned int sign = static_cast<unsigned int>(value & 0x8000) << 16;
+			const unsigned int em   = value & 0x7fff;
+
+			if( em >= 0x7c00 ){
+				// 無限大/NaN (NaNはquiet NaNとする)
+				const unsigned int m = em & 0x3ff;
+				return BitsFloat(sign | 0x7f800000 | (m != 0 ? 0x00400000 : 0) | (m << 13));
+			}
+			if( em >= 0x400 ){
+				return BitsFloat(sign | ((em + (112 << 10)) << 13));
+			}
+			// 非正規化数と0
+			return BitsFloat(sign | FloatBits(static_cast<float>(em) * 5.9604644775390625e-8f));
+		}
+
+		/// 単精度 -> bfloat16 (最近接偶数丸め．NaNはquiet NaN)
+		inline unsigned short ToBFloat16(const float value)
+		{
+			const unsigned int x = FloatBits(value);
+			const unsigned int r = (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+			const unsigned int n = (x >> 16) | 0x40;
+			return static_cast<unsigned short>( (x & 0x7fffffff) > 0x7f800000 ? n : r );
+		}
+
+		/// bfloat16 -> 単精度 (誤差なし)
+		inline float FromBFloat16(const unsigned short value)
+		{
+			return BitsFloat(static_cast<unsigned int>(value) << 16);
+		}
+
+		void FloatToHalfKernel(const float* src, unsigned short* dst, const size_t count)
+		{
+			for(size_t i = 0; i < count; i++){ dst[i] = ToHalf(src[i]); }
+		}
+
+		void HalfToFloatKernel(const unsigned short* src, float* dst, const size_t count)
+		{
+			for(size_t i = 0; i < count; i++){ dst[i] = FromHalf(src[i]); }
+		}
+
+		void FloatToBFloat16Kernel(const float* src, unsigned short* dst, const size_t count)
+		{
+			for(size_t i = 0; i < count; i++){ dst[i] = ToBFloat16(src[i]); }
+		}
+
+		void BFloat16ToFloatKernel(const unsigned short* src, float* dst, const size_t count)
+		{
+			for(size_t i = 0; i < count; i++){ dst[i] = FromBFloat16(src[i]); }
+		}
+
+#ifdef TYPECONVERT_USE_F16C
+		/// 単精度 -> IEEE754半精度 (F16C．8要素単位)
+		__attribute__((target("avx,f16c")))
+		void FloatToHalfKernelF16C(const float* src, unsigned short* dst, const size_t count)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8){
+				const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), h);
+			}
+			FloatToHalfKernel(&src[i], &dst[i], count - i);
+		}
+
+		/// IEEE754半精度 -> 単精度 (F16C．8要素単位)
+		__attribute__((target("avx,f16c")))
+		void HalfToFloatKernelF16C(const unsigned short* src, float* dst, const size_t count)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8){
+				const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+				_mm256_storeu_ps(&dst[i], _mm256_cvtph_ps(h));
+			}
+			HalfToFloatKernel(&src[i], &dst[i], count - i);
+		}
+
+		/// F16Cが使用可能かを判定 (F16CはAVX2対応のCPUで必ず使用可能)
+		bool HasF16C()
+		{
+			static const bool hasF16C = __builtin_cpu_supports("avx2") != 0;
+			return hasF16C;
+		}
+#endif // TYPECONVERT_USE_F16C
+
+		typedef void (*ToHalfFunc)(const float*, unsigned short*, const size_t);
+		typedef void (*FromHalfFunc)(const unsigned short*, float*, const size_t);
+
+		/// 単精度から半精度 (LB_FLOAT16, LB_BFLOAT16) への変換の実装を取得
+		ToHalfFunc GetToHalfFunc(const LB_DATA_TYPE type)
+		{
+			if( type == LB_BFLOAT16 ){ return FloatToBFloat16Kernel; }
+#ifdef TYPECONVERT_USE_F16C
+			if( HasF16C() ){ return FloatToHalfKernelF16C; }
+#endif // TYPECONVERT_USE_F16C
+			return FloatToHalfKernel;
+		}
+
+		/// 半精度 (LB_FLOAT16, LB_BFLOAT16) から単精度への変換の実装を取得
+		FromHalfFunc GetFromHalfFunc(const LB_DATA_TYPE type)
+		{
+			if( type == LB_BFLOAT16 ){ return BFloat16ToFloatKernel; }
+#ifdef TYPECONVERT_USE_F16C
+			if( HasF16C() ){ return HalfToFloatKernelF16C; }
+#endif // TYPECONVERT_USE_F16C
+			return HalfToFloatKernel;
+		}
+
+		inline bool IsHalf(const LB_DATA_TYPE type)
+		{
+			return type == LB_FLOAT16 || type == LB_BFLOAT16;
+		}
+
+		/// 要素ごとのstatic_cast (コンパイラの自動ベクトル化の対象)
+		template<typename S, typename D>
+		void CastKernel(const S* src, D* dst, const size_t count)
+		{
+			for(size_t i = 0; i < count; i++){ dst[i] = static_cast<D>(src[i]); }
+		}
+
+		/// 出力のデータ型に応じてCastKernelを選択
+		template<typename S>
+		void CastFrom(const S* src, const LB_DATA_TYPE dstType, void* dst, const size_t count)
+		{
+			switch( dstType ){
+				case LB_INT8   : CastKernel(src, static_cast<signed char*       >(dst), count); break;
+				case LB_UINT8  : CastKernel(src, static_cast<unsigned char*     >(dst), count); break;
+				case LB_INT16  : CastKernel(src, static_cast<short*             >(dst), count); break;
+				case LB_UINT16 : CastKernel(src, static_cast<unsigned short*    >(dst), count); break;
+				case LB_INT32  : CastKernel(src, static_cast<int*               >(dst), count); break;
+				case LB_UINT32 : CastKernel(src, static_cast<unsigned int*      >(dst), count); break;
+				case LB_INT64  : CastKernel(src, static_cast<long long*         >(dst), count); break;
+				case LB_UINT64 : CastKernel(src, static_cast<unsigned long long*>(dst), count); break;
+				case LB_FLOAT32: CastKernel(src, static_cast<float*             >(dst), count); break;
+				case LB_FLOAT64: CastKernel(src, static_cast<double*            >(dst), count); break;
+				default        : break;
+			}
+		}
+
+		/// 半精度以外のデータ型間の変換
+		void Cast(const LB_DATA_TYPE srcType, const void* src, const LB_DATA_TYPE dstType, void* dst, const size_t count)
+		{
+			switch( srcType ){
+				case LB_INT8   : CastFrom(static_cast<const signed char*       >(src), dstType, dst, count); break;
+				case LB_UINT8  : CastFrom(static_cast<const unsigned char*     >(src), dstType, dst, count); break;
+				case LB_INT16  : CastFrom(static_cast<const short*             >(src), dstType, dst, count); break;
+				case LB_UINT16 : CastFrom(static_cast<const unsigned short*    >(src), dstType, dst, count); break;
+				case LB_INT32  : CastFrom(static_cast<const int*               >(src), dstType, dst, count); break;
+				case LB_UINT32 : CastFrom(static_cast<const unsigned int*      >(src), dstType, dst, count); break;
+				case LB_INT64  : CastFrom(static_cast<const long long*         >(src), dstType, dst, count); break;
+				case LB_UINT64 : CastFrom(static_cast<const unsigned long long*>(src), dstType, dst, count); break;
+				case LB_FLOAT32: CastFrom(static_cast<const float*             >(src), dstType, dst, count); break;
+				case LB_FLOAT64: CastFrom(static_cast<const double*            >(src), dstType, dst, count); break;
+				default        : break;
+			}
+		}
+
+	} // namespace
+
+	size_t TypeConvert::GetSize(const LB_DATA_TYPE type)
+	{
+		const static size_t typeByteTable[12] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2 };
+		return IsValid(type) ? typeByteTable[type] : 0;
+	}
+
+	bool TypeConvert::IsValid(const LB_DATA_TYPE type)
+	{
+		return static_cast<int>(type) >= static_cast<int>(LB_INT8) && static_cast<int>(type) <= static_cast<int>(LB_BFLOAT16);
+	}
+
+	void TypeConvert::Convert(const LB_DATA_TYPE srcType, const void* src, const LB_DATA_TYPE dstType, void* dst, const size_t count)
+	{
+		if( srcType == dstType ){
+			memcpy(dst, src, GetSize(srcType) * count);
+			return;
+		}
+		if( !IsHalf(srcType) && !IsHalf(dstType) ){
+			Cast(srcType, src, dstType, dst, count);
+			return;
+		}
+
+		// 半精度を含む変換は単精度を経由 (単精度との変換は一時領域を使用しない)
+		const size_t srcByte = GetSize(srcType);
+		const size_t dstByte = GetSize(dstType);
+		const unsigned char* s = static_cast<const unsigned char*>(src);
+		unsigned char*       d = static_cast<unsigned char*>(dst);
+
+		float tmp[CHUNK_SIZE];
+		for(size_t i = 0; i < count; i += CHUNK_SIZE){
+			const size_t n = count - i < CHUNK_SIZE ? count - i : CHUNK_SIZE;
+
+			const float* f = tmp;
+			if( IsHalf(srcType) ){
+				float* o = dstType == LB_FLOAT32 ? reinterpret_cast<float*>(&d[i * dstByte]) : tmp;
+				GetFromHalfFunc(srcType)(reinterpret_cast<const unsigned short*>(&s[i * srcByte]), o, n);
+				if( o != tmp ){ continue; }
+			}else if( srcType == LB_FLOAT32 ){
+				f = reinterpret_cast<const float*>(&s[i * srcByte]);
+			}else{
+				Cast(srcType, &s[i * srcByte], LB_FLOAT32, tmp, n);
+			}
+
+			if( IsHalf(dstType) ){
+				GetToHalfFunc(dstType)(f, reinterpret_cast<unsigned short*>(&d[i * dstByte]), n);
+			}else{
+				CastFrom(f, dstType, &d[i * dstByte], n);
+			}
+		}
+	}
+
+	unsigned short TypeConvert::FloatToHalf(const float value)
+	{
+		return ToHalf(value);
+	}
+
+	float TypeConvert::HalfToFloat(const unsigned short value)
+	{
+		return FromHalf(value);
+	}
+
+	unsigned short TypeConvert::FloatToBFloat16(const float value)
+	{
+		return ToBFloat16(value);
+	}
+
+	float TypeConvert::BFloat16ToFloat(const unsigned short value)
+	{
+		return FromBFloat16(value);
+	}
+
+} // namespace BCMFileIO